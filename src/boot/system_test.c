@@ -79,5 +79,31 @@ int system_test() {
 
     assert(janet_equals(tuple1, tuple2));
 
+    /* Symbols stay interned while the symbol cache grows */
+    const uint8_t *syms[4096];
+    char name[32];
+    for (int i = 0; i < 4096; i++) {
+        snprintf(name, sizeof(name), "sym-%d", i);
+        syms[i] = janet_csymbol(name);
+    }
+    for (int i = 0; i < 4096; i++) {
+        snprintf(name, sizeof(name), "sym-%d", i);
+        assert(syms[i] == janet_csymbol(name));
+    }
+
+    /* Creating many symbols at once */
+    JanetByteView views[3];
+    const uint8_t *many[3];
+    views[0].bytes = (const uint8_t *) "sym-7";
+    views[0].len = 5;
+    views[1].bytes = (const uint8_t *) "fresh-symbol";
+    views[1].len = 12;
+    views[2].bytes = (const uint8_t *) "fresh-symbol";
+    views[2].len = 12;
+    janet_symbol_many(views, 3, many);
+    assert(many[0] == syms[7]);
+    assert(many[1] == many[2]);
+    assert(many[1] == janet_csymbol("fresh-symbol"));
+
     return 0;
 }
@@ -53,6 +53,11 @@ int table_test() {
     assert(janet_equals(janet_table_get(t1, janet_cstringv("hello")), janet_wrap_nil()));
     assert(janet_equals(janet_table_get(t1, janet_cstringv("box")), janet_wrap_nil()));
 
+    assert(janet_equals(janet_table_lookup(t1, janet_cstringv("akey"))->value, janet_wrap_integer(5)));
+    assert(NULL == janet_table_lookup(t1, janet_cstringv("hello")));
+    assert(janet_table_find(t1, janet_cstringv("akey")) == janet_table_lookup(t1, janet_cstringv("akey")));
+    assert(janet_checktype(janet_table_find(t1, janet_cstringv("hello"))->key, JANET_NIL));
+
     janet_table_put(t2, janet_csymbolv("t2key1"), janet_wrap_integer(10));
     janet_table_put(t2, janet_csymbolv("t2key2"), janet_wrap_integer(100));
     janet_table_put(t2, janet_csymbolv("some key "), janet_wrap_integer(-2));
@@ -42,6 +42,8 @@
 /* Other settings */
 /* #define JANET_DEBUG */
 /* #define JANET_PRF */
+/* #define JANET_FAST_HASH */
+/* #define JANET_NO_SIMD */
 /* #define JANET_NO_UTC_MKTIME */
 /* #define JANET_OUT_OF_MEMORY do { printf("janet out of memory\n"); exit(1); } while (0) */
 /* #define JANET_EXIT(msg) do { printf("C assert failed executing janet: %s\n", msg); exit(1); } while (0) */
@@ -50,10 +52,17 @@
 /* #define JANET_MAX_PROTO_DEPTH 200 */
 /* #define JANET_MAX_MACRO_EXPAND 200 */
 /* #define JANET_STACK_MAX 16384 */
+/* #define JANET_TABLE_HASH_CACHE */
 /* #define JANET_OS_NAME my-custom-os */
 /* #define JANET_ARCH_NAME pdp-8 */
 /* #define JANET_EV_NO_EPOLL */
 /* #define JANET_EV_NO_KQUEUE */
+/* #define JANET_EV_MAX_EVENTS 64 */
+/* #define JANET_EV_ACCEPT_BATCH 16 */
+/* #define JANET_EV_TASK_BUDGET 0 */
+/* #define JANET_EV_TIMER_HEAP */
+/* #define JANET_EV_TIMER_TICK 1 */
+/* #define JANET_EV_NO_PIDFD */
 /* #define JANET_NO_INTERPRETER_INTERRUPT */
 /* #define JANET_NO_IPV6 */
 /* #define JANET_NO_CRYPTORAND */
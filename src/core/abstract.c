@@ -193,6 +193,74 @@ void janet_os_rwlock_wunlock(JanetOSRWLock *rwlock) {
 
 #endif
 
+/* Data parallel helper */
+
+typedef struct {
+    void (*fn)(void *data, int32_t index);
+    void *data;
+    int32_t index;
+} JanetParallelJob;
+
+#ifdef JANET_WINDOWS
+static DWORD WINAPI janet_parallel_body(LPVOID ptr) {
+#else
+static void *janet_parallel_body(void *ptr) {
+#endif
+    JanetParallelJob *job = (JanetParallelJob *) ptr;
+    job->fn(job->data, job->index);
+    return 0;
+}
+
+/* Run fn(data, i) for every i in [0, n) and wait for all of them. Index 0
+ * runs on the calling thread, the rest each get a thread of their own. fn
+ * cannot use the Janet VM - no allocation, panics, or dynamic bindings. If a
+ * thread cannot be started, its index runs on the calling thread instead. */
+void janet_os_parallel(int32_t n, void (*fn)(void *data, int32_t index), void *data) {
+    if (n <= 1) {
+        if (n == 1) fn(data, 0);
+        return;
+    }
+    JanetParallelJob *jobs = janet_smalloc(sizeof(JanetParallelJob) * n);
+#ifdef JANET_WINDOWS
+    HANDLE *threads = janet_smalloc(sizeof(HANDLE) * n);
+#else
+    pthread_t *threads = janet_smalloc(sizeof(pthread_t) * n);
+    char *started = janet_smalloc(n);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, JANET_PARALLEL_STACK);
+#endif
+    for (int32_t i = 1; i < n; i++) {
+        jobs[i].fn = fn;
+        jobs[i].data = data;
+        jobs[i].index = i;
+#ifdef JANET_WINDOWS
+        threads[i] = CreateThread(NULL, JANET_PARALLEL_STACK, janet_parallel_body, jobs + i, 0, NULL);
+        if (NULL == threads[i]) fn(data, i);
+#else
+        started[i] = !pthread_create(threads + i, &attr, janet_parallel_body, jobs + i);
+        if (!started[i]) fn(data, i);
+#endif
+    }
+    fn(data, 0);
+    for (int32_t i = 1; i < n; i++) {
+#ifdef JANET_WINDOWS
+        if (NULL != threads[i]) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+#else
+        if (started[i]) pthread_join(threads[i], NULL);
+#endif
+    }
+#ifndef JANET_WINDOWS
+    pthread_attr_destroy(&attr);
+    janet_sfree(started);
+#endif
+    janet_sfree(threads);
+    janet_sfree(jobs);
+}
+
 int32_t janet_abstract_incref(void *abst) {
     return janet_atomic_inc(&janet_abstract_head(abst)->gc.data.refcount);
 }
@@ -214,4 +282,216 @@ int32_t janet_abstract_decref_maybe_free(void *abst) {
     return result;
 }
 
+/* Take ownership of a reference to a threaded abstract that was passed in from another
+ * thread. If the current heap already holds a reference, drop the extra one. */
+void janet_abstract_adopt_threaded(void *abst) {
+    Janet x = janet_wrap_abstract(abst);
+    Janet check = janet_table_get(&janet_vm.threaded_abstracts, x);
+    if (janet_checktype(check, JANET_NIL)) {
+        janet_table_put(&janet_vm.threaded_abstracts, x, janet_wrap_false());
+    } else {
+        janet_abstract_decref(abst);
+    }
+}
+
+/*
+ * Shared heaps
+ *
+ * Immutable values can be copied into a shared heap, which is a threaded abstract that owns
+ * a list of memory chunks. Each copied object keeps the usual header, flagged with JANET_MEM_SHARED,
+ * and the data.next field points back to the owning heap. Shared objects are never on a
+ * thread's block list - marking one marks the heap instead, so the heap lives as long as
+ * any thread can reach one of its values.
+ */
+
+#define JANET_SHARED_CHUNK_SIZE 4096
+
+typedef struct JanetSharedChunk JanetSharedChunk;
+struct JanetSharedChunk {
+    JanetSharedChunk *next;
+    size_t used;
+    size_t capacity;
+    uint64_t data[];
+};
+
+typedef struct {
+    JanetSharedChunk *chunks;
+} JanetSharedHeap;
+
+static int janet_shared_heap_gc(void *p, size_t size) {
+    (void) size;
+    JanetSharedHeap *heap = (JanetSharedHeap *) p;
+    JanetSharedChunk *chunk = heap->chunks;
+    while (NULL != chunk) {
+        JanetSharedChunk *next = chunk->next;
+        janet_free(chunk);
+        chunk = next;
+    }
+    return 0;
+}
+
+const JanetAbstractType janet_shared_heap_type = {
+    "core/shared-heap",
+    janet_shared_heap_gc,
+    JANET_ATEND_GC
+};
+
+/* Allocate an object in a shared heap, copying the header flags from src */
+static void *janet_shared_alloc(JanetSharedHeap *heap, const JanetGCObject *src, size_t size) {
+    size = (size + 7) & ~((size_t) 7);
+    JanetSharedChunk *chunk = heap->chunks;
+    if (NULL == chunk || chunk->capacity - chunk->used < size) {
+        int dedicated = size > JANET_SHARED_CHUNK_SIZE / 2;
+        size_t capacity = dedicated ? size : JANET_SHARED_CHUNK_SIZE;
+        JanetSharedChunk *newchunk = janet_malloc(sizeof(JanetSharedChunk) + capacity);
+        if (NULL == newchunk) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_vm.next_collection += capacity;
+        newchunk->used = 0;
+        newchunk->capacity = capacity;
+        if (dedicated && NULL != chunk) {
+            /* Keep filling the current chunk after a large allocation */
+            newchunk->next = chunk->next;
+            chunk->next = newchunk;
+        } else {
+            newchunk->next = chunk;
+            heap->chunks = newchunk;
+        }
+        chunk = newchunk;
+    }
+    JanetGCObject *mem = (JanetGCObject *)((char *) chunk->data + chunk->used);
+    chunk->used += size;
+    mem->flags = (src->flags & ~(JANET_MEM_REACHABLE | JANET_MEM_DISABLED)) | JANET_MEM_SHARED | JANET_MEM_REACHABLE;
+    mem->data.next = (JanetGCObject *) heap;
+    return mem;
+}
+
+static JanetGCObject *janet_shared_header(Janet x) {
+    switch (janet_type(x)) {
+        default:
+            return NULL;
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD:
+            return (JanetGCObject *) janet_string_head(janet_unwrap_string(x));
+        case JANET_TUPLE:
+            return (JanetGCObject *) janet_tuple_head(janet_unwrap_tuple(x));
+        case JANET_STRUCT:
+            return (JanetGCObject *) janet_struct_head(janet_unwrap_struct(x));
+    }
+}
+
+/* Get the shared heap that owns a value, or NULL if the value is not shared */
+void *janet_shared_heap(Janet x) {
+    JanetGCObject *header = janet_shared_header(x);
+    if (NULL == header || !(header->flags & JANET_MEM_SHARED)) return NULL;
+    return header->data.next;
+}
+
+int janet_is_shared(Janet x) {
+    return NULL != janet_shared_heap(x);
+}
+
+static Janet janet_share_one(JanetSharedHeap *heap, JanetTable *memo, Janet x, int depth) {
+    if (depth <= 0) janet_panic("value too deeply nested to share");
+    JanetType type = janet_type(x);
+    switch (type) {
+        case JANET_NIL:
+        case JANET_BOOLEAN:
+        case JANET_NUMBER:
+            return x;
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD:
+        case JANET_TUPLE:
+        case JANET_STRUCT:
+            break;
+        default:
+            janet_panicf("cannot share value of type %t, expected an immutable value", x);
+    }
+    if (janet_shared_heap(x) == heap) return x;
+    Janet key = janet_wrap_pointer(janet_unwrap_pointer(x));
+    Janet check = janet_table_get(memo, key);
+    if (!janet_checktype(check, JANET_NIL)) return check;
+    Janet result;
+    switch (type) {
+        default: {
+            const uint8_t *str = janet_unwrap_string(x);
+            JanetStringHead *src = janet_string_head(str);
+            size_t size = sizeof(JanetStringHead) + (size_t) src->length + 1;
+            JanetStringHead *head = janet_shared_alloc(heap, &src->gc, size);
+            memcpy((char *) head + sizeof(JanetGCObject), (char *) src + sizeof(JanetGCObject),
+                   size - sizeof(JanetGCObject));
+            result = type == JANET_STRING ? janet_wrap_string(head->data) :
+                     type == JANET_SYMBOL ? janet_wrap_symbol(head->data) :
+                     janet_wrap_keyword(head->data);
+            break;
+        }
+        case JANET_TUPLE: {
+            const Janet *tup = janet_unwrap_tuple(x);
+            JanetTupleHead *src = janet_tuple_head(tup);
+            JanetTupleHead *head = janet_shared_alloc(heap, &src->gc,
+                                   sizeof(JanetTupleHead) + (size_t) src->length * sizeof(Janet));
+            head->length = src->length;
+            head->hash = src->hash;
+            head->sm_line = src->sm_line;
+            head->sm_column = src->sm_column;
+            Janet *data = (Janet *) head->data;
+            for (int32_t i = 0; i < src->length; i++) {
+                data[i] = janet_share_one(heap, memo, tup[i], depth - 1);
+            }
+            result = janet_wrap_tuple(head->data);
+            break;
+        }
+        case JANET_STRUCT: {
+            const JanetKV *st = janet_unwrap_struct(x);
+            JanetStructHead *src = janet_struct_head(st);
+            JanetStructHead *head = janet_shared_alloc(heap, &src->gc,
+                                    sizeof(JanetStructHead) + (size_t) src->capacity * sizeof(JanetKV));
+            head->length = src->length;
+            head->hash = src->hash;
+            head->capacity = src->capacity;
+            head->proto = NULL;
+            /* Keys and values keep their hashes, so every entry stays in the same slot */
+            JanetKV *data = (JanetKV *) head->data;
+            for (int32_t i = 0; i < src->capacity; i++) {
+                data[i].key = janet_share_one(heap, memo, st[i].key, depth - 1);
+                data[i].value = janet_share_one(heap, memo, st[i].value, depth - 1);
+            }
+            if (NULL != src->proto) {
+                head->proto = janet_unwrap_struct(janet_share_one(heap, memo,
+                                                  janet_wrap_struct(src->proto), depth - 1));
+            }
+            result = janet_wrap_struct(head->data);
+            break;
+        }
+    }
+    janet_table_put(memo, key, result);
+    return result;
+}
+
+/* Copy an immutable value into a new shared heap. Values that are already shared, as
+ * well as nil, booleans and numbers, are returned unchanged. */
+Janet janet_share(Janet x) {
+    switch (janet_type(x)) {
+        case JANET_NIL:
+        case JANET_BOOLEAN:
+        case JANET_NUMBER:
+            return x;
+        default:
+            break;
+    }
+    if (janet_is_shared(x)) return x;
+    JanetSharedHeap *heap = janet_abstract_threaded(&janet_shared_heap_type, sizeof(JanetSharedHeap));
+    heap->chunks = NULL;
+    return janet_share_one(heap, janet_table(0), x, JANET_RECURSION_GUARD);
+}
+
+#else
+
+void janet_os_parallel(int32_t n, void (*fn)(void *data, int32_t index), void *data) {
+    for (int32_t i = 0; i < n; i++) fn(data, i);
+}
+
 #endif
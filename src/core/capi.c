@@ -641,6 +641,48 @@ JanetAtomicInt janet_atomic_load_relaxed(JanetAtomicInt volatile *x) {
 #endif
 }
 
+/* Returns 1 and sets *x to desired if *x was equal to expected, otherwise returns 0. Sequentially consistent. */
+int janet_atomic_cas(JanetAtomicInt volatile *x, JanetAtomicInt expected, JanetAtomicInt desired) {
+#ifdef _MSC_VER
+    return _InterlockedCompareExchange(x, desired, expected) == expected;
+#elif defined(JANET_USE_STDATOMIC)
+    return atomic_compare_exchange_strong(x, &expected, desired);
+#elif defined(JANET_PLAN9)
+    return cas((int *) x, (int) expected, (int) desired);
+#else
+    return __atomic_compare_exchange_n(x, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Sequentially consistent store */
+void janet_atomic_store(JanetAtomicInt volatile *x, JanetAtomicInt value) {
+#ifdef _MSC_VER
+    _InterlockedExchange(x, value);
+#elif defined(JANET_USE_STDATOMIC)
+    atomic_store(x, value);
+#elif defined(JANET_PLAN9)
+    JanetAtomicInt old;
+    do {
+        old = agetl((void *)x);
+    } while (!cas((int *) x, (int) old, (int) value));
+#else
+    __atomic_store_n(x, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Full memory barrier */
+void janet_atomic_fence(void) {
+#ifdef _MSC_VER
+    MemoryBarrier();
+#elif defined(JANET_USE_STDATOMIC)
+    atomic_thread_fence(memory_order_seq_cst);
+#elif defined(JANET_PLAN9)
+    coherence();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
 /* Some definitions for function-like macros */
 
 JANET_API JanetStructHead *(janet_struct_head)(JanetStruct st) {
@@ -1135,6 +1135,11 @@ static void janet_load_libs(JanetTable *env) {
     janet_lib_buffer(env);
     janet_lib_table(env);
     janet_lib_struct(env);
+    janet_lib_pmap(env);
+    janet_lib_pvec(env);
+    janet_lib_tarray(env);
+    janet_lib_rope(env);
+    janet_lib_json(env);
     janet_lib_fiber(env);
     janet_lib_os(env);
     janet_lib_parse(env);
@@ -62,26 +62,45 @@
 #endif
 #endif
 
+typedef enum {
+    JANET_CP_MODE_READ,
+    JANET_CP_MODE_WRITE,
+    JANET_CP_MODE_CHOICE_READ,
+    JANET_CP_MODE_CHOICE_WRITE,
+    JANET_CP_MODE_READ_MANY
+} JanetChannelMode;
+
 typedef struct {
     JanetVM *thread;
     JanetFiber *fiber;
     uint32_t sched_id;
-    enum {
-        JANET_CP_MODE_READ,
-        JANET_CP_MODE_WRITE,
-        JANET_CP_MODE_CHOICE_READ,
-        JANET_CP_MODE_CHOICE_WRITE,
-        JANET_CP_MODE_CLOSE
-    } mode;
+    JanetChannelMode mode;
+    int32_t many; /* Max number of items for JANET_CP_MODE_READ_MANY */
+    Janet value; /* Value held by a blocked writer on a threaded channel */
 } JanetChannelPending;
 
+/* Slot in the item ring of a threaded channel */
+typedef struct {
+    volatile JanetAtomicInt seq;
+    Janet value;
+} JanetChannelCell;
+
 struct JanetChannel {
-    JanetQueue items;
+    JanetQueue items; /* All items, or items that did not fit in the ring for threaded channels */
     JanetQueue read_pending;
     JanetQueue write_pending;
     int32_t limit;
     int closed;
     int is_threaded;
+    /* Threaded channels keep buffered items in a bounded lock-free ring. The lock
+     * below is only taken to block, to wake blocked fibers, or for overflow. */
+    JanetChannelCell *ring;
+    uint32_t ring_mask;
+    int32_t ring_size; /* Number of items the ring may hold, at most the limit */
+    volatile JanetAtomicInt ring_head;
+    volatile JanetAtomicInt ring_tail;
+    volatile JanetAtomicInt ring_free; /* Number of ring slots not yet claimed by writers */
+    volatile JanetAtomicInt slow; /* Non-zero if a reader or writer needs to take the lock */
 #ifdef JANET_WINDOWS
     CRITICAL_SECTION lock;
 #else
@@ -112,18 +131,25 @@ typedef struct {
     JanetHandle write_pipe;
 } JanetEVThreadInit;
 
-/* Structure used to initialize threads that run timeouts */
-typedef struct {
-    double sec;
-    JanetVM *vm;
-    JanetFiber *fiber;
-#ifdef JANET_WINDOWS
-    HANDLE cancel_event;
-#endif
-} JanetThreadedTimeout;
-
 #define JANET_MAX_Q_CAPACITY 0x7FFFFFF
 
+/* Default event loop tuning. All of these can be changed at runtime
+ * with ev/set-loop-options. */
+#ifndef JANET_EV_MAX_EVENTS
+#ifdef JANET_EV_KQUEUE
+#define JANET_EV_MAX_EVENTS 512
+#else
+#define JANET_EV_MAX_EVENTS 64
+#endif
+#endif
+#define JANET_EV_MAX_EVENTS_LIMIT 0x10000
+#ifndef JANET_EV_ACCEPT_BATCH
+#define JANET_EV_ACCEPT_BATCH 16
+#endif
+#ifndef JANET_EV_TASK_BUDGET
+#define JANET_EV_TASK_BUDGET 0
+#endif
+
 static void janet_q_init(JanetQueue *q) {
     q->data = NULL;
     q->head = 0;
@@ -205,6 +231,26 @@ static JanetTimestamp ts_delta(JanetTimestamp ts, double delta) {
     return ts;
 }
 
+static void handle_timeout_worker(JanetTimeout to, int cancel);
+
+/* Check if a timeout can no longer do anything when it expires */
+static int timeout_is_stale(JanetTimeout *to) {
+    if (to->curr_fiber != NULL) {
+        return !janet_fiber_can_resume(to->curr_fiber);
+    }
+    return to->fiber->sched_id != to->sched_id;
+}
+
+/* Clean up a stale timeout that will not be run */
+static void timeout_drop(JanetTimeout to) {
+    if (to.curr_fiber != NULL) {
+        janet_table_remove(&janet_vm.active_tasks, janet_wrap_fiber(to.curr_fiber));
+    }
+    handle_timeout_worker(to, 1);
+}
+
+#ifdef JANET_EV_TIMER_HEAP
+
 /* Look at the next timeout value without removing it. */
 static int peek_timeout(JanetTimeout *out) {
     if (janet_vm.tq_count == 0) return 0;
@@ -264,6 +310,387 @@ static void add_timeout(JanetTimeout to) {
     }
 }
 
+/* Get the next timeout that has expired by now */
+static int pop_expired_timeout(JanetTimestamp now, JanetTimeout *out) {
+    if (peek_timeout(out) && out->when <= now) {
+        pop_timeout(0);
+        return 1;
+    }
+    return 0;
+}
+
+/* Drop timeouts that are no longer needed and get the time of the next one */
+static int next_timeout(JanetTimestamp *when) {
+    JanetTimeout to;
+    while (peek_timeout(&to)) {
+        if (!timeout_is_stale(&to)) {
+            *when = to.when;
+            return 1;
+        }
+        pop_timeout(0);
+        timeout_drop(to);
+    }
+    return 0;
+}
+
+/* The heap cancels timeouts lazily */
+static void timeouts_fiber_rescheduled(JanetFiber *fiber) {
+    (void) fiber;
+}
+
+static void timeouts_init(void) {
+    janet_vm.tq = NULL;
+    janet_vm.tq_count = 0;
+    janet_vm.tq_capacity = 0;
+}
+
+static void timeouts_deinit(void) {
+    JanetTimeout to;
+    while (peek_timeout(&to)) {
+        handle_timeout_worker(to, 1);
+        pop_timeout(0);
+    }
+    janet_free(janet_vm.tq);
+}
+
+static void timeouts_mark(void) {
+    for (size_t i = 0; i < janet_vm.tq_count; i++) {
+        janet_mark(janet_wrap_fiber(janet_vm.tq[i].fiber));
+        if (janet_vm.tq[i].curr_fiber != NULL) {
+            janet_mark(janet_wrap_fiber(janet_vm.tq[i].curr_fiber));
+        }
+    }
+}
+
+#else
+
+/*
+ * Hierarchical timing wheel. Timeouts are rounded up to a whole number of
+ * ticks, so timeouts that expire within the same tick are handled together.
+ * Insertion and cancellation are O(1). Each slot in level n covers the
+ * ticks [u * 64^n, (u + 1) * 64^n) for some u, and when the wheel reaches
+ * the start of a slot its timeouts are redistributed to the lower levels.
+ */
+
+#ifndef JANET_EV_TIMER_TICK
+#define JANET_EV_TIMER_TICK 1
+#endif
+
+#define JANET_TW_MASK ((uint64_t) JANET_TW_SLOTS - 1)
+#define JANET_TW_OVERFLOW JANET_TW_LEVELS
+#define JANET_TW_EXPIRED (JANET_TW_LEVELS + 1)
+#define JANET_TW_TOP_SHIFT ((JANET_TW_LEVELS - 1) * JANET_TW_BITS)
+
+static int tw_ctz(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Distance from slot start to the next occupied slot, wrapping around */
+static int tw_next_slot(uint64_t occupied, int start) {
+    if (start) occupied = (occupied >> start) | (occupied << (JANET_TW_SLOTS - start));
+    return tw_ctz(occupied);
+}
+
+static uint64_t tw_tick_ceil(JanetTimestamp ts) {
+    if (ts < 0) return 0;
+    return ((uint64_t) ts + (JANET_EV_TIMER_TICK - 1)) / JANET_EV_TIMER_TICK;
+}
+
+static uint64_t tw_tick_floor(JanetTimestamp ts) {
+    if (ts < 0) return 0;
+    return (uint64_t) ts / JANET_EV_TIMER_TICK;
+}
+
+static JanetTimerNode **tw_list(int level, int slot) {
+    if (level < JANET_TW_LEVELS) return &janet_vm.tw.slots[level][slot];
+    if (level == JANET_TW_OVERFLOW) return &janet_vm.tw.overflow;
+    return &janet_vm.tw.expired;
+}
+
+/* Append a node to the end of a list */
+static void tw_push(JanetTimerNode *node, int level, int slot) {
+    JanetTimerNode **head = tw_list(level, slot);
+    node->level = (int16_t) level;
+    node->slot = (int16_t) slot;
+    if (*head == NULL) {
+        node->next = node;
+        node->prev = node;
+        *head = node;
+    } else {
+        JanetTimerNode *first = *head;
+        node->next = first;
+        node->prev = first->prev;
+        first->prev->next = node;
+        first->prev = node;
+    }
+    if (level < JANET_TW_LEVELS) {
+        janet_vm.tw.occupied[level] |= (uint64_t) 1 << slot;
+    }
+}
+
+static void tw_unlink(JanetTimerNode *node) {
+    JanetTimerNode **head = tw_list(node->level, node->slot);
+    if (node->next == node) {
+        *head = NULL;
+        if (node->level < JANET_TW_LEVELS) {
+            janet_vm.tw.occupied[node->level] &= ~((uint64_t) 1 << node->slot);
+        }
+    } else {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        if (*head == node) *head = node->next;
+    }
+}
+
+/* Remove a whole list, returning it as a NULL terminated list */
+static JanetTimerNode *tw_detach(int level, int slot) {
+    JanetTimerNode **head = tw_list(level, slot);
+    JanetTimerNode *first = *head;
+    if (first == NULL) return NULL;
+    first->prev->next = NULL;
+    *head = NULL;
+    if (level < JANET_TW_LEVELS) {
+        janet_vm.tw.occupied[level] &= ~((uint64_t) 1 << slot);
+    }
+    return first;
+}
+
+/* Put a node in the right slot relative to the current tick */
+static void tw_place(JanetTimerNode *node) {
+    uint64_t cur = janet_vm.tw.cur;
+    uint64_t tick = node->tick < cur ? cur : node->tick;
+    uint64_t delta = tick - cur;
+    for (int level = 0; level < JANET_TW_LEVELS; level++) {
+        int shift = level * JANET_TW_BITS;
+        if ((delta >> (shift + JANET_TW_BITS)) == 0) {
+            tw_push(node, level, (int)((tick >> shift) & JANET_TW_MASK));
+            return;
+        }
+    }
+    tw_push(node, JANET_TW_OVERFLOW, 0);
+}
+
+/* Return an unlinked node to the free list */
+static void tw_release(JanetTimerNode *node) {
+    JanetFiber *fiber = node->to.fiber;
+    if (fiber->ev_timeout == node) fiber->ev_timeout = NULL;
+    if (node->to.curr_fiber != NULL) janet_vm.tw.deadline_count--;
+    janet_vm.tq_count--;
+    node->next = janet_vm.tw.free_list;
+    janet_vm.tw.free_list = node;
+}
+
+/* Redistribute a slot, dropping timeouts that are no longer needed */
+static void tw_cascade(int level, int slot) {
+    JanetTimerNode *node = tw_detach(level, slot);
+    while (node != NULL) {
+        JanetTimerNode *next = node->next;
+        if (timeout_is_stale(&node->to)) {
+            JanetTimeout to = node->to;
+            tw_release(node);
+            timeout_drop(to);
+        } else {
+            tw_place(node);
+        }
+        node = next;
+    }
+}
+
+/* Get the first tick at which the wheel has work to do */
+static uint64_t tw_next_tick(void) {
+    JanetTimerWheel *tw = &janet_vm.tw;
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < JANET_TW_LEVELS; level++) {
+        if (!tw->occupied[level]) continue;
+        int shift = level * JANET_TW_BITS;
+        /* Level 0 covers [cur, cur + 64), higher levels start after the current slot */
+        uint64_t unit = (tw->cur >> shift) + (level ? 1 : 0);
+        unit += (uint64_t) tw_next_slot(tw->occupied[level], (int)(unit & JANET_TW_MASK));
+        uint64_t tick = unit << shift;
+        if (tick < best) best = tick;
+    }
+    if (tw->overflow != NULL) {
+        uint64_t tick = ((tw->cur >> JANET_TW_TOP_SHIFT) + 1) << JANET_TW_TOP_SHIFT;
+        if (tick < best) best = tick;
+    }
+    return best;
+}
+
+/* Move the wheel forward to the target tick, collecting expired timeouts */
+static void tw_advance(uint64_t target) {
+    JanetTimerWheel *tw = &janet_vm.tw;
+    for (;;) {
+        uint64_t next = tw_next_tick();
+        if (next > target) {
+            if (target > tw->cur) tw->cur = target;
+            return;
+        }
+        tw->cur = next;
+        for (int level = JANET_TW_LEVELS - 1; level > 0; level--) {
+            int shift = level * JANET_TW_BITS;
+            if (next & (((uint64_t) 1 << shift) - 1)) continue;
+            tw_cascade(level, (int)((next >> shift) & JANET_TW_MASK));
+        }
+        if (!(next & (((uint64_t) 1 << JANET_TW_TOP_SHIFT) - 1))) {
+            tw_cascade(JANET_TW_OVERFLOW, 0);
+        }
+        JanetTimerNode *node = tw_detach(0, (int)(next & JANET_TW_MASK));
+        while (node != NULL) {
+            JanetTimerNode *nextnode = node->next;
+            tw_push(node, JANET_TW_EXPIRED, 0);
+            node = nextnode;
+        }
+    }
+}
+
+static void add_timeout(JanetTimeout to) {
+    JanetTimerWheel *tw = &janet_vm.tw;
+    JanetTimerNode *node = tw->free_list;
+    if (NULL != node) {
+        tw->free_list = node->next;
+    } else {
+        node = janet_malloc(sizeof(JanetTimerNode));
+        if (NULL == node) {
+            JANET_OUT_OF_MEMORY;
+        }
+    }
+    node->to = to;
+    /* Deadlines that interrupt the VM must be expired by the time the interrupt
+     * arrives, otherwise the interrupted fiber would just be resumed again. */
+    node->tick = to.has_worker ? tw_tick_floor(to.when) : tw_tick_ceil(to.when);
+    janet_vm.tq_count++;
+    if (to.curr_fiber != NULL) {
+        tw->deadline_count++;
+    } else {
+        to.fiber->ev_timeout = node;
+    }
+    tw_place(node);
+}
+
+/* Get the next timeout that has expired by now */
+static int pop_expired_timeout(JanetTimestamp now, JanetTimeout *out) {
+    JanetTimerWheel *tw = &janet_vm.tw;
+    if (tw->expired == NULL) {
+        tw_advance(tw_tick_floor(now));
+    }
+    JanetTimerNode *node = tw->expired;
+    if (node == NULL) return 0;
+    tw_unlink(node);
+    *out = node->to;
+    tw_release(node);
+    return 1;
+}
+
+/* Drop all stale deadlines in a list */
+static void tw_sweep(int level, int slot) {
+    JanetTimerNode *node = tw_detach(level, slot);
+    while (node != NULL) {
+        JanetTimerNode *next = node->next;
+        if (node->to.curr_fiber != NULL && timeout_is_stale(&node->to)) {
+            JanetTimeout to = node->to;
+            tw_release(node);
+            timeout_drop(to);
+        } else {
+            tw_push(node, level, slot);
+        }
+        node = next;
+    }
+}
+
+/* Drop timeouts that are no longer needed and get the time of the next one */
+static int next_timeout(JanetTimestamp *when) {
+    JanetTimerWheel *tw = &janet_vm.tw;
+    /* Deadlines are not removed when the fiber they watch finishes. If nothing
+     * else can wake the event loop, sweep them so they don't keep it alive. */
+    if (tw->deadline_count && tw->deadline_count == janet_vm.tq_count &&
+            !janet_atomic_load(&janet_vm.listener_count)) {
+        for (int level = 0; level < JANET_TW_LEVELS; level++) {
+            for (int slot = 0; slot < JANET_TW_SLOTS; slot++) {
+                if (tw->slots[level][slot] != NULL) tw_sweep(level, slot);
+            }
+        }
+        tw_sweep(JANET_TW_OVERFLOW, 0);
+        tw_sweep(JANET_TW_EXPIRED, 0);
+    }
+    if (janet_vm.tq_count == 0) return 0;
+    uint64_t tick = tw->expired != NULL ? tw->cur : tw_next_tick();
+    *when = (tick > (uint64_t) INT64_MAX / JANET_EV_TIMER_TICK)
+            ? INT64_MAX
+            : (JanetTimestamp)(tick * JANET_EV_TIMER_TICK);
+    return 1;
+}
+
+/* Remove the timeout of a fiber that is being rescheduled */
+static void timeouts_fiber_rescheduled(JanetFiber *fiber) {
+    JanetTimerNode *node = fiber->ev_timeout;
+    if (NULL != node) {
+        tw_unlink(node);
+        tw_release(node);
+    }
+}
+
+static void timeouts_init(void) {
+    memset(&janet_vm.tw, 0, sizeof(janet_vm.tw));
+    janet_vm.tw.cur = tw_tick_floor(ts_now());
+    janet_vm.tq_count = 0;
+}
+
+static void tw_free_list(JanetTimerNode *node, int cancel) {
+    while (node != NULL) {
+        JanetTimerNode *next = node->next;
+        if (cancel) handle_timeout_worker(node->to, 1);
+        janet_free(node);
+        node = next;
+    }
+}
+
+static void timeouts_deinit(void) {
+    for (int level = 0; level < JANET_TW_LEVELS; level++) {
+        for (int slot = 0; slot < JANET_TW_SLOTS; slot++) {
+            tw_free_list(tw_detach(level, slot), 1);
+        }
+    }
+    tw_free_list(tw_detach(JANET_TW_OVERFLOW, 0), 1);
+    tw_free_list(tw_detach(JANET_TW_EXPIRED, 0), 1);
+    tw_free_list(janet_vm.tw.free_list, 0);
+    janet_vm.tw.free_list = NULL;
+    janet_vm.tq_count = 0;
+}
+
+static void tw_mark_list(JanetTimerNode *first) {
+    JanetTimerNode *node = first;
+    if (node == NULL) return;
+    do {
+        janet_mark(janet_wrap_fiber(node->to.fiber));
+        if (node->to.curr_fiber != NULL) {
+            janet_mark(janet_wrap_fiber(node->to.curr_fiber));
+        }
+        node = node->next;
+    } while (node != first);
+}
+
+static void timeouts_mark(void) {
+    for (int level = 0; level < JANET_TW_LEVELS; level++) {
+        if (!janet_vm.tw.occupied[level]) continue;
+        for (int slot = 0; slot < JANET_TW_SLOTS; slot++) {
+            tw_mark_list(janet_vm.tw.slots[level][slot]);
+        }
+    }
+    tw_mark_list(janet_vm.tw.overflow);
+    tw_mark_list(janet_vm.tw.expired);
+}
+
+#endif
+
 void janet_async_end(JanetFiber *fiber) {
     if (fiber->ev_callback) {
         if (fiber->ev_stream->read_fiber == fiber) {
@@ -519,6 +946,7 @@ static void janet_schedule_general(JanetFiber *fiber, Janet value, JanetSignal s
         Janet task_element = janet_wrap_fiber(fiber);
         janet_table_put(&janet_vm.active_tasks, task_element, janet_wrap_true());
     }
+    timeouts_fiber_rescheduled(fiber);
     JanetTask t = { fiber, value, sig, ++fiber->sched_id };
     if (sig == JANET_SIGNAL_ERROR) fiber->gc.flags |= JANET_FIBER_EV_GCFLAG_CANCELED;
     if (soon) {
@@ -569,12 +997,7 @@ void janet_ev_mark(void) {
     }
 
     /* Pending timeouts */
-    for (size_t i = 0; i < janet_vm.tq_count; i++) {
-        janet_mark(janet_wrap_fiber(janet_vm.tq[i].fiber));
-        if (janet_vm.tq[i].curr_fiber != NULL) {
-            janet_mark(janet_wrap_fiber(janet_vm.tq[i].curr_fiber));
-        }
-    }
+    timeouts_mark();
 }
 
 static int janet_channel_push(JanetChannel *channel, Janet x, int mode);
@@ -595,62 +1018,37 @@ static Janet make_supervisor_event(const char *name, JanetFiber *fiber, int thre
 /* Common init code */
 void janet_ev_init_common(void) {
     janet_q_init(&janet_vm.spawn);
-    janet_vm.tq = NULL;
-    janet_vm.tq_count = 0;
-    janet_vm.tq_capacity = 0;
+    timeouts_init();
     janet_table_init_raw(&janet_vm.threaded_abstracts, 0);
     janet_table_init_raw(&janet_vm.active_tasks, 0);
     janet_table_init_raw(&janet_vm.signal_handlers, 0);
     janet_rng_seed(&janet_vm.ev_rng, 0);
+    janet_vm.ev_max_events = JANET_EV_MAX_EVENTS;
+    janet_vm.ev_accept_batch = JANET_EV_ACCEPT_BATCH;
+    janet_vm.ev_task_budget = JANET_EV_TASK_BUDGET;
+    janet_vm.ev_events = NULL;
+    janet_vm.ev_events_capacity = 0;
 #ifndef JANET_WINDOWS
+    janet_vm.proc_waiters = NULL;
+    janet_vm.proc_waiter_count = 0;
+    janet_vm.proc_waiter_capacity = 0;
+    janet_vm.proc_sigchld_slot = -1;
+    janet_vm.proc_sigchld_pending = 0;
     pthread_attr_init(&janet_vm.new_thread_attr);
     pthread_attr_setdetachstate(&janet_vm.new_thread_attr, PTHREAD_CREATE_DETACHED);
 #endif
 }
 
-#if JANET_ANDROID
-static void janet_timeout_stop(int sig_num) {
-    if (sig_num == SIGUSR1) {
-        pthread_exit(NULL);
-    }
-}
-#endif
-
-static void handle_timeout_worker(JanetTimeout to, int cancel) {
-    if (!to.has_worker) return;
-#ifdef JANET_WINDOWS
-    if (cancel && to.worker_event) {
-        SetEvent(to.worker_event);
-    }
-    WaitForSingleObject(to.worker, INFINITE);
-    CloseHandle(to.worker);
-    if (to.worker_event) {
-        CloseHandle(to.worker_event);
-    }
-#else
-#ifdef JANET_ANDROID
-    if (cancel) janet_assert(!pthread_kill(to.worker, SIGUSR1), "pthread_kill");
-#else
-    if (cancel) janet_assert(!pthread_cancel(to.worker), "pthread_cancel");
-#endif
-    void *res = NULL;
-    janet_assert(!pthread_join(to.worker, &res), "pthread_join");
-#endif
-}
-
 /* Common deinit code */
 void janet_ev_deinit_common(void) {
-    JanetTimeout to;
-    while (peek_timeout(&to)) {
-        handle_timeout_worker(to, 1);
-        pop_timeout(0);
-    }
+    timeouts_deinit();
     janet_q_deinit(&janet_vm.spawn);
-    janet_free(janet_vm.tq);
+    janet_free(janet_vm.ev_events);
     janet_table_deinit(&janet_vm.threaded_abstracts);
     janet_table_deinit(&janet_vm.active_tasks);
     janet_table_deinit(&janet_vm.signal_handlers);
 #ifndef JANET_WINDOWS
+    janet_ev_deinit_procs();
     pthread_attr_destroy(&janet_vm.new_thread_attr);
 #endif
 }
@@ -692,51 +1090,220 @@ static void janet_timeout_cb(JanetEVGenericMessage msg) {
     janet_interpreter_interrupt_handled(&janet_vm);
 }
 
+/*
+ * Watchdog for deadlines that interrupt the VM. One thread per process
+ * sleeps until the earliest pending deadline of any VM and then interrupts
+ * that VM. The thread exits once there are no more pending deadlines, and
+ * is started again on demand.
+ */
+
+typedef struct {
+    JanetTimestamp when;
+    JanetVM *vm;
+    size_t index; /* Position in the watchdog heap, SIZE_MAX when no longer pending */
+} JanetWatchdogEntry;
+
+static struct {
 #ifdef JANET_WINDOWS
-static DWORD WINAPI janet_timeout_body(LPVOID ptr) {
-    JanetThreadedTimeout tto = *(JanetThreadedTimeout *)ptr;
-    janet_free(ptr);
-    JanetTimestamp wait_begin = ts_now();
-    DWORD duration = (DWORD)round(tto.sec * 1000);
-    DWORD res = WAIT_TIMEOUT;
-    JanetTimestamp wait_end = ts_now();
-    for (DWORD i = 1; res == WAIT_TIMEOUT && (wait_end - wait_begin) < duration; i++) {
-        res = WaitForSingleObject(tto.cancel_event, (duration + i));
-        wait_end = ts_now();
-    }
-    /* only send interrupt message if result is WAIT_TIMEOUT */
-    if (res == WAIT_TIMEOUT) {
-        janet_interpreter_interrupt(tto.vm);
-        JanetEVGenericMessage msg = {0};
-        janet_ev_post_event(tto.vm, janet_timeout_cb, msg);
-    }
-    return 0;
+    SRWLOCK lock;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+    JanetWatchdogEntry **heap;
+    size_t count;
+    size_t capacity;
+    int running;
+} janet_watchdog = {
+#ifdef JANET_WINDOWS
+    SRWLOCK_INIT,
+    CONDITION_VARIABLE_INIT,
+#else
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+#endif
+    NULL, 0, 0, 0
+};
+
+static void janet_watchdog_lock(void) {
+#ifdef JANET_WINDOWS
+    AcquireSRWLockExclusive(&janet_watchdog.lock);
+#else
+    pthread_mutex_lock(&janet_watchdog.lock);
+#endif
 }
+
+static void janet_watchdog_unlock(void) {
+#ifdef JANET_WINDOWS
+    ReleaseSRWLockExclusive(&janet_watchdog.lock);
+#else
+    pthread_mutex_unlock(&janet_watchdog.lock);
+#endif
+}
+
+static void janet_watchdog_signal(void) {
+#ifdef JANET_WINDOWS
+    WakeConditionVariable(&janet_watchdog.cond);
 #else
-static void *janet_timeout_body(void *ptr) {
-#ifdef JANET_ANDROID
-    struct sigaction action;
-    memset(&action, 0, sizeof(action));
-    sigemptyset(&action.sa_mask);
-    action.sa_flags = 0;
-    action.sa_handler = &janet_timeout_stop;
-    sigaction(SIGUSR1, &action, NULL);
+    pthread_cond_signal(&janet_watchdog.cond);
 #endif
-    JanetThreadedTimeout tto = *(JanetThreadedTimeout *)ptr;
-    janet_free(ptr);
+}
+
+/* Wait at most ms milliseconds for the heap to change. Must hold the lock. */
+static void janet_watchdog_wait(JanetTimestamp ms) {
+#ifdef JANET_WINDOWS
+    SleepConditionVariableSRW(&janet_watchdog.cond, &janet_watchdog.lock, (DWORD) ms, 0);
+#else
     struct timespec ts;
-    ts.tv_sec = (time_t) tto.sec;
-    ts.tv_nsec = (tto.sec <= UINT32_MAX)
-                 ? (long)((tto.sec - ((uint32_t)tto.sec)) * 1000000000)
-                 : 0;
-    nanosleep(&ts, &ts);
-    janet_interpreter_interrupt(tto.vm);
+    janet_gettime(&ts, JANET_TIME_REALTIME);
+    ts.tv_sec += (time_t)(ms / 1000);
+    ts.tv_nsec += (long)((ms % 1000) * 1000000);
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&janet_watchdog.cond, &janet_watchdog.lock, &ts);
+#endif
+}
+
+static void janet_watchdog_swap(size_t i, size_t j) {
+    JanetWatchdogEntry **heap = janet_watchdog.heap;
+    JanetWatchdogEntry *tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+    heap[i]->index = i;
+    heap[j]->index = j;
+}
+
+static void janet_watchdog_sift(size_t index) {
+    JanetWatchdogEntry **heap = janet_watchdog.heap;
+    while (index > 0) {
+        size_t parent = (index - 1) >> 1;
+        if (heap[parent]->when <= heap[index]->when) break;
+        janet_watchdog_swap(index, parent);
+        index = parent;
+    }
+    for (;;) {
+        size_t left = (index << 1) + 1;
+        size_t right = left + 1;
+        size_t smallest = index;
+        if (left < janet_watchdog.count && heap[left]->when < heap[smallest]->when)
+            smallest = left;
+        if (right < janet_watchdog.count && heap[right]->when < heap[smallest]->when)
+            smallest = right;
+        if (smallest == index) break;
+        janet_watchdog_swap(index, smallest);
+        index = smallest;
+    }
+}
+
+/* Remove an entry from the heap. Must hold the lock. */
+static void janet_watchdog_pop(JanetWatchdogEntry *entry) {
+    size_t index = entry->index;
+    size_t last = --janet_watchdog.count;
+    entry->index = SIZE_MAX;
+    if (index != last) {
+        janet_watchdog.heap[index] = janet_watchdog.heap[last];
+        janet_watchdog.heap[index]->index = index;
+        janet_watchdog_sift(index);
+    }
+}
+
+static void janet_watchdog_fire(JanetWatchdogEntry *entry) {
+    janet_watchdog_pop(entry);
+    janet_interpreter_interrupt(entry->vm);
     JanetEVGenericMessage msg = {0};
-    janet_ev_post_event(tto.vm, janet_timeout_cb, msg);
+    janet_ev_post_event(entry->vm, janet_timeout_cb, msg);
+}
+
+#ifdef JANET_WINDOWS
+static DWORD WINAPI janet_watchdog_body(LPVOID ptr) {
+#else
+static void *janet_watchdog_body(void *ptr) {
+#endif
+    (void) ptr;
+    janet_watchdog_lock();
+    while (janet_watchdog.count) {
+        JanetWatchdogEntry *entry = janet_watchdog.heap[0];
+        JanetTimestamp now = ts_now();
+        if (entry->when <= now) {
+            janet_watchdog_fire(entry);
+        } else {
+            janet_watchdog_wait(entry->when - now);
+        }
+    }
+    janet_watchdog.running = 0;
+    janet_watchdog_unlock();
+#ifdef JANET_WINDOWS
+    return 0;
+#else
     return NULL;
+#endif
 }
+
+/* Schedule an interrupt of the current VM at a given time */
+static JanetWatchdogEntry *janet_watchdog_add(JanetTimestamp when) {
+    JanetWatchdogEntry *entry = janet_malloc(sizeof(JanetWatchdogEntry));
+    if (NULL == entry) {
+        JANET_OUT_OF_MEMORY;
+    }
+    entry->when = when;
+    entry->vm = &janet_vm;
+    janet_watchdog_lock();
+    if (janet_watchdog.count == janet_watchdog.capacity) {
+        size_t newcap = 2 * janet_watchdog.capacity + 8;
+        JanetWatchdogEntry **heap = janet_realloc(janet_watchdog.heap, newcap * sizeof(JanetWatchdogEntry *));
+        if (NULL == heap) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_watchdog.heap = heap;
+        janet_watchdog.capacity = newcap;
+    }
+    entry->index = janet_watchdog.count++;
+    janet_watchdog.heap[entry->index] = entry;
+    janet_watchdog_sift(entry->index);
+    if (!janet_watchdog.running) {
+#ifdef JANET_WINDOWS
+        HANDLE worker = CreateThread(NULL, 0, janet_watchdog_body, NULL, 0, NULL);
+        int err = (NULL == worker);
+        if (!err) CloseHandle(worker);
+#else
+        pthread_t worker;
+        int err = pthread_create(&worker, &janet_vm.new_thread_attr, janet_watchdog_body, NULL);
+#endif
+        if (err) {
+            janet_watchdog_pop(entry);
+            janet_watchdog_unlock();
+            janet_free(entry);
+#ifdef JANET_WINDOWS
+            janet_panic("failed to create thread");
+#else
+            janet_panicf("%s", janet_strerror(err));
 #endif
+        }
+        janet_watchdog.running = 1;
+    } else if (entry->index == 0) {
+        /* New earliest deadline */
+        janet_watchdog_signal();
+    }
+    janet_watchdog_unlock();
+    return entry;
+}
 
+/* Called once for every timeout that has a worker, whether it expired or was dropped */
+static void handle_timeout_worker(JanetTimeout to, int cancel) {
+    (void) cancel;
+    if (!to.has_worker) return;
+    JanetWatchdogEntry *entry = to.worker;
+    janet_watchdog_lock();
+    if (entry->index != SIZE_MAX) {
+        janet_watchdog_pop(entry);
+        if (janet_watchdog.count == 0) janet_watchdog_signal();
+    }
+    janet_watchdog_unlock();
+    janet_free(entry);
+}
 
 void janet_ev_inc_refcount(void) {
     janet_atomic_inc(&janet_vm.listener_count);
@@ -749,6 +1316,8 @@ void janet_ev_dec_refcount(void) {
 /* Channels */
 
 #define JANET_MAX_CHANNEL_CAPACITY 0xFFFFFF
+#define JANET_CHANNEL_RING_MAX 4096
+#define JANET_CHANNEL_CLOSED_BIT 0x40000000
 
 static inline int janet_chan_is_threaded(JanetChannel *chan) {
     return chan->is_threaded;
@@ -758,6 +1327,12 @@ static int janet_chan_pack(JanetChannel *chan, Janet *x) {
     if (!janet_chan_is_threaded(chan)) return 0;
     switch (janet_type(*x)) {
         default: {
+            void *heap = janet_shared_heap(*x);
+            if (NULL != heap) {
+                /* Shared values are sent as is */
+                janet_abstract_incref(heap);
+                return 0;
+            }
             JanetBuffer *buf = janet_malloc(sizeof(JanetBuffer));
             if (NULL == buf) {
                 JANET_OUT_OF_MEMORY;
@@ -779,8 +1354,16 @@ static int janet_chan_pack(JanetChannel *chan, Janet *x) {
 static int janet_chan_unpack(JanetChannel *chan, Janet *x, int is_cleanup) {
     if (!janet_chan_is_threaded(chan)) return 0;
     switch (janet_type(*x)) {
-        default:
-            return 1;
+        default: {
+            void *heap = janet_shared_heap(*x);
+            if (NULL == heap) return 1;
+            if (is_cleanup) {
+                janet_abstract_decref_maybe_free(heap);
+            } else {
+                janet_abstract_adopt_threaded(heap);
+            }
+            return 0;
+        }
         case JANET_BUFFER: {
             JanetBuffer *buf = janet_unwrap_buffer(*x);
             int flags = is_cleanup ? (JANET_MARSHAL_UNSAFE | JANET_MARSHAL_DECREF) : JANET_MARSHAL_UNSAFE;
@@ -798,6 +1381,67 @@ static int janet_chan_unpack(JanetChannel *chan, Janet *x, int is_cleanup) {
     }
 }
 
+/*
+ * Item ring for threaded channels. This is a bounded multi-producer, multi-consumer
+ * queue where each cell carries a sequence number (Vyukov). Writers first claim a
+ * slot from ring_free so that the ring never holds more than ring_size items, and
+ * readers give the slot back after taking an item. Neither side ever spins waiting
+ * on the other, so a preempted thread cannot stall the channel.
+ */
+
+/* Push to the ring. Fails if the ring is full, or if the reader of the previous
+ * lap has not yet released the cell - writers never wait on a reader. */
+static int janet_ring_push(JanetChannel *chan, Janet x) {
+    if (NULL == chan->ring) return 0;
+    /* Claim a slot */
+    JanetAtomicInt n = janet_atomic_load(&chan->ring_free);
+    for (;;) {
+        if (n <= 0) return 0;
+        if (janet_atomic_cas(&chan->ring_free, n, n - 1)) break;
+        n = janet_atomic_load(&chan->ring_free);
+    }
+    uint32_t pos = (uint32_t) janet_atomic_load_relaxed(&chan->ring_tail);
+    for (;;) {
+        JanetChannelCell *cell = chan->ring + (pos & chan->ring_mask);
+        uint32_t seq = (uint32_t) janet_atomic_load(&cell->seq);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (janet_atomic_cas(&chan->ring_tail, (JanetAtomicInt) pos, (JanetAtomicInt)(pos + 1))) {
+                cell->value = x;
+                janet_atomic_store(&cell->seq, (JanetAtomicInt)(pos + 1));
+                return 1;
+            }
+        } else if (diff < 0) {
+            /* A reader is still taking the item in this cell */
+            janet_atomic_inc(&chan->ring_free);
+            return 0;
+        }
+        pos = (uint32_t) janet_atomic_load_relaxed(&chan->ring_tail);
+    }
+}
+
+static int janet_ring_pop(JanetChannel *chan, Janet *out) {
+    if (NULL == chan->ring) return 0;
+    uint32_t pos = (uint32_t) janet_atomic_load_relaxed(&chan->ring_head);
+    for (;;) {
+        JanetChannelCell *cell = chan->ring + (pos & chan->ring_mask);
+        uint32_t seq = (uint32_t) janet_atomic_load(&cell->seq);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (janet_atomic_cas(&chan->ring_head, (JanetAtomicInt) pos, (JanetAtomicInt)(pos + 1))) {
+                *out = cell->value;
+                janet_atomic_store(&cell->seq, (JanetAtomicInt)(pos + chan->ring_mask + 1));
+                janet_atomic_inc(&chan->ring_free);
+                return 1;
+            }
+        } else if (diff < 0) {
+            /* Empty, or the next item is still being written */
+            return 0;
+        }
+        pos = (uint32_t) janet_atomic_load_relaxed(&chan->ring_head);
+    }
+}
+
 static void janet_chan_init(JanetChannel *chan, int32_t limit, int threaded) {
     chan->limit = limit;
     chan->closed = 0;
@@ -805,6 +1449,29 @@ static void janet_chan_init(JanetChannel *chan, int32_t limit, int threaded) {
     janet_q_init(&chan->items);
     janet_q_init(&chan->read_pending);
     janet_q_init(&chan->write_pending);
+    chan->ring = NULL;
+    chan->ring_mask = 0;
+    chan->ring_size = 0;
+    chan->ring_head = 0;
+    chan->ring_tail = 0;
+    chan->ring_free = 0;
+    chan->slow = 0;
+    if (threaded && limit > 0) {
+        int32_t size = limit < JANET_CHANNEL_RING_MAX ? limit : JANET_CHANNEL_RING_MAX;
+        uint32_t cap = 1;
+        while (cap < (uint32_t) size) cap <<= 1;
+        chan->ring = janet_malloc(cap * sizeof(JanetChannelCell));
+        if (NULL == chan->ring) {
+            JANET_OUT_OF_MEMORY;
+        }
+        for (uint32_t i = 0; i < cap; i++) {
+            chan->ring[i].seq = (JanetAtomicInt) i;
+            chan->ring[i].value = janet_wrap_nil();
+        }
+        chan->ring_mask = cap - 1;
+        chan->ring_size = size;
+        chan->ring_free = size;
+    }
     janet_os_mutex_init((JanetOSMutex *) &chan->lock);
 }
 
@@ -821,14 +1488,22 @@ static void janet_chan_unlock(JanetChannel *chan) {
 static void janet_chan_deinit(JanetChannel *chan) {
     if (janet_chan_is_threaded(chan)) {
         Janet item;
+        JanetChannelPending writer;
         janet_chan_lock(chan);
-        janet_q_deinit(&chan->read_pending);
-        janet_q_deinit(&chan->write_pending);
+        while (janet_ring_pop(chan, &item)) {
+            janet_chan_unpack(chan, &item, 1);
+        }
         while (!janet_q_pop(&chan->items, &item, sizeof(item))) {
             janet_chan_unpack(chan, &item, 1);
         }
+        while (!janet_q_pop(&chan->write_pending, &writer, sizeof(writer))) {
+            janet_chan_unpack(chan, &writer.value, 1);
+        }
+        janet_q_deinit(&chan->read_pending);
+        janet_q_deinit(&chan->write_pending);
         janet_q_deinit(&chan->items);
         janet_chan_unlock(chan);
+        janet_free(chan->ring);
     } else {
         janet_q_deinit(&chan->read_pending);
         janet_q_deinit(&chan->write_pending);
@@ -898,6 +1573,8 @@ static int janet_chanat_mark(void *p, size_t s) {
     JanetChannel *chan = p;
     janet_chanat_mark_fq(&chan->read_pending);
     janet_chanat_mark_fq(&chan->write_pending);
+    /* Items in threaded channels are packed, and not owned by any heap */
+    if (janet_chan_is_threaded(chan)) return 0;
     JanetQueue *items = &chan->items;
     Janet *data = chan->items.data;
     if (items->head <= items->tail) {
@@ -909,233 +1586,535 @@ static int janet_chanat_mark(void *p, size_t s) {
         for (int32_t i = 0; i < items->tail; i++)
             janet_mark(data[i]);
     }
-    return 0;
+    return 0;
+}
+
+static Janet make_write_result(JanetChannel *channel) {
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_ckeywordv("give");
+    tup[1] = janet_wrap_channel(channel);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+static Janet make_read_result(JanetChannel *channel, Janet x) {
+    Janet *tup = janet_tuple_begin(3);
+    tup[0] = janet_ckeywordv("take");
+    tup[1] = janet_wrap_channel(channel);
+    tup[2] = x;
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+static Janet make_close_result(JanetChannel *channel) {
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_ckeywordv("close");
+    tup[1] = janet_wrap_channel(channel);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+/* Describe the current root fiber blocking on a channel */
+static void janet_chan_pending_init(JanetChannelPending *pending, JanetChannelMode mode, int32_t many) {
+    pending->thread = &janet_vm;
+    pending->fiber = janet_vm.root_fiber;
+    pending->sched_id = janet_vm.root_fiber->sched_id;
+    pending->mode = mode;
+    pending->many = many;
+    pending->value = janet_wrap_nil();
+}
+
+/* Push a value to a channel, and return 1 if channel should block, zero otherwise.
+ * If the push would block, will add to the write_pending queue in the channel.
+ * Only for channels local to this thread. */
+static int janet_channel_push_local(JanetChannel *channel, Janet x, int mode) {
+    JanetChannelPending reader;
+    int is_empty;
+    if (channel->closed) {
+        janet_panic("cannot write to closed channel");
+    }
+    do {
+        is_empty = janet_q_pop(&channel->read_pending, &reader, sizeof(reader));
+    } while (!is_empty && (reader.sched_id != reader.fiber->sched_id));
+    if (is_empty) {
+        /* No pending reader */
+        if (janet_q_push(&channel->items, &x, sizeof(Janet))) {
+            janet_panicf("channel overflow: %v", x);
+        } else if (janet_q_count(&channel->items) > channel->limit) {
+            /* No root fiber, we are in completion on a root fiber. Don't block. */
+            if (mode == 2) return 1;
+            /* Pushed successfully, but should block. */
+            JanetChannelPending pending;
+            janet_chan_pending_init(&pending, mode ? JANET_CP_MODE_CHOICE_WRITE : JANET_CP_MODE_WRITE, 0);
+            janet_q_push(&channel->write_pending, &pending, sizeof(pending));
+            return 1;
+        }
+    } else {
+        /* Pending reader */
+        if (reader.mode == JANET_CP_MODE_CHOICE_READ) {
+            janet_schedule(reader.fiber, make_read_result(channel, x));
+        } else if (reader.mode == JANET_CP_MODE_READ_MANY) {
+            JanetArray *array = janet_array(1);
+            janet_array_push(array, x);
+            janet_schedule(reader.fiber, janet_wrap_array(array));
+        } else {
+            janet_schedule(reader.fiber, x);
+        }
+    }
+    return 0;
+}
+
+/* Pop from a channel - returns 1 if item was obtained, 0 otherwise. The item
+ * is returned by reference. If the pop would block, will add to the read_pending
+ * queue in the channel. Only for channels local to this thread. */
+static int janet_channel_pop_local(JanetChannel *channel, Janet *item, int is_choice) {
+    JanetChannelPending writer;
+    if (channel->closed) {
+        *item = janet_wrap_nil();
+        return 1;
+    }
+    if (janet_q_pop(&channel->items, item, sizeof(Janet))) {
+        /* Queue empty */
+        if (is_choice == 2) return 0; /* Skip pending read */
+        JanetChannelPending pending;
+        janet_chan_pending_init(&pending, is_choice ? JANET_CP_MODE_CHOICE_READ : JANET_CP_MODE_READ, 0);
+        janet_q_push(&channel->read_pending, &pending, sizeof(pending));
+        return 0;
+    }
+    if (!janet_q_pop(&channel->write_pending, &writer, sizeof(writer))) {
+        /* Pending writer */
+        if (writer.mode == JANET_CP_MODE_CHOICE_WRITE) {
+            janet_schedule(writer.fiber, make_write_result(channel));
+        } else {
+            janet_schedule(writer.fiber, janet_wrap_abstract(channel));
+        }
+    }
+    return 1;
+}
+
+/*
+ * Threaded channels. Items move through the lock-free ring when possible. The lock
+ * protects the overflow queue (chan->items) and the queues of blocked fibers. Fibers
+ * to wake are collected while holding the lock, and then woken with a single event
+ * per thread after the lock is released.
+ */
+
+typedef struct {
+    JanetChannelPending pending;
+    int closed;
+} JanetChannelWake;
+
+typedef struct {
+    JanetChannelWake *data;
+    int32_t count;
+    int32_t capacity;
+    JanetChannelWake local[8];
+} JanetChannelWakes;
+
+typedef struct {
+    JanetChannel *channel;
+    int32_t count;
+    JanetChannelWake wakes[];
+} JanetChannelWakeBatch;
+
+static void janet_tchan_wakes_init(JanetChannelWakes *wakes) {
+    wakes->data = wakes->local;
+    wakes->count = 0;
+    wakes->capacity = 8;
+}
+
+static void janet_tchan_wake(JanetChannelWakes *wakes, JanetChannelPending *pending, Janet value, int closed) {
+    if (wakes->count >= wakes->capacity) {
+        int32_t newcap = wakes->capacity * 2;
+        JanetChannelWake *data = janet_malloc(newcap * sizeof(JanetChannelWake));
+        if (NULL == data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        memcpy(data, wakes->data, wakes->count * sizeof(JanetChannelWake));
+        if (wakes->data != wakes->local) janet_free(wakes->data);
+        wakes->data = data;
+        wakes->capacity = newcap;
+    }
+    JanetChannelWake *w = wakes->data + wakes->count++;
+    w->pending = *pending;
+    w->pending.value = value;
+    w->closed = closed;
+}
+
+/* Publish whether readers and writers can skip the lock. Call with the lock held. */
+static void janet_tchan_update(JanetChannel *chan) {
+    JanetAtomicInt slow = janet_q_count(&chan->items)
+                          + janet_q_count(&chan->read_pending)
+                          + janet_q_count(&chan->write_pending);
+    if (chan->closed) slow |= JANET_CHANNEL_CLOSED_BIT;
+    janet_atomic_store(&chan->slow, slow);
+}
+
+/* Number of items in a threaded channel, including values held by blocked writers */
+static int32_t janet_tchan_count(JanetChannel *chan) {
+    int32_t in_ring = chan->ring_size - (int32_t) janet_atomic_load(&chan->ring_free);
+    return in_ring + janet_q_count(&chan->items) + janet_q_count(&chan->write_pending);
+}
+
+/* Store a packed value without blocking if the channel has room. Returns 1 on success. */
+static int janet_tchan_store(JanetChannel *chan, Janet x) {
+    if (0 == janet_q_count(&chan->items) && janet_ring_push(chan, x)) {
+        return 1;
+    }
+    if (janet_q_count(&chan->read_pending) > 0 ||
+            janet_q_count(&chan->items) < chan->limit - chan->ring_size) {
+        return !janet_q_push(&chan->items, &x, sizeof(x));
+    }
+    return 0;
+}
+
+/* Take the next packed value, possibly from a blocked writer. Returns 1 on success. */
+static int janet_tchan_take_one(JanetChannel *chan, Janet *x, JanetChannelWakes *wakes) {
+    JanetChannelPending writer;
+    if (janet_ring_pop(chan, x)) return 1;
+    if (!janet_q_pop(&chan->items, x, sizeof(Janet))) return 1;
+    if (!janet_q_pop(&chan->write_pending, &writer, sizeof(writer))) {
+        *x = writer.value;
+        if (writer.thread) janet_tchan_wake(wakes, &writer, janet_wrap_nil(), 0);
+        return 1;
+    }
+    return 0;
+}
+
+static int janet_tchan_settle_pass(JanetChannel *chan, JanetChannelWakes *wakes) {
+    int progress = 0;
+    Janet x;
+    JanetChannelPending pending;
+    /* Move overflow into the ring as slots free up */
+    while (!janet_q_pop(&chan->items, &x, sizeof(x))) {
+        if (!janet_ring_push(chan, x)) {
+            janet_q_push_head(&chan->items, &x, sizeof(x));
+            break;
+        }
+    }
+    /* Unblock writers whose values now fit */
+    while (!janet_q_pop(&chan->write_pending, &pending, sizeof(pending))) {
+        if (!janet_tchan_store(chan, pending.value)) {
+            janet_q_push_head(&chan->write_pending, &pending, sizeof(pending));
+            break;
+        }
+        if (pending.thread) janet_tchan_wake(wakes, &pending, janet_wrap_nil(), 0);
+        progress = 1;
+    }
+    /* Hand items to blocked readers */
+    while (janet_q_count(&chan->read_pending) > 0) {
+        if (!janet_tchan_take_one(chan, &x, wakes)) break;
+        int found = 0;
+        while (!janet_q_pop(&chan->read_pending, &pending, sizeof(pending))) {
+            /* Skip readers on threads that have dropped the channel */
+            if (pending.thread) {
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            janet_q_push_head(&chan->items, &x, sizeof(x));
+            break;
+        }
+        janet_tchan_wake(wakes, &pending, x, 0);
+        progress = 1;
+    }
+    return progress;
 }
 
-static Janet make_write_result(JanetChannel *channel) {
-    Janet *tup = janet_tuple_begin(2);
-    tup[0] = janet_ckeywordv("give");
-    tup[1] = janet_wrap_channel(channel);
-    return janet_wrap_tuple(janet_tuple_end(tup));
+/* Move items to blocked fibers until nothing changes. Call with the lock held.
+ * After publishing the new state, check again so that a concurrent lock-free push or
+ * pop either sees that it must take the lock, or is seen here. */
+static void janet_tchan_settle(JanetChannel *chan, JanetChannelWakes *wakes) {
+    int progress;
+    do {
+        janet_tchan_settle_pass(chan, wakes);
+        janet_tchan_update(chan);
+        janet_atomic_fence();
+        progress = janet_tchan_settle_pass(chan, wakes);
+    } while (progress);
+    janet_tchan_update(chan);
 }
 
-static Janet make_read_result(JanetChannel *channel, Janet x) {
-    Janet *tup = janet_tuple_begin(3);
-    tup[0] = janet_ckeywordv("take");
-    tup[1] = janet_wrap_channel(channel);
-    tup[2] = x;
-    return janet_wrap_tuple(janet_tuple_end(tup));
-}
+static void janet_tchan_wake_all(JanetChannel *chan, JanetChannelWakes *wakes);
+static int32_t janet_tchan_take(JanetChannel *chan, Janet *buf, int32_t n, JanetChannelPending *block);
 
-static Janet make_close_result(JanetChannel *channel) {
-    Janet *tup = janet_tuple_begin(2);
-    tup[0] = janet_ckeywordv("close");
-    tup[1] = janet_wrap_channel(channel);
-    return janet_wrap_tuple(janet_tuple_end(tup));
+/* Put back a packed item that was sent to a fiber that is no longer waiting */
+static void janet_tchan_requeue(JanetChannel *chan, Janet x) {
+    JanetChannelWakes wakes;
+    janet_tchan_wakes_init(&wakes);
+    janet_chan_lock(chan);
+    if (chan->closed || janet_q_push_head(&chan->items, &x, sizeof(x))) {
+        janet_chan_unlock(chan);
+        janet_chan_unpack(chan, &x, 1);
+        return;
+    }
+    janet_tchan_settle(chan, &wakes);
+    janet_chan_unlock(chan);
+    janet_tchan_wake_all(chan, &wakes);
+}
+
+/* Take up to n more items without blocking */
+static void janet_tchan_take_into(JanetChannel *chan, JanetArray *out, int32_t n) {
+    Janet buf[64];
+    while (n > 0) {
+        int32_t chunk = n < 64 ? n : 64;
+        int32_t got = janet_tchan_take(chan, buf, chunk, NULL);
+        for (int32_t i = 0; i < got; i++) {
+            janet_assert(!janet_chan_unpack(chan, buf + i, 0), "bad channel packing");
+            janet_array_push(out, buf[i]);
+        }
+        if (got < chunk) break;
+        n -= got;
+    }
 }
 
-/* Callback to use for scheduling a fiber from another thread. */
-static void janet_thread_chan_cb(JanetEVGenericMessage msg) {
-    uint32_t sched_id = (uint32_t) msg.argi;
-    JanetFiber *fiber = msg.fiber;
-    int mode = msg.tag;
-    JanetChannel *channel = (JanetChannel *) msg.argp;
-    Janet x = msg.argj;
-    janet_chan_lock(channel);
-    if (fiber->sched_id == sched_id) {
-        if (mode == JANET_CP_MODE_CHOICE_READ) {
-            janet_assert(!janet_chan_unpack(channel, &x, 0), "packing error");
-            janet_schedule(fiber, make_read_result(channel, x));
-        } else if (mode == JANET_CP_MODE_CHOICE_WRITE) {
-            janet_schedule(fiber, make_write_result(channel));
-        } else if (mode == JANET_CP_MODE_READ) {
-            janet_assert(!janet_chan_unpack(channel, &x, 0), "packing error");
-            janet_schedule(fiber, x);
-        } else if (mode == JANET_CP_MODE_WRITE) {
-            janet_schedule(fiber, janet_wrap_channel(channel));
-        } else { /* (mode == JANET_CP_MODE_CLOSE) */
+/* Resume a fiber of the current thread that was blocked on a threaded channel */
+static void janet_tchan_deliver(JanetChannel *chan, JanetChannelWake *w) {
+    JanetChannelPending *p = &w->pending;
+    JanetFiber *fiber = p->fiber;
+    Janet x = p->value;
+    int is_read = p->mode == JANET_CP_MODE_READ ||
+                  p->mode == JANET_CP_MODE_CHOICE_READ ||
+                  p->mode == JANET_CP_MODE_READ_MANY;
+    janet_gcunroot(janet_wrap_fiber(fiber));
+    if (!janet_fiber_can_resume(fiber) || fiber->sched_id != p->sched_id) {
+        /* Fiber has already been canceled or resumed, don't lose the item */
+        if (is_read && !w->closed) janet_tchan_requeue(chan, x);
+        return;
+    }
+    if (w->closed) {
+        if (p->mode == JANET_CP_MODE_CHOICE_READ || p->mode == JANET_CP_MODE_CHOICE_WRITE) {
+            janet_schedule(fiber, make_close_result(chan));
+        } else {
             janet_schedule(fiber, janet_wrap_nil());
         }
-    } else if (mode != JANET_CP_MODE_CLOSE) {
-        /* Fiber has already been canceled or resumed. */
-        /* Resend event to another waiting thread, depending on mode */
-        int is_read = (mode == JANET_CP_MODE_CHOICE_READ) || (mode == JANET_CP_MODE_READ);
-        if (is_read) {
-            JanetChannelPending reader;
-            int sent = 0;
-            while (!janet_q_pop(&channel->read_pending, &reader, sizeof(reader))) {
-                JanetVM *vm = reader.thread;
-                if (!vm) continue;
-                JanetEVGenericMessage msg;
-                msg.tag = reader.mode;
-                msg.fiber = reader.fiber;
-                msg.argi = (int32_t) reader.sched_id;
-                msg.argp = channel;
-                msg.argj = x;
-                janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-                sent = 1;
-                break;
-            }
-            if (!sent) {
-                janet_chan_unpack(channel, &x, 1);
-            }
-        } else {
-            JanetChannelPending writer;
-            while (!janet_q_pop(&channel->write_pending, &writer, sizeof(writer))) {
-                JanetVM *vm = writer.thread;
-                if (!vm) continue;
-                JanetEVGenericMessage msg;
-                msg.tag = writer.mode;
-                msg.fiber = writer.fiber;
-                msg.argi = (int32_t) writer.sched_id;
-                msg.argp = channel;
-                msg.argj = janet_wrap_nil();
-                janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-                break;
+        return;
+    }
+    if (is_read) {
+        janet_assert(!janet_chan_unpack(chan, &x, 0), "packing error");
+    }
+    switch (p->mode) {
+        case JANET_CP_MODE_READ:
+            janet_schedule(fiber, x);
+            break;
+        case JANET_CP_MODE_CHOICE_READ:
+            janet_schedule(fiber, make_read_result(chan, x));
+            break;
+        case JANET_CP_MODE_READ_MANY: {
+            JanetArray *array = janet_array(1);
+            janet_array_push(array, x);
+            janet_tchan_take_into(chan, array, p->many - 1);
+            janet_schedule(fiber, janet_wrap_array(array));
+            break;
+        }
+        case JANET_CP_MODE_WRITE:
+            janet_schedule(fiber, janet_wrap_channel(chan));
+            break;
+        case JANET_CP_MODE_CHOICE_WRITE:
+            janet_schedule(fiber, make_write_result(chan));
+            break;
+    }
+}
+
+/* Callback to resume fibers blocked on a threaded channel from another thread. */
+static void janet_tchan_batch_cb(JanetEVGenericMessage msg) {
+    JanetChannelWakeBatch *batch = (JanetChannelWakeBatch *) msg.argp;
+    for (int32_t i = 0; i < batch->count; i++) {
+        janet_tchan_deliver(batch->channel, batch->wakes + i);
+    }
+    janet_abstract_decref_maybe_free(batch->channel);
+    janet_free(batch);
+}
+
+/* Wake all collected fibers. Fibers on other threads are woken with one event per thread.
+ * Call without the lock held. */
+static void janet_tchan_wake_all(JanetChannel *chan, JanetChannelWakes *wakes) {
+    JanetChannelWake *w = wakes->data;
+    int32_t count = wakes->count;
+    for (int32_t i = 0; i < count; i++) {
+        JanetVM *vm = w[i].pending.thread;
+        if (NULL == vm || vm == &janet_vm) continue;
+        int32_t n = 0;
+        for (int32_t j = i; j < count; j++) {
+            if (w[j].pending.thread == vm) n++;
+        }
+        JanetChannelWakeBatch *batch = janet_malloc(sizeof(JanetChannelWakeBatch) + n * sizeof(JanetChannelWake));
+        if (NULL == batch) {
+            JANET_OUT_OF_MEMORY;
+        }
+        batch->channel = chan;
+        batch->count = 0;
+        for (int32_t j = i; j < count; j++) {
+            if (w[j].pending.thread == vm) {
+                batch->wakes[batch->count++] = w[j];
+                w[j].pending.thread = NULL;
             }
         }
+        /* Keep the channel alive until the event is handled */
+        janet_abstract_incref(chan);
+        JanetEVGenericMessage msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.argp = batch;
+        janet_ev_post_event(vm, janet_tchan_batch_cb, msg);
     }
-    janet_chan_unlock(channel);
+    for (int32_t i = 0; i < count; i++) {
+        if (w[i].pending.thread == &janet_vm) {
+            janet_tchan_deliver(chan, w + i);
+        }
+    }
+    if (wakes->data != wakes->local) janet_free(wakes->data);
 }
 
-/* Push a value to a channel, and return 1 if channel should block, zero otherwise.
- * If the push would block, will add to the write_pending queue in the channel.
- * Handles both threaded and unthreaded channels. */
-static int janet_channel_push_with_lock(JanetChannel *channel, Janet x, int mode) {
-    JanetChannelPending reader;
-    int is_empty;
-    if (channel->closed) {
-        janet_chan_unlock(channel);
+/* Called after a lock-free push or pop if other fibers might be blocked on the channel */
+static void janet_tchan_sync(JanetChannel *chan) {
+    JanetChannelWakes wakes;
+    janet_tchan_wakes_init(&wakes);
+    janet_chan_lock(chan);
+    janet_tchan_settle(chan, &wakes);
+    janet_chan_unlock(chan);
+    janet_tchan_wake_all(chan, &wakes);
+}
+
+/* Write n packed values to a threaded channel. If block is not NULL and the last value
+ * does not fit, the fiber described by block is queued as a blocked writer holding that
+ * value. Earlier values are always queued. Returns 1 if the channel is over its limit. */
+static int janet_tchan_give(JanetChannel *chan, Janet *values, int32_t n, JanetChannelPending *block) {
+    int32_t i = 0;
+    if (0 == janet_atomic_load(&chan->slow)) {
+        /* Fast path - no lock */
+        while (i < n && janet_ring_push(chan, values[i])) i++;
+        if (i > 0) {
+            janet_atomic_fence();
+            if (0 != janet_atomic_load(&chan->slow)) janet_tchan_sync(chan);
+        }
+        if (i == n) return 0;
+    }
+    JanetChannelWakes wakes;
+    janet_tchan_wakes_init(&wakes);
+    int blocked = 0;
+    janet_chan_lock(chan);
+    if (chan->closed) {
+        janet_chan_unlock(chan);
+        for (; i < n; i++) janet_chan_unpack(chan, values + i, 1);
         janet_panic("cannot write to closed channel");
     }
-    if (janet_chan_pack(channel, &x)) {
-        janet_chan_unlock(channel);
-        janet_panicf("failed to pack value for channel: %v", x);
+    for (; i < n; i++) {
+        if (janet_tchan_store(chan, values[i])) continue;
+        if (i == n - 1 && NULL != block) {
+            block->value = values[i];
+            janet_q_push(&chan->write_pending, block, sizeof(JanetChannelPending));
+            janet_gcroot(janet_wrap_fiber(block->fiber));
+            blocked = 1;
+        } else if (janet_q_push(&chan->items, values + i, sizeof(Janet))) {
+            janet_tchan_settle(chan, &wakes);
+            janet_chan_unlock(chan);
+            janet_tchan_wake_all(chan, &wakes);
+            for (; i < n; i++) janet_chan_unpack(chan, values + i, 1);
+            janet_panic("channel overflow");
+        } else if (i == n - 1) {
+            blocked = 1;
+        }
     }
-    int is_threaded = janet_chan_is_threaded(channel);
-    if (is_threaded) {
-        /* don't dereference fiber from another thread */
-        is_empty = janet_q_pop(&channel->read_pending, &reader, sizeof(reader));
-    } else {
-        do {
-            is_empty = janet_q_pop(&channel->read_pending, &reader, sizeof(reader));
-        } while (!is_empty && (reader.sched_id != reader.fiber->sched_id));
+    janet_tchan_settle(chan, &wakes);
+    janet_chan_unlock(chan);
+    janet_tchan_wake_all(chan, &wakes);
+    return blocked;
+}
+
+/* Take up to n packed values from a threaded channel into buf. If nothing is available and
+ * block is not NULL, the fiber described by block is queued as a blocked reader. Returns
+ * the number of values taken, or -1 if the channel is closed. */
+static int32_t janet_tchan_take(JanetChannel *chan, Janet *buf, int32_t n, JanetChannelPending *block) {
+    int32_t count = 0;
+    if (!(janet_atomic_load(&chan->slow) & JANET_CHANNEL_CLOSED_BIT)) {
+        /* Fast path - no lock */
+        while (count < n && janet_ring_pop(chan, buf + count)) count++;
+        if (count > 0) {
+            janet_atomic_fence();
+            if (0 == janet_atomic_load(&chan->slow)) return count;
+            /* Overflow items or blocked writers - take the rest with the lock */
+        }
     }
-    if (is_empty) {
-        /* No pending reader */
-        if (janet_q_push(&channel->items, &x, sizeof(Janet))) {
-            janet_chan_unpack(channel, &x, 1);
-            janet_chan_unlock(channel);
-            janet_panicf("channel overflow: %v", x);
-        } else if (janet_q_count(&channel->items) > channel->limit) {
-            /* No root fiber, we are in completion on a root fiber. Don't block. */
-            if (mode == 2) {
-                janet_chan_unlock(channel);
-                return 1;
-            }
-            /* Pushed successfully, but should block. */
-            JanetChannelPending pending;
-            pending.thread = &janet_vm;
-            pending.fiber = janet_vm.root_fiber,
-            pending.sched_id = janet_vm.root_fiber->sched_id,
-            pending.mode = mode ? JANET_CP_MODE_CHOICE_WRITE : JANET_CP_MODE_WRITE;
-            janet_q_push(&channel->write_pending, &pending, sizeof(pending));
-            janet_chan_unlock(channel);
-            if (is_threaded) {
-                janet_gcroot(janet_wrap_fiber(pending.fiber));
+    JanetChannelWakes wakes;
+    janet_tchan_wakes_init(&wakes);
+    janet_chan_lock(chan);
+    if (chan->closed) {
+        janet_chan_unlock(chan);
+        for (int32_t i = 0; i < count; i++) janet_chan_unpack(chan, buf + i, 1);
+        return -1;
+    }
+    while (count < n && janet_tchan_take_one(chan, buf + count, &wakes)) count++;
+    if (count == 0 && NULL != block) {
+        janet_q_push(&chan->read_pending, block, sizeof(JanetChannelPending));
+        janet_gcroot(janet_wrap_fiber(block->fiber));
+    }
+    janet_tchan_settle(chan, &wakes);
+    janet_chan_unlock(chan);
+    janet_tchan_wake_all(chan, &wakes);
+    return count;
+}
+
+static void janet_tchan_close(JanetChannel *chan) {
+    JanetChannelWakes wakes;
+    janet_tchan_wakes_init(&wakes);
+    janet_chan_lock(chan);
+    if (!chan->closed) {
+        chan->closed = 1;
+        JanetChannelPending pending;
+        while (!janet_q_pop(&chan->write_pending, &pending, sizeof(pending))) {
+            /* Value stays in the channel until it is freed */
+            if (janet_q_push(&chan->items, &pending.value, sizeof(Janet))) {
+                janet_chan_unpack(chan, &pending.value, 1);
             }
-            return 1;
+            if (pending.thread) janet_tchan_wake(&wakes, &pending, janet_wrap_nil(), 1);
         }
-    } else {
-        /* Pending reader */
-        if (is_threaded) {
-            JanetVM *vm = reader.thread;
-            JanetEVGenericMessage msg;
-            msg.tag = reader.mode;
-            msg.fiber = reader.fiber;
-            msg.argi = (int32_t) reader.sched_id;
-            msg.argp = channel;
-            msg.argj = x;
-            if (vm) {
-                janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-            } else {
-                /* If no vm to send to, we must clean up (unpack) the packed payload to avoid leak */
-                janet_chan_unpack(channel, &x, 1);
-            }
-        } else {
-            if (reader.mode == JANET_CP_MODE_CHOICE_READ) {
-                janet_schedule(reader.fiber, make_read_result(channel, x));
-            } else {
-                janet_schedule(reader.fiber, x);
-            }
+        while (!janet_q_pop(&chan->read_pending, &pending, sizeof(pending))) {
+            if (pending.thread) janet_tchan_wake(&wakes, &pending, janet_wrap_nil(), 1);
         }
+        janet_tchan_update(chan);
     }
-    janet_chan_unlock(channel);
-    return 0;
+    janet_chan_unlock(chan);
+    janet_tchan_wake_all(chan, &wakes);
 }
 
+/* Push a value to a channel, and return 1 if channel should block, zero otherwise.
+ * If the push would block, will add to the write_pending queue in the channel.
+ * Handles both threaded and unthreaded channels. Mode 0 is a normal write, 1 is
+ * a write from ev/select, and 2 never blocks. */
 static int janet_channel_push(JanetChannel *channel, Janet x, int mode) {
-    janet_chan_lock(channel);
-    return janet_channel_push_with_lock(channel, x, mode);
+    if (!janet_chan_is_threaded(channel)) {
+        return janet_channel_push_local(channel, x, mode);
+    }
+    if (janet_chan_pack(channel, &x)) {
+        janet_panicf("failed to pack value for channel: %v", x);
+    }
+    if (mode == 2) {
+        return janet_tchan_give(channel, &x, 1, NULL);
+    }
+    JanetChannelPending pending;
+    janet_chan_pending_init(&pending, mode ? JANET_CP_MODE_CHOICE_WRITE : JANET_CP_MODE_WRITE, 0);
+    return janet_tchan_give(channel, &x, 1, &pending);
 }
 
 /* Pop from a channel - returns 1 if item was obtained, 0 otherwise. The item
  * is returned by reference. If the pop would block, will add to the read_pending
  * queue in the channel. */
-static int janet_channel_pop_with_lock(JanetChannel *channel, Janet *item, int is_choice) {
-    JanetChannelPending writer;
-    if (channel->closed) {
-        janet_chan_unlock(channel);
+static int janet_channel_pop(JanetChannel *channel, Janet *item, int is_choice) {
+    if (!janet_chan_is_threaded(channel)) {
+        return janet_channel_pop_local(channel, item, is_choice);
+    }
+    JanetChannelPending pending;
+    if (is_choice != 2) {
+        janet_chan_pending_init(&pending, is_choice ? JANET_CP_MODE_CHOICE_READ : JANET_CP_MODE_READ, 0);
+    }
+    int32_t got = janet_tchan_take(channel, item, 1, is_choice == 2 ? NULL : &pending);
+    if (got < 0) {
         *item = janet_wrap_nil();
         return 1;
     }
-    int is_threaded = janet_chan_is_threaded(channel);
-    if (janet_q_pop(&channel->items, item, sizeof(Janet))) {
-        /* Queue empty */
-        if (is_choice == 2) return 0; /* Skip pending read */
-        JanetChannelPending pending;
-        pending.thread = &janet_vm;
-        pending.fiber = janet_vm.root_fiber,
-        pending.sched_id = janet_vm.root_fiber->sched_id;
-        pending.mode = is_choice ? JANET_CP_MODE_CHOICE_READ : JANET_CP_MODE_READ;
-        janet_q_push(&channel->read_pending, &pending, sizeof(pending));
-        janet_chan_unlock(channel);
-        if (is_threaded) {
-            janet_gcroot(janet_wrap_fiber(pending.fiber));
-        }
-        return 0;
-    }
+    if (got == 0) return 0;
     janet_assert(!janet_chan_unpack(channel, item, 0), "bad channel packing");
-    if (!janet_q_pop(&channel->write_pending, &writer, sizeof(writer))) {
-        /* Pending writer */
-        if (is_threaded) {
-            JanetVM *vm = writer.thread;
-            JanetEVGenericMessage msg;
-            msg.tag = writer.mode;
-            msg.fiber = writer.fiber;
-            msg.argi = (int32_t) writer.sched_id;
-            msg.argp = channel;
-            msg.argj = janet_wrap_nil();
-            if (vm) {
-                janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-            }
-        } else {
-            if (writer.mode == JANET_CP_MODE_CHOICE_WRITE) {
-                janet_schedule(writer.fiber, make_write_result(channel));
-            } else {
-                janet_schedule(writer.fiber, janet_wrap_abstract(channel));
-            }
-        }
-    }
-    janet_chan_unlock(channel);
     return 1;
 }
 
-static int janet_channel_pop(JanetChannel *channel, Janet *item, int is_choice) {
-    janet_chan_lock(channel);
-    return janet_channel_pop_with_lock(channel, item, is_choice);
-}
-
 JanetChannel *janet_channel_unwrap(void *abstract) {
     return abstract;
 }
@@ -1206,6 +2185,89 @@ JANET_CORE_FN(cfun_channel_pop,
     janet_await();
 }
 
+JANET_CORE_FN(cfun_channel_push_many,
+              "(ev/give-many channel values)",
+              "Write each value in the indexed collection `values` to a channel, in order. Only the last "
+              "write can suspend the current fiber - earlier values are queued even if the channel is full. "
+              "On a threaded channel, the values are written together, and fibers waiting on other threads "
+              "are woken with a single event per thread. Returns the channel.") {
+    janet_fixarity(argc, 2);
+    JanetChannel *channel = janet_getchannel(argv, 0);
+    JanetView values = janet_getindexed(argv, 1);
+    if (janet_vm.coerce_error) {
+        janet_panic("cannot give to channel inside janet_call");
+    }
+    if (values.len == 0) return argv[0];
+    if (!janet_chan_is_threaded(channel)) {
+        for (int32_t i = 0; i < values.len - 1; i++) {
+            janet_channel_push_local(channel, values.items[i], 2);
+        }
+        if (janet_channel_push_local(channel, values.items[values.len - 1], 0)) {
+            janet_await();
+        }
+        return argv[0];
+    }
+    Janet *packed = janet_smalloc(sizeof(Janet) * (size_t) values.len);
+    for (int32_t i = 0; i < values.len; i++) {
+        packed[i] = values.items[i];
+        janet_chan_pack(channel, packed + i);
+    }
+    JanetChannelPending pending;
+    janet_chan_pending_init(&pending, JANET_CP_MODE_WRITE, 0);
+    int blocked = janet_tchan_give(channel, packed, values.len, &pending);
+    janet_sfree(packed);
+    if (blocked) {
+        janet_await();
+    }
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_channel_pop_many,
+              "(ev/take-many channel n)",
+              "Read up to `n` values from a channel, suspending the current fiber only if no value is "
+              "available. Returns an array of at least one value, or nil if the channel is closed.") {
+    janet_fixarity(argc, 2);
+    JanetChannel *channel = janet_getchannel(argv, 0);
+    int32_t n = janet_getinteger(argv, 1);
+    if (n < 1) {
+        janet_panicf("expected positive integer, got %d", n);
+    }
+    if (janet_vm.coerce_error) {
+        janet_panic("cannot take from channel inside janet_call");
+    }
+    JanetChannelPending pending;
+    janet_chan_pending_init(&pending, JANET_CP_MODE_READ_MANY, n);
+    if (!janet_chan_is_threaded(channel)) {
+        if (channel->closed) return janet_wrap_nil();
+        int32_t count = janet_q_count(&channel->items);
+        if (count == 0) {
+            janet_q_push(&channel->read_pending, &pending, sizeof(pending));
+            janet_await();
+        }
+        JanetArray *array = janet_array(count < n ? count : n);
+        Janet item;
+        while (array->count < n && janet_q_count(&channel->items) > 0) {
+            janet_channel_pop_local(channel, &item, 2);
+            janet_array_push(array, item);
+        }
+        return janet_wrap_array(array);
+    }
+    Janet buf[64];
+    int32_t chunk = n < 64 ? n : 64;
+    int32_t got = janet_tchan_take(channel, buf, chunk, &pending);
+    if (got < 0) return janet_wrap_nil();
+    if (got == 0) janet_await();
+    JanetArray *array = janet_array(got);
+    for (int32_t i = 0; i < got; i++) {
+        janet_assert(!janet_chan_unpack(channel, buf + i, 0), "bad channel packing");
+        janet_array_push(array, buf[i]);
+    }
+    if (got == chunk) {
+        janet_tchan_take_into(channel, array, n - got);
+    }
+    return janet_wrap_array(array);
+}
+
 JANET_CORE_FN(cfun_channel_choice,
               "(ev/select & clauses)",
               "Block until the first of several channel operations occur. Returns a "
@@ -1231,30 +2293,50 @@ JANET_CORE_FN(cfun_channel_choice,
         if (janet_indexed_view(argv[i], &data, &len) && len == 2) {
             /* Write */
             JanetChannel *chan = janet_getchannel(data, 0);
-            janet_chan_lock(chan);
-            if (chan->closed) {
+            if (janet_chan_is_threaded(chan)) {
+                Janet x = data[1];
+                janet_chan_pack(chan, &x);
+                JanetChannelWakes wakes;
+                janet_tchan_wakes_init(&wakes);
+                janet_chan_lock(chan);
+                int closed = chan->closed;
+                int stored = !closed && janet_tchan_store(chan, x);
+                if (stored) janet_tchan_settle(chan, &wakes);
                 janet_chan_unlock(chan);
+                janet_tchan_wake_all(chan, &wakes);
+                if (stored) return make_write_result(chan);
+                janet_chan_unpack(chan, &x, 1);
+                if (closed) return make_close_result(chan);
+                continue;
+            }
+            if (chan->closed) {
                 return make_close_result(chan);
             }
             if (janet_q_count(&chan->items) < chan->limit) {
-                janet_channel_push_with_lock(chan, data[1], 1);
+                janet_channel_push_local(chan, data[1], 1);
                 return make_write_result(chan);
             }
-            janet_chan_unlock(chan);
         } else {
             /* Read */
             JanetChannel *chan = janet_getchannel(argv, i);
-            janet_chan_lock(chan);
+            if (janet_chan_is_threaded(chan)) {
+                Janet item;
+                int32_t got = janet_tchan_take(chan, &item, 1, NULL);
+                if (got < 0) return make_close_result(chan);
+                if (got > 0) {
+                    janet_assert(!janet_chan_unpack(chan, &item, 0), "bad channel packing");
+                    return make_read_result(chan, item);
+                }
+                continue;
+            }
             if (chan->closed) {
-                janet_chan_unlock(chan);
                 return make_close_result(chan);
             }
             if (chan->items.head != chan->items.tail) {
                 Janet item;
-                janet_channel_pop_with_lock(chan, &item, 1);
+                janet_channel_pop_local(chan, &item, 1);
                 return make_read_result(chan, item);
             }
-            janet_chan_unlock(chan);
         }
     }
 
@@ -1263,14 +2345,24 @@ JANET_CORE_FN(cfun_channel_choice,
         if (janet_indexed_view(argv[i], &data, &len) && len == 2) {
             /* Write */
             JanetChannel *chan = janet_getchannel(data, 0);
-            janet_chan_lock(chan);
-            janet_channel_push_with_lock(chan, data[1], 1);
+            if (!janet_channel_push(chan, data[1], 1) && janet_chan_is_threaded(chan)) {
+                /* Room appeared since the first check */
+                janet_schedule(janet_vm.root_fiber, make_write_result(chan));
+                break;
+            }
         } else {
             /* Read */
             Janet item;
             JanetChannel *chan = janet_getchannel(argv, i);
-            janet_chan_lock(chan);
-            janet_channel_pop_with_lock(chan, &item, 1);
+            if (janet_channel_pop(chan, &item, 1) && janet_chan_is_threaded(chan)) {
+                /* An item or a close arrived since the first check */
+                if (janet_checktype(item, JANET_NIL) && (janet_atomic_load(&chan->slow) & JANET_CHANNEL_CLOSED_BIT)) {
+                    janet_schedule(janet_vm.root_fiber, make_close_result(chan));
+                } else {
+                    janet_schedule(janet_vm.root_fiber, make_read_result(chan, item));
+                }
+                break;
+            }
         }
     }
 
@@ -1283,7 +2375,10 @@ JANET_CORE_FN(cfun_channel_full,
     janet_fixarity(argc, 1);
     JanetChannel *channel = janet_getchannel(argv, 0);
     janet_chan_lock(channel);
-    Janet ret = janet_wrap_boolean(janet_q_count(&channel->items) >= channel->limit);
+    int32_t count = janet_chan_is_threaded(channel)
+                    ? janet_tchan_count(channel)
+                    : janet_q_count(&channel->items);
+    Janet ret = janet_wrap_boolean(count >= channel->limit);
     janet_chan_unlock(channel);
     return ret;
 }
@@ -1305,7 +2400,10 @@ JANET_CORE_FN(cfun_channel_count,
     janet_fixarity(argc, 1);
     JanetChannel *channel = janet_getchannel(argv, 0);
     janet_chan_lock(channel);
-    Janet ret = janet_wrap_integer(janet_q_count(&channel->items));
+    int32_t count = janet_chan_is_threaded(channel)
+                    ? janet_tchan_count(channel)
+                    : janet_q_count(&channel->items);
+    Janet ret = janet_wrap_integer(count);
     janet_chan_unlock(channel);
     return ret;
 }
@@ -1349,63 +2447,57 @@ JANET_CORE_FN(cfun_channel_new_threaded,
     return janet_wrap_abstract(tchan);
 }
 
+JANET_CORE_FN(cfun_ev_share,
+              "(ev/share x)",
+              "Copy an immutable value into a reference counted heap that can be shared between threads. "
+              "Strings, symbols, keywords, tuples and structs can be shared, nested to any depth. A shared "
+              "value is sent over threaded channels and to `ev/thread` by pointer instead of being copied, "
+              "and is freed once no thread can reach it. Returns the shared copy, or `x` itself if it is "
+              "already shared or is a number, boolean or nil.") {
+    janet_fixarity(argc, 1);
+    return janet_share(argv[0]);
+}
+
+JANET_CORE_FN(cfun_ev_sharedp,
+              "(ev/shared? x)",
+              "Check if a value lives in a shared heap created by `ev/share`.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(janet_is_shared(argv[0]));
+}
+
 JANET_CORE_FN(cfun_channel_close,
               "(ev/chan-close chan)",
               "Close a channel. A closed channel will cause all pending reads and writes to return nil. "
               "Returns the channel.") {
     janet_fixarity(argc, 1);
     JanetChannel *channel = janet_getchannel(argv, 0);
-    janet_chan_lock(channel);
+    if (janet_chan_is_threaded(channel)) {
+        janet_tchan_close(channel);
+        return argv[0];
+    }
     if (!channel->closed) {
         channel->closed = 1;
         JanetChannelPending writer;
         while (!janet_q_pop(&channel->write_pending, &writer, sizeof(writer))) {
-            if (writer.thread != &janet_vm) {
-                JanetVM *vm = writer.thread;
-                JanetEVGenericMessage msg;
-                msg.fiber = writer.fiber;
-                msg.argp = channel;
-                msg.tag = JANET_CP_MODE_CLOSE;
-                msg.argi = (int32_t) writer.sched_id;
-                msg.argj = janet_wrap_nil();
-                if (vm) {
-                    janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-                }
-            } else {
-                if (janet_fiber_can_resume(writer.fiber) && writer.sched_id == writer.fiber->sched_id) {
-                    if (writer.mode == JANET_CP_MODE_CHOICE_WRITE) {
-                        janet_schedule(writer.fiber, make_close_result(channel));
-                    } else {
-                        janet_schedule(writer.fiber, janet_wrap_nil());
-                    }
+            if (janet_fiber_can_resume(writer.fiber) && writer.sched_id == writer.fiber->sched_id) {
+                if (writer.mode == JANET_CP_MODE_CHOICE_WRITE) {
+                    janet_schedule(writer.fiber, make_close_result(channel));
+                } else {
+                    janet_schedule(writer.fiber, janet_wrap_nil());
                 }
             }
         }
         JanetChannelPending reader;
         while (!janet_q_pop(&channel->read_pending, &reader, sizeof(reader))) {
-            if (reader.thread != &janet_vm) {
-                JanetVM *vm = reader.thread;
-                JanetEVGenericMessage msg;
-                msg.fiber = reader.fiber;
-                msg.argp = channel;
-                msg.tag = JANET_CP_MODE_CLOSE;
-                msg.argi = (int32_t) reader.sched_id;
-                msg.argj = janet_wrap_nil();
-                if (vm) {
-                    janet_ev_post_event(vm, janet_thread_chan_cb, msg);
-                }
-            } else {
-                if (janet_fiber_can_resume(reader.fiber) && reader.sched_id == reader.fiber->sched_id) {
-                    if (reader.mode == JANET_CP_MODE_CHOICE_READ) {
-                        janet_schedule(reader.fiber, make_close_result(channel));
-                    } else {
-                        janet_schedule(reader.fiber, janet_wrap_nil());
-                    }
+            if (janet_fiber_can_resume(reader.fiber) && reader.sched_id == reader.fiber->sched_id) {
+                if (reader.mode == JANET_CP_MODE_CHOICE_READ) {
+                    janet_schedule(reader.fiber, make_close_result(channel));
+                } else {
+                    janet_schedule(reader.fiber, janet_wrap_nil());
                 }
             }
         }
     }
-    janet_chan_unlock(channel);
     return argv[0];
 }
 
@@ -1415,6 +2507,8 @@ static const JanetMethod ev_chanat_methods[] = {
     {"count", cfun_channel_count},
     {"take", cfun_channel_pop},
     {"give", cfun_channel_push},
+    {"take-many", cfun_channel_pop_many},
+    {"give-many", cfun_channel_push_many},
     {"capacity", cfun_channel_capacity},
     {"full", cfun_channel_full},
     {"close", cfun_channel_close},
@@ -1438,10 +2532,26 @@ static void janet_chanat_marshal(void *p, JanetMarshalContext *ctx) {
     janet_marshal_abstract(ctx, channel);
     janet_marshal_byte(ctx, channel->closed);
     janet_marshal_int(ctx, channel->limit);
-    int32_t count = janet_q_count(&channel->items);
-    janet_marshal_int(ctx, count);
     JanetQueue *items = &channel->items;
     Janet *data = channel->items.data;
+    if (janet_chan_is_threaded(channel)) {
+        /* Snapshot the ring, followed by the overflow items */
+        janet_chan_lock(channel);
+        uint32_t head = (uint32_t) janet_atomic_load(&channel->ring_head);
+        uint32_t tail = (uint32_t) janet_atomic_load(&channel->ring_tail);
+        int32_t count = janet_q_count(items);
+        for (uint32_t pos = head; pos != tail; pos++) {
+            JanetChannelCell *cell = channel->ring + (pos & channel->ring_mask);
+            if ((uint32_t) janet_atomic_load(&cell->seq) == pos + 1) count++;
+        }
+        janet_marshal_int(ctx, count);
+        for (uint32_t pos = head; pos != tail; pos++) {
+            JanetChannelCell *cell = channel->ring + (pos & channel->ring_mask);
+            if ((uint32_t) janet_atomic_load(&cell->seq) == pos + 1) janet_marshal_janet(ctx, cell->value);
+        }
+    } else {
+        janet_marshal_int(ctx, janet_q_count(items));
+    }
     if (items->head <= items->tail) {
         for (int32_t i = items->head; i < items->tail; i++)
             janet_marshal_janet(ctx, data[i]);
@@ -1451,6 +2561,7 @@ static void janet_chanat_marshal(void *p, JanetMarshalContext *ctx) {
         for (int32_t i = 0; i < items->tail; i++)
             janet_marshal_janet(ctx, data[i]);
     }
+    janet_chan_unlock(channel);
 }
 
 static void *janet_chanat_unmarshal(JanetMarshalContext *ctx) {
@@ -1507,8 +2618,7 @@ JanetFiber *janet_loop1(void) {
     /* Schedule expired timers */
     JanetTimeout to;
     JanetTimestamp now = ts_now();
-    while (peek_timeout(&to) && to.when <= now) {
-        pop_timeout(0);
+    while (pop_expired_timeout(now, &to)) {
         if (to.curr_fiber != NULL) {
             if (janet_fiber_can_resume(to.curr_fiber)) {
                 janet_cancel(to.fiber, janet_cstringv("deadline expired"));
@@ -1526,15 +2636,25 @@ JanetFiber *janet_loop1(void) {
         handle_timeout_worker(to, 0);
     }
 
-    /* Run scheduled fibers unless interrupts need to be handled. */
+    /* Run scheduled fibers unless interrupts need to be handled. If the task budget
+     * runs out, stop early and poll for events without blocking so that ready I/O
+     * is not starved by tasks that keep rescheduling each other. */
+    int32_t budget = janet_vm.ev_task_budget;
+    int32_t resumed = 0;
+    int over_budget = 0;
     while (janet_vm.spawn.head != janet_vm.spawn.tail) {
         /* Don't run until all interrupts have been marked as handled by calling janet_interpreter_interrupt_handled */
         if (janet_atomic_load_relaxed(&janet_vm.auto_suspend)) break;
+        if (budget > 0 && resumed >= budget) {
+            over_budget = 1;
+            break;
+        }
         JanetTask task = {NULL, janet_wrap_nil(), JANET_SIGNAL_OK, 0};
         janet_q_pop(&janet_vm.spawn, &task, sizeof(task));
         if (task.fiber->gc.flags & JANET_FIBER_EV_GCFLAG_SUSPENDED) janet_ev_dec_refcount();
         task.fiber->gc.flags &= ~(JANET_FIBER_EV_GCFLAG_CANCELED | JANET_FIBER_EV_GCFLAG_SUSPENDED);
         if (task.expected_sched_id != task.fiber->sched_id) continue;
+        resumed++;
         Janet res;
         JanetSignal sig = janet_continue_signal(task.fiber, task.value, &res, task.sig);
         if (!janet_fiber_can_resume(task.fiber)) {
@@ -1564,28 +2684,17 @@ JanetFiber *janet_loop1(void) {
 
     /* Poll for events */
     if (janet_vm.tq_count || janet_atomic_load(&janet_vm.listener_count)) {
-        JanetTimeout to;
-        memset(&to, 0, sizeof(to));
-        int has_timeout;
         /* Drop timeouts that are no longer needed */
-        while ((has_timeout = peek_timeout(&to))) {
-            if (to.curr_fiber != NULL) {
-                if (!janet_fiber_can_resume(to.curr_fiber)) {
-                    pop_timeout(0);
-                    janet_table_remove(&janet_vm.active_tasks, janet_wrap_fiber(to.curr_fiber));
-                    handle_timeout_worker(to, 1);
-                    continue;
-                }
-            } else if (to.fiber->sched_id != to.sched_id) {
-                pop_timeout(0);
-                handle_timeout_worker(to, 1);
-                continue;
-            }
-            break;
+        JanetTimestamp when = 0;
+        int has_timeout = next_timeout(&when);
+        /* Tasks are still waiting, so don't block */
+        if (over_budget && (!has_timeout || when > now)) {
+            has_timeout = 1;
+            when = now;
         }
         /* Run polling implementation only if pending timeouts or pending events */
         if (janet_vm.tq_count || janet_atomic_load(&janet_vm.listener_count)) {
-            janet_loop1_impl(has_timeout, to.when);
+            janet_loop1_impl(has_timeout, when);
         }
     }
 
@@ -1613,6 +2722,23 @@ void janet_loop(void) {
     }
 }
 
+#if defined(JANET_EV_EPOLL) || defined(JANET_EV_KQUEUE)
+
+/* Get a buffer large enough to receive ev_max_events events from the poller */
+static void *janet_ev_events(size_t itemsize) {
+    if (janet_vm.ev_events_capacity < janet_vm.ev_max_events) {
+        void *events = janet_realloc(janet_vm.ev_events, itemsize * (size_t) janet_vm.ev_max_events);
+        if (NULL == events) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_vm.ev_events = events;
+        janet_vm.ev_events_capacity = janet_vm.ev_max_events;
+    }
+    return janet_vm.ev_events;
+}
+
+#endif
+
 /*
  * Self-pipe handling code.
  */
@@ -1796,7 +2922,6 @@ void janet_unregister_stream(JanetStream *stream) {
     stream->flags |= JANET_STREAM_UNREGISTERED;
 }
 
-#define JANET_EPOLL_MAX_EVENTS 64
 void janet_loop1_impl(int has_timeout, JanetTimestamp timeout) {
     struct itimerspec its;
     if (janet_vm.timer_enabled || has_timeout) {
@@ -1810,10 +2935,10 @@ void janet_loop1_impl(int has_timeout, JanetTimestamp timeout) {
     janet_vm.timer_enabled = has_timeout;
 
     /* Poll for events */
-    struct epoll_event events[JANET_EPOLL_MAX_EVENTS];
+    struct epoll_event *events = janet_ev_events(sizeof(struct epoll_event));
     int ready;
     do {
-        ready = epoll_wait(janet_vm.epoll, events, JANET_EPOLL_MAX_EVENTS, -1);
+        ready = epoll_wait(janet_vm.epoll, events, janet_vm.ev_max_events, -1);
     } while (ready == -1 && errno == EINTR);
     if (ready == -1) {
         JANET_EXIT("failed to poll events");
@@ -1990,8 +3115,6 @@ void janet_unregister_stream(JanetStream *stream) {
     stream->flags |= JANET_STREAM_UNREGISTERED;
 }
 
-#define JANET_KQUEUE_MAX_EVENTS 512
-
 void janet_loop1_impl(int has_timeout, JanetTimestamp timeout) {
     /* Poll for events */
     /* NOTE:
@@ -2002,15 +3125,15 @@ void janet_loop1_impl(int has_timeout, JanetTimestamp timeout) {
      * JANET_KQUEUE_INTERVAL insures we have a timeout of no less than 0. */
     int status;
     struct timespec ts;
-    struct kevent events[JANET_KQUEUE_MAX_EVENTS];
+    struct kevent *events = janet_ev_events(sizeof(struct kevent));
     do {
         if (janet_vm.timer_enabled || has_timeout) {
             timestamp2timespec(&ts, JANET_KQUEUE_INTERVAL(timeout));
             status = kevent(janet_vm.kq, NULL, 0, events,
-                            JANET_KQUEUE_MAX_EVENTS, &ts);
+                            janet_vm.ev_max_events, &ts);
         } else {
             status = kevent(janet_vm.kq, NULL, 0, events,
-                            JANET_KQUEUE_MAX_EVENTS, NULL);
+                            janet_vm.ev_max_events, NULL);
         }
     } while (status == -1 && errno == EINTR);
     if (status == -1) {
@@ -3325,8 +4448,8 @@ JANET_CORE_FN(cfun_ev_deadline,
               "`tocheck` fiber is resumable. `sec` is a number that can have a fractional part. "
               "`tocancel` defaults to `(fiber/root)`, but if specified, must be a task (root "
               "fiber). `tocheck` defaults to `(fiber/current)`, but if specified, must be a fiber. "
-              "Returns `tocancel` immediately. If `interrupt?` is set to true, will create a "
-              "background thread to try to interrupt the VM if the timeout expires.") {
+              "Returns `tocancel` immediately. If `interrupt?` is set to true, a shared "
+              "background watchdog thread will try to interrupt the VM if the timeout expires.") {
     janet_arity(argc, 1, 4);
     double sec = janet_getnumber(argv, 0);
     sec = (sec < 0) ? 0 : sec;
@@ -3340,42 +4463,8 @@ JANET_CORE_FN(cfun_ev_deadline,
     to.is_error = 0;
     to.sched_id = to.fiber->sched_id;
     if (use_interrupt) {
-#ifdef JANET_ANDROID
-        janet_sandbox_assert(JANET_SANDBOX_SIGNAL);
-#endif
-        JanetThreadedTimeout *tto = janet_malloc(sizeof(JanetThreadedTimeout));
-        if (NULL == tto) {
-            JANET_OUT_OF_MEMORY;
-        }
-        tto->sec = sec;
-        tto->vm = &janet_vm;
-        tto->fiber = tocheck;
-#ifdef JANET_WINDOWS
-        HANDLE cancel_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-        if (NULL == cancel_event) {
-            janet_free(tto);
-            janet_panic("failed to create cancel event");
-        }
-        tto->cancel_event = cancel_event;
-        HANDLE worker = CreateThread(NULL, 0, janet_timeout_body, tto, CREATE_SUSPENDED, NULL);
-        if (NULL == worker) {
-            janet_free(tto);
-            janet_panic("failed to create thread");
-        }
-#else
-        pthread_t worker;
-        int err = pthread_create(&worker, NULL, janet_timeout_body, tto);
-        if (err) {
-            janet_free(tto);
-            janet_panicf("%s", janet_strerror(err));
-        }
-#endif
         to.has_worker = 1;
-        to.worker = worker;
-#ifdef JANET_WINDOWS
-        to.worker_event = cancel_event;
-        ResumeThread(worker);
-#endif
+        to.worker = janet_watchdog_add(to.when);
     } else {
         to.has_worker = 0;
     }
@@ -3632,10 +4721,48 @@ JANET_CORE_FN(janet_cfun_ev_all_tasks,
     return janet_wrap_array(array);
 }
 
+static int32_t ev_loop_option(JanetDictView opts, const char *name, int32_t current, int32_t min, int32_t max) {
+    Janet x = janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv(name));
+    if (janet_checktype(x, JANET_NIL)) return current;
+    if (!janet_checkint(x) || janet_unwrap_integer(x) < min || janet_unwrap_integer(x) > max) {
+        janet_panicf("expected integer in range [%d, %d] for :%s, got %v", min, max, name, x);
+    }
+    return janet_unwrap_integer(x);
+}
+
+JANET_CORE_FN(cfun_ev_set_loop_options,
+              "(ev/set-loop-options &opt options)",
+              "Tune the event loop of the current thread. `options` is a dictionary that can contain "
+              "any of the following keys:\n\n"
+              "* :max-events - the maximum number of events to receive from the operating system in a single poll.\n\n"
+              "* :accept-batch - the maximum number of connections `net/accept-loop` will accept "
+              "each time a server becomes readable before returning to the event loop.\n\n"
+              "* :task-budget - the maximum number of tasks to resume before polling for events again. "
+              "0 means no limit, so every scheduled task runs before the next poll.\n\n"
+              "Keys that are not present are left unchanged. Returns a struct of the options now in effect.") {
+    janet_arity(argc, 0, 1);
+    if (argc > 0 && !janet_checktype(argv[0], JANET_NIL)) {
+        JanetDictView opts = janet_getdictionary(argv, 0);
+        int32_t max_events = ev_loop_option(opts, "max-events", janet_vm.ev_max_events, 1, JANET_EV_MAX_EVENTS_LIMIT);
+        int32_t accept_batch = ev_loop_option(opts, "accept-batch", janet_vm.ev_accept_batch, 1, INT32_MAX);
+        int32_t task_budget = ev_loop_option(opts, "task-budget", janet_vm.ev_task_budget, 0, INT32_MAX);
+        janet_vm.ev_max_events = max_events;
+        janet_vm.ev_accept_batch = accept_batch;
+        janet_vm.ev_task_budget = task_budget;
+    }
+    JanetKV *st = janet_struct_begin(3);
+    janet_struct_put(st, janet_ckeywordv("max-events"), janet_wrap_integer(janet_vm.ev_max_events));
+    janet_struct_put(st, janet_ckeywordv("accept-batch"), janet_wrap_integer(janet_vm.ev_accept_batch));
+    janet_struct_put(st, janet_ckeywordv("task-budget"), janet_wrap_integer(janet_vm.ev_task_budget));
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
 void janet_lib_ev(JanetTable *env) {
     JanetRegExt ev_cfuns_ext[] = {
         JANET_CORE_REG("ev/give", cfun_channel_push),
         JANET_CORE_REG("ev/take", cfun_channel_pop),
+        JANET_CORE_REG("ev/give-many", cfun_channel_push_many),
+        JANET_CORE_REG("ev/take-many", cfun_channel_pop_many),
         JANET_CORE_REG("ev/full", cfun_channel_full),
         JANET_CORE_REG("ev/capacity", cfun_channel_capacity),
         JANET_CORE_REG("ev/count", cfun_channel_count),
@@ -3643,6 +4770,8 @@ void janet_lib_ev(JanetTable *env) {
         JANET_CORE_REG("ev/rselect", cfun_channel_rchoice),
         JANET_CORE_REG("ev/chan", cfun_channel_new),
         JANET_CORE_REG("ev/thread-chan", cfun_channel_new_threaded),
+        JANET_CORE_REG("ev/share", cfun_ev_share),
+        JANET_CORE_REG("ev/shared?", cfun_ev_sharedp),
         JANET_CORE_REG("ev/chan-close", cfun_channel_close),
         JANET_CORE_REG("ev/go", cfun_ev_go),
         JANET_CORE_REG("ev/thread", cfun_ev_thread),
@@ -3664,6 +4793,7 @@ void janet_lib_ev(JanetTable *env) {
         JANET_CORE_REG("ev/release-wlock", janet_cfun_rwlock_write_release),
         JANET_CORE_REG("ev/to-file", janet_cfun_to_file),
         JANET_CORE_REG("ev/all-tasks", janet_cfun_ev_all_tasks),
+        JANET_CORE_REG("ev/set-loop-options", cfun_ev_set_loop_options),
         JANET_REG_END
     };
 
@@ -239,11 +239,7 @@ static int janet_ffijit_gc(void *p, size_t s) {
     JanetFFIJittedFn *fn = p;
     if (fn->function_pointer == NULL) return 0;
 #ifdef JANET_FFI_JIT
-#ifdef JANET_WINDOWS
-    VirtualFree(fn->function_pointer, fn->size, MEM_RELEASE);
-#else
-    munmap(fn->function_pointer, fn->size);
-#endif
+    janet_jit_unmap(fn->function_pointer, fn->size);
 #endif
     return 0;
 }
@@ -1607,60 +1603,86 @@ static Janet janet_ffi_aapcs64(JanetFFISignature *signature, void *function_poin
  * region but it isn't really worth it. */
 #define FFI_PAGE_MASK 0xFFF
 
-JANET_CORE_FN(cfun_ffi_jitfn,
-              "(ffi/jitfn bytes)",
-              "Create an abstract type that can be used as the pointer argument to `ffi/call`. The content "
-              "of `bytes` is architecture specific machine code that will be copied into executable memory.") {
-    janet_sandbox_assert(JANET_SANDBOX_FFI_JIT);
-    janet_fixarity(argc, 1);
-    JanetByteView bytes = janet_getbytes(argv, 0);
+#ifdef JANET_FFI_JIT
 
+/* Returns NULL if executable memory can't be mapped, as on W^X hardened systems. */
+void *janet_jit_try_map(const uint8_t *bytes, size_t len, size_t *alloc_size) {
     /* Quick hack to align to page boundary, we should query OS. FIXME */
-    size_t alloc_size = ((size_t) bytes.len + FFI_PAGE_MASK) & ~FFI_PAGE_MASK;
-
-#ifdef JANET_FFI_JIT
-#ifdef JANET_EV
-    JanetFFIJittedFn *fn = janet_abstract_threaded(&janet_type_ffijit, sizeof(JanetFFIJittedFn));
-#else
-    JanetFFIJittedFn *fn = janet_abstract(&janet_type_ffijit, sizeof(JanetFFIJittedFn));
-#endif
-    fn->function_pointer = NULL;
-    fn->size = 0;
+    size_t size = (len + FFI_PAGE_MASK) & ~FFI_PAGE_MASK;
 #ifdef JANET_WINDOWS
-    void *ptr = VirtualAlloc(NULL, alloc_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-    if (!ptr) {
-        janet_panic("failed to allocate writable memory");
-    }
+    void *ptr = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!ptr) return NULL;
 #else
 #ifdef MAP_ANONYMOUS
-    void *ptr = mmap(0, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 #elif defined(MAP_ANON)
     /* macos doesn't have MAP_ANONYMOUS */
-    void *ptr = mmap(0, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    void *ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
 #else
     /* -std=c99 gets in the way */
     /* #define MAP_ANONYMOUS 0x20 should work, though. */
-    void *ptr = mmap(0, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, -1, 0);
+    void *ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, -1, 0);
 #endif
-    if (ptr == MAP_FAILED) {
-        janet_panic("failed to memory map writable memory");
-    }
+    if (ptr == MAP_FAILED) return NULL;
 #endif
-    memcpy(ptr, bytes.bytes, bytes.len);
+    memcpy(ptr, bytes, len);
 #ifdef JANET_WINDOWS
     DWORD old = 0;
-    if (!VirtualProtect(ptr, alloc_size, PAGE_EXECUTE_READ, &old)) {
-        janet_panic("failed to make mapped memory executable");
+    if (!VirtualProtect(ptr, size, PAGE_EXECUTE_READ, &old)) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+        return NULL;
     }
 #else
-    if (mprotect(ptr, alloc_size, PROT_READ | PROT_EXEC) == -1) {
-        janet_panic("failed to make mapped memory executable");
+    if (mprotect(ptr, size, PROT_READ | PROT_EXEC) == -1) {
+        munmap(ptr, size);
+        return NULL;
     }
 #endif
+    *alloc_size = size;
+    return ptr;
+}
+
+void *janet_jit_map(const uint8_t *bytes, size_t len, size_t *alloc_size) {
+    void *ptr = janet_jit_try_map(bytes, len, alloc_size);
+    if (NULL == ptr) {
+        janet_panic("failed to map executable memory");
+    }
+    return ptr;
+}
+
+void janet_jit_unmap(void *ptr, size_t alloc_size) {
+#ifdef JANET_WINDOWS
+    (void) alloc_size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, alloc_size);
+#endif
+}
+
+#endif
+
+JANET_CORE_FN(cfun_ffi_jitfn,
+              "(ffi/jitfn bytes)",
+              "Create an abstract type that can be used as the pointer argument to `ffi/call`. The content "
+              "of `bytes` is architecture specific machine code that will be copied into executable memory.") {
+    janet_sandbox_assert(JANET_SANDBOX_FFI_JIT);
+    janet_fixarity(argc, 1);
+    JanetByteView bytes = janet_getbytes(argv, 0);
+#ifdef JANET_FFI_JIT
+#ifdef JANET_EV
+    JanetFFIJittedFn *fn = janet_abstract_threaded(&janet_type_ffijit, sizeof(JanetFFIJittedFn));
+#else
+    JanetFFIJittedFn *fn = janet_abstract(&janet_type_ffijit, sizeof(JanetFFIJittedFn));
+#endif
+    fn->function_pointer = NULL;
+    fn->size = 0;
+    size_t alloc_size = 0;
+    void *ptr = janet_jit_map(bytes.bytes, (size_t) bytes.len, &alloc_size);
     fn->size = alloc_size;
     fn->function_pointer = ptr;
     return janet_wrap_abstract(fn);
 #else
+    (void) bytes;
     janet_panic("ffi/jitfn not available on this platform");
 #endif
 }
@@ -44,6 +44,7 @@ static void fiber_reset(JanetFiber *fiber) {
     fiber->ev_state = NULL;
     fiber->ev_stream = NULL;
     fiber->supervisor_channel = NULL;
+    fiber->ev_timeout = NULL;
 #endif
     janet_fiber_set_status(fiber, JANET_STATUS_NEW);
 }
@@ -96,7 +96,20 @@ void janet_mark(Janet x) {
     }
 }
 
+#ifdef JANET_EV
+/* Values in a shared heap are marked by marking the heap */
+#define JANET_MARK_SHARED(head) do { \
+    if ((head)->gc.flags & JANET_MEM_SHARED) { \
+        janet_mark_abstract((head)->gc.data.next); \
+        return; \
+    } \
+} while (0)
+#else
+#define JANET_MARK_SHARED(head) ((void) 0)
+#endif
+
 static void janet_mark_string(const uint8_t *str) {
+    JANET_MARK_SHARED(janet_string_head(str));
     janet_gc_mark(janet_string_head(str));
 }
 
@@ -191,6 +204,7 @@ recur: /* Manual tail recursion */
 
 static void janet_mark_struct(const JanetKV *st) {
 recur:
+    JANET_MARK_SHARED(janet_struct_head(st));
     if (janet_gc_reachable(janet_struct_head(st)))
         return;
     janet_gc_mark(janet_struct_head(st));
@@ -200,6 +214,7 @@ recur:
 }
 
 static void janet_mark_tuple(const Janet *tuple) {
+    JANET_MARK_SHARED(janet_tuple_head(tuple));
     if (janet_gc_reachable(janet_tuple_head(tuple)))
         return;
     janet_gc_mark(janet_tuple_head(tuple));
@@ -425,20 +440,20 @@ void janet_sweep() {
                 JanetTable *table = (JanetTable *) current;
                 int check_values = (type == JANET_MEMORY_TABLE_WEAKV) || (type == JANET_MEMORY_TABLE_WEAKKV);
                 int check_keys = (type == JANET_MEMORY_TABLE_WEAKK) || (type == JANET_MEMORY_TABLE_WEAKKV);
-                JanetKV *end = table->data + table->capacity;
-                JanetKV *kvs = table->data;
-                while (kvs < end) {
+                int32_t i = 0;
+                while (i < table->capacity) {
+                    JanetKV *kv = table->data + i;
                     int drop = 0;
-                    if (check_keys && !janet_check_liveref(kvs->key)) drop = 1;
-                    if (check_values && !janet_check_liveref(kvs->value)) drop = 1;
+                    if (!janet_checktype(kv->key, JANET_NIL)) {
+                        if (check_keys && !janet_check_liveref(kv->key)) drop = 1;
+                        if (check_values && !janet_check_liveref(kv->value)) drop = 1;
+                    }
                     if (drop) {
-                        /* Inlined from janet_table_remove without search */
-                        table->count--;
-                        table->deleted++;
-                        kvs->key = janet_wrap_nil();
-                        kvs->value = janet_wrap_false();
+                        /* Removal shifts the next entry into this slot, so check it again */
+                        janet_table_remove_index(table, i);
+                    } else {
+                        i++;
                     }
-                    kvs++;
                 }
             }
         }
@@ -489,34 +504,35 @@ void janet_sweep() {
 
 #ifdef JANET_EV
     /* Sweep threaded abstract types for references to decrement */
-    JanetKV *items = janet_vm.threaded_abstracts.data;
-    for (int32_t i = 0; i < janet_vm.threaded_abstracts.capacity; i++) {
-        if (janet_checktype(items[i].key, JANET_ABSTRACT)) {
+    JanetTable *threaded = &janet_vm.threaded_abstracts;
+    for (int32_t i = 0; i < threaded->capacity; i++) {
+        JanetKV *item = threaded->data + i;
+        if (janet_checktype(item->key, JANET_ABSTRACT)) {
+            /* Flag unvisited items with nil, and reset the rest for the next sweep */
+            item->value = janet_truthy(item->value) ? janet_wrap_false() : janet_wrap_nil();
+        }
+    }
+    int32_t i = 0;
+    while (i < threaded->capacity) {
+        JanetKV *item = threaded->data + i;
+        if (janet_checktype(item->key, JANET_ABSTRACT) && janet_checktype(item->value, JANET_NIL)) {
 
             /* If item was not visited during the mark phase, then this
              * abstract type isn't present in the heap and needs its refcount
              * decremented, and shouuld be removed from table. If the refcount is
              * then 0, the item will be collected. This ensures that only one interpreter
              * will clean up the threaded abstract. */
+            void *abst = janet_unwrap_abstract(item->key);
+            JanetAbstractHead *head = janet_abstract_head(abst);
 
-            /* If not visited... */
-            if (!janet_truthy(items[i].value)) {
-                void *abst = janet_unwrap_abstract(items[i].key);
-                JanetAbstractHead *head = janet_abstract_head(abst);
-                if (head->type->gcperthread) {
-                    janet_assert(!head->type->gcperthread(head->data, head->size), "per-thread finalizer failed");
-                }
-                janet_abstract_decref_maybe_free(abst);
-
-                /* Mark as tombstone in place */
-                items[i].key = janet_wrap_nil();
-                items[i].value = janet_wrap_false();
-                janet_vm.threaded_abstracts.deleted++;
-                janet_vm.threaded_abstracts.count--;
+            /* Removal shifts the next entry into this slot, so check it again */
+            janet_table_remove_index(threaded, i);
+            if (head->type->gcperthread) {
+                janet_assert(!head->type->gcperthread(head->data, head->size), "per-thread finalizer failed");
             }
-
-            /* Reset for next sweep */
-            items[i].value = janet_wrap_false();
+            janet_abstract_decref_maybe_free(abst);
+        } else {
+            i++;
         }
     }
 #endif
@@ -578,6 +594,7 @@ static JanetScratch *janet_mem2scratch(void *mem) {
 void janet_collect(void) {
     uint32_t i;
     if (janet_vm.gc_suspend) return;
+    memset((void *) janet_vm.short_strings, 0, sizeof(janet_vm.short_strings));
     depth = JANET_RECURSION_GUARD;
     janet_vm.gc_mark_phase = 1;
     /* Try to prevent many major collections back to back.
@@ -0,0 +1,964 @@
+/*
+* Copyright (c) 2026 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+/* JSON encoding and decoding (RFC 8259).
+ *
+ * The decoder is a state machine with an explicit stack of open arrays and
+ * objects instead of a recursive parser, so it can stop at the end of any
+ * chunk of input and pick up again when the next one arrives. Nothing but
+ * an unfinished number, literal or escape sequence needs to be kept from one
+ * chunk to the next - the decoded part of a string in progress is kept in a
+ * scratch buffer - so json/feed never scans input twice.
+ *
+ * Strings are not checked for valid UTF-8, and are copied through as is in
+ * both directions. Escaped lone surrogates decode to their 3 byte UTF-8
+ * form. */
+
+#define JSON_KEYWORDS 0x1
+#define JSON_STRUCTS 0x2
+#define JSON_TUPLES 0x4
+
+/* Plain string bytes are checked 8 at a time for this many bytes before
+ * handing long strings to janet_memscan. */
+#define JSON_SWAR_MAX 256
+
+/* Bytes that must be escaped in a string: control characters, '"' and '\' */
+static const uint32_t json_string_stops[8] = {
+    0xFFFFFFFF, 0x4, 0x10000000, 0, 0, 0, 0, 0
+};
+
+/* Find the first byte in text that is a quote, backslash or control
+ * character, or len if there is none. */
+static size_t json_string_run(const uint8_t *text, size_t len) {
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+    const uint64_t highs = UINT64_C(0x8080808080808080);
+    const uint64_t quotes = ones * '"';
+    const uint64_t slashes = ones * '\\';
+    const uint64_t controls = ones * 0x20;
+    size_t i = 0;
+    while (len - i >= 8) {
+        uint64_t word, q, s;
+        memcpy(&word, text + i, sizeof(word));
+        q = word ^ quotes;
+        s = word ^ slashes;
+        if ((((q - ones) & ~q) | ((s - ones) & ~s) | ((word - controls) & ~word)) & highs) break;
+        i += 8;
+        if (i == JSON_SWAR_MAX) {
+            return i + janet_memscan(text + i, len - i, json_string_stops, 0);
+        }
+    }
+    while (i < len && !(json_string_stops[text[i] >> 5] & ((uint32_t) 1 << (text[i] & 0x1F)))) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Encoding
+ */
+
+typedef struct {
+    JanetBuffer *buffer;
+    const uint8_t *indent;
+    int32_t indent_len;
+    int32_t depth;
+    Janet null;
+} JsonEncoder;
+
+static void json_encode_string(JanetBuffer *buffer, const uint8_t *str, int32_t len) {
+    static const char hex[] = "0123456789abcdef";
+    janet_buffer_extra(buffer, len + 2);
+    buffer->data[buffer->count++] = '"';
+    while (len > 0) {
+        int32_t run = (int32_t) json_string_run(str, (size_t) len);
+        janet_buffer_push_bytes(buffer, str, run);
+        str += run;
+        len -= run;
+        if (len == 0) break;
+        uint8_t c = *str++;
+        len--;
+        uint8_t esc[6] = {'\\', c, 0, 0, 0, 0};
+        int32_t n = 2;
+        switch (c) {
+            case '"':
+            case '\\':
+                break;
+            case '\b':
+                esc[1] = 'b';
+                break;
+            case '\f':
+                esc[1] = 'f';
+                break;
+            case '\n':
+                esc[1] = 'n';
+                break;
+            case '\r':
+                esc[1] = 'r';
+                break;
+            case '\t':
+                esc[1] = 't';
+                break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = (uint8_t) hex[c >> 4];
+                esc[5] = (uint8_t) hex[c & 0xF];
+                n = 6;
+                break;
+        }
+        janet_buffer_push_bytes(buffer, esc, n);
+    }
+    janet_buffer_push_u8(buffer, '"');
+}
+
+static void json_newline(JsonEncoder *e) {
+    if (!e->indent_len) return;
+    janet_buffer_push_u8(e->buffer, '\n');
+    for (int32_t i = 0; i < e->depth; i++) {
+        janet_buffer_push_bytes(e->buffer, e->indent, e->indent_len);
+    }
+}
+
+static void json_encode_one(JsonEncoder *e, Janet x) {
+    JanetBuffer *buffer = e->buffer;
+    if (!janet_checktype(e->null, JANET_NIL) && janet_equals(x, e->null)) {
+        janet_buffer_push_cstring(buffer, "null");
+        return;
+    }
+    switch (janet_type(x)) {
+        default:
+            janet_panicf("cannot encode %t as json", x);
+        case JANET_NIL:
+            janet_buffer_push_cstring(buffer, "null");
+            break;
+        case JANET_BOOLEAN:
+            janet_buffer_push_cstring(buffer, janet_unwrap_boolean(x) ? "true" : "false");
+            break;
+        case JANET_NUMBER: {
+            double num = janet_unwrap_number(x);
+            if (isnan(num) || isinf(num)) janet_panicf("cannot encode %v as json", x);
+            janet_buffer_dtostr(buffer, num);
+            break;
+        }
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD:
+        case JANET_BUFFER: {
+            JanetByteView view;
+            janet_bytes_view(x, &view.bytes, &view.len);
+            json_encode_string(buffer, view.bytes, view.len);
+            break;
+        }
+        case JANET_ARRAY:
+        case JANET_TUPLE: {
+            const Janet *items = NULL;
+            int32_t count = 0;
+            janet_indexed_view(x, &items, &count);
+            if (++e->depth > JANET_RECURSION_GUARD) janet_panic("json nesting too deep");
+            janet_buffer_push_u8(buffer, '[');
+            for (int32_t i = 0; i < count; i++) {
+                if (i) janet_buffer_push_u8(buffer, ',');
+                json_newline(e);
+                json_encode_one(e, items[i]);
+            }
+            e->depth--;
+            if (count) json_newline(e);
+            janet_buffer_push_u8(buffer, ']');
+            break;
+        }
+        case JANET_TABLE:
+        case JANET_STRUCT: {
+            const JanetKV *kvs = NULL;
+            int32_t count = 0, cap = 0;
+            janet_dictionary_view(x, &kvs, &count, &cap);
+            if (++e->depth > JANET_RECURSION_GUARD) janet_panic("json nesting too deep");
+            janet_buffer_push_u8(buffer, '{');
+            int first = 1;
+            for (int32_t i = 0; i < cap; i++) {
+                Janet key = kvs[i].key;
+                if (janet_checktype(key, JANET_NIL)) continue;
+                if (!first) janet_buffer_push_u8(buffer, ',');
+                first = 0;
+                json_newline(e);
+                if (janet_checktype(key, JANET_NUMBER)) {
+                    janet_buffer_push_u8(buffer, '"');
+                    janet_buffer_dtostr(buffer, janet_unwrap_number(key));
+                    janet_buffer_push_u8(buffer, '"');
+                } else {
+                    JanetByteView view;
+                    if (!janet_bytes_view(key, &view.bytes, &view.len)) {
+                        janet_panicf("cannot encode %v as a json object key", key);
+                    }
+                    json_encode_string(buffer, view.bytes, view.len);
+                }
+                if (e->indent_len) {
+                    janet_buffer_push_bytes(buffer, (const uint8_t *) ": ", 2);
+                } else {
+                    janet_buffer_push_u8(buffer, ':');
+                }
+                json_encode_one(e, kvs[i].value);
+            }
+            e->depth--;
+            if (!first) json_newline(e);
+            janet_buffer_push_u8(buffer, '}');
+            break;
+        }
+    }
+}
+
+/*
+ * Decoding
+ */
+
+typedef enum {
+    JSON_VALUE,
+    JSON_ARRAY_FIRST,
+    JSON_ARRAY_NEXT,
+    JSON_OBJECT_FIRST,
+    JSON_OBJECT_KEY,
+    JSON_OBJECT_COLON,
+    JSON_OBJECT_NEXT,
+    JSON_STRING,
+    JSON_KEY_STRING,
+    JSON_DONE
+} JsonState;
+
+/* An open array or object. Arrays and tables are built in place. Tuples
+ * and structs are collected on the decoder's value stack from start until
+ * they are closed. */
+typedef struct {
+    Janet container;
+    Janet key;
+    int32_t object;
+    int32_t start;
+} JsonFrame;
+
+typedef struct {
+    JsonFrame *stack;
+    int32_t depth;
+    int32_t capacity;
+    JsonState state;
+    int32_t flags;
+    int32_t single; /* Decode exactly one value */
+    int32_t closed;
+    Janet null;
+    Janet result;
+    JanetArray *out; /* Completed top level values when streaming */
+    JanetArray *values; /* Items of open tuples and structs */
+    JanetBuffer scratch; /* Decoded bytes of the string in progress */
+    /* Unconsumed input when streaming */
+    uint8_t *data;
+    int32_t count;
+    int32_t capacity_data;
+    int64_t offset; /* Bytes consumed before the current input */
+    const char *error;
+    int64_t error_at;
+} JsonDecoder;
+
+static void json_decoder_init(JsonDecoder *d, int32_t flags, Janet null, int single) {
+    d->stack = NULL;
+    d->depth = 0;
+    d->capacity = 0;
+    d->state = JSON_VALUE;
+    d->flags = flags;
+    d->single = single;
+    d->closed = 0;
+    d->null = null;
+    d->result = janet_wrap_nil();
+    d->out = NULL;
+    d->values = NULL;
+    janet_buffer_init(&d->scratch, 0);
+    d->data = NULL;
+    d->count = 0;
+    d->capacity_data = 0;
+    d->offset = 0;
+    d->error = NULL;
+    d->error_at = 0;
+}
+
+static void json_decoder_deinit(JsonDecoder *d) {
+    janet_free(d->stack);
+    janet_free(d->data);
+    janet_buffer_deinit(&d->scratch);
+    d->stack = NULL;
+    d->data = NULL;
+}
+
+/* Add a finished value to the innermost open array or object */
+static void json_add(JsonDecoder *d, Janet x) {
+    if (d->depth == 0) {
+        if (d->single) {
+            d->result = x;
+            d->state = JSON_DONE;
+        } else {
+            janet_array_push(d->out, x);
+            d->state = JSON_VALUE;
+        }
+        return;
+    }
+    JsonFrame *frame = d->stack + d->depth - 1;
+    if (frame->object) {
+        if (d->flags & JSON_STRUCTS) {
+            janet_array_push(d->values, frame->key);
+            janet_array_push(d->values, x);
+        } else {
+            janet_table_put(janet_unwrap_table(frame->container), frame->key, x);
+        }
+        d->state = JSON_OBJECT_NEXT;
+    } else {
+        if (d->flags & JSON_TUPLES) {
+            janet_array_push(d->values, x);
+        } else {
+            janet_array_push(janet_unwrap_array(frame->container), x);
+        }
+        d->state = JSON_ARRAY_NEXT;
+    }
+}
+
+static void json_open(JsonDecoder *d, int object) {
+    if (d->depth == d->capacity) {
+        int32_t capacity = d->capacity ? 2 * d->capacity : 16;
+        JsonFrame *stack = janet_realloc(d->stack, (size_t) capacity * sizeof(JsonFrame));
+        if (NULL == stack) {
+            JANET_OUT_OF_MEMORY;
+        }
+        d->stack = stack;
+        d->capacity = capacity;
+    }
+    JsonFrame *frame = d->stack + d->depth++;
+    frame->object = object;
+    frame->key = janet_wrap_nil();
+    frame->container = janet_wrap_nil();
+    frame->start = 0;
+    if ((d->flags & (object ? JSON_STRUCTS : JSON_TUPLES))) {
+        if (NULL == d->values) d->values = janet_array(0);
+        frame->start = d->values->count;
+    } else if (object) {
+        frame->container = janet_wrap_table(janet_table(0));
+    } else {
+        frame->container = janet_wrap_array(janet_array(0));
+    }
+    d->state = object ? JSON_OBJECT_FIRST : JSON_ARRAY_FIRST;
+}
+
+static void json_close(JsonDecoder *d) {
+    JsonFrame *frame = d->stack + --d->depth;
+    Janet x = frame->container;
+    if (janet_checktype(x, JANET_NIL)) {
+        Janet *items = d->values->data + frame->start;
+        int32_t count = d->values->count - frame->start;
+        if (frame->object) {
+            JanetKV *st = janet_struct_begin(count / 2);
+            for (int32_t i = 0; i < count; i += 2) {
+                janet_struct_put(st, items[i], items[i + 1]);
+            }
+            x = janet_wrap_struct(janet_struct_end(st));
+        } else {
+            x = janet_wrap_tuple(janet_tuple_n(items, count));
+        }
+        d->values->count = frame->start;
+    }
+    json_add(d, x);
+}
+
+static void json_string_done(JsonDecoder *d, const uint8_t *bytes, int32_t len) {
+    if (d->state == JSON_KEY_STRING) {
+        Janet key = (d->flags & JSON_KEYWORDS)
+                    ? janet_keywordv(bytes, len)
+                    : janet_stringv(bytes, len);
+        d->stack[d->depth - 1].key = key;
+        d->state = JSON_OBJECT_COLON;
+    } else {
+        json_add(d, janet_stringv(bytes, len));
+    }
+}
+
+static int json_hex4(const uint8_t *p, uint32_t *out) {
+    uint32_t x = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t c = p[i];
+        x <<= 4;
+        if (c >= '0' && c <= '9') x |= (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') x |= (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') x |= (uint32_t)(c - 'A' + 10);
+        else return 0;
+    }
+    *out = x;
+    return 1;
+}
+
+static void json_push_utf8(JanetBuffer *buffer, uint32_t cp) {
+    uint8_t b[4];
+    int32_t n;
+    if (cp < 0x80) {
+        b[0] = (uint8_t) cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        b[0] = (uint8_t)(0xC0 | (cp >> 6));
+        b[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        b[0] = (uint8_t)(0xE0 | (cp >> 12));
+        b[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        b[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        b[0] = (uint8_t)(0xF0 | (cp >> 18));
+        b[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        b[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        b[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    janet_buffer_push_bytes(buffer, b, n);
+}
+
+/* Return values of the token scanners */
+#define JSON_OK 0
+#define JSON_MORE 1
+#define JSON_ERROR 2
+
+static int json_fail(JsonDecoder *d, int32_t at, const char *message) {
+    d->error = message;
+    d->error_at = d->offset + at;
+    return JSON_ERROR;
+}
+
+/* Continue a string from bytes + *pos, after the opening quote. */
+static int json_string(JsonDecoder *d, const uint8_t *bytes, int32_t len, int32_t *pos, int final) {
+    int32_t i = *pos;
+    for (;;) {
+        int32_t run = (int32_t) json_string_run(bytes + i, (size_t)(len - i));
+        if (i + run < len && bytes[i + run] == '"' && d->scratch.count == 0) {
+            /* No escapes, so make the string straight from the input */
+            json_string_done(d, bytes + i, run);
+            *pos = i + run + 1;
+            return JSON_OK;
+        }
+        janet_buffer_push_bytes(&d->scratch, bytes + i, run);
+        i += run;
+        if (i >= len) break;
+        uint8_t c = bytes[i];
+        if (c == '"') {
+            json_string_done(d, d->scratch.data, d->scratch.count);
+            d->scratch.count = 0;
+            *pos = i + 1;
+            return JSON_OK;
+        }
+        if (c < 0x20) return json_fail(d, i, "control character in string");
+        if (i + 1 >= len) break;
+        uint8_t e = bytes[i + 1];
+        switch (e) {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                e = '\b';
+                break;
+            case 'f':
+                e = '\f';
+                break;
+            case 'n':
+                e = '\n';
+                break;
+            case 'r':
+                e = '\r';
+                break;
+            case 't':
+                e = '\t';
+                break;
+            case 'u': {
+                uint32_t cp, lo;
+                if (i + 6 > len) goto more;
+                if (!json_hex4(bytes + i + 2, &cp)) return json_fail(d, i, "invalid unicode escape");
+                i += 6;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    /* Combine a surrogate pair if there is one */
+                    if (i + 6 > len && !final) {
+                        i -= 6;
+                        goto more;
+                    }
+                    if (i + 6 <= len && bytes[i] == '\\' && bytes[i + 1] == 'u' &&
+                            json_hex4(bytes + i + 2, &lo) && lo >= 0xDC00 && lo < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        i += 6;
+                    }
+                }
+                json_push_utf8(&d->scratch, cp);
+                continue;
+            }
+            default:
+                return json_fail(d, i, "invalid escape in string");
+        }
+        janet_buffer_push_u8(&d->scratch, e);
+        i += 2;
+    }
+more:
+    *pos = i;
+    if (final) return json_fail(d, i, "unterminated string");
+    return JSON_MORE;
+}
+
+static int json_isdigit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+/* Bytes that can't directly follow a number or literal */
+static int json_istoken(uint8_t c) {
+    return json_isdigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '.' || c == '+' || c == '-' || c == '_';
+}
+
+static int json_number(JsonDecoder *d, const uint8_t *bytes, int32_t len, int32_t *pos, int final) {
+    int32_t start = *pos, i = start;
+    int simple = 1;
+    int32_t ndigits = 0;
+    uint64_t w = 0;
+    if (bytes[i] == '-') i++;
+    if (i >= len) goto more;
+    if (bytes[i] == '0') {
+        i++;
+    } else if (json_isdigit(bytes[i])) {
+        while (i < len && json_isdigit(bytes[i])) {
+            if (ndigits < 16) w = w * 10 + (uint64_t)(bytes[i] - '0');
+            ndigits++;
+            i++;
+        }
+    } else {
+        return json_fail(d, start, "invalid number");
+    }
+    if (i < len && bytes[i] == '.') {
+        simple = 0;
+        i++;
+        if (i >= len) goto more;
+        if (!json_isdigit(bytes[i])) return json_fail(d, start, "invalid number");
+        while (i < len && json_isdigit(bytes[i])) i++;
+    }
+    if (i < len && (bytes[i] == 'e' || bytes[i] == 'E')) {
+        simple = 0;
+        i++;
+        if (i < len && (bytes[i] == '+' || bytes[i] == '-')) i++;
+        if (i >= len) goto more;
+        if (!json_isdigit(bytes[i])) return json_fail(d, start, "invalid number");
+        while (i < len && json_isdigit(bytes[i])) i++;
+    }
+    if (i >= len && !final) goto more;
+    if (i < len && json_istoken(bytes[i])) return json_fail(d, start, "invalid number");
+    double x;
+    if (simple && ndigits <= 15) {
+        /* Small integers are exact */
+        x = (double) w;
+        if (bytes[start] == '-') x = -x;
+    } else if (janet_scan_number(bytes + start, i - start, &x)) {
+        return json_fail(d, start, "invalid number");
+    }
+    json_add(d, janet_wrap_number(x));
+    *pos = i;
+    return JSON_OK;
+more:
+    if (final) return json_fail(d, start, "unexpected end of input");
+    return JSON_MORE;
+}
+
+static int json_literal(JsonDecoder *d, const uint8_t *bytes, int32_t len, int32_t *pos, int final,
+                        const char *word, Janet x) {
+    int32_t i = *pos;
+    int32_t n = (int32_t) strlen(word);
+    int32_t avail = len - i < n ? len - i : n;
+    if (memcmp(bytes + i, word, (size_t) avail)) return json_fail(d, i, "unexpected character");
+    if (avail < n) {
+        if (final) return json_fail(d, i, "unexpected end of input");
+        return JSON_MORE;
+    }
+    if (i + n < len && json_istoken(bytes[i + n])) return json_fail(d, i, "unexpected character");
+    json_add(d, x);
+    *pos = i + n;
+    return JSON_OK;
+}
+
+/* Decode as much of bytes as possible. Returns the number of bytes
+ * consumed, or -1 on a syntax error. Unless final is set, an unfinished
+ * token at the end is left unconsumed for the next call. */
+static int32_t json_run(JsonDecoder *d, const uint8_t *bytes, int32_t len, int final) {
+    int32_t i = 0;
+    for (;;) {
+        int status;
+        if (d->state == JSON_STRING || d->state == JSON_KEY_STRING) {
+            status = json_string(d, bytes, len, &i, final);
+            if (status == JSON_MORE) return i;
+            if (status == JSON_ERROR) return -1;
+            continue;
+        }
+        while (i < len && (bytes[i] == ' ' || bytes[i] == '\n' || bytes[i] == '\r' || bytes[i] == '\t')) {
+            i++;
+        }
+        if (i >= len) return i;
+        uint8_t c = bytes[i];
+        switch (d->state) {
+            default:
+                json_fail(d, i, "unexpected character after value");
+                return -1;
+            case JSON_ARRAY_FIRST:
+                if (c == ']') {
+                    i++;
+                    json_close(d);
+                    continue;
+                }
+            /* fallthrough */
+            case JSON_VALUE:
+                switch (c) {
+                    case '"':
+                        i++;
+                        d->state = JSON_STRING;
+                        continue;
+                    case '[':
+                    case '{':
+                        i++;
+                        json_open(d, c == '{');
+                        continue;
+                    case 't':
+                        status = json_literal(d, bytes, len, &i, final, "true", janet_wrap_true());
+                        break;
+                    case 'f':
+                        status = json_literal(d, bytes, len, &i, final, "false", janet_wrap_false());
+                        break;
+                    case 'n':
+                        status = json_literal(d, bytes, len, &i, final, "null", d->null);
+                        break;
+                    default:
+                        if (c != '-' && !json_isdigit(c)) {
+                            json_fail(d, i, "unexpected character");
+                            return -1;
+                        }
+                        status = json_number(d, bytes, len, &i, final);
+                        break;
+                }
+                if (status == JSON_MORE) return i;
+                if (status == JSON_ERROR) return -1;
+                continue;
+            case JSON_ARRAY_NEXT:
+                i++;
+                if (c == ',') {
+                    d->state = JSON_VALUE;
+                } else if (c == ']') {
+                    json_close(d);
+                } else {
+                    json_fail(d, i - 1, "expected , or ]");
+                    return -1;
+                }
+                continue;
+            case JSON_OBJECT_FIRST:
+                if (c == '}') {
+                    i++;
+                    json_close(d);
+                    continue;
+                }
+            /* fallthrough */
+            case JSON_OBJECT_KEY:
+                if (c != '"') {
+                    json_fail(d, i, "expected string key");
+                    return -1;
+                }
+                i++;
+                d->state = JSON_KEY_STRING;
+                continue;
+            case JSON_OBJECT_COLON:
+                if (c != ':') {
+                    json_fail(d, i, "expected :");
+                    return -1;
+                }
+                i++;
+                d->state = JSON_VALUE;
+                continue;
+            case JSON_OBJECT_NEXT:
+                i++;
+                if (c == ',') {
+                    d->state = JSON_OBJECT_KEY;
+                } else if (c == '}') {
+                    json_close(d);
+                } else {
+                    json_fail(d, i - 1, "expected , or }");
+                    return -1;
+                }
+                continue;
+        }
+    }
+}
+
+static int32_t json_flags(Janet *argv, int32_t argc, int32_t n, Janet *null) {
+    int32_t flags = 0;
+    *null = janet_wrap_nil();
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return 0;
+    JanetDictView opts = janet_getdictionary(argv, n);
+    if (janet_truthy(janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("keywords")))) flags |= JSON_KEYWORDS;
+    if (janet_truthy(janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("structs")))) flags |= JSON_STRUCTS;
+    if (janet_truthy(janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("tuples")))) flags |= JSON_TUPLES;
+    *null = janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("null"));
+    return flags;
+}
+
+/*
+ * Streaming
+ */
+
+static int json_stream_gc(void *p, size_t size) {
+    (void) size;
+    json_decoder_deinit((JsonDecoder *) p);
+    return 0;
+}
+
+static int json_stream_mark(void *p, size_t size) {
+    (void) size;
+    JsonDecoder *d = (JsonDecoder *) p;
+    for (int32_t i = 0; i < d->depth; i++) {
+        janet_mark(d->stack[i].container);
+        janet_mark(d->stack[i].key);
+    }
+    janet_mark(d->null);
+    if (NULL != d->values) janet_mark(janet_wrap_array(d->values));
+    return 0;
+}
+
+static int json_stream_getter(void *p, Janet key, Janet *out);
+static Janet json_stream_next(void *p, Janet key);
+
+static const JanetAbstractType janet_json_stream_type = {
+    "core/json-stream",
+    json_stream_gc,
+    json_stream_mark,
+    json_stream_getter,
+    NULL, /* put */
+    NULL, /* marshal */
+    NULL, /* unmarshal */
+    NULL, /* tostring */
+    NULL, /* compare */
+    NULL, /* hash */
+    json_stream_next,
+    JANET_ATEND_NEXT
+};
+
+/* Decode the buffered input of a stream, appending finished top level
+ * values to out. */
+static void json_stream_run(JsonDecoder *d, JanetArray *out) {
+    if (NULL != d->error) {
+        janet_panicf("%s at byte %v of json stream", d->error, janet_wrap_number((double) d->error_at));
+    }
+    d->out = out;
+    int32_t used = json_run(d, d->data, d->count, d->closed);
+    d->out = NULL;
+    if (used < 0) {
+        d->count = 0;
+        /* Return the values decoded so far, the error will be raised
+         * again by the next call */
+        if (out->count) return;
+        janet_panicf("%s at byte %v of json stream", d->error, janet_wrap_number((double) d->error_at));
+    }
+    if (used > 0) {
+        d->count -= used;
+        memmove(d->data, d->data + used, d->count);
+        d->offset += used;
+    }
+    if (d->closed && (d->depth > 0 || d->state != JSON_VALUE)) {
+        json_fail(d, d->count, "unexpected end of input");
+        if (out->count) return;
+        janet_panicf("%s at byte %v of json stream", d->error, janet_wrap_number((double) d->error_at));
+    }
+}
+
+/*
+ * C Functions
+ */
+
+JANET_CORE_FN(cfun_json_encode,
+              "(json/encode x &opt options buffer)",
+              "Encode `x` as JSON and append it to `buffer`, or to a new buffer. Returns the buffer. "
+              "`nil` encodes as null, strings, symbols, keywords and buffers as strings, arrays and "
+              "tuples as arrays, and tables and structs as objects, whose keys must be string-like "
+              "or numbers. Numbers are written with the shortest digits that read back the same, "
+              "and cannot be NaN or infinite. Other types raise an error. `options` is a dictionary "
+              "that can contain the following keys:\n\n"
+              "* :indent - a string or number of spaces to indent nested values by. If given, "
+              "arrays and objects are written over several lines.\n\n"
+              "* :null - a value that is encoded as null, as well as `nil`.") {
+    janet_arity(argc, 1, 3);
+    JsonEncoder e;
+    e.indent = NULL;
+    e.indent_len = 0;
+    e.depth = 0;
+    e.null = janet_wrap_nil();
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) {
+        JanetDictView opts = janet_getdictionary(argv, 1);
+        Janet indent = janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("indent"));
+        if (janet_checkint(indent)) {
+            int32_t n = janet_unwrap_integer(indent);
+            if (n < 0 || n > 64) janet_panicf("expected indent between 0 and 64, got %d", n);
+            e.indent = (const uint8_t *) "                                                                ";
+            e.indent_len = n;
+        } else if (!janet_checktype(indent, JANET_NIL)) {
+            JanetByteView view;
+            if (!janet_bytes_view(indent, &view.bytes, &view.len)) {
+                janet_panicf("expected string or integer indent, got %v", indent);
+            }
+            e.indent = view.bytes;
+            e.indent_len = view.len;
+        }
+        e.null = janet_dictionary_get(opts.kvs, opts.cap, janet_ckeywordv("null"));
+    }
+    e.buffer = janet_optbuffer(argv, argc, 2, 64);
+    json_encode_one(&e, argv[0]);
+    return janet_wrap_buffer(e.buffer);
+}
+
+#define JSON_DECODE_OPTIONS \
+    "`options` is a dictionary that can contain the following keys:\n\n" \
+    "* :keywords - if truthy, object keys become keywords instead of strings.\n\n" \
+    "* :structs - if truthy, objects become structs instead of tables.\n\n" \
+    "* :tuples - if truthy, arrays become tuples instead of arrays.\n\n" \
+    "* :null - the value to use for null, `nil` by default. Object entries whose value " \
+    "is `nil` are left out."
+
+JANET_CORE_FN(cfun_json_decode,
+              "(json/decode src &opt options)",
+              "Decode the JSON text in the string or buffer `src`. Raises an error if `src` "
+              "does not hold exactly one JSON value. " JSON_DECODE_OPTIONS) {
+    janet_arity(argc, 1, 2);
+    JanetByteView src = janet_getbytes(argv, 0);
+    Janet null;
+    int32_t flags = json_flags(argv, argc, 1, &null);
+    JsonDecoder d;
+    json_decoder_init(&d, flags, null, 1);
+    int32_t used = json_run(&d, src.bytes, src.len, 1);
+    Janet result = d.result;
+    json_decoder_deinit(&d);
+    if (used >= 0 && d.state != JSON_DONE) {
+        json_fail(&d, used, "unexpected end of input");
+        used = -1;
+    }
+    if (used < 0) {
+        janet_panicf("%s at byte %v", d.error, janet_wrap_number((double) d.error_at));
+    }
+    return result;
+}
+
+JANET_CORE_FN(cfun_json_stream,
+              "(json/stream &opt options)",
+              "Create a decoder for JSON that arrives in chunks, such as from `ev/read`. Feed "
+              "chunks with `json/feed` and signal the end of input with `json/finish`. The input "
+              "can hold any number of JSON values, separated by whitespace as in JSON lines. "
+              "Input is consumed as it is decoded, so a single large document does not need to "
+              "be held in memory as text. " JSON_DECODE_OPTIONS) {
+    janet_arity(argc, 0, 1);
+    Janet null;
+    int32_t flags = json_flags(argv, argc, 0, &null);
+    JsonDecoder *d = janet_abstract(&janet_json_stream_type, sizeof(JsonDecoder));
+    json_decoder_init(d, flags, null, 0);
+    return janet_wrap_abstract(d);
+}
+
+JANET_CORE_FN(cfun_json_feed,
+              "(json/feed jstream chunk)",
+              "Add a chunk of input to a json stream, and return an array of the top level values "
+              "that are now complete. A number at the end of the chunk is kept until more input "
+              "arrives, since it could go on. Raises an error on invalid JSON. If some values were "
+              "decoded before the error, they are returned and the error is raised by the next call.") {
+    janet_fixarity(argc, 2);
+    JsonDecoder *d = janet_getabstract(argv, 0, &janet_json_stream_type);
+    JanetByteView chunk = janet_getbytes(argv, 1);
+    if (d->closed) janet_panic("json stream is finished");
+    if ((int64_t) d->count + chunk.len > INT32_MAX) janet_panic("json stream input too large");
+    if (d->count + chunk.len > d->capacity_data) {
+        int64_t capacity = 2 * (int64_t)(d->count + chunk.len);
+        if (capacity > INT32_MAX) capacity = INT32_MAX;
+        uint8_t *data = janet_realloc(d->data, (size_t) capacity);
+        if (NULL == data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        d->data = data;
+        d->capacity_data = (int32_t) capacity;
+    }
+    safe_memcpy(d->data + d->count, chunk.bytes, chunk.len);
+    d->count += chunk.len;
+    JanetArray *out = janet_array(0);
+    json_stream_run(d, out);
+    return janet_wrap_array(out);
+}
+
+JANET_CORE_FN(cfun_json_finish,
+              "(json/finish jstream)",
+              "Signal the end of input to a json stream, and return an array of the remaining "
+              "top level values. Raises an error if the input ends in the middle of a value.") {
+    janet_fixarity(argc, 1);
+    JsonDecoder *d = janet_getabstract(argv, 0, &janet_json_stream_type);
+    d->closed = 1;
+    JanetArray *out = janet_array(0);
+    json_stream_run(d, out);
+    return janet_wrap_array(out);
+}
+
+static JanetMethod json_stream_methods[] = {
+    {"feed", cfun_json_feed},
+    {"finish", cfun_json_finish},
+    {NULL, NULL}
+};
+
+static int json_stream_getter(void *p, Janet key, Janet *out) {
+    JsonDecoder *d = (JsonDecoder *)p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    if (janet_keyeq(key, "offset")) {
+        *out = janet_wrap_number((double) d->offset);
+        return 1;
+    }
+    if (janet_keyeq(key, "pending")) {
+        *out = janet_wrap_integer(d->count);
+        return 1;
+    }
+    return janet_getmethod(janet_unwrap_keyword(key), json_stream_methods, out);
+}
+
+static Janet json_stream_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(json_stream_methods, key);
+}
+
+void janet_lib_json(JanetTable *env) {
+    JanetRegExt json_cfuns[] = {
+        JANET_CORE_REG("json/encode", cfun_json_encode),
+        JANET_CORE_REG("json/decode", cfun_json_decode),
+        JANET_CORE_REG("json/stream", cfun_json_stream),
+        JANET_CORE_REG("json/feed", cfun_json_feed),
+        JANET_CORE_REG("json/finish", cfun_json_finish),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, json_cfuns);
+    janet_register_abstract_type(&janet_json_stream_type);
+}
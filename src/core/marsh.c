@@ -78,6 +78,9 @@ enum {
     LB_TABLE_WEAKV_PROTO, /* 230 */
     LB_TABLE_WEAKKV_PROTO, /* 231 */
     LB_ARRAY_WEAK, /* 232 */
+#ifdef JANET_EV
+    LB_SHARED, /* 233 */
+#endif
 } LeadBytes;
 
 /* Helper to look inside an entry in an environment */
@@ -516,6 +519,23 @@ static void marshal_one(MarshalState *st, Janet x, int flags) {
         }
     }
 
+#ifdef JANET_EV
+    /* Values in a shared heap get passed through as pointers in the unsafe mode */
+    if (flags & JANET_MARSHAL_UNSAFE) {
+        void *heap = janet_shared_heap(x);
+        if (NULL != heap) {
+            /* Hold a reference while in transit, as with threaded abstracts */
+            janet_abstract_incref(heap);
+            void *ptr = janet_unwrap_pointer(x);
+            pushbyte(st, LB_SHARED);
+            pushbyte(st, (uint8_t) type);
+            pushbytes(st, (uint8_t *) &ptr, sizeof(ptr));
+            MARK_SEEN();
+            return;
+        }
+    }
+#endif
+
     /* Reference types */
     switch (type) {
         case JANET_NUMBER: {
@@ -1093,6 +1113,7 @@ static const uint8_t *unmarshal_one_fiber(
     fiber->sched_id = 0;
     fiber->supervisor_channel = NULL;
     fiber->ev_state = NULL;
+    fiber->ev_timeout = NULL;
     fiber->ev_callback = NULL;
     fiber->ev_stream = NULL;
 #endif
@@ -1622,20 +1643,59 @@ static const uint8_t *unmarshal_one(
                 janet_abstract_decref(u.ptr);
                 *out = janet_wrap_nil();
             } else {
+                /* Transfers reference from threaded channel buffer to current heap */
                 *out = janet_wrap_abstract(u.ptr);
-                Janet check = janet_table_get(&janet_vm.threaded_abstracts, *out);
-                if (janet_checktype(check, JANET_NIL)) {
-                    /* Transfers reference from threaded channel buffer to current heap */
-                    janet_table_put(&janet_vm.threaded_abstracts, *out, janet_wrap_false());
-                } else {
-                    /* Heap reference already accounted for, remove threaded channel reference. */
-                    janet_abstract_decref(u.ptr);
-                }
+                janet_abstract_adopt_threaded(u.ptr);
             }
 
             janet_v_push(st->lookup, *out);
             return data;
         }
+        case LB_SHARED: {
+            MARSH_EOS(st, data + 1 + sizeof(void *));
+            data++;
+            if (!(flags & JANET_MARSHAL_UNSAFE)) {
+                janet_panicf("unsafe flag not given, "
+                             "will not unmarshal shared value pointer at index %d",
+                             (int)(data - st->start));
+            }
+            JanetType type = (JanetType) *data++;
+            union {
+                void *ptr;
+                uint8_t bytes[sizeof(void *)];
+            } u;
+            memcpy(u.bytes, data, sizeof(void *));
+            data += sizeof(void *);
+            switch (type) {
+                case JANET_STRING:
+                    *out = janet_wrap_string(u.ptr);
+                    break;
+                case JANET_SYMBOL:
+                    *out = janet_wrap_symbol(u.ptr);
+                    break;
+                case JANET_KEYWORD:
+                    *out = janet_wrap_keyword(u.ptr);
+                    break;
+                case JANET_TUPLE:
+                    *out = janet_wrap_tuple(u.ptr);
+                    break;
+                case JANET_STRUCT:
+                    *out = janet_wrap_struct(u.ptr);
+                    break;
+                default:
+                    janet_panicf("invalid shared value type %d at index %d",
+                                 (int) type, (int)(data - st->start));
+            }
+            void *heap = janet_shared_heap(*out);
+            if (flags & JANET_MARSHAL_DECREF) {
+                janet_abstract_decref_maybe_free(heap);
+                *out = janet_wrap_nil();
+            } else {
+                janet_abstract_adopt_threaded(heap);
+            }
+            janet_v_push(st->lookup, *out);
+            return data;
+        }
 #endif
         default: {
             janet_panicf("unknown byte %x at index %d",
@@ -344,13 +344,17 @@ void net_callback_accept(JanetFiber *fiber, JanetAsyncEvent event) {
             return;
         case JANET_ASYNC_EVENT_INIT:
         case JANET_ASYNC_EVENT_READ: {
+            /* Drain pending connections, but return to the event loop
+             * after a bounded number so other streams are not starved. */
+            int32_t batch = janet_vm.ev_accept_batch;
+            for (int32_t i = 0; i < batch; i++) {
 #if defined(JANET_LINUX)
-            JSock connfd = accept4(stream->handle, NULL, NULL, SOCK_CLOEXEC);
+                JSock connfd = accept4(stream->handle, NULL, NULL, SOCK_CLOEXEC);
 #else
-            /* On BSDs, CLOEXEC should be inherited from server socket */
-            JSock connfd = accept(stream->handle, NULL, NULL);
+                /* On BSDs, CLOEXEC should be inherited from server socket */
+                JSock connfd = accept(stream->handle, NULL, NULL);
 #endif
-            if (JSOCKVALID(connfd)) {
+                if (!JSOCKVALID(connfd)) break;
                 janet_net_socknoblock(connfd);
                 JanetStream *stream = make_stream(connfd, JANET_STREAM_READABLE | JANET_STREAM_WRITABLE);
                 Janet streamv = janet_wrap_abstract(stream);
@@ -82,6 +82,12 @@ extern char **environ;
 #ifdef JANET_THREADS
 #include <pthread.h>
 #endif
+#if defined(JANET_EV) && defined(JANET_LINUX) && !defined(JANET_EV_NO_PIDFD)
+#include <sys/syscall.h>
+#ifdef SYS_pidfd_open
+#define JANET_PROC_PIDFD
+#endif
+#endif
 #endif
 
 /* Detect availability of posix_spawn_file_actions_addchdir_np. Since
@@ -556,13 +562,8 @@ static JanetEVGenericMessage janet_proc_wait_subr(JanetEVGenericMessage args) {
 
 #else /* windows check */
 
-static int proc_get_status(JanetProc *proc) {
-    /* Use POSIX shell semantics for interpreting signals */
-    int status = 0;
-    pid_t result;
-    do {
-        result = waitpid(proc->pid, &status, 0);
-    } while (result == -1 && errno == EINTR);
+/* Use POSIX shell semantics for interpreting signals */
+static int proc_decode_status(int status) {
     if (WIFEXITED(status)) {
         status = WEXITSTATUS(status);
     } else if (WIFSTOPPED(status)) {
@@ -576,6 +577,28 @@ static int proc_get_status(JanetProc *proc) {
     return status;
 }
 
+static int proc_get_status(JanetProc *proc) {
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(proc->pid, &status, 0);
+    } while (result == -1 && errno == EINTR);
+    return proc_decode_status(status);
+}
+
+/* Check if a process has exited without blocking. Returns 1 and sets *status if
+ * it has. If the child was already reaped elsewhere, report an exit code of 0. */
+static int proc_poll_status(JanetProc *proc, int *status) {
+    int wstatus = 0;
+    pid_t result;
+    do {
+        result = waitpid(proc->pid, &wstatus, WNOHANG);
+    } while (result == -1 && errno == EINTR);
+    if (result == 0) return 0;
+    *status = proc_decode_status(wstatus);
+    return 1;
+}
+
 /* Function that is called in separate thread to wait on a pid */
 static JanetEVGenericMessage janet_proc_wait_subr(JanetEVGenericMessage args) {
     JanetProc *proc = (JanetProc *) args.argp;
@@ -585,28 +608,284 @@ static JanetEVGenericMessage janet_proc_wait_subr(JanetEVGenericMessage args) {
 
 #endif /* End windows check */
 
+/* Record the exit status of a process and resume the fiber that waited on it. */
+static void proc_wait_finish(JanetProc *proc, JanetFiber *fiber, int status) {
+    proc->return_code = (int32_t) status;
+    proc->flags |= JANET_PROC_WAITED;
+    proc->flags &= ~JANET_PROC_WAITING;
+    if ((status != 0) && (proc->flags & JANET_PROC_ERROR_NONZERO)) {
+        JanetString s = janet_formatc("command failed with non-zero exit code %d", status);
+        janet_cancel(fiber, janet_wrap_string(s));
+    } else {
+        janet_schedule(fiber, janet_wrap_integer(status));
+    }
+}
+
 /* Callback that is called in main thread when subroutine completes. */
 static void janet_proc_wait_cb(JanetEVGenericMessage args) {
     JanetProc *proc = (JanetProc *) args.argp;
     if (NULL != proc) {
-        int status = args.tag;
-        proc->return_code = (int32_t) status;
-        proc->flags |= JANET_PROC_WAITED;
-        proc->flags &= ~JANET_PROC_WAITING;
         janet_gcunroot(janet_wrap_abstract(proc));
         janet_gcunroot(janet_wrap_fiber(args.fiber));
         uint32_t sched_id = (uint32_t) args.argi;
         if (janet_fiber_can_resume(args.fiber) && args.fiber->sched_id == sched_id) {
-            if ((status != 0) && (proc->flags & JANET_PROC_ERROR_NONZERO)) {
-                JanetString s = janet_formatc("command failed with non-zero exit code %d", status);
-                janet_cancel(args.fiber, janet_wrap_string(s));
-            } else {
-                janet_schedule(args.fiber, janet_wrap_integer(status));
+            proc_wait_finish(proc, args.fiber, args.tag);
+        } else {
+            proc->return_code = (int32_t) args.tag;
+            proc->flags |= JANET_PROC_WAITED;
+            proc->flags &= ~JANET_PROC_WAITING;
+        }
+    }
+}
+
+#ifndef JANET_WINDOWS
+
+#ifdef JANET_PROC_PIDFD
+
+/* On Linux, wait on a pidfd with the event loop. The pidfd becomes readable when
+ * the child exits, so no helper thread or signal handler is needed. */
+
+static int janet_pidfd_unsupported = 0;
+
+typedef struct {
+    JanetProc *proc;
+} ProcPidfdState;
+
+static void proc_pidfd_callback(JanetFiber *fiber, JanetAsyncEvent event) {
+    ProcPidfdState *state = (ProcPidfdState *) fiber->ev_state;
+    JanetProc *proc = state->proc;
+    switch (event) {
+        default:
+            break;
+        case JANET_ASYNC_EVENT_MARK:
+            janet_mark(janet_wrap_abstract(proc));
+            break;
+        case JANET_ASYNC_EVENT_DEINIT:
+            /* If the waiting fiber was canceled, the child is not reaped here -
+             * it can be waited on again, and will be reaped on garbage collection. */
+            proc->flags &= ~JANET_PROC_WAITING;
+            janet_stream_close(fiber->ev_stream);
+            break;
+        case JANET_ASYNC_EVENT_INIT:
+        case JANET_ASYNC_EVENT_READ:
+        case JANET_ASYNC_EVENT_HUP:
+        case JANET_ASYNC_EVENT_ERR: {
+            int status;
+            if (proc_poll_status(proc, &status)) {
+                proc_wait_finish(proc, fiber, status);
+                janet_async_end(fiber);
             }
+            break;
         }
     }
 }
 
+/* Returns 0 if pidfds are not usable and another method should be used */
+static int proc_wait_pidfd(JanetProc *proc) {
+    if (janet_pidfd_unsupported) return 0;
+    int fd = (int) syscall(SYS_pidfd_open, proc->pid, 0);
+    if (fd < 0) {
+        if (errno == ENOSYS || errno == EPERM) janet_pidfd_unsupported = 1;
+        return 0;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    JanetStream *stream = janet_stream(fd, JANET_STREAM_READABLE, NULL);
+    if (stream->flags & JANET_STREAM_UNREGISTERED) {
+        janet_stream_close(stream);
+        return 0;
+    }
+    ProcPidfdState *state = janet_malloc(sizeof(ProcPidfdState));
+    if (NULL == state) {
+        JANET_OUT_OF_MEMORY;
+    }
+    state->proc = proc;
+    proc->flags |= JANET_PROC_WAITING;
+    janet_async_start(stream, JANET_ASYNC_LISTEN_READ, proc_pidfd_callback, state);
+}
+
+#endif /* JANET_PROC_PIDFD */
+
+/* Otherwise, wait on children with a SIGCHLD handler. Each VM with processes to wait
+ * on registers itself so that the handler can wake its event loop via the self-pipe,
+ * and the VM then polls its pending children with waitpid. */
+
+typedef struct {
+    JanetProc *proc;
+    JanetFiber *fiber;
+    uint32_t sched_id;
+} JanetProcWaiter;
+
+#define JANET_SIGCHLD_MAX_VMS 64
+static JanetVM *volatile janet_sigchld_vms[JANET_SIGCHLD_MAX_VMS];
+/* Number of SIGCHLD handlers currently running on any thread. Unregistering waits
+ * for this to reach zero after clearing its slot, so no handler can still hold a
+ * pointer to a VM that is about to be torn down. */
+static volatile JanetAtomicInt janet_sigchld_active = 0;
+static struct sigaction janet_sigchld_old;
+static int janet_sigchld_installed = 0;
+#ifdef JANET_THREADS
+static pthread_mutex_t janet_sigchld_lock = PTHREAD_MUTEX_INITIALIZER;
+#define janet_sigchld_acquire() pthread_mutex_lock(&janet_sigchld_lock)
+#define janet_sigchld_release() pthread_mutex_unlock(&janet_sigchld_lock)
+#else
+#define janet_sigchld_acquire()
+#define janet_sigchld_release()
+#endif
+
+static void proc_sigchld_poll(JanetEVGenericMessage msg);
+
+static void janet_sigchld_handler(int sig, siginfo_t *info, void *context) {
+    /* Do not interact with global janet state here except for janet_ev_post_event, unsafe! */
+    int saved_errno = errno;
+    janet_atomic_inc(&janet_sigchld_active);
+    janet_atomic_fence();
+    for (int i = 0; i < JANET_SIGCHLD_MAX_VMS; i++) {
+        JanetVM *vm = janet_sigchld_vms[i];
+        if (NULL != vm && janet_atomic_inc(&vm->proc_sigchld_pending) == 1) {
+            JanetEVGenericMessage msg;
+            memset(&msg, 0, sizeof(msg));
+            janet_ev_post_event(vm, proc_sigchld_poll, msg);
+        }
+    }
+    janet_atomic_fence();
+    janet_atomic_dec(&janet_sigchld_active);
+    /* Chain to any previously installed handler */
+    if (janet_sigchld_old.sa_flags & SA_SIGINFO) {
+        janet_sigchld_old.sa_sigaction(sig, info, context);
+    } else if (janet_sigchld_old.sa_handler != SIG_DFL && janet_sigchld_old.sa_handler != SIG_IGN) {
+        janet_sigchld_old.sa_handler(sig);
+    }
+    errno = saved_errno;
+}
+
+/* Returns 0 if there is no room for another VM in the registry. */
+static int proc_sigchld_register(void) {
+    if (janet_vm.proc_sigchld_slot >= 0) return 1;
+    int ok = 0;
+    janet_sigchld_acquire();
+    if (!janet_sigchld_installed) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = janet_sigchld_handler;
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP | SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        if (0 == sigaction(SIGCHLD, &action, &janet_sigchld_old)) {
+            janet_sigchld_installed = 1;
+        }
+    }
+    if (janet_sigchld_installed) {
+        for (int i = 0; i < JANET_SIGCHLD_MAX_VMS; i++) {
+            if (NULL == janet_sigchld_vms[i]) {
+                janet_sigchld_vms[i] = &janet_vm;
+                janet_vm.proc_sigchld_slot = i;
+                ok = 1;
+                break;
+            }
+        }
+    }
+    janet_sigchld_release();
+    if (ok) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+#ifdef JANET_THREADS
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+#else
+        sigprocmask(SIG_UNBLOCK, &set, NULL);
+#endif
+    }
+    return ok;
+}
+
+static void proc_sigchld_unregister(void) {
+    if (janet_vm.proc_sigchld_slot < 0) return;
+    janet_sigchld_acquire();
+    janet_sigchld_vms[janet_vm.proc_sigchld_slot] = NULL;
+    janet_sigchld_release();
+    janet_vm.proc_sigchld_slot = -1;
+    /* A handler on another thread may have loaded our slot before it was cleared */
+    janet_atomic_fence();
+    while (0 != janet_atomic_load(&janet_sigchld_active)) {
+        janet_atomic_fence();
+    }
+}
+
+static void proc_waiter_remove(size_t i) {
+    JanetProcWaiter *waiters = (JanetProcWaiter *) janet_vm.proc_waiters;
+    janet_gcunroot(janet_wrap_abstract(waiters[i].proc));
+    janet_gcunroot(janet_wrap_fiber(waiters[i].fiber));
+    waiters[i] = waiters[--janet_vm.proc_waiter_count];
+    janet_ev_dec_refcount();
+    if (0 == janet_vm.proc_waiter_count) proc_sigchld_unregister();
+}
+
+/* Drop waiters whose fibers have been canceled, and optionally reap exited children. */
+static void proc_waiters_poll(int reap) {
+    size_t i = 0;
+    while (i < janet_vm.proc_waiter_count) {
+        JanetProcWaiter *w = ((JanetProcWaiter *) janet_vm.proc_waiters) + i;
+        JanetProc *proc = w->proc;
+        JanetFiber *fiber = w->fiber;
+        int status;
+        if (!janet_fiber_can_resume(fiber) || fiber->sched_id != w->sched_id) {
+            proc->flags &= ~JANET_PROC_WAITING;
+            proc_waiter_remove(i);
+        } else if (reap && proc_poll_status(proc, &status)) {
+            proc_waiter_remove(i);
+            proc_wait_finish(proc, fiber, status);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void proc_sigchld_poll(JanetEVGenericMessage msg) {
+    (void) msg;
+    JanetAtomicInt pending = janet_atomic_load(&janet_vm.proc_sigchld_pending);
+    for (;;) {
+        proc_waiters_poll(1);
+        JanetAtomicInt left = pending;
+        for (JanetAtomicInt j = 0; j < pending; j++) {
+            left = janet_atomic_dec(&janet_vm.proc_sigchld_pending);
+        }
+        if (left <= 0) break;
+        pending = left;
+    }
+}
+
+/* Returns 0 if the SIGCHLD handler can't be used and another method should be used */
+static int proc_wait_sigchld(JanetProc *proc) {
+    if (!proc_sigchld_register()) return 0;
+    int status;
+    JanetFiber *fiber = janet_vm.root_fiber;
+    if (proc_poll_status(proc, &status)) {
+        /* Already exited */
+        if (0 == janet_vm.proc_waiter_count) proc_sigchld_unregister();
+        proc_wait_finish(proc, fiber, status);
+        janet_await();
+    }
+    if (janet_vm.proc_waiter_count >= janet_vm.proc_waiter_capacity) {
+        size_t newcap = 2 * janet_vm.proc_waiter_count + 4;
+        JanetProcWaiter *waiters = janet_realloc(janet_vm.proc_waiters, newcap * sizeof(JanetProcWaiter));
+        if (NULL == waiters) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_vm.proc_waiters = waiters;
+        janet_vm.proc_waiter_capacity = newcap;
+    }
+    JanetProcWaiter *w = ((JanetProcWaiter *) janet_vm.proc_waiters) + janet_vm.proc_waiter_count++;
+    w->proc = proc;
+    w->fiber = fiber;
+    w->sched_id = fiber->sched_id;
+    proc->flags |= JANET_PROC_WAITING;
+    janet_gcroot(janet_wrap_abstract(proc));
+    janet_gcroot(janet_wrap_fiber(fiber));
+    janet_ev_inc_refcount();
+    janet_await();
+}
+
+#endif /* JANET_WINDOWS */
+
 #endif /* End ev check */
 
 static int janet_proc_gc(void *p, size_t s) {
@@ -648,11 +927,21 @@ static JANET_NO_RETURN void
 static Janet
 #endif
 os_proc_wait_impl(JanetProc *proc) {
+#if defined(JANET_EV) && !defined(JANET_WINDOWS)
+    /* A wait canceled from another fiber may not have been noticed yet */
+    if (proc->flags & JANET_PROC_WAITING) proc_waiters_poll(0);
+#endif
     if (proc->flags & (JANET_PROC_WAITED | JANET_PROC_WAITING)) {
         janet_panicf("cannot wait twice on a process");
     }
 #ifdef JANET_EV
-    /* Event loop implementation - threaded call */
+#ifndef JANET_WINDOWS
+#ifdef JANET_PROC_PIDFD
+    proc_wait_pidfd(proc);
+#endif
+    proc_wait_sigchld(proc);
+#endif
+    /* Fallback event loop implementation - threaded call */
     proc->flags |= JANET_PROC_WAITING;
     JanetEVGenericMessage targs;
     memset(&targs, 0, sizeof(targs));
@@ -686,8 +975,8 @@ os_proc_wait_impl(JanetProc *proc) {
 JANET_CORE_FN(os_proc_wait,
               "(os/proc-wait proc)",
               "Suspend the current fiber until the subprocess `proc` completes. Once `proc` "
-              "completes, return the exit code of `proc`. If called more than once on the same "
-              "core/process value, will raise an error. When creating subprocesses using "
+              "completes, return the exit code of `proc`. Raises an error if `proc` has already "
+              "completed, or if another fiber is waiting on it. When creating subprocesses using "
               "`os/spawn`, this function should be called on the returned value to avoid zombie "
               "processes.") {
     janet_fixarity(argc, 1);
@@ -2949,6 +3238,18 @@ JANET_CORE_FN(os_pipe,
 #endif /* JANET_REDUCED_OS */
 
 /* Module entry point */
+#if defined(JANET_EV) && !defined(JANET_WINDOWS)
+void janet_ev_deinit_procs(void) {
+#if !defined(JANET_REDUCED_OS) && !defined(JANET_NO_PROCESSES)
+    proc_sigchld_unregister();
+#endif
+    janet_free(janet_vm.proc_waiters);
+    janet_vm.proc_waiters = NULL;
+    janet_vm.proc_waiter_count = 0;
+    janet_vm.proc_waiter_capacity = 0;
+}
+#endif
+
 void janet_lib_os(JanetTable *env) {
 #if !defined(JANET_REDUCED_OS) && defined(JANET_WINDOWS) && defined(JANET_THREADS)
     /* During start up, the top-most abstract machine (thread)
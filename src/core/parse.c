@@ -131,6 +131,21 @@ DEF_PARSER_STACK(_pushstate, JanetParseState, states, statecount, statecap)
 
 #undef DEF_PARSER_STACK
 
+static void push_buf_bytes(JanetParser *p, const uint8_t *bytes, size_t n) {
+    size_t newcount = p->bufcount + n;
+    if (newcount > p->bufcap) {
+        size_t newcap = 2 * newcount;
+        uint8_t *next = janet_realloc(p->buf, newcap);
+        if (NULL == next) {
+            JANET_OUT_OF_MEMORY;
+        }
+        p->buf = next;
+        p->bufcap = newcap;
+    }
+    memcpy(p->buf + p->bufcount, bytes, n);
+    p->bufcount = newcount;
+}
+
 #define PFLAG_CONTAINER 0x100
 #define PFLAG_BUFFER 0x200
 #define PFLAG_PARENS 0x400
@@ -727,6 +742,68 @@ void janet_parser_eof(JanetParser *parser) {
     parser->flag |= JANET_PARSER_DEAD;
 }
 
+/* Bulk consumption. Runs of bytes that cannot change the state of the
+ * parser - the rest of a token, the body of a string or comment, or
+ * whitespace - are scanned with janet_memscan and added all at once. The
+ * bytes that end a run go through janet_parser_consume as usual. Runs never
+ * contain newlines, so only the column moves. */
+
+/* Bytes that end a string, long string or comment run */
+static const uint32_t string_stops[8] = {
+    0x00002400, 0x00000004, 0x10000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+static const uint32_t longstring_stops[8] = {
+    0x00002400, 0x00000000, 0x00000000, 0x00000001,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+static const uint32_t comment_stops[8] = {
+    0x00002400, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+
+/* Bytes that continue a token or whitespace run. Non ascii token bytes
+ * take the slow path, which marks the token for a utf-8 check. */
+static const uint32_t token_run[8] = {
+    0x00000000, 0xf7ffec72, 0xc7ffffff, 0x07fffffe,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+static const uint32_t whitespace_run[8] = {
+    0x00001a01, 0x00000001, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+
+/* Consume a run of bytes at the start of bytes, returning its length */
+static size_t parser_run(JanetParser *p, const uint8_t *bytes, size_t len) {
+    JanetParseState *state = p->states + p->statecount - 1;
+    Consumer consumer = state->consumer;
+    size_t n;
+    if (consumer == tokenchar) {
+        n = janet_memscan(bytes, len, token_run, 1);
+    } else if (consumer == stringchar) {
+        n = janet_memscan(bytes, len, string_stops, 0);
+    } else if (consumer == longstring && (state->flags & PFLAG_INSTRING)) {
+        n = janet_memscan(bytes, len, longstring_stops, 0);
+    } else if (consumer == comment) {
+        n = janet_memscan(bytes, len, comment_stops, 0);
+    } else if (consumer == root) {
+        n = janet_memscan(bytes, len, whitespace_run, 1);
+        if (n) {
+            p->column += n;
+            p->lookback = bytes[n - 1];
+        }
+        return n;
+    } else {
+        return 0;
+    }
+    if (n) {
+        push_buf_bytes(p, bytes, n);
+        p->column += n;
+        p->lookback = bytes[n - 1];
+    }
+    return n;
+}
+
 enum JanetParserStatus janet_parser_status(JanetParser *parser) {
     if (parser->error) return JANET_PARSE_ERROR;
     if (parser->flag) return JANET_PARSE_DEAD;
@@ -923,15 +1000,18 @@ JANET_CORE_FN(cfun_parse_consume,
         view.len -= offset;
         view.bytes += offset;
     }
-    int32_t i;
-    for (i = 0; i < view.len; i++) {
-        janet_parser_consume(p, view.bytes[i]);
+    int32_t i = 0;
+    if (view.len > 0) janet_parser_checkdead(p);
+    while (i < view.len) {
+        i += (int32_t) parser_run(p, view.bytes + i, (size_t)(view.len - i));
+        if (i >= view.len) break;
+        janet_parser_consume(p, view.bytes[i++]);
         switch (janet_parser_status(p)) {
             case JANET_PARSE_ROOT:
             case JANET_PARSE_PENDING:
                 break;
             default:
-                return janet_wrap_integer(i + 1);
+                return janet_wrap_integer(i);
         }
     }
     return janet_wrap_integer(i);
@@ -55,10 +55,19 @@ typedef struct {
     int32_t depth;
     int32_t linemaplen;
     int32_t has_backref;
+    int32_t hit_end; /* Set when a rule looked at the end of input */
     enum {
         PEG_MODE_NORMAL,
         PEG_MODE_ACCUMULATE
     } mode;
+    struct PegMemoEntry *memo;
+    uint32_t memo_capacity; /* Power of 2, 0 until a memo rule runs */
+    uint32_t memo_limit;
+    uint32_t memo_count;
+    int64_t memo_hits;
+    int64_t memo_misses;
+    int64_t memo_evictions;
+    jmp_buf *bail; /* Set on threads that cannot panic, see peg_overflow */
 } PegState;
 
 /* Allow backtrack with captures. We need
@@ -165,9 +174,175 @@ static int64_t peg_convert_u64_s64(uint64_t from, int width) {
     return ((int64_t)(from << shift)) >> shift;
 }
 
-/* Prevent stack overflow */
+/* Record that the result of a rule depended on where the input ends, so
+ * a streaming match may change once more input arrives. */
+#define peg_hit_end(s) ((s)->hit_end |= ((s)->text_end == (s)->outer_text_end))
+
+/* Memoization for the memo special. Results are kept in a direct mapped
+ * table keyed on the rule and the input position, along with the captures
+ * that the rule pushed so they can be replayed on a hit. The table starts
+ * small and doubles up to (dyn :peg-memo-size) entries, after which new
+ * results overwrite old ones. A hit replays the saved captures without
+ * running the rule, so backrefs to outside tags and match-time functions
+ * inside a memoized rule are not re-evaluated. */
+
+#define JANET_PEG_MEMO_SIZE 65536
+
+typedef struct PegMemoEntry {
+    const uint32_t *rule; /* NULL if the entry is empty */
+    const uint8_t *text;
+    const uint8_t *text_end;
+    const uint8_t *result; /* NULL if the rule did not match */
+    const Janet *captures;
+    const Janet *tagged_captures;
+    const uint8_t *tags;
+    const uint8_t *scratch;
+    int32_t mode;
+} PegMemoEntry;
+
+static uint32_t peg_memo_hash(const uint32_t *rule, const uint8_t *text) {
+    uint64_t h = (uint64_t)(uintptr_t) rule * UINT64_C(0x9E3779B97F4A7C15);
+    h ^= (uint64_t)(uintptr_t) text * UINT64_C(0xC2B2AE3D27D4EB4F);
+    return (uint32_t)(h >> 32);
+}
+
+static void peg_memo_resize(PegState *s, uint32_t capacity) {
+    PegMemoEntry *old = s->memo;
+    uint32_t old_capacity = s->memo_capacity;
+    s->memo = janet_scalloc(capacity, sizeof(PegMemoEntry));
+    s->memo_capacity = capacity;
+    s->memo_count = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (NULL == old[i].rule) continue;
+        PegMemoEntry *e = s->memo + (peg_memo_hash(old[i].rule, old[i].text) & (capacity - 1));
+        if (NULL == e->rule) s->memo_count++;
+        *e = old[i];
+    }
+    janet_sfree(old);
+}
+
+static PegMemoEntry *peg_memo_find(PegState *s, const uint32_t *rule, const uint8_t *text) {
+    if (!s->memo_capacity) {
+        Janet size = janet_dyn("peg-memo-size");
+        s->memo_limit = JANET_PEG_MEMO_SIZE;
+        if (janet_checkint(size) && janet_unwrap_integer(size) > 0) {
+            s->memo_limit = 1;
+            while (s->memo_limit < (uint32_t) janet_unwrap_integer(size) && s->memo_limit < (1u << 30)) {
+                s->memo_limit <<= 1;
+            }
+        }
+        peg_memo_resize(s, s->memo_limit < 256 ? s->memo_limit : 256);
+    }
+    return s->memo + (peg_memo_hash(rule, text) & (s->memo_capacity - 1));
+}
+
+static void peg_memo_store(PegState *s, const uint32_t *rule, const uint8_t *text,
+                           const uint8_t *result, CapState cs) {
+    if (s->memo_count >= s->memo_capacity / 2 && s->memo_capacity < s->memo_limit) {
+        peg_memo_resize(s, s->memo_capacity * 2);
+    }
+    PegMemoEntry *e = peg_memo_find(s, rule, text);
+    if (NULL == e->rule) {
+        s->memo_count++;
+    } else {
+        s->memo_evictions++;
+    }
+    e->rule = rule;
+    e->text = text;
+    e->text_end = s->text_end;
+    e->result = result;
+    e->mode = s->mode;
+    e->captures = NULL;
+    e->tagged_captures = NULL;
+    e->tags = NULL;
+    e->scratch = NULL;
+    if (NULL == result) return;
+    if (s->captures->count > cs.cap) {
+        e->captures = janet_tuple_n(s->captures->data + cs.cap, s->captures->count - cs.cap);
+    }
+    if (s->tagged_captures->count > cs.tcap) {
+        e->tagged_captures = janet_tuple_n(s->tagged_captures->data + cs.tcap,
+                                           s->tagged_captures->count - cs.tcap);
+        e->tags = janet_string(s->tags->data + cs.tcap, s->tags->count - cs.tcap);
+    }
+    if (s->scratch->count > cs.scratch) {
+        e->scratch = janet_string(s->scratch->data + cs.scratch, s->scratch->count - cs.scratch);
+    }
+}
+
+/* Push the captures of a memoized match */
+static void peg_memo_replay(PegState *s, const PegMemoEntry *e) {
+    if (NULL != e->captures) {
+        for (int32_t i = 0; i < janet_tuple_length(e->captures); i++) {
+            janet_array_push(s->captures, e->captures[i]);
+        }
+    }
+    if (NULL != e->tagged_captures) {
+        for (int32_t i = 0; i < janet_tuple_length(e->tagged_captures); i++) {
+            janet_array_push(s->tagged_captures, e->tagged_captures[i]);
+        }
+        janet_buffer_push_bytes(s->tags, e->tags, janet_string_length(e->tags));
+    }
+    if (NULL != e->scratch) {
+        janet_buffer_push_bytes(s->scratch, e->scratch, janet_string_length(e->scratch));
+    }
+}
+
+/* Find the end of the run of bytes in [text, limit) that are in the set of
+ * a RULE_SPAN. When the set leaves out at most 4 bytes, the run is scanned 8
+ * bytes at a time for the bytes left out, and otherwise with janet_memscan. */
+static const uint8_t *peg_span(const uint32_t *rule, const uint8_t *text, const uint8_t *limit) {
+    uint32_t nstops = rule[11];
+    if (nstops == 0) return limit;
+    if (nstops == 1) {
+        const uint8_t *stop = memchr(text, (int)(rule[12] & 0xFF), (size_t)(limit - text));
+        return stop ? stop : limit;
+    }
+    if (nstops <= 4) {
+        const uint64_t ones = UINT64_C(0x0101010101010101);
+        const uint64_t highs = UINT64_C(0x8080808080808080);
+        uint64_t stops[4];
+        for (uint32_t k = 0; k < nstops; k++) {
+            stops[k] = ones * ((rule[12] >> (8 * k)) & 0xFF);
+        }
+        while (limit - text >= 8) {
+            uint64_t word, hit = 0;
+            memcpy(&word, text, sizeof(word));
+            for (uint32_t k = 0; k < nstops; k++) {
+                uint64_t x = word ^ stops[k];
+                hit |= (x - ones) & ~x & highs;
+            }
+            if (hit) break;
+            text += 8;
+        }
+    }
+    /* Most runs are short, so only hand long ones to janet_memscan */
+    const uint32_t *bitmap = rule + 3;
+    const uint8_t *scalar = (limit - text > 64) ? text + 64 : limit;
+    while (text < scalar && (bitmap[text[0] >> 5] & ((uint32_t) 1 << (text[0] & 0x1F)))) {
+        text++;
+    }
+    if (text == scalar && text < limit) {
+        text += janet_memscan(text, (size_t)(limit - text), bitmap, 1);
+    }
+    return text;
+}
+
+/* Prevent stack overflow. Matches on worker threads cannot panic, so they
+ * jump back to the worker instead. */
+static JANET_NO_RETURN void peg_overflow(PegState *s) {
+    if (NULL != s->bail) {
+#if defined(JANET_BSD) || defined(JANET_APPLE)
+        _longjmp(*s->bail, 1);
+#else
+        longjmp(*s->bail, 1);
+#endif
+    }
+    janet_panic("peg/match recursed too deeply");
+}
+
 #define down1(s) do { \
-    if (0 == --((s)->depth)) janet_panic("peg/match recursed too deeply"); \
+    if (0 == --((s)->depth)) peg_overflow(s); \
 } while (0)
 #define up1(s) ((s)->depth++)
 
@@ -190,8 +365,13 @@ tail:
 
         case RULE_LITERAL: {
             uint32_t len = rule[1];
-            if (text + len > s->text_end) return NULL;
-            return memcmp(text, rule + 2, len) ? NULL : text + len;
+            size_t avail = (size_t)(s->text_end - text);
+            if (memcmp(text, rule + 2, len > avail ? avail : len)) return NULL;
+            if (len > avail) {
+                peg_hit_end(s);
+                return NULL;
+            }
+            return text + len;
         }
 
         case RULE_DEBUG: {
@@ -231,26 +411,37 @@ tail:
 
         case RULE_NCHAR: {
             uint32_t n = rule[1];
-            return (text + n > s->text_end) ? NULL : text + n;
+            if (text + n > s->text_end) {
+                peg_hit_end(s);
+                return NULL;
+            }
+            return text + n;
         }
 
         case RULE_NOTNCHAR: {
             uint32_t n = rule[1];
-            return (text + n > s->text_end) ? text : NULL;
+            if (text + n > s->text_end) {
+                peg_hit_end(s);
+                return text;
+            }
+            return NULL;
         }
 
         case RULE_RANGE: {
             uint8_t lo = rule[1] & 0xFF;
             uint8_t hi = (rule[1] >> 16) & 0xFF;
-            return (text < s->text_end &&
-                    text[0] >= lo &&
-                    text[0] <= hi)
-                   ? text + 1
-                   : NULL;
+            if (text >= s->text_end) {
+                peg_hit_end(s);
+                return NULL;
+            }
+            return (text[0] >= lo && text[0] <= hi) ? text + 1 : NULL;
         }
 
         case RULE_SET: {
-            if (text >= s->text_end) return NULL;
+            if (text >= s->text_end) {
+                peg_hit_end(s);
+                return NULL;
+            }
             uint32_t word = rule[1 + (text[0] >> 5)];
             uint32_t mask = (uint32_t)1 << (text[0] & 0x1F);
             return (word & mask)
@@ -258,8 +449,18 @@ tail:
                    : NULL;
         }
 
+        case RULE_SPAN: {
+            uint32_t lo = rule[1];
+            uint32_t hi = rule[2];
+            const uint8_t *limit = ((size_t)(s->text_end - text) > hi) ? text + hi : s->text_end;
+            const uint8_t *next_text = peg_span(rule, text, limit);
+            if (next_text == s->text_end && (uint32_t)(next_text - text) < hi) peg_hit_end(s);
+            return ((uint32_t)(next_text - text) < lo) ? NULL : next_text;
+        }
+
         case RULE_LOOK: {
             text += ((int32_t *)rule)[1];
+            if (text > s->text_end) peg_hit_end(s);
             if (text < s->text_start || text > s->text_end) return NULL;
             down1(s);
             const uint8_t *result = peg_rule(s, s->bytecode + rule[2], text);
@@ -287,6 +488,38 @@ tail:
             goto tail;
         }
 
+        case RULE_CHOICE_NOCAP: {
+            uint32_t len = rule[1];
+            const uint32_t *args = rule + 2;
+            if (len == 0) return NULL;
+            down1(s);
+            for (uint32_t i = 0; i < len - 1; i++) {
+                const uint8_t *result = peg_rule(s, s->bytecode + args[i], text);
+                if (result) {
+                    up1(s);
+                    return result;
+                }
+            }
+            up1(s);
+            rule = s->bytecode + args[len - 1];
+            goto tail;
+        }
+
+        case RULE_DISPATCH: {
+            uint32_t len = rule[1];
+            const uint8_t *table = (const uint8_t *)(rule + 2 + len);
+            uint32_t target;
+            if (text < s->text_end) {
+                target = table[text[0]];
+            } else {
+                peg_hit_end(s);
+                target = table[256];
+            }
+            if (!target) return NULL;
+            rule = s->bytecode + rule[1 + target];
+            goto tail;
+        }
+
         case RULE_SEQUENCE: {
             uint32_t len = rule[1];
             const uint32_t *args = rule + 2;
@@ -346,6 +579,17 @@ tail:
         case RULE_TO: {
             const uint32_t *rule_a = s->bytecode + rule[1];
             const uint8_t *next_text = NULL;
+            if (rule_a[0] == RULE_LITERAL && rule_a[1] > 0) {
+                /* Search for a literal directly */
+                uint32_t len = rule_a[1];
+                const uint8_t *lit = (const uint8_t *)(rule_a + 2);
+                const uint8_t *found = janet_memsearch(text, (size_t)(s->text_end - text), lit, len, NULL);
+                if (NULL != found) {
+                    return rule[0] == RULE_TO ? found : found + len;
+                }
+                peg_hit_end(s);
+                return NULL;
+            }
             CapState cs = cap_save(s);
             down1(s);
             while (text <= s->text_end) {
@@ -392,6 +636,22 @@ tail:
             return text;
         }
 
+        case RULE_BETWEEN_NOCAP: {
+            uint32_t lo = rule[1];
+            uint32_t hi = rule[2];
+            const uint32_t *rule_a = s->bytecode + rule[3];
+            uint32_t captured = 0;
+            down1(s);
+            while (captured < hi) {
+                const uint8_t *next_text = peg_rule(s, rule_a, text);
+                if (!next_text || ((next_text == text) && (hi == UINT32_MAX))) break;
+                captured++;
+                text = next_text;
+            }
+            up1(s);
+            return captured < lo ? NULL : text;
+        }
+
         /* Capturing rules */
 
         case RULE_GETTAG: {
@@ -742,8 +1002,10 @@ tail:
                         return NULL;
                     const uint8_t *bytes = janet_unwrap_string(capture);
                     int32_t len = janet_string_length(bytes);
-                    if (text + len > s->text_end)
+                    if (text + len > s->text_end) {
+                        if (!memcmp(text, bytes, s->text_end - text)) peg_hit_end(s);
                         return NULL;
+                    }
                     return memcmp(text, bytes, len) ? NULL : text + len;
                 }
             }
@@ -787,7 +1049,10 @@ tail:
             uint32_t signedness = rule[1] & 0x10;
             uint32_t endianness = rule[1] & 0x20;
             int width = (int)(rule[1] & 0xF);
-            if (text + width > s->text_end) return NULL;
+            if (text + width > s->text_end) {
+                peg_hit_end(s);
+                return NULL;
+            }
             uint64_t accum = 0;
             if (endianness) {
                 /* BE */
@@ -823,6 +1088,23 @@ tail:
             return text + width;
         }
 
+        case RULE_MEMO: {
+            PegMemoEntry *e = peg_memo_find(s, rule, text);
+            if (e->rule == rule && e->text == text &&
+                    e->text_end == s->text_end && e->mode == (int32_t) s->mode) {
+                s->memo_hits++;
+                if (NULL != e->result) peg_memo_replay(s, e);
+                return e->result;
+            }
+            s->memo_misses++;
+            CapState cs = cap_save(s);
+            down1(s);
+            const uint8_t *result = peg_rule(s, s->bytecode + rule[1], text);
+            up1(s);
+            peg_memo_store(s, rule, text, result, cs);
+            return result;
+        }
+
         case RULE_UNREF: {
             int32_t tcap = s->tags->count;
             down1(s);
@@ -1179,6 +1461,9 @@ static void spec_thru(Builder *b, int32_t argc, const Janet *argv) {
 static void spec_drop(Builder *b, int32_t argc, const Janet *argv) {
     spec_onerule(b, argc, argv, RULE_DROP);
 }
+static void spec_memo(Builder *b, int32_t argc, const Janet *argv) {
+    spec_onerule(b, argc, argv, RULE_MEMO);
+}
 static void spec_only_tags(Builder *b, int32_t argc, const Janet *argv) {
     spec_onerule(b, argc, argv, RULE_ONLY_TAGS);
 }
@@ -1418,6 +1703,7 @@ static const SpecialPair peg_specials[] = {
     {"lenprefix", spec_lenprefix},
     {"line", spec_line},
     {"look", spec_look},
+    {"memo", spec_memo},
     {"not", spec_not},
     {"nth", spec_nth},
     {"number", spec_capture_number},
@@ -1600,82 +1886,1333 @@ static uint32_t peg_compile1(Builder *b, Janet peg) {
 }
 
 /*
- * Post-Compilation
+ * Optimization
  */
 
-static int peg_mark(void *p, size_t size) {
-    (void) size;
-    JanetPeg *peg = (JanetPeg *)p;
-    if (NULL != peg->constants)
-        for (uint32_t i = 0; i < peg->num_constants; i++)
-            janet_mark(peg->constants[i]);
-    return 0;
+/* After compilation, the bytecode is rewritten into a faster equivalent:
+ *
+ * - Choices are turned into jump tables on the next byte of input, so only
+ *   the alternatives that can match a given byte are tried.
+ * - Nested sequences and choices are flattened, adjacent literals in a
+ *   sequence are merged, and rules that match exactly one byte from a set
+ *   are turned into sets.
+ * - Repetitions of a set become span loops, which are scanned with memchr or
+ *   several bytes at a time when the set leaves out only a few bytes.
+ * - Choices and repetitions whose alternatives cannot capture skip saving
+ *   and restoring the capture stack.
+ *
+ * The rewrite copies every rule reachable from the main rule into new
+ * bytecode, so rules can change size. It relies on a conservative analysis
+ * of each rule of the original bytecode. */
+
+typedef struct {
+    uint32_t first[8]; /* Bytes that can start a non-empty match */
+    uint8_t state; /* 0 - not analyzed, 1 - in progress, 2 - done */
+    uint8_t nullable; /* Can match without consuming a byte in first */
+    uint8_t effects; /* Can have side effects before failing */
+    uint8_t captures; /* Can change the capture stacks */
+} PegRuleInfo;
+
+typedef struct {
+    const uint32_t *old;
+    PegRuleInfo *info;
+    int32_t *map; /* Old rule index to new rule index, or -1 */
+    uint32_t *code;
+} PegOptimizer;
+
+#define PEG_FLATTEN_DEPTH 8
+
+/* Get the size of a rule in words, and the range of words that hold
+ * references to other rules. */
+static uint32_t peg_rule_shape(const uint32_t *rule, uint32_t *refs, uint32_t *nrefs) {
+    *refs = 0;
+    *nrefs = 0;
+    switch (rule[0]) {
+        default:
+            janet_panic("unexpected opcode");
+        case RULE_LITERAL:
+            return 2 + ((rule[1] + 3) >> 2);
+        case RULE_DEBUG:
+            return 1;
+        case RULE_NCHAR:
+        case RULE_NOTNCHAR:
+        case RULE_RANGE:
+        case RULE_POSITION:
+        case RULE_LINE:
+        case RULE_COLUMN:
+        case RULE_BACKMATCH:
+            return 2;
+        case RULE_ARGUMENT:
+        case RULE_GETTAG:
+        case RULE_CONSTANT:
+        case RULE_READINT:
+            return 3;
+        case RULE_SET:
+            return 9;
+        case RULE_SPAN:
+            return 13;
+        case RULE_LOOK:
+            *refs = 2;
+            *nrefs = 1;
+            return 3;
+        case RULE_CHOICE:
+        case RULE_CHOICE_NOCAP:
+        case RULE_SEQUENCE:
+            *refs = 2;
+            *nrefs = rule[1];
+            return 2 + rule[1];
+        case RULE_DISPATCH:
+            *refs = 2;
+            *nrefs = rule[1];
+            return 2 + rule[1] + 65;
+        case RULE_IF:
+        case RULE_IFNOT:
+        case RULE_LENPREFIX:
+        case RULE_SUB:
+        case RULE_TIL:
+        case RULE_SPLIT:
+            *refs = 1;
+            *nrefs = 2;
+            return 3;
+        case RULE_BETWEEN:
+        case RULE_BETWEEN_NOCAP:
+            *refs = 3;
+            *nrefs = 1;
+            return 4;
+        case RULE_CAPTURE_NUM:
+        case RULE_REPLACE:
+        case RULE_MATCHTIME:
+        case RULE_MATCHSPLICE:
+            *refs = 1;
+            *nrefs = 1;
+            return 4;
+        case RULE_ACCUMULATE:
+        case RULE_GROUP:
+        case RULE_CAPTURE:
+        case RULE_UNREF:
+            *refs = 1;
+            *nrefs = 1;
+            return 3;
+        case RULE_ERROR:
+        case RULE_DROP:
+        case RULE_ONLY_TAGS:
+        case RULE_NOT:
+        case RULE_TO:
+        case RULE_THRU:
+        case RULE_MEMO:
+            *refs = 1;
+            *nrefs = 1;
+            return 2;
+        case RULE_NTH:
+            *refs = 2;
+            *nrefs = 1;
+            return 4;
+    }
 }
 
-static void peg_marshal(void *p, JanetMarshalContext *ctx) {
-    JanetPeg *peg = (JanetPeg *)p;
-    janet_marshal_size(ctx, peg->bytecode_len);
-    janet_marshal_int(ctx, (int32_t)peg->num_constants);
-    janet_marshal_abstract(ctx, p);
-    for (size_t i = 0; i < peg->bytecode_len; i++)
-        janet_marshal_int(ctx, (int32_t) peg->bytecode[i]);
-    for (uint32_t j = 0; j < peg->num_constants; j++)
-        janet_marshal_janet(ctx, peg->constants[j]);
+static const PegRuleInfo *popt_info(PegOptimizer *o, uint32_t index) {
+    PegRuleInfo *info = o->info + index;
+    if (info->state == 2) return info;
+    if (info->state == 1) {
+        /* Recursive rule - assume the worst until it is analyzed */
+        static const PegRuleInfo top = {
+            {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+            1, 1, 1, 1
+        };
+        return &top;
+    }
+    info->state = 1;
+    PegRuleInfo r;
+    memset(&r, 0, sizeof(r));
+    const uint32_t *rule = o->old + index;
+    uint32_t refs, nrefs;
+    peg_rule_shape(rule, &refs, &nrefs);
+    /* Effects and captures of subrules carry over to every rule */
+    for (uint32_t i = 0; i < nrefs; i++) {
+        const PegRuleInfo *sub = popt_info(o, rule[refs + i]);
+        r.effects |= sub->effects;
+        r.captures |= sub->captures;
+    }
+    switch (rule[0]) {
+        default:
+            /* Unknown rules can match anything */
+            memset(r.first, 0xFF, sizeof(r.first));
+            r.nullable = 1;
+            r.captures = 1;
+            break;
+        case RULE_LITERAL:
+            if (rule[1]) {
+                bitmap_set(r.first, ((const uint8_t *)(rule + 2))[0]);
+            } else {
+                r.nullable = 1;
+            }
+            break;
+        case RULE_NCHAR:
+            if (rule[1]) {
+                memset(r.first, 0xFF, sizeof(r.first));
+            } else {
+                r.nullable = 1;
+            }
+            break;
+        case RULE_RANGE:
+            for (uint32_t c = rule[1] & 0xFF; c <= ((rule[1] >> 16) & 0xFF); c++) {
+                bitmap_set(r.first, (uint8_t) c);
+            }
+            break;
+        case RULE_SET:
+            memcpy(r.first, rule + 1, sizeof(r.first));
+            break;
+        case RULE_NOTNCHAR:
+        case RULE_LOOK:
+        case RULE_NOT:
+            r.nullable = 1;
+            break;
+        case RULE_POSITION:
+        case RULE_LINE:
+        case RULE_COLUMN:
+        case RULE_ARGUMENT:
+        case RULE_CONSTANT:
+        case RULE_GETTAG:
+            r.nullable = 1;
+            r.captures = 1;
+            break;
+        case RULE_READINT:
+            memset(r.first, 0xFF, sizeof(r.first));
+            r.captures = 1;
+            break;
+        case RULE_DEBUG:
+            r.nullable = 1;
+            r.effects = 1;
+            break;
+        case RULE_CHOICE:
+            for (uint32_t i = 0; i < nrefs; i++) {
+                const PegRuleInfo *sub = popt_info(o, rule[refs + i]);
+                for (int j = 0; j < 8; j++) r.first[j] |= sub->first[j];
+                r.nullable |= sub->nullable;
+            }
+            break;
+        case RULE_SEQUENCE:
+            r.nullable = 1;
+            for (uint32_t i = 0; i < nrefs && r.nullable; i++) {
+                const PegRuleInfo *sub = popt_info(o, rule[refs + i]);
+                for (int j = 0; j < 8; j++) r.first[j] |= sub->first[j];
+                r.nullable = sub->nullable;
+            }
+            break;
+        case RULE_IF: {
+            /* Both rules must match at the same position */
+            const PegRuleInfo *a = popt_info(o, rule[1]);
+            const PegRuleInfo *b = popt_info(o, rule[2]);
+            for (int j = 0; j < 8; j++) {
+                r.first[j] = (a->nullable ? 0xFFFFFFFF : a->first[j]) &
+                             (b->nullable ? 0xFFFFFFFF : b->first[j]);
+            }
+            r.nullable = a->nullable && b->nullable;
+            break;
+        }
+        case RULE_IFNOT: {
+            const PegRuleInfo *b = popt_info(o, rule[2]);
+            memcpy(r.first, b->first, sizeof(r.first));
+            r.nullable = b->nullable;
+            break;
+        }
+        case RULE_BETWEEN: {
+            const PegRuleInfo *sub = popt_info(o, rule[3]);
+            memcpy(r.first, sub->first, sizeof(r.first));
+            r.nullable = sub->nullable || rule[1] == 0;
+            break;
+        }
+        case RULE_REPLACE:
+        case RULE_MATCHTIME:
+        case RULE_MATCHSPLICE:
+        case RULE_ERROR:
+            r.effects = 1;
+        /* fallthrough */
+        case RULE_CAPTURE:
+        case RULE_CAPTURE_NUM:
+        case RULE_ACCUMULATE:
+        case RULE_GROUP:
+        case RULE_NTH:
+        case RULE_UNREF:
+        case RULE_DROP:
+        case RULE_ONLY_TAGS: {
+            const PegRuleInfo *sub = popt_info(o, rule[refs]);
+            memcpy(r.first, sub->first, sizeof(r.first));
+            r.nullable = sub->nullable;
+            r.captures = 1;
+            break;
+        }
+        case RULE_MEMO: {
+            const PegRuleInfo *sub = popt_info(o, rule[1]);
+            memcpy(r.first, sub->first, sizeof(r.first));
+            r.nullable = sub->nullable;
+            break;
+        }
+    }
+    r.state = 2;
+    o->info[index] = r;
+    return o->info + index;
 }
 
-/* Used to ensure that if we place several arrays in one memory chunk, each
- * array will be correctly aligned */
-static size_t size_padded(size_t offset, size_t size) {
-    size_t x = size + offset - 1;
-    return x - (x % size);
+/* Check if a rule matches exactly one byte from a set, with no captures.
+ * If so, get the set as a bitmap. */
+static int popt_class(PegOptimizer *o, uint32_t index, uint32_t *bitmap, int depth) {
+    const uint32_t *rule = o->old + index;
+    if (depth > PEG_FLATTEN_DEPTH) return 0;
+    memset(bitmap, 0, 8 * sizeof(uint32_t));
+    switch (rule[0]) {
+        default:
+            return 0;
+        case RULE_LITERAL:
+            if (rule[1] != 1) return 0;
+            bitmap_set(bitmap, ((const uint8_t *)(rule + 2))[0]);
+            return 1;
+        case RULE_NCHAR:
+            if (rule[1] != 1) return 0;
+            memset(bitmap, 0xFF, 8 * sizeof(uint32_t));
+            return 1;
+        case RULE_RANGE:
+        case RULE_SET:
+            memcpy(bitmap, popt_info(o, index)->first, 8 * sizeof(uint32_t));
+            return 1;
+        case RULE_SEQUENCE:
+            return rule[1] == 1 && popt_class(o, rule[2], bitmap, depth + 1);
+        case RULE_CHOICE: {
+            uint32_t sub[8];
+            if (rule[1] == 0) return 0;
+            for (uint32_t i = 0; i < rule[1]; i++) {
+                if (!popt_class(o, rule[2 + i], sub, depth + 1)) return 0;
+                for (int j = 0; j < 8; j++) bitmap[j] |= sub[j];
+            }
+            return 1;
+        }
+        case RULE_IFNOT: {
+            uint32_t not[8];
+            if (!popt_class(o, rule[1], not, depth + 1)) return 0;
+            if (!popt_class(o, rule[2], bitmap, depth + 1)) return 0;
+            for (int j = 0; j < 8; j++) bitmap[j] &= ~not[j];
+            return 1;
+        }
+    }
 }
 
-#define OVERFLOW_CHECK(n) do { if (i > blen - (n)) goto bad; } while (0) /* overflow */
+static uint32_t popt_reserve(PegOptimizer *o, uint32_t size) {
+    uint32_t index = janet_v_count(o->code);
+    janet_v__maybegrow(o->code, (int32_t) size);
+    memset(o->code + index, 0, size * sizeof(uint32_t));
+    janet_v__cnt(o->code) += (int32_t) size;
+    return index;
+}
 
-static void *peg_unmarshal(JanetMarshalContext *ctx) {
-    size_t bytecode_len = janet_unmarshal_size(ctx);
-    uint32_t num_constants = (uint32_t) janet_unmarshal_int(ctx);
+static uint32_t popt_emit_set(PegOptimizer *o, const uint32_t *bitmap) {
+    uint32_t index = popt_reserve(o, 9);
+    o->code[index] = RULE_SET;
+    memcpy(o->code + index + 1, bitmap, 8 * sizeof(uint32_t));
+    return index;
+}
 
-    /* Calculate offsets. Should match those in make_peg */
-    size_t bytecode_start = size_padded(sizeof(JanetPeg), sizeof(uint32_t));
-    size_t bytecode_size = bytecode_len * sizeof(uint32_t);
-    size_t constants_start = size_padded(bytecode_start + bytecode_size, sizeof(Janet));
-    size_t total_size = constants_start + sizeof(Janet) * (size_t) num_constants;
+static uint32_t popt_emit_literal(PegOptimizer *o, const uint8_t *bytes, uint32_t len) {
+    uint32_t index = popt_reserve(o, 2 + ((len + 3) >> 2));
+    o->code[index] = RULE_LITERAL;
+    o->code[index + 1] = len;
+    memcpy(o->code + index + 2, bytes, len);
+    return index;
+}
 
-    /* DOS prevention? I.E. we could read bytecode and constants before
-     * hand so we don't allocated a ton of memory on bad, short input */
+/* Collect the subrules of a sequence or choice, splicing in nested rules
+ * of the same kind. Recursive rules are not spliced into themselves. */
+static void popt_flatten(PegOptimizer *o, uint32_t *path, int depth, uint32_t **list) {
+    const uint32_t *rule = o->old + path[depth];
+    for (uint32_t i = 0; i < rule[1]; i++) {
+        uint32_t sub = rule[2 + i];
+        int splice = o->old[sub] == rule[0] && depth + 1 < PEG_FLATTEN_DEPTH;
+        for (int j = 0; splice && j <= depth; j++) {
+            if (path[j] == sub) splice = 0;
+        }
+        if (splice) {
+            path[depth + 1] = sub;
+            popt_flatten(o, path, depth + 1, list);
+        } else {
+            janet_v_push(*list, sub);
+        }
+    }
+}
 
-    /* Allocate PEG */
-    char *mem = janet_unmarshal_abstract(ctx, total_size);
-    JanetPeg *peg = (JanetPeg *)mem;
-    uint32_t *bytecode = (uint32_t *)(mem + bytecode_start);
-    Janet *constants = (Janet *)(mem + constants_start);
-    peg->bytecode = NULL;
-    peg->constants = NULL;
-    peg->bytecode_len = bytecode_len;
-    peg->num_constants = num_constants;
+static uint32_t popt_emit(PegOptimizer *o, uint32_t index);
 
-    for (size_t i = 0; i < peg->bytecode_len; i++)
-        bytecode[i] = (uint32_t) janet_unmarshal_int(ctx);
-    for (uint32_t j = 0; j < peg->num_constants; j++)
-        constants[j] = janet_unmarshal_janet(ctx);
+static uint32_t popt_emit_choice_of(PegOptimizer *o, const uint32_t *alts, uint32_t n) {
+    uint32_t op = RULE_CHOICE_NOCAP;
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        if (popt_info(o, alts[i])->captures) op = RULE_CHOICE;
+    }
+    uint32_t index = popt_reserve(o, 2 + n);
+    o->code[index] = op;
+    o->code[index + 1] = n;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t sub = popt_emit(o, alts[i]);
+        o->code[index + 2 + i] = sub;
+    }
+    return index;
+}
 
-    /* After here, no panics except for the bad: label. */
+/* Write a choice as a jump table on the next byte, where each entry is the
+ * choice of the alternatives that can match that byte. Returns 0 if that
+ * would not rule out any alternatives. */
+static int popt_dispatch(PegOptimizer *o, uint32_t index, const uint32_t *alts, uint32_t n) {
+    uint64_t masks[257];
+    uint64_t targets[255];
+    uint8_t table[260];
+    uint64_t always = 0;
+    uint64_t all = (n == 64) ? UINT64_MAX : (((uint64_t) 1 << n) - 1);
+    uint32_t ntargets = 0;
+    int useful = 0;
+    if (n < 2 || n > 64) return 0;
+    const PegRuleInfo *infos[64];
+    for (uint32_t i = 0; i < n; i++) {
+        infos[i] = popt_info(o, alts[i]);
+        if (infos[i]->nullable || infos[i]->effects) always |= (uint64_t) 1 << i;
+    }
+    for (uint32_t c = 0; c < 257; c++) {
+        uint64_t mask = always;
+        if (c < 256) {
+            for (uint32_t i = 0; i < n; i++) {
+                if (infos[i]->first[c >> 5] & ((uint32_t) 1 << (c & 0x1F))) {
+                    mask |= (uint64_t) 1 << i;
+                }
+            }
+        }
+        masks[c] = mask;
+        if (mask != all) useful = 1;
+    }
+    if (!useful) return 0;
+    memset(table, 0, sizeof(table));
+    for (uint32_t c = 0; c < 257; c++) {
+        if (!masks[c]) continue;
+        uint32_t t = 0;
+        while (t < ntargets && targets[t] != masks[c]) t++;
+        if (t == ntargets) {
+            if (ntargets == 255) return 0;
+            targets[ntargets++] = masks[c];
+        }
+        table[c] = (uint8_t)(t + 1);
+    }
+    o->map[index] = (int32_t) popt_reserve(o, 2 + ntargets + 65);
+    uint32_t at = (uint32_t) o->map[index];
+    o->code[at] = RULE_DISPATCH;
+    o->code[at + 1] = ntargets;
+    memcpy(o->code + at + 2 + ntargets, table, sizeof(table));
+    for (uint32_t t = 0; t < ntargets; t++) {
+        uint32_t subset[64];
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (targets[t] & ((uint64_t) 1 << i)) subset[k++] = alts[i];
+        }
+        uint32_t sub = (k == 1) ? popt_emit(o, subset[0]) : popt_emit_choice_of(o, subset, k);
+        o->code[at + 2 + t] = sub;
+    }
+    return 1;
+}
 
-    /* Keep track at each index if an instruction was
-     * referenced (0x01) or is in a main bytecode position
-     * (0x02). This lets us do a linear scan and not
-     * need to a depth first traversal. It is stricter
-     * than a dfs by not allowing certain kinds of unused
-     * bytecode. */
-    uint32_t blen = (int32_t) peg->bytecode_len;
-    uint32_t clen = peg->num_constants;
-    uint8_t *op_flags = janet_calloc(1, blen);
-    if (NULL == op_flags) {
-        JANET_OUT_OF_MEMORY;
+static uint32_t popt_emit_sequence(PegOptimizer *o, uint32_t index) {
+    uint32_t *list = NULL;
+    uint32_t *items = NULL; /* Old rule index, or UINT32_MAX for a merged literal */
+    uint8_t *bytes = NULL;
+    uint32_t *lens = NULL;
+    uint32_t path[PEG_FLATTEN_DEPTH] = {index};
+    popt_flatten(o, path, 0, &list);
+    for (int32_t i = 0; i < janet_v_count(list); i++) {
+        const uint32_t *sub = o->old + list[i];
+        if (sub[0] != RULE_LITERAL) {
+            janet_v_push(items, list[i]);
+            continue;
+        }
+        if (sub[1] == 0) continue;
+        if (janet_v_count(items) && janet_v_last(items) == UINT32_MAX) {
+            janet_v_last(lens) += sub[1];
+        } else {
+            janet_v_push(items, UINT32_MAX);
+            janet_v_push(lens, sub[1]);
+        }
+        for (uint32_t j = 0; j < sub[1]; j++) {
+            janet_v_push(bytes, ((const uint8_t *)(sub + 2))[j]);
+        }
+    }
+    uint32_t n = janet_v_count(items);
+    uint32_t result;
+    if (n == 1 && items[0] == UINT32_MAX) {
+        result = popt_emit_literal(o, bytes, lens[0]);
+        o->map[index] = (int32_t) result;
+    } else {
+        result = popt_reserve(o, 2 + n);
+        o->map[index] = (int32_t) result;
+        o->code[result] = RULE_SEQUENCE;
+        o->code[result + 1] = n;
+        uint32_t nlit = 0, offset = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t sub;
+            if (items[i] == UINT32_MAX) {
+                sub = popt_emit_literal(o, bytes + offset, lens[nlit]);
+                offset += lens[nlit++];
+            } else {
+                sub = popt_emit(o, items[i]);
+            }
+            o->code[result + 2 + i] = sub;
+        }
     }
+    janet_v_free(list);
+    janet_v_free(items);
+    janet_v_free(bytes);
+    janet_v_free(lens);
+    return result;
+}
 
-    /* verify peg bytecode */
+static uint32_t popt_emit(PegOptimizer *o, uint32_t index) {
+    if (o->map[index] >= 0) return (uint32_t) o->map[index];
+    const uint32_t *rule = o->old + index;
+    uint32_t bitmap[8];
+    switch (rule[0]) {
+        default:
+            break;
+        case RULE_SEQUENCE:
+        case RULE_CHOICE:
+        case RULE_IFNOT:
+            if (popt_class(o, index, bitmap, 0)) {
+                o->map[index] = (int32_t) popt_emit_set(o, bitmap);
+                return (uint32_t) o->map[index];
+            }
+            break;
+    }
+    switch (rule[0]) {
+        default: {
+            uint32_t refs, nrefs;
+            uint32_t size = peg_rule_shape(rule, &refs, &nrefs);
+            uint32_t result = popt_reserve(o, size);
+            o->map[index] = (int32_t) result;
+            memcpy(o->code + result, rule, size * sizeof(uint32_t));
+            for (uint32_t i = 0; i < nrefs; i++) {
+                uint32_t sub = popt_emit(o, rule[refs + i]);
+                o->code[result + refs + i] = sub;
+            }
+            return result;
+        }
+        case RULE_SEQUENCE:
+            return popt_emit_sequence(o, index);
+        case RULE_CHOICE: {
+            uint32_t *alts = NULL;
+            uint32_t path[PEG_FLATTEN_DEPTH] = {index};
+            popt_flatten(o, path, 0, &alts);
+            uint32_t n = janet_v_count(alts);
+            if (!popt_dispatch(o, index, alts, n)) {
+                /* Reserve before emitting alternatives, as they may refer back to this rule */
+                uint32_t op = RULE_CHOICE_NOCAP;
+                for (uint32_t i = 0; i + 1 < n; i++) {
+                    if (popt_info(o, alts[i])->captures) op = RULE_CHOICE;
+                }
+                uint32_t result = popt_reserve(o, 2 + n);
+                o->map[index] = (int32_t) result;
+                o->code[result] = op;
+                o->code[result + 1] = n;
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t sub = popt_emit(o, alts[i]);
+                    o->code[result + 2 + i] = sub;
+                }
+            }
+            janet_v_free(alts);
+            return (uint32_t) o->map[index];
+        }
+        case RULE_BETWEEN: {
+            uint32_t result;
+            if (popt_class(o, rule[3], bitmap, 0)) {
+                uint32_t nstops = 0, stops = 0;
+                for (uint32_t c = 0; c < 256 && nstops <= 4; c++) {
+                    if (bitmap[c >> 5] == 0xFFFFFFFF) {
+                        c |= 0x1F;
+                    } else if (!(bitmap[c >> 5] & ((uint32_t) 1 << (c & 0x1F)))) {
+                        if (nstops < 4) stops |= c << (8 * nstops);
+                        nstops++;
+                    }
+                }
+                result = popt_reserve(o, 13);
+                o->map[index] = (int32_t) result;
+                o->code[result] = RULE_SPAN;
+                o->code[result + 1] = rule[1];
+                o->code[result + 2] = rule[2];
+                memcpy(o->code + result + 3, bitmap, sizeof(bitmap));
+                o->code[result + 11] = nstops > 4 ? 0xFF : nstops;
+                o->code[result + 12] = stops;
+            } else {
+                result = popt_reserve(o, 4);
+                o->map[index] = (int32_t) result;
+                o->code[result] = popt_info(o, rule[3])->captures ? RULE_BETWEEN : RULE_BETWEEN_NOCAP;
+                o->code[result + 1] = rule[1];
+                o->code[result + 2] = rule[2];
+                uint32_t sub = popt_emit(o, rule[3]);
+                o->code[result + 3] = sub;
+            }
+            return result;
+        }
+    }
+}
+
+/* Replace the bytecode of a builder with optimized bytecode */
+static void peg_optimize(Builder *b) {
+    uint32_t len = janet_v_count(b->bytecode);
+    if (len == 0) return;
+    PegOptimizer o;
+    o.old = b->bytecode;
+    o.code = NULL;
+    o.info = janet_calloc(len, sizeof(PegRuleInfo));
+    o.map = janet_malloc(len * sizeof(int32_t));
+    if (NULL == o.info || NULL == o.map) {
+        JANET_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < len; i++) o.map[i] = -1;
+    janet_v__maybegrow(o.code, (int32_t) len);
+    popt_emit(&o, 0);
+    janet_free(o.info);
+    janet_free(o.map);
+    janet_v_free(b->bytecode);
+    b->bytecode = o.code;
+}
+
+/*
+ * Native Code
+ */
+
+/* On x86-64 with the System V calling convention, (peg/compile peg :native)
+ * also translates the compiled bytecode to machine code. Every rule that is
+ * reachable from the main rule through rules the backend understands becomes
+ * a small function. Inside generated code, the input text is passed and
+ * returned in rax (NULL for no match), rbx holds the PegState and r12 holds
+ * the end of input. Captures and capture stack saves go through C helpers,
+ * and all other rules are run by the interpreter, so the interpreter never
+ * calls back into native code. */
+
+#if defined(JANET_FFI_JIT) && (defined(__x86_64__) || defined(_M_X64)) && !defined(JANET_WINDOWS)
+#define JANET_PEG_JIT
+#endif
+
+#ifdef JANET_PEG_JIT
+
+typedef const uint8_t *(*PegNativeFn)(PegState *s, const uint8_t *text, const uint8_t *text_end);
+
+/* A call, jump or jump table entry that refers to the function for a rule */
+typedef struct {
+    int32_t at;
+    int32_t base;
+    uint32_t rule;
+} PegJitFixup;
+
+typedef struct {
+    uint8_t *code;
+    PegJitFixup *fixups;
+    uint32_t *pending;
+    int32_t *funcs; /* Position of the function for each rule, or -1 */
+    const uint32_t *bytecode;
+    int32_t fail; /* Returns NULL */
+    int32_t overflow; /* Raises a recursion error */
+} PegJit;
+
+static void peg_native_overflow(PegState *s) {
+    peg_overflow(s);
+}
+
+static void peg_native_save(PegState *s, CapState *cs) {
+    *cs = cap_save(s);
+}
+
+static void peg_native_load(PegState *s, CapState *cs) {
+    cap_load(s, *cs);
+}
+
+static const uint8_t *peg_native_capture(PegState *s, const uint8_t *text,
+        const uint8_t *result, uint32_t tag) {
+    if (!s->has_backref && s->mode == PEG_MODE_ACCUMULATE) {
+        janet_buffer_push_bytes(s->scratch, text, (int32_t)(result - text));
+    } else {
+        pushcap(s, janet_stringv(text, (int32_t)(result - text)), tag);
+    }
+    return result;
+}
+
+/* Emitting code */
+
+#define PJ_JB 0x82
+#define PJ_JAE 0x83
+#define PJ_JE 0x84
+#define PJ_JNE 0x85
+#define PJ_JA 0x87
+
+static int32_t pj_pos(PegJit *j) {
+    return janet_v_count(j->code);
+}
+
+static void pj_bytes(PegJit *j, const char *bytes, int32_t n) {
+    for (int32_t i = 0; i < n; i++) janet_v_push(j->code, (uint8_t) bytes[i]);
+}
+
+static void pj_u8(PegJit *j, uint32_t x) {
+    janet_v_push(j->code, (uint8_t) x);
+}
+
+static void pj_u32(PegJit *j, uint32_t x) {
+    for (int i = 0; i < 4; i++) janet_v_push(j->code, (uint8_t)(x >> (8 * i)));
+}
+
+static void pj_u64(PegJit *j, uint64_t x) {
+    for (int i = 0; i < 8; i++) janet_v_push(j->code, (uint8_t)(x >> (8 * i)));
+}
+
+static void pj_patch(PegJit *j, int32_t at, int32_t value) {
+    for (int i = 0; i < 4; i++) j->code[at + i] = (uint8_t)((uint32_t) value >> (8 * i));
+}
+
+/* Make the 32 bit relative offset at `at` point to the current position */
+static void pj_bind(PegJit *j, int32_t at) {
+    pj_patch(j, at, pj_pos(j) - (at + 4));
+}
+
+/* Conditional jump to target, or to a label bound later if target is -1.
+ * Returns the position of the offset. */
+static int32_t pj_jcc(PegJit *j, uint8_t cc, int32_t target) {
+    pj_u8(j, 0x0F);
+    pj_u8(j, cc);
+    int32_t at = pj_pos(j);
+    pj_u32(j, (uint32_t)(target < 0 ? 0 : target - (at + 4)));
+    return at;
+}
+
+static int32_t pj_jmp(PegJit *j, int32_t target) {
+    pj_u8(j, 0xE9);
+    int32_t at = pj_pos(j);
+    pj_u32(j, (uint32_t)(target < 0 ? 0 : target - (at + 4)));
+    return at;
+}
+
+static void pj_fixup(PegJit *j, int32_t at, int32_t base, uint32_t rule) {
+    PegJitFixup f;
+    f.at = at;
+    f.base = base;
+    f.rule = rule;
+    janet_v_push(j->fixups, f);
+    if (j->funcs[rule] == -1) {
+        j->funcs[rule] = -2;
+        janet_v_push(j->pending, rule);
+    }
+}
+
+/* Call (0xE8) or jump to (0xE9) the function for a rule */
+static void pj_rule(PegJit *j, uint8_t op, uint32_t rule) {
+    pj_u8(j, op);
+    int32_t at = pj_pos(j);
+    pj_u32(j, 0);
+    pj_fixup(j, at, at + 4, rule);
+}
+
+/* Call a C function with the PegState as the first argument */
+static void pj_call_c(PegJit *j, void *fn) {
+    pj_bytes(j, "\x48\x89\xDF", 3); /* mov rdi, rbx */
+    pj_bytes(j, "\x49\xBB", 2); /* mov r11, fn */
+    pj_u64(j, (uint64_t)(uintptr_t) fn);
+    pj_bytes(j, "\x41\xFF\xD3", 3); /* call r11 */
+}
+
+/* Save or load the CapState in the stack frame at offset */
+static void pj_capstate(PegJit *j, void *fn, uint8_t offset) {
+    pj_bytes(j, "\x48\x8D\x74\x24", 4); /* lea rsi, [rsp + offset] */
+    pj_u8(j, offset);
+    pj_call_c(j, fn);
+}
+
+/* Set up a stack frame of n bytes, with n = 8 mod 16 to keep calls aligned,
+ * and go down one level of recursion */
+static void pj_enter(PegJit *j, uint8_t n) {
+    pj_bytes(j, "\x48\x83\xEC", 3); /* sub rsp, n */
+    pj_u8(j, n);
+    pj_bytes(j, "\xFF\x8B", 2); /* dec dword [rbx + depth] */
+    pj_u32(j, (uint32_t) offsetof(PegState, depth));
+    pj_jcc(j, PJ_JE, j->overflow);
+}
+
+static void pj_exit(PegJit *j, uint8_t n) {
+    pj_bytes(j, "\xFF\x83", 2); /* inc dword [rbx + depth] */
+    pj_u32(j, (uint32_t) offsetof(PegState, depth));
+    pj_bytes(j, "\x48\x83\xC4", 3); /* add rsp, n */
+    pj_u8(j, n);
+}
+
+static void pj_save_text(PegJit *j) {
+    pj_bytes(j, "\x48\x89\x04\x24", 4); /* mov [rsp], rax */
+}
+
+static void pj_load_text(PegJit *j) {
+    pj_bytes(j, "\x48\x8B\x04\x24", 4); /* mov rax, [rsp] */
+}
+
+static void pj_test(PegJit *j) {
+    pj_bytes(j, "\x48\x85\xC0", 3); /* test rax, rax */
+}
+
+static void pj_ret(PegJit *j) {
+    pj_u8(j, 0xC3);
+}
+
+static void pj_ret_null(PegJit *j) {
+    pj_bytes(j, "\x31\xC0\xC3", 3); /* xor eax, eax; ret */
+}
+
+static void pj_add_text(PegJit *j, uint32_t n) {
+    pj_bytes(j, "\x48\x05", 2); /* add rax, n */
+    pj_u32(j, n);
+}
+
+/* Compare the number of bytes left with n */
+static void pj_cmp_left(PegJit *j, uint32_t n) {
+    pj_bytes(j, "\x4C\x89\xE2", 3); /* mov rdx, r12 */
+    pj_bytes(j, "\x48\x29\xC2", 3); /* sub rdx, rax */
+    pj_bytes(j, "\x48\x81\xFA", 3); /* cmp rdx, n */
+    pj_u32(j, n);
+}
+
+static void pj_cmp_end(PegJit *j) {
+    pj_bytes(j, "\x4C\x39\xE0", 3); /* cmp rax, r12 */
+}
+
+/* Load the address of data placed after the function into a register
+ * (0x05 for rax, 0x15 for rdx, 0x0D with REX.R for r9). Returns the position
+ * of the offset to bind. */
+static int32_t pj_lea_data(PegJit *j, const char *prefix) {
+    pj_bytes(j, prefix, 3);
+    int32_t at = pj_pos(j);
+    pj_u32(j, 0);
+    return at;
+}
+
+/* Set the carry flag if the byte in ecx is in the bitmap at r9 */
+static void pj_bitmap_test(PegJit *j) {
+    pj_bytes(j, "\x41\x89\xC8", 3); /* mov r8d, ecx */
+    pj_bytes(j, "\x41\xC1\xE8\x05", 4); /* shr r8d, 5 */
+    pj_bytes(j, "\x47\x8B\x04\x81", 4); /* mov r8d, [r9 + r8 * 4] */
+    pj_bytes(j, "\x41\x0F\xA3\xC8", 4); /* bt r8d, ecx */
+}
+
+static void pj_load_byte(PegJit *j) {
+    pj_bytes(j, "\x0F\xB6\x08", 3); /* movzx ecx, byte [rax] */
+}
+
+static void pj_data_bitmap(PegJit *j, int32_t at, const uint32_t *bitmap) {
+    pj_bind(j, at);
+    for (int i = 0; i < 8; i++) pj_u32(j, bitmap[i]);
+}
+
+/* Emit the function for one rule */
+static void pj_emit_rule(PegJit *j, uint32_t index) {
+    const uint32_t *rule = j->bytecode + index;
+    j->funcs[index] = pj_pos(j);
+    switch (rule[0]) {
+        default:
+            break;
+
+        case RULE_LITERAL: {
+            uint32_t len = rule[1];
+            const uint8_t *lit = (const uint8_t *)(rule + 2);
+            if (len > 64) break;
+            if (len) {
+                pj_cmp_left(j, len);
+                pj_jcc(j, PJ_JB, j->fail);
+            }
+            for (uint32_t i = 0; i < len;) {
+                if (len - i >= 8) {
+                    uint64_t x;
+                    memcpy(&x, lit + i, 8);
+                    pj_bytes(j, "\x48\xB9", 2); /* mov rcx, x */
+                    pj_u64(j, x);
+                    pj_bytes(j, "\x48\x39\x88", 3); /* cmp [rax + i], rcx */
+                    pj_u32(j, i);
+                    i += 8;
+                } else if (len - i >= 4) {
+                    uint32_t x;
+                    memcpy(&x, lit + i, 4);
+                    pj_bytes(j, "\x81\xB8", 2); /* cmp dword [rax + i], x */
+                    pj_u32(j, i);
+                    pj_u32(j, x);
+                    i += 4;
+                } else if (len - i >= 2) {
+                    pj_bytes(j, "\x66\x81\xB8", 3); /* cmp word [rax + i], x */
+                    pj_u32(j, i);
+                    pj_u8(j, lit[i]);
+                    pj_u8(j, lit[i + 1]);
+                    i += 2;
+                } else {
+                    pj_bytes(j, "\x80\xB8", 2); /* cmp byte [rax + i], x */
+                    pj_u32(j, i);
+                    pj_u8(j, lit[i]);
+                    i += 1;
+                }
+                pj_jcc(j, PJ_JNE, j->fail);
+            }
+            if (len) pj_add_text(j, len);
+            pj_ret(j);
+            return;
+        }
+
+        case RULE_NCHAR:
+            if (rule[1] > INT32_MAX) break;
+            pj_cmp_left(j, rule[1]);
+            pj_jcc(j, PJ_JB, j->fail);
+            pj_add_text(j, rule[1]);
+            pj_ret(j);
+            return;
+
+        case RULE_NOTNCHAR:
+            if (rule[1] > INT32_MAX) break;
+            pj_cmp_left(j, rule[1]);
+            pj_jcc(j, PJ_JAE, j->fail);
+            pj_ret(j);
+            return;
+
+        case RULE_RANGE: {
+            uint32_t lo = rule[1] & 0xFF;
+            uint32_t hi = (rule[1] >> 16) & 0xFF;
+            if (hi < lo) {
+                pj_ret_null(j);
+                return;
+            }
+            pj_cmp_end(j);
+            pj_jcc(j, PJ_JAE, j->fail);
+            pj_load_byte(j);
+            pj_bytes(j, "\x81\xE9", 2); /* sub ecx, lo */
+            pj_u32(j, lo);
+            pj_bytes(j, "\x81\xF9", 2); /* cmp ecx, hi - lo */
+            pj_u32(j, hi - lo);
+            pj_jcc(j, PJ_JA, j->fail);
+            pj_add_text(j, 1);
+            pj_ret(j);
+            return;
+        }
+
+        case RULE_SET: {
+            pj_cmp_end(j);
+            pj_jcc(j, PJ_JAE, j->fail);
+            pj_load_byte(j);
+            int32_t bitmap = pj_lea_data(j, "\x4C\x8D\x0D");
+            pj_bitmap_test(j);
+            pj_jcc(j, PJ_JAE, j->fail);
+            pj_add_text(j, 1);
+            pj_ret(j);
+            pj_data_bitmap(j, bitmap, rule + 1);
+            return;
+        }
+
+        case RULE_SPAN: {
+            uint32_t lo = rule[1];
+            uint32_t hi = rule[2];
+            uint32_t nstops = rule[11];
+            int32_t bitmap = -1;
+            if (lo > INT32_MAX) break;
+            pj_bytes(j, "\x48\x89\xC6", 3); /* mov rsi, rax */
+            pj_u8(j, 0xBA); /* mov edx, hi */
+            pj_u32(j, hi);
+            pj_bytes(j, "\x48\x01\xC2", 3); /* add rdx, rax */
+            pj_bytes(j, "\x4C\x39\xE2", 3); /* cmp rdx, r12 */
+            pj_bytes(j, "\x49\x0F\x47\xD4", 4); /* cmova rdx, r12 */
+            if (nstops == 0) {
+                pj_bytes(j, "\x48\x89\xD0", 3); /* mov rax, rdx */
+            } else if (nstops <= 4) {
+                /* Let peg_span search for the stop bytes */
+                pj_u8(j, 0x56); /* push rsi */
+                pj_bytes(j, "\x48\xBF", 2); /* mov rdi, rule */
+                pj_u64(j, (uint64_t)(uintptr_t) rule);
+                pj_bytes(j, "\x49\xBB", 2); /* mov r11, peg_span */
+                pj_u64(j, (uint64_t)(uintptr_t) peg_span);
+                pj_bytes(j, "\x41\xFF\xD3", 3); /* call r11 */
+                pj_u8(j, 0x5E); /* pop rsi */
+            } else {
+                bitmap = pj_lea_data(j, "\x4C\x8D\x0D");
+                int32_t loop = pj_pos(j);
+                pj_bytes(j, "\x48\x39\xD0", 3); /* cmp rax, rdx */
+                int32_t done1 = pj_jcc(j, PJ_JAE, -1);
+                pj_load_byte(j);
+                pj_bitmap_test(j);
+                int32_t done2 = pj_jcc(j, PJ_JAE, -1);
+                pj_add_text(j, 1);
+                pj_jmp(j, loop);
+                pj_bind(j, done1);
+                pj_bind(j, done2);
+            }
+            pj_bytes(j, "\x48\x89\xC1", 3); /* mov rcx, rax */
+            pj_bytes(j, "\x48\x29\xF1", 3); /* sub rcx, rsi */
+            pj_bytes(j, "\x48\x81\xF9", 3); /* cmp rcx, lo */
+            pj_u32(j, lo);
+            pj_jcc(j, PJ_JB, j->fail);
+            pj_ret(j);
+            if (bitmap >= 0) pj_data_bitmap(j, bitmap, rule + 3);
+            return;
+        }
+
+        case RULE_SEQUENCE: {
+            uint32_t len = rule[1];
+            int32_t *fails = NULL;
+            if (len == 0) {
+                pj_ret(j);
+                return;
+            }
+            if (len > 1) pj_enter(j, 8);
+            for (uint32_t i = 0; i + 1 < len; i++) {
+                pj_rule(j, 0xE8, rule[2 + i]);
+                pj_test(j);
+                janet_v_push(fails, pj_jcc(j, PJ_JE, -1));
+            }
+            if (len > 1) pj_exit(j, 8);
+            pj_rule(j, 0xE9, rule[1 + len]);
+            if (len > 1) {
+                for (int32_t i = 0; i < janet_v_count(fails); i++) pj_bind(j, fails[i]);
+                pj_exit(j, 8);
+                pj_ret(j);
+            }
+            janet_v_free(fails);
+            return;
+        }
+
+        case RULE_CHOICE:
+        case RULE_CHOICE_NOCAP: {
+            uint32_t len = rule[1];
+            int caps = rule[0] == RULE_CHOICE;
+            uint8_t frame = caps ? 24 : 8;
+            int32_t *oks = NULL;
+            if (len == 0) {
+                pj_ret_null(j);
+                return;
+            }
+            if (len > 1) {
+                pj_enter(j, frame);
+                pj_save_text(j);
+                if (caps) pj_capstate(j, (void *) peg_native_save, 8);
+            }
+            for (uint32_t i = 0; i + 1 < len; i++) {
+                if (i || caps) pj_load_text(j);
+                pj_rule(j, 0xE8, rule[2 + i]);
+                pj_test(j);
+                janet_v_push(oks, pj_jcc(j, PJ_JNE, -1));
+                if (caps) pj_capstate(j, (void *) peg_native_load, 8);
+            }
+            if (len > 1) {
+                pj_load_text(j);
+                pj_exit(j, frame);
+            }
+            pj_rule(j, 0xE9, rule[1 + len]);
+            if (len > 1) {
+                for (int32_t i = 0; i < janet_v_count(oks); i++) pj_bind(j, oks[i]);
+                pj_exit(j, frame);
+                pj_ret(j);
+            }
+            janet_v_free(oks);
+            return;
+        }
+
+        case RULE_DISPATCH: {
+            uint32_t len = rule[1];
+            const uint8_t *table = (const uint8_t *)(rule + 2 + len);
+            pj_cmp_end(j);
+            int32_t eof = pj_jcc(j, PJ_JAE, -1);
+            pj_load_byte(j);
+            int32_t bytes = pj_lea_data(j, "\x48\x8D\x15"); /* lea rdx, [rip + bytes] */
+            pj_bytes(j, "\x0F\xB6\x0C\x0A", 4); /* movzx ecx, byte [rdx + rcx] */
+            int32_t go = pj_jmp(j, -1);
+            pj_bind(j, eof);
+            pj_u8(j, 0xB9); /* mov ecx, table[256] */
+            pj_u32(j, table[256]);
+            pj_bind(j, go);
+            int32_t jumps = pj_lea_data(j, "\x48\x8D\x15"); /* lea rdx, [rip + jumps] */
+            pj_bytes(j, "\x48\x63\x0C\x8A", 4); /* movsxd rcx, dword [rdx + rcx * 4] */
+            pj_bytes(j, "\x48\x01\xD1", 3); /* add rcx, rdx */
+            pj_bytes(j, "\xFF\xE1", 2); /* jmp rcx */
+            pj_bind(j, jumps);
+            int32_t base = pj_pos(j);
+            pj_u32(j, (uint32_t)(j->fail - base));
+            for (uint32_t i = 0; i < len; i++) {
+                pj_fixup(j, pj_pos(j), base, rule[2 + i]);
+                pj_u32(j, 0);
+            }
+            pj_bind(j, bytes);
+            for (int i = 0; i < 257; i++) pj_u8(j, table[i]);
+            return;
+        }
+
+        case RULE_BETWEEN:
+        case RULE_BETWEEN_NOCAP: {
+            /* Frame: text at 0, count at 8, capture states at 12 and 24 */
+            uint32_t lo = rule[1];
+            uint32_t hi = rule[2];
+            int caps = rule[0] == RULE_BETWEEN;
+            uint8_t frame = caps ? 40 : 24;
+            pj_enter(j, frame);
+            pj_save_text(j);
+            pj_bytes(j, "\xC7\x44\x24\x08", 4); /* mov dword [rsp + 8], 0 */
+            pj_u32(j, 0);
+            if (caps) pj_capstate(j, (void *) peg_native_save, 12);
+            int32_t loop = pj_pos(j);
+            pj_bytes(j, "\x81\x7C\x24\x08", 4); /* cmp dword [rsp + 8], hi */
+            pj_u32(j, hi);
+            int32_t done = pj_jcc(j, PJ_JAE, -1);
+            if (caps) pj_capstate(j, (void *) peg_native_save, 24);
+            pj_load_text(j);
+            pj_rule(j, 0xE8, rule[3]);
+            pj_test(j);
+            int32_t stop1 = pj_jcc(j, PJ_JE, -1);
+            int32_t stop2 = -1;
+            if (hi == UINT32_MAX) {
+                pj_bytes(j, "\x48\x3B\x04\x24", 4); /* cmp rax, [rsp] */
+                stop2 = pj_jcc(j, PJ_JE, -1);
+            }
+            pj_save_text(j);
+            pj_bytes(j, "\xFF\x44\x24\x08", 4); /* inc dword [rsp + 8] */
+            pj_jmp(j, loop);
+            pj_bind(j, stop1);
+            if (stop2 >= 0) pj_bind(j, stop2);
+            if (caps) pj_capstate(j, (void *) peg_native_load, 24);
+            pj_bind(j, done);
+            pj_bytes(j, "\x81\x7C\x24\x08", 4); /* cmp dword [rsp + 8], lo */
+            pj_u32(j, lo);
+            int32_t fail = pj_jcc(j, PJ_JB, -1);
+            pj_load_text(j);
+            pj_exit(j, frame);
+            pj_ret(j);
+            pj_bind(j, fail);
+            if (caps) pj_capstate(j, (void *) peg_native_load, 12);
+            pj_exit(j, frame);
+            pj_ret_null(j);
+            return;
+        }
+
+        case RULE_NOT:
+        case RULE_IFNOT: {
+            /* Frame: text at 0, capture state at 8 */
+            pj_enter(j, 24);
+            pj_save_text(j);
+            pj_capstate(j, (void *) peg_native_save, 8);
+            pj_load_text(j);
+            pj_rule(j, 0xE8, rule[1]);
+            pj_test(j);
+            int32_t no = pj_jcc(j, PJ_JE, -1);
+            pj_exit(j, 24);
+            pj_ret_null(j);
+            pj_bind(j, no);
+            pj_capstate(j, (void *) peg_native_load, 8);
+            pj_load_text(j);
+            pj_exit(j, 24);
+            if (rule[0] == RULE_NOT) {
+                pj_ret(j);
+            } else {
+                pj_rule(j, 0xE9, rule[2]);
+            }
+            return;
+        }
+
+        case RULE_IF: {
+            pj_enter(j, 8);
+            pj_save_text(j);
+            pj_rule(j, 0xE8, rule[1]);
+            pj_test(j);
+            int32_t fail = pj_jcc(j, PJ_JE, -1);
+            pj_load_text(j);
+            pj_exit(j, 8);
+            pj_rule(j, 0xE9, rule[2]);
+            pj_bind(j, fail);
+            pj_exit(j, 8);
+            pj_ret(j);
+            return;
+        }
+
+        case RULE_LOOK: {
+            pj_enter(j, 8);
+            pj_save_text(j);
+            pj_add_text(j, rule[1]);
+            pj_bytes(j, "\x48\x3B\x83", 3); /* cmp rax, [rbx + text_start] */
+            pj_u32(j, (uint32_t) offsetof(PegState, text_start));
+            int32_t fail1 = pj_jcc(j, PJ_JB, -1);
+            pj_cmp_end(j);
+            int32_t fail2 = pj_jcc(j, PJ_JA, -1);
+            pj_rule(j, 0xE8, rule[2]);
+            pj_test(j);
+            int32_t fail3 = pj_jcc(j, PJ_JE, -1);
+            pj_load_text(j);
+            pj_exit(j, 8);
+            pj_ret(j);
+            pj_bind(j, fail1);
+            pj_bind(j, fail2);
+            pj_bind(j, fail3);
+            pj_exit(j, 8);
+            pj_ret_null(j);
+            return;
+        }
+
+        case RULE_CAPTURE: {
+            pj_enter(j, 8);
+            pj_save_text(j);
+            pj_rule(j, 0xE8, rule[1]);
+            pj_test(j);
+            int32_t fail = pj_jcc(j, PJ_JE, -1);
+            pj_bytes(j, "\x48\x89\xC2", 3); /* mov rdx, rax */
+            pj_bytes(j, "\x48\x8B\x34\x24", 4); /* mov rsi, [rsp] */
+            pj_u8(j, 0xB9); /* mov ecx, tag */
+            pj_u32(j, rule[2]);
+            pj_call_c(j, (void *) peg_native_capture);
+            pj_bind(j, fail);
+            pj_exit(j, 8);
+            pj_ret(j);
+            return;
+        }
+    }
+
+    /* Run anything else with the interpreter */
+    pj_bytes(j, "\x48\x89\xDF", 3); /* mov rdi, rbx */
+    pj_bytes(j, "\x48\xBE", 2); /* mov rsi, rule */
+    pj_u64(j, (uint64_t)(uintptr_t) rule);
+    pj_bytes(j, "\x48\x89\xC2", 3); /* mov rdx, rax */
+    pj_bytes(j, "\x49\xBB", 2); /* mov r11, peg_rule */
+    pj_u64(j, (uint64_t)(uintptr_t) peg_rule);
+    pj_bytes(j, "\x41\xFF\xE3", 3); /* jmp r11 */
+}
+
+/* Translate a compiled peg to machine code. If executable memory is not
+ * available, peg->native stays NULL and the peg is interpreted. */
+static void peg_native_compile(JanetPeg *peg) {
+    PegJit j;
+    j.code = NULL;
+    j.fixups = NULL;
+    j.pending = NULL;
+    j.bytecode = peg->bytecode;
+    j.funcs = janet_smalloc(sizeof(int32_t) * peg->bytecode_len);
+    for (size_t i = 0; i < peg->bytecode_len; i++) j.funcs[i] = -1;
+
+    /* Entry point, called as a PegNativeFn */
+    pj_bytes(&j, "\x53\x41\x54\x41\x55", 5); /* push rbx; push r12; push r13 */
+    pj_bytes(&j, "\x48\x89\xFB", 3); /* mov rbx, rdi */
+    pj_bytes(&j, "\x49\x89\xD4", 3); /* mov r12, rdx */
+    pj_bytes(&j, "\x48\x89\xF0", 3); /* mov rax, rsi */
+    pj_rule(&j, 0xE8, 0);
+    pj_bytes(&j, "\x41\x5D\x41\x5C\x5B", 5); /* pop r13; pop r12; pop rbx */
+    pj_ret(&j);
+    j.fail = pj_pos(&j);
+    pj_ret_null(&j);
+    j.overflow = pj_pos(&j);
+    pj_bytes(&j, "\x48\x89\xDF", 3); /* mov rdi, rbx */
+    pj_bytes(&j, "\x49\xBB", 2); /* mov r11, peg_native_overflow */
+    pj_u64(&j, (uint64_t)(uintptr_t) peg_native_overflow);
+    pj_bytes(&j, "\x41\xFF\xD3", 3); /* call r11 */
+
+    while (janet_v_count(j.pending)) {
+        uint32_t rule = janet_v_last(j.pending);
+        janet_v_pop(j.pending);
+        pj_emit_rule(&j, rule);
+    }
+    for (int32_t i = 0; i < janet_v_count(j.fixups); i++) {
+        PegJitFixup f = j.fixups[i];
+        pj_patch(&j, f.at, j.funcs[f.rule] - f.base);
+    }
+
+    size_t size = 0;
+    peg->native = janet_jit_try_map(j.code, (size_t) janet_v_count(j.code), &size);
+    peg->native_size = peg->native ? size : 0;
+    janet_v_free(j.code);
+    janet_v_free(j.fixups);
+    janet_v_free(j.pending);
+    janet_sfree(j.funcs);
+}
+
+#endif
+
+/*
+ * Post-Compilation
+ */
+
+static int peg_gc(void *p, size_t size) {
+    (void) size;
+#ifdef JANET_PEG_JIT
+    JanetPeg *peg = (JanetPeg *)p;
+    if (NULL != peg->native) janet_jit_unmap(peg->native, peg->native_size);
+#else
+    (void) p;
+#endif
+    return 0;
+}
+
+static int peg_mark(void *p, size_t size) {
+    (void) size;
+    JanetPeg *peg = (JanetPeg *)p;
+    if (NULL != peg->constants)
+        for (uint32_t i = 0; i < peg->num_constants; i++)
+            janet_mark(peg->constants[i]);
+    return 0;
+}
+
+static void peg_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetPeg *peg = (JanetPeg *)p;
+    janet_marshal_size(ctx, peg->bytecode_len);
+    janet_marshal_int(ctx, (int32_t)peg->num_constants);
+    janet_marshal_abstract(ctx, p);
+    for (size_t i = 0; i < peg->bytecode_len; i++)
+        janet_marshal_int(ctx, (int32_t) peg->bytecode[i]);
+    for (uint32_t j = 0; j < peg->num_constants; j++)
+        janet_marshal_janet(ctx, peg->constants[j]);
+}
+
+/* Used to ensure that if we place several arrays in one memory chunk, each
+ * array will be correctly aligned */
+static size_t size_padded(size_t offset, size_t size) {
+    size_t x = size + offset - 1;
+    return x - (x % size);
+}
+
+#define OVERFLOW_CHECK(n) do { if (i > blen - (n)) goto bad; } while (0) /* overflow */
+
+static void *peg_unmarshal(JanetMarshalContext *ctx) {
+    size_t bytecode_len = janet_unmarshal_size(ctx);
+    uint32_t num_constants = (uint32_t) janet_unmarshal_int(ctx);
+
+    /* Calculate offsets. Should match those in make_peg */
+    size_t bytecode_start = size_padded(sizeof(JanetPeg), sizeof(uint32_t));
+    size_t bytecode_size = bytecode_len * sizeof(uint32_t);
+    size_t constants_start = size_padded(bytecode_start + bytecode_size, sizeof(Janet));
+    size_t total_size = constants_start + sizeof(Janet) * (size_t) num_constants;
+
+    /* DOS prevention? I.E. we could read bytecode and constants before
+     * hand so we don't allocated a ton of memory on bad, short input */
+
+    /* Allocate PEG */
+    char *mem = janet_unmarshal_abstract(ctx, total_size);
+    JanetPeg *peg = (JanetPeg *)mem;
+    uint32_t *bytecode = (uint32_t *)(mem + bytecode_start);
+    Janet *constants = (Janet *)(mem + constants_start);
+    peg->bytecode = NULL;
+    peg->constants = NULL;
+    peg->native = NULL;
+    peg->native_size = 0;
+    peg->bytecode_len = bytecode_len;
+    peg->num_constants = num_constants;
+
+    for (size_t i = 0; i < peg->bytecode_len; i++)
+        bytecode[i] = (uint32_t) janet_unmarshal_int(ctx);
+    for (uint32_t j = 0; j < peg->num_constants; j++)
+        constants[j] = janet_unmarshal_janet(ctx);
+
+    /* After here, no panics except for the bad: label. */
+
+    /* Keep track at each index if an instruction was
+     * referenced (0x01) or is in a main bytecode position
+     * (0x02). This lets us do a linear scan and not
+     * need to a depth first traversal. It is stricter
+     * than a dfs by not allowing certain kinds of unused
+     * bytecode. */
+    uint32_t blen = (int32_t) peg->bytecode_len;
+    uint32_t clen = peg->num_constants;
+    uint8_t *op_flags = janet_calloc(1, blen);
+    if (NULL == op_flags) {
+        JANET_OUT_OF_MEMORY;
+    }
+
+    /* verify peg bytecode */
     int32_t has_backref = 0;
     uint32_t i = 0;
     while (i < blen) {
@@ -1717,6 +3254,7 @@ static void *peg_unmarshal(JanetMarshalContext *ctx) {
                 i += 3;
                 break;
             case RULE_CHOICE:
+            case RULE_CHOICE_NOCAP:
             case RULE_SEQUENCE:
                 /* [len, rules...] */
             {
@@ -1741,7 +3279,29 @@ static void *peg_unmarshal(JanetMarshalContext *ctx) {
                 op_flags[rule[2]] |= 0x01;
                 i += 3;
                 break;
+            case RULE_SPAN:
+                /* [lo, hi, bitmap (8 words), nstops, stops] */
+                i += 13;
+                break;
+            case RULE_DISPATCH:
+                /* [len, rules..., table (65 words)] */
+            {
+                OVERFLOW_CHECK(2);
+                uint32_t len = rule[1];
+                OVERFLOW_CHECK(2 + len + 65);
+                for (uint32_t j = 0; j < len; j++) {
+                    if (rule[2 + j] >= blen) goto bad;
+                    op_flags[rule[2 + j]] |= 0x1;
+                }
+                const uint8_t *table = (const uint8_t *)(rule + 2 + len);
+                for (uint32_t j = 0; j < 257; j++) {
+                    if (table[j] > len) goto bad;
+                }
+                i += 2 + len + 65;
+            }
+            break;
             case RULE_BETWEEN:
+            case RULE_BETWEEN_NOCAP:
                 /* [lo, hi, rule] */
                 OVERFLOW_CHECK(4);
                 if (rule[3] >= blen) goto bad;
@@ -1807,6 +3367,7 @@ static void *peg_unmarshal(JanetMarshalContext *ctx) {
             case RULE_NOT:
             case RULE_TO:
             case RULE_THRU:
+            case RULE_MEMO:
                 /* [rule] */
                 OVERFLOW_CHECK(2);
                 if (rule[1] >= blen) goto bad;
@@ -1858,7 +3419,7 @@ static Janet peg_next(void *p, Janet key);
 
 const JanetAbstractType janet_peg_type = {
     "core/peg",
-    NULL,
+    peg_gc,
     peg_mark,
     cfun_peg_getter,
     NULL, /* put */
@@ -1887,6 +3448,8 @@ static JanetPeg *make_peg(Builder *b) {
     safe_memcpy(peg->constants, b->constants, constants_size);
     peg->bytecode_len = janet_v_count(b->bytecode);
     peg->has_backref = b->has_backref;
+    peg->native = NULL;
+    peg->native_size = 0;
     return peg;
 }
 
@@ -1909,6 +3472,7 @@ static JanetPeg *compile_peg(Janet x) {
     builder.depth = JANET_RECURSION_GUARD;
     builder.has_backref = 0;
     peg_compile1(&builder, x);
+    peg_optimize(&builder);
     JanetPeg *peg = make_peg(&builder);
     builder_cleanup(&builder);
     return peg;
@@ -1919,12 +3483,27 @@ static JanetPeg *compile_peg(Janet x) {
  */
 
 JANET_CORE_FN(cfun_peg_compile,
-              "(peg/compile peg)",
+              "(peg/compile peg &opt mode)",
               "Compiles a peg source data structure into a <core/peg>. This will speed up matching "
               "if the same peg will be used multiple times. `(dyn :peg-grammar)` replaces "
-              "`default-peg-grammar` for the grammar of the peg.") {
-    janet_fixarity(argc, 1);
+              "`default-peg-grammar` for the grammar of the peg. If `mode` is `:native`, the peg is "
+              "also translated to machine code where supported (currently x86-64 outside of Windows). "
+              "Elsewhere, after marshalling, when executable memory can't be mapped, and when the "
+              "sandbox disallows `:ffi-jit`, the peg is interpreted as usual.") {
+    janet_arity(argc, 1, 2);
+    int native = 0;
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) {
+        if (!janet_keyeq(argv[1], "native")) {
+            janet_panicf("expected :native, got %v", argv[1]);
+        }
+        native = 1;
+    }
     JanetPeg *peg = compile_peg(argv[0]);
+#ifdef JANET_PEG_JIT
+    if (native && !(janet_vm.sandbox_flags & JANET_SANDBOX_FFI_JIT)) peg_native_compile(peg);
+#else
+    (void) native;
+#endif
     return janet_wrap_abstract(peg);
 }
 
@@ -1937,6 +3516,33 @@ typedef struct {
     int32_t start;
 } PegCall;
 
+/* Initialize match state for a peg over some bytes */
+static void peg_state_init(PegState *s, JanetPeg *peg, const uint8_t *bytes, int32_t len) {
+    s->mode = PEG_MODE_NORMAL;
+    s->text_start = bytes;
+    s->text_end = bytes + len;
+    s->outer_text_end = s->text_end;
+    s->depth = JANET_RECURSION_GUARD;
+    s->captures = janet_array(0);
+    s->tagged_captures = janet_array(0);
+    s->scratch = janet_buffer(10);
+    s->tags = janet_buffer(10);
+    s->constants = peg->constants;
+    s->bytecode = peg->bytecode;
+    s->linemap = NULL;
+    s->linemaplen = -1;
+    s->has_backref = peg->has_backref;
+    s->hit_end = 0;
+    s->memo = NULL;
+    s->memo_capacity = 0;
+    s->memo_limit = 0;
+    s->memo_count = 0;
+    s->memo_hits = 0;
+    s->memo_misses = 0;
+    s->memo_evictions = 0;
+    s->bail = NULL;
+}
+
 /* Initialize state for peg cfunctions */
 static PegCall peg_cfun_init(int32_t argc, Janet *argv, int get_replace) {
     PegCall ret;
@@ -1954,6 +3560,7 @@ static PegCall peg_cfun_init(int32_t argc, Janet *argv, int get_replace) {
     } else {
         ret.bytes = janet_getbytes(argv, 1);
     }
+    peg_state_init(&ret.s, ret.peg, ret.bytes.bytes, ret.bytes.len);
     if (argc > min) {
         ret.start = janet_gethalfrange(argv, min, ret.bytes.len, "offset");
         ret.s.extrac = argc - min - 1;
@@ -1963,23 +3570,42 @@ static PegCall peg_cfun_init(int32_t argc, Janet *argv, int get_replace) {
         ret.s.extrac = 0;
         ret.s.extrav = NULL;
     }
-    ret.s.mode = PEG_MODE_NORMAL;
-    ret.s.text_start = ret.bytes.bytes;
-    ret.s.text_end = ret.bytes.bytes + ret.bytes.len;
-    ret.s.outer_text_end = ret.s.text_end;
-    ret.s.depth = JANET_RECURSION_GUARD;
-    ret.s.captures = janet_array(0);
-    ret.s.tagged_captures = janet_array(0);
-    ret.s.scratch = janet_buffer(10);
-    ret.s.tags = janet_buffer(10);
-    ret.s.constants = ret.peg->constants;
-    ret.s.bytecode = ret.peg->bytecode;
-    ret.s.linemap = NULL;
-    ret.s.linemaplen = -1;
-    ret.s.has_backref = ret.peg->has_backref;
     return ret;
 }
 
+/* Free the memo table, and report its use in (dyn :peg-memo-stats) */
+static void peg_state_finish(PegState *s) {
+    if (!s->memo_capacity) return;
+    Janet stats = janet_dyn("peg-memo-stats");
+    if (janet_checktype(stats, JANET_TABLE)) {
+        JanetTable *t = janet_unwrap_table(stats);
+        janet_table_put(t, janet_ckeywordv("hits"), janet_wrap_number((double) s->memo_hits));
+        janet_table_put(t, janet_ckeywordv("misses"), janet_wrap_number((double) s->memo_misses));
+        janet_table_put(t, janet_ckeywordv("evictions"), janet_wrap_number((double) s->memo_evictions));
+        janet_table_put(t, janet_ckeywordv("entries"), janet_wrap_number((double) s->memo_count));
+        janet_table_put(t, janet_ckeywordv("capacity"), janet_wrap_number((double) s->memo_capacity));
+    }
+    janet_sfree(s->memo);
+    s->memo = NULL;
+    s->memo_capacity = 0;
+}
+
+/* Match the main rule of the peg at text */
+static const uint8_t *peg_state_rule(JanetPeg *peg, PegState *s, const uint8_t *text) {
+#ifdef JANET_PEG_JIT
+    if (NULL != peg->native) {
+        return ((PegNativeFn) peg->native)(s, text, s->text_end);
+    }
+#else
+    (void) peg;
+#endif
+    return peg_rule(s, s->bytecode, text);
+}
+
+static const uint8_t *peg_call_rule(PegCall *c, const uint8_t *text) {
+    return peg_state_rule(c->peg, &c->s, text);
+}
+
 static void peg_call_reset(PegCall *c) {
     c->s.depth = JANET_RECURSION_GUARD;
     c->s.captures->count = 0;
@@ -1988,12 +3614,233 @@ static void peg_call_reset(PegCall *c) {
     c->s.tags->count = 0;
 }
 
+/*
+ * Parallel matching
+ */
+
+/* find-all and replace-all split large inputs between threads when
+ * (dyn :match-threads) is set. Worker threads have no Janet VM, so only
+ * grammars that never capture, allocate, or call back into Janet can run on
+ * them, and everything else is matched serially. Each worker scans its own
+ * segment of start positions, but may read the whole text. */
+
+typedef struct {
+    PegState s;
+    jmp_buf bail;
+    int32_t from;
+    int32_t to;
+    int32_t next; /* Where a serial scan continues after the segment */
+    int32_t *found; /* Match positions, or start and end pairs for replace-all */
+    size_t count;
+    size_t capacity;
+    int failed;
+} PegSegment;
+
+typedef struct {
+    JanetPeg *peg;
+    const uint8_t *bytes;
+    int replace;
+    PegSegment *segments;
+} PegParallel;
+
+/* Check that every rule reachable from the main rule can run on a worker thread */
+static int peg_parallel_safe(JanetPeg *peg) {
+    uint8_t *seen = janet_scalloc(peg->bytecode_len, 1);
+    uint32_t *stack = NULL;
+    int safe = 1;
+    janet_v_push(stack, 0);
+    while (safe && janet_v_count(stack)) {
+        uint32_t index = janet_v_last(stack);
+        janet_v_pop(stack);
+        if (seen[index]) continue;
+        seen[index] = 1;
+        const uint32_t *rule = peg->bytecode + index;
+        switch (rule[0]) {
+            default:
+                safe = 0;
+                continue;
+            case RULE_LITERAL:
+            case RULE_NCHAR:
+            case RULE_NOTNCHAR:
+            case RULE_RANGE:
+            case RULE_SET:
+            case RULE_SPAN:
+            case RULE_LOOK:
+            case RULE_CHOICE:
+            case RULE_CHOICE_NOCAP:
+            case RULE_SEQUENCE:
+            case RULE_DISPATCH:
+            case RULE_IF:
+            case RULE_IFNOT:
+            case RULE_NOT:
+            case RULE_BETWEEN:
+            case RULE_BETWEEN_NOCAP:
+            case RULE_TO:
+            case RULE_THRU:
+            case RULE_SUB:
+            case RULE_TIL:
+            case RULE_DROP:
+                break;
+        }
+        uint32_t refs, nrefs;
+        peg_rule_shape(rule, &refs, &nrefs);
+        for (uint32_t i = 0; i < nrefs; i++) {
+            janet_v_push(stack, rule[refs + i]);
+        }
+    }
+    janet_v_free(stack);
+    janet_sfree(seen);
+    return safe;
+}
+
+static void peg_segment_push(PegSegment *seg, int32_t x) {
+    if (seg->count == seg->capacity) {
+        size_t newcap = seg->capacity ? 2 * seg->capacity : 64;
+        int32_t *found = janet_realloc(seg->found, sizeof(int32_t) * newcap);
+        if (NULL == found) {
+            JANET_OUT_OF_MEMORY;
+        }
+        seg->found = found;
+        seg->capacity = newcap;
+    }
+    seg->found[seg->count++] = x;
+}
+
+static void peg_segment_scan(PegParallel *p, PegSegment *seg) {
+    int32_t i = seg->from;
+    while (i < seg->to) {
+        seg->s.depth = JANET_RECURSION_GUARD;
+        const uint8_t *result = peg_state_rule(p->peg, &seg->s, p->bytes + i);
+        if (NULL == result) {
+            i++;
+        } else if (p->replace) {
+            int32_t end = (int32_t)(result - p->bytes);
+            peg_segment_push(seg, i);
+            peg_segment_push(seg, end);
+            i = (end == i) ? i + 1 : end;
+        } else {
+            peg_segment_push(seg, i++);
+        }
+    }
+    seg->next = i;
+}
+
+/* Runs on a worker thread */
+static void peg_segment_run(void *data, int32_t index) {
+    PegParallel *p = (PegParallel *) data;
+    PegSegment *seg = p->segments + index;
+    seg->s.bail = &seg->bail;
+#if defined(JANET_BSD) || defined(JANET_APPLE)
+    if (_setjmp(seg->bail)) {
+#else
+    if (setjmp(seg->bail)) {
+#endif
+        seg->failed = 1;
+        return;
+    }
+    peg_segment_scan(p, seg);
+}
+
+/* Match every start position of the call on several threads. Returns NULL if
+ * the call should be matched serially instead. The results of each segment
+ * are moved to scratch memory, so nothing leaks if merging them panics. */
+static PegSegment *peg_parallel(PegCall *c, int replace, int32_t *count) {
+    int32_t n = janet_match_threads(c->bytes.len - c->start);
+    if (n <= 1 || !peg_parallel_safe(c->peg)) return NULL;
+    PegParallel p;
+    p.peg = c->peg;
+    p.bytes = c->bytes.bytes;
+    p.replace = replace;
+    p.segments = janet_smalloc(sizeof(PegSegment) * n);
+    int64_t span = c->bytes.len - c->start;
+    for (int32_t i = 0; i < n; i++) {
+        PegSegment *seg = p.segments + i;
+        peg_state_init(&seg->s, c->peg, c->bytes.bytes, c->bytes.len);
+        seg->s.extrac = c->s.extrac;
+        seg->s.extrav = c->s.extrav;
+        seg->from = c->start + (int32_t)(span * i / n);
+        seg->to = c->start + (int32_t)(span * (i + 1) / n);
+        seg->next = seg->to;
+        seg->found = NULL;
+        seg->count = 0;
+        seg->capacity = 0;
+        seg->failed = 0;
+    }
+    janet_os_parallel(n, peg_segment_run, &p);
+    int failed = 0;
+    for (int32_t i = 0; i < n; i++) {
+        PegSegment *seg = p.segments + i;
+        int32_t *found = janet_smalloc(sizeof(int32_t) * (seg->count + 1));
+        if (seg->count) memcpy(found, seg->found, sizeof(int32_t) * seg->count);
+        janet_free(seg->found);
+        seg->found = found;
+        failed |= seg->failed;
+    }
+    if (failed) janet_panic("peg/match recursed too deeply");
+    *count = n;
+    return p.segments;
+}
+
+static void peg_parallel_free(PegSegment *segments, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        janet_sfree(segments[i].found);
+    }
+    janet_sfree(segments);
+}
+
+/* Add a match to the result of replace-all */
+static void peg_replace_push(PegCall *c, JanetBuffer *ret, int32_t *trail, int32_t start, int32_t end) {
+    if (*trail < start) {
+        janet_buffer_push_bytes(ret, c->bytes.bytes + *trail, start - *trail);
+    }
+    JanetByteView subst = janet_text_substitution(&c->subst, c->bytes.bytes + start, end - start, c->s.captures);
+    janet_buffer_push_bytes(ret, subst.bytes, subst.len);
+    *trail = end;
+}
+
+/* Stitch the matches of each segment together for replace-all. A segment
+ * only agrees with a serial scan from the position the previous segment
+ * stopped at if the segment's own scan also visited that position. If it
+ * was skipped inside a match, the serial scan is repeated on this thread
+ * until it lands on a visited position, and the segment is trusted from
+ * there on. */
+static void peg_replace_merge(PegCall *c, JanetBuffer *ret, int32_t *trail,
+                              PegSegment *segments, int32_t count) {
+    int32_t i = c->start;
+    for (int32_t k = 0; k < count; k++) {
+        PegSegment *seg = segments + k;
+        size_t pairs = seg->count / 2;
+        size_t j = 0;
+        while (i < seg->next) {
+            while (j < pairs && seg->found[2 * j] < i) j++;
+            if (j == 0 || seg->found[2 * j - 1] <= i) {
+                for (; j < pairs; j++) {
+                    peg_call_reset(c);
+                    peg_replace_push(c, ret, trail, seg->found[2 * j], seg->found[2 * j + 1]);
+                }
+                i = seg->next;
+                break;
+            }
+            peg_call_reset(c);
+            const uint8_t *result = peg_call_rule(c, c->bytes.bytes + i);
+            if (NULL != result) {
+                int32_t end = (int32_t)(result - c->bytes.bytes);
+                peg_replace_push(c, ret, trail, i, end);
+                i = (end == i) ? i + 1 : end;
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
 JANET_CORE_FN(cfun_peg_match,
               "(peg/match peg text &opt start & args)",
               "Match a Parsing Expression Grammar to a byte string and return an array of captured values. "
               "Returns nil if text does not match the language defined by peg. The syntax of PEGs is documented on the Janet website.") {
     PegCall c = peg_cfun_init(argc, argv, 0);
-    const uint8_t *result = peg_rule(&c.s, c.s.bytecode, c.bytes.bytes + c.start);
+    const uint8_t *result = peg_call_rule(&c, c.bytes.bytes + c.start);
+    peg_state_finish(&c.s);
     return result ? janet_wrap_array(c.s.captures) : janet_wrap_nil();
 }
 
@@ -2003,22 +3850,45 @@ JANET_CORE_FN(cfun_peg_find,
     PegCall c = peg_cfun_init(argc, argv, 0);
     for (int32_t i = c.start; i < c.bytes.len; i++) {
         peg_call_reset(&c);
-        if (peg_rule(&c.s, c.s.bytecode, c.bytes.bytes + i))
+        if (peg_call_rule(&c, c.bytes.bytes + i)) {
+            peg_state_finish(&c.s);
             return janet_wrap_integer(i);
+        }
     }
+    peg_state_finish(&c.s);
     return janet_wrap_nil();
 }
 
 JANET_CORE_FN(cfun_peg_find_all,
               "(peg/find-all peg text &opt start & args)",
-              "Find all indexes where the peg matches in text. Returns an array of integers.") {
+              "Find all indexes where the peg matches in text. Returns an array of integers. "
+              "If `(dyn :match-threads)` is an integer greater than 1, large texts are split "
+              "between that many threads, as long as the peg makes no captures and has no "
+              "function or argument rules. The thread count is a dynamic binding rather "
+              "than an argument because the trailing arguments are passed to the peg. It "
+              "is ignored if the sandbox disallows `:threads`.") {
     PegCall c = peg_cfun_init(argc, argv, 0);
+    int32_t count;
+    PegSegment *segments = peg_parallel(&c, 0, &count);
+    if (NULL != segments) {
+        size_t total = 0;
+        for (int32_t k = 0; k < count; k++) total += segments[k].count;
+        JanetArray *ret = janet_array((int32_t) total);
+        for (int32_t k = 0; k < count; k++) {
+            for (size_t j = 0; j < segments[k].count; j++) {
+                ret->data[ret->count++] = janet_wrap_integer(segments[k].found[j]);
+            }
+        }
+        peg_parallel_free(segments, count);
+        return janet_wrap_array(ret);
+    }
     JanetArray *ret = janet_array(0);
     for (int32_t i = c.start; i < c.bytes.len; i++) {
         peg_call_reset(&c);
-        if (peg_rule(&c.s, c.s.bytecode, c.bytes.bytes + i))
+        if (peg_call_rule(&c, c.bytes.bytes + i))
             janet_array_push(ret, janet_wrap_integer(i));
     }
+    peg_state_finish(&c.s);
     return janet_wrap_array(ret);
 }
 
@@ -2026,9 +3896,19 @@ static Janet cfun_peg_replace_generic(int32_t argc, Janet *argv, int only_one) {
     PegCall c = peg_cfun_init(argc, argv, 1);
     JanetBuffer *ret = janet_buffer(0);
     int32_t trail = 0;
+    int32_t count;
+    PegSegment *segments = only_one ? NULL : peg_parallel(&c, 1, &count);
+    if (NULL != segments) {
+        peg_replace_merge(&c, ret, &trail, segments, count);
+        peg_parallel_free(segments, count);
+        if (trail < c.bytes.len) {
+            janet_buffer_push_bytes(ret, c.bytes.bytes + trail, (c.bytes.len - trail));
+        }
+        return janet_wrap_buffer(ret);
+    }
     for (int32_t i = c.start; i < c.bytes.len;) {
         peg_call_reset(&c);
-        const uint8_t *result = peg_rule(&c.s, c.s.bytecode, c.bytes.bytes + i);
+        const uint8_t *result = peg_call_rule(&c, c.bytes.bytes + i);
         if (NULL != result) {
             if (trail < i) {
                 janet_buffer_push_bytes(ret, c.bytes.bytes + trail, (i - trail));
@@ -2048,6 +3928,7 @@ static Janet cfun_peg_replace_generic(int32_t argc, Janet *argv, int only_one) {
     if (trail < c.bytes.len) {
         janet_buffer_push_bytes(ret, c.bytes.bytes + trail, (c.bytes.len - trail));
     }
+    peg_state_finish(&c.s);
     return janet_wrap_buffer(ret);
 }
 
@@ -2056,7 +3937,8 @@ JANET_CORE_FN(cfun_peg_replace_all,
               "Replace all matches of `peg` in `text` with `subst`, returning a new buffer. "
               "The peg does not need to make captures to do replacement. "
               "If `subst` is a function, it will be called with the "
-              "matching text followed by any captures.") {
+              "matching text followed by any captures. Large texts can be split between "
+              "threads with `(dyn :match-threads)`, as with `peg/find-all`.") {
     return cfun_peg_replace_generic(argc, argv, 0);
 }
 
@@ -2070,6 +3952,208 @@ JANET_CORE_FN(cfun_peg_replace,
     return cfun_peg_replace_generic(argc, argv, 1);
 }
 
+/*
+ * Streaming matches
+ */
+
+/* A peg stream matches a record rule over and over against input that
+ * arrives in chunks. Unconsumed input is kept in a buffer that only grows
+ * to hold the largest record. A match that looked at the end of the
+ * buffered input is not trusted until more input arrives, since it could
+ * change - the record is retried from its start on the next feed. */
+typedef struct {
+    JanetPeg *peg;
+    const Janet *extrav;
+    int32_t extrac;
+    int32_t closed;
+    uint8_t *data;
+    int32_t start; /* Offset of the first unconsumed byte in data */
+    int32_t count;
+    int32_t capacity;
+    int64_t offset; /* Number of bytes consumed so far */
+} JanetPegStream;
+
+static int peg_stream_gc(void *p, size_t size) {
+    (void) size;
+    JanetPegStream *st = (JanetPegStream *)p;
+    janet_free(st->data);
+    return 0;
+}
+
+static int peg_stream_mark(void *p, size_t size) {
+    (void) size;
+    JanetPegStream *st = (JanetPegStream *)p;
+    janet_mark(janet_wrap_abstract(st->peg));
+    if (NULL != st->extrav) janet_mark(janet_wrap_tuple(st->extrav));
+    return 0;
+}
+
+static int peg_stream_getter(void *p, Janet key, Janet *out);
+static Janet peg_stream_next(void *p, Janet key);
+
+static const JanetAbstractType janet_peg_stream_type = {
+    "core/peg-stream",
+    peg_stream_gc,
+    peg_stream_mark,
+    peg_stream_getter,
+    NULL, /* put */
+    NULL, /* marshal */
+    NULL, /* unmarshal */
+    NULL, /* tostring */
+    NULL, /* compare */
+    NULL, /* hash */
+    peg_stream_next,
+    JANET_ATEND_NEXT
+};
+
+static void peg_stream_push(JanetPegStream *st, const uint8_t *bytes, int32_t len) {
+    if (st->start > 0 && st->count + len > st->capacity) {
+        /* Drop consumed input before growing */
+        st->count -= st->start;
+        memmove(st->data, st->data + st->start, st->count);
+        st->start = 0;
+    }
+    if ((int64_t) st->count + len > INT32_MAX) {
+        janet_panic("peg stream record too large");
+    }
+    if (st->count + len > st->capacity) {
+        int64_t capacity = 2 * (int64_t)(st->count + len);
+        if (capacity > INT32_MAX) capacity = INT32_MAX;
+        uint8_t *data = janet_realloc(st->data, (size_t) capacity);
+        if (NULL == data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        st->data = data;
+        st->capacity = (int32_t) capacity;
+    }
+    safe_memcpy(st->data + st->count, bytes, len);
+    st->count += len;
+}
+
+/* Match as many whole records as possible from the buffered input, pushing
+ * an array of captures for each one to out. */
+static void peg_stream_run(JanetPegStream *st, JanetArray *out) {
+    while (st->start < st->count) {
+        const uint8_t *text = st->data + st->start;
+        int32_t len = st->count - st->start;
+        PegState s;
+        peg_state_init(&s, st->peg, text, len);
+        s.extrac = st->extrac;
+        s.extrav = st->extrav;
+        const uint8_t *result = peg_rule(&s, s.bytecode, text);
+        peg_state_finish(&s);
+        if (s.hit_end && !st->closed) break;
+        if (NULL == result || result == text) {
+            /* Return the records matched so far, the error will be raised
+             * again by the next call */
+            if (out->count) break;
+            janet_panicf("%s at byte %v of peg stream",
+                         result ? "record matched no input" : "match failed",
+                         janet_wrap_number((double) st->offset));
+        }
+        janet_array_push(out, janet_wrap_array(s.captures));
+        st->start += (int32_t)(result - text);
+        st->offset += result - text;
+    }
+    if (st->start == st->count) {
+        st->start = 0;
+        st->count = 0;
+        if (st->capacity > 4096) {
+            janet_free(st->data);
+            st->data = NULL;
+            st->capacity = 0;
+        }
+    }
+}
+
+JANET_CORE_FN(cfun_peg_stream,
+              "(peg/stream peg & args)",
+              "Create a matcher that applies `peg` to input that arrives in chunks, such as from "
+              "`ev/read`. Feed chunks with `peg/feed` and signal the end of input with `peg/finish`. "
+              "The peg is matched repeatedly as a record rule, and each match consumes its input. "
+              "Extra `args` are passed to the peg as with `peg/match`. Positions and line numbers "
+              "captured by the peg are relative to the start of each record, and look-behind "
+              "cannot see input from earlier records.") {
+    janet_arity(argc, 1, -1);
+    JanetPegStream *st = janet_abstract(&janet_peg_stream_type, sizeof(JanetPegStream));
+    st->peg = NULL;
+    st->extrav = NULL;
+    st->extrac = 0;
+    st->closed = 0;
+    st->data = NULL;
+    st->start = 0;
+    st->count = 0;
+    st->capacity = 0;
+    st->offset = 0;
+    if (janet_checktype(argv[0], JANET_ABSTRACT) &&
+            janet_abstract_type(janet_unwrap_abstract(argv[0])) == &janet_peg_type) {
+        st->peg = janet_unwrap_abstract(argv[0]);
+    } else {
+        st->peg = compile_peg(argv[0]);
+    }
+    if (argc > 1) {
+        st->extrac = argc - 1;
+        st->extrav = janet_tuple_n(argv + 1, argc - 1);
+    }
+    return janet_wrap_abstract(st);
+}
+
+JANET_CORE_FN(cfun_peg_feed,
+              "(peg/feed pstream chunk)",
+              "Add a chunk of input to a peg stream, and return an array with the captures of "
+              "each record that is now complete. A record is only complete once the peg no longer "
+              "depends on where the input ends, so a partial record at the end of the chunk is kept "
+              "until more input arrives. Raises an error if the input cannot match the peg. If some "
+              "records were matched before the error, they are returned and the error is raised "
+              "by the next call.") {
+    janet_fixarity(argc, 2);
+    JanetPegStream *st = janet_getabstract(argv, 0, &janet_peg_stream_type);
+    JanetByteView chunk = janet_getbytes(argv, 1);
+    if (st->closed) janet_panic("peg stream is finished");
+    peg_stream_push(st, chunk.bytes, chunk.len);
+    JanetArray *out = janet_array(0);
+    peg_stream_run(st, out);
+    return janet_wrap_array(out);
+}
+
+JANET_CORE_FN(cfun_peg_finish,
+              "(peg/finish pstream)",
+              "Signal the end of input to a peg stream, and return an array with the captures of "
+              "the remaining records. Raises an error if input is left that does not match the peg.") {
+    janet_fixarity(argc, 1);
+    JanetPegStream *st = janet_getabstract(argv, 0, &janet_peg_stream_type);
+    st->closed = 1;
+    JanetArray *out = janet_array(0);
+    peg_stream_run(st, out);
+    return janet_wrap_array(out);
+}
+
+static JanetMethod peg_stream_methods[] = {
+    {"feed", cfun_peg_feed},
+    {"finish", cfun_peg_finish},
+    {NULL, NULL}
+};
+
+static int peg_stream_getter(void *p, Janet key, Janet *out) {
+    JanetPegStream *st = (JanetPegStream *)p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    if (janet_keyeq(key, "offset")) {
+        *out = janet_wrap_number((double) st->offset);
+        return 1;
+    }
+    if (janet_keyeq(key, "pending")) {
+        *out = janet_wrap_integer(st->count - st->start);
+        return 1;
+    }
+    return janet_getmethod(janet_unwrap_keyword(key), peg_stream_methods, out);
+}
+
+static Janet peg_stream_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(peg_stream_methods, key);
+}
+
 static JanetMethod peg_methods[] = {
     {"match", cfun_peg_match},
     {"find", cfun_peg_find},
@@ -2100,10 +4184,14 @@ void janet_lib_peg(JanetTable *env) {
         JANET_CORE_REG("peg/find-all", cfun_peg_find_all),
         JANET_CORE_REG("peg/replace", cfun_peg_replace),
         JANET_CORE_REG("peg/replace-all", cfun_peg_replace_all),
+        JANET_CORE_REG("peg/stream", cfun_peg_stream),
+        JANET_CORE_REG("peg/feed", cfun_peg_feed),
+        JANET_CORE_REG("peg/finish", cfun_peg_finish),
         JANET_REG_END
     };
     janet_core_cfuns_ext(env, NULL, cfuns);
     janet_register_abstract_type(&janet_peg_type);
+    janet_register_abstract_type(&janet_peg_stream_type);
 }
 
 #endif /* ifdef JANET_PEG */
@@ -0,0 +1,674 @@
+/*
+* Copyright (c) 2026 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <math.h>
+
+/* Persistent hash maps, stored as compressed hash array mapped tries (CHAMP).
+ * Each node is indexed by 5 bits of a key's hash and has two bitmaps - one for
+ * key-value pairs stored inline, and one for child nodes. Pairs come first in
+ * the node, followed by children. Updating a map copies only the nodes on the
+ * path to the changed key, so every older version stays valid and shares the
+ * rest of the trie. Keys whose hashes are entirely equal go in a collision
+ * node at the bottom of the trie, which is a flat list of pairs.
+ *
+ * Nodes are abstract values themselves, so the garbage collector frees them
+ * once no version of any map refers to them. */
+
+#define JANET_PMAP_BITS 5
+#define JANET_PMAP_FANOUT_MASK 31
+#define JANET_PMAP_MAX_SHIFT 30
+#define JANET_PMAP_MAX_DEPTH 8
+
+typedef struct JanetPMapNode JanetPMapNode;
+struct JanetPMapNode {
+    uint32_t datamap;
+    uint32_t nodemap;
+    int32_t collisions; /* Number of pairs in a collision node, else 0 */
+    int32_t padding;
+    Janet items[];
+};
+
+typedef struct {
+    JanetPMapNode *root;
+    int32_t count;
+    int32_t hash; /* 0 if not yet computed */
+} JanetPMap;
+
+static int pmap_popcount(uint32_t x) {
+#ifdef __GNUC__
+    return __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return (int)((x * 0x01010101u) >> 24);
+#endif
+}
+
+#define pmap_ndata(node) ((node)->collisions ? (node)->collisions : pmap_popcount((node)->datamap))
+#define pmap_nchildren(node) (pmap_popcount((node)->nodemap))
+#define pmap_child(node, i) ((JanetPMapNode *) janet_unwrap_abstract((node)->items[2 * pmap_ndata(node) + (i)]))
+#define pmap_bit(hash, shift) ((uint32_t) 1 << (((hash) >> (shift)) & JANET_PMAP_FANOUT_MASK))
+#define pmap_index(map, bit) (pmap_popcount((map) & ((bit) - 1)))
+
+static int pmap_node_gcmark(void *p, size_t size) {
+    JanetPMapNode *node = (JanetPMapNode *) p;
+    (void) size;
+    int32_t n = 2 * pmap_ndata(node) + pmap_nchildren(node);
+    for (int32_t i = 0; i < n; i++) {
+        janet_mark(node->items[i]);
+    }
+    return 0;
+}
+
+static const JanetAbstractType janet_pmap_node_type = {
+    "core/pmap-node",
+    NULL,
+    pmap_node_gcmark,
+    JANET_ATEND_GCMARK
+};
+
+static JanetPMapNode *pmap_node(uint32_t datamap, uint32_t nodemap, int32_t collisions, int32_t nitems) {
+    JanetPMapNode *node = janet_abstract(&janet_pmap_node_type,
+                                         sizeof(JanetPMapNode) + (size_t) nitems * sizeof(Janet));
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->collisions = collisions;
+    node->padding = 0;
+    return node;
+}
+
+/* Make a node for two pairs that collide at the level above shift */
+static JanetPMapNode *pmap_pair(int shift,
+                                Janet k1, Janet v1, uint32_t h1,
+                                Janet k2, Janet v2, uint32_t h2) {
+    if (shift > JANET_PMAP_MAX_SHIFT) {
+        JanetPMapNode *node = pmap_node(0, 0, 2, 4);
+        node->items[0] = k1;
+        node->items[1] = v1;
+        node->items[2] = k2;
+        node->items[3] = v2;
+        return node;
+    }
+    uint32_t b1 = pmap_bit(h1, shift);
+    uint32_t b2 = pmap_bit(h2, shift);
+    if (b1 == b2) {
+        JanetPMapNode *node = pmap_node(0, b1, 0, 1);
+        node->items[0] = janet_wrap_abstract(pmap_pair(shift + JANET_PMAP_BITS, k1, v1, h1, k2, v2, h2));
+        return node;
+    }
+    JanetPMapNode *node = pmap_node(b1 | b2, 0, 0, 4);
+    int first = b1 < b2 ? 0 : 2;
+    node->items[first] = k1;
+    node->items[first + 1] = v1;
+    node->items[2 - first] = k2;
+    node->items[3 - first] = v2;
+    return node;
+}
+
+static const Janet *pmap_find(const JanetPMapNode *node, Janet key, uint32_t hash) {
+    int shift = 0;
+    while (NULL != node) {
+        if (node->collisions) {
+            for (int32_t i = 0; i < node->collisions; i++) {
+                if (janet_equals(node->items[2 * i], key)) return node->items + 2 * i + 1;
+            }
+            return NULL;
+        }
+        uint32_t bit = pmap_bit(hash, shift);
+        if (node->datamap & bit) {
+            int index = pmap_index(node->datamap, bit);
+            return janet_equals(node->items[2 * index], key) ? node->items + 2 * index + 1 : NULL;
+        }
+        if (!(node->nodemap & bit)) return NULL;
+        node = pmap_child(node, pmap_index(node->nodemap, bit));
+        shift += JANET_PMAP_BITS;
+    }
+    return NULL;
+}
+
+/* Copy a node, leaving room to insert or remove pairs and children. Items
+ * before a pair at dindex or a child at cindex are copied to the same place. */
+static JanetPMapNode *pmap_copy(const JanetPMapNode *node, uint32_t datamap, uint32_t nodemap,
+                                int32_t dindex, int32_t ddelta, int32_t cindex, int32_t cdelta) {
+    int32_t ndata = pmap_ndata(node);
+    int32_t nchildren = pmap_nchildren(node);
+    JanetPMapNode *copy = pmap_node(datamap, nodemap, 0,
+                                    2 * (ndata + ddelta) + nchildren + cdelta);
+    const Janet *src = node->items;
+    Janet *dest = copy->items;
+    /* Pairs before and after the change */
+    memcpy(dest, src, 2 * (size_t) dindex * sizeof(Janet));
+    if (ddelta >= 0) {
+        memcpy(dest + 2 * (dindex + ddelta), src + 2 * dindex, 2 * (size_t)(ndata - dindex) * sizeof(Janet));
+    } else {
+        memcpy(dest + 2 * dindex, src + 2 * (dindex + 1), 2 * (size_t)(ndata - dindex - 1) * sizeof(Janet));
+    }
+    /* Children before and after the change */
+    src += 2 * ndata;
+    dest += 2 * (ndata + ddelta);
+    memcpy(dest, src, (size_t) cindex * sizeof(Janet));
+    if (cdelta >= 0) {
+        memcpy(dest + cindex + cdelta, src + cindex, (size_t)(nchildren - cindex) * sizeof(Janet));
+    } else {
+        memcpy(dest + cindex, src + cindex + 1, (size_t)(nchildren - cindex - 1) * sizeof(Janet));
+    }
+    return copy;
+}
+
+static JanetPMapNode *pmap_assoc(const JanetPMapNode *node, int shift, Janet key, Janet value,
+                                 uint32_t hash, int *added) {
+    if (NULL == node) {
+        JanetPMapNode *leaf = pmap_node(pmap_bit(hash, shift), 0, 0, 2);
+        leaf->items[0] = key;
+        leaf->items[1] = value;
+        *added = 1;
+        return leaf;
+    }
+    if (node->collisions) {
+        int32_t n = node->collisions;
+        int32_t i;
+        for (i = 0; i < n && !janet_equals(node->items[2 * i], key); i++);
+        JanetPMapNode *copy = pmap_node(0, 0, i < n ? n : n + 1, 2 * (i < n ? n : n + 1));
+        memcpy(copy->items, node->items, 2 * (size_t) n * sizeof(Janet));
+        copy->items[2 * i] = key;
+        copy->items[2 * i + 1] = value;
+        *added = i == n;
+        return copy;
+    }
+    uint32_t bit = pmap_bit(hash, shift);
+    if (node->datamap & bit) {
+        int32_t index = pmap_index(node->datamap, bit);
+        Janet oldkey = node->items[2 * index];
+        if (janet_equals(oldkey, key)) {
+            JanetPMapNode *copy = pmap_copy(node, node->datamap, node->nodemap, index, 0, 0, 0);
+            copy->items[2 * index + 1] = value;
+            return copy;
+        }
+        /* Push both pairs down into a new child */
+        Janet oldvalue = node->items[2 * index + 1];
+        JanetPMapNode *child = pmap_pair(shift + JANET_PMAP_BITS,
+                                         oldkey, oldvalue, (uint32_t) janet_hash(oldkey),
+                                         key, value, hash);
+        int32_t cindex = pmap_index(node->nodemap, bit);
+        JanetPMapNode *copy = pmap_copy(node, node->datamap ^ bit, node->nodemap | bit,
+                                        index, -1, cindex, 1);
+        copy->items[2 * (pmap_ndata(node) - 1) + cindex] = janet_wrap_abstract(child);
+        *added = 1;
+        return copy;
+    }
+    if (node->nodemap & bit) {
+        int32_t cindex = pmap_index(node->nodemap, bit);
+        JanetPMapNode *child = pmap_assoc(pmap_child(node, cindex), shift + JANET_PMAP_BITS,
+                                          key, value, hash, added);
+        JanetPMapNode *copy = pmap_copy(node, node->datamap, node->nodemap, 0, 0, cindex, 0);
+        copy->items[2 * pmap_ndata(node) + cindex] = janet_wrap_abstract(child);
+        return copy;
+    }
+    int32_t index = pmap_index(node->datamap, bit);
+    JanetPMapNode *copy = pmap_copy(node, node->datamap | bit, node->nodemap, index, 1, 0, 0);
+    copy->items[2 * index] = key;
+    copy->items[2 * index + 1] = value;
+    *added = 1;
+    return copy;
+}
+
+/* A node with a single pair and no children gets merged into its parent */
+static int pmap_is_single(const JanetPMapNode *node) {
+    return node->collisions == 1 ||
+           (!node->collisions && !node->nodemap && pmap_popcount(node->datamap) == 1);
+}
+
+/* Returns node itself if key is not present, and NULL if the node is left empty. */
+static const JanetPMapNode *pmap_dissoc(const JanetPMapNode *node, int shift, Janet key,
+                                        uint32_t hash, int *removed) {
+    if (node->collisions) {
+        int32_t n = node->collisions;
+        int32_t i;
+        for (i = 0; i < n && !janet_equals(node->items[2 * i], key); i++);
+        if (i == n) return node;
+        *removed = 1;
+        JanetPMapNode *copy = pmap_node(0, 0, n - 1, 2 * (n - 1));
+        memcpy(copy->items, node->items, 2 * (size_t) i * sizeof(Janet));
+        memcpy(copy->items + 2 * i, node->items + 2 * (i + 1), 2 * (size_t)(n - i - 1) * sizeof(Janet));
+        return copy;
+    }
+    uint32_t bit = pmap_bit(hash, shift);
+    if (node->datamap & bit) {
+        int32_t index = pmap_index(node->datamap, bit);
+        if (!janet_equals(node->items[2 * index], key)) return node;
+        *removed = 1;
+        if (node->datamap == bit && !node->nodemap) return NULL;
+        return pmap_copy(node, node->datamap ^ bit, node->nodemap, index, -1, 0, 0);
+    }
+    if (node->nodemap & bit) {
+        int32_t cindex = pmap_index(node->nodemap, bit);
+        const JanetPMapNode *child = pmap_child(node, cindex);
+        const JanetPMapNode *newchild = pmap_dissoc(child, shift + JANET_PMAP_BITS, key, hash, removed);
+        if (newchild == child) return node;
+        if (NULL == newchild) {
+            if (node->nodemap == bit && !node->datamap) return NULL;
+            return pmap_copy(node, node->datamap, node->nodemap ^ bit, 0, 0, cindex, -1);
+        }
+        if (pmap_is_single(newchild)) {
+            /* If this node only leads to the child, pass the last pair further up */
+            if (!node->datamap && node->nodemap == bit) return newchild;
+            /* Otherwise pull the last pair of the child up into this node */
+            int32_t index = pmap_index(node->datamap, bit);
+            JanetPMapNode *copy = pmap_copy(node, node->datamap | bit, node->nodemap ^ bit,
+                                            index, 1, cindex, -1);
+            copy->items[2 * index] = newchild->items[0];
+            copy->items[2 * index + 1] = newchild->items[1];
+            return copy;
+        }
+        JanetPMapNode *copy = pmap_copy(node, node->datamap, node->nodemap, 0, 0, cindex, 0);
+        copy->items[2 * pmap_ndata(node) + cindex] = janet_wrap_abstract((JanetPMapNode *) newchild);
+        return copy;
+    }
+    return node;
+}
+
+/* Map values */
+
+static int pmap_gcmark(void *p, size_t size) {
+    JanetPMap *map = (JanetPMap *) p;
+    (void) size;
+    if (NULL != map->root) janet_mark(janet_wrap_abstract(map->root));
+    return 0;
+}
+
+static int pmap_get(void *p, Janet key, Janet *out) {
+    JanetPMap *map = (JanetPMap *) p;
+    const Janet *value = pmap_find(map->root, key, (uint32_t) janet_hash(key));
+    if (NULL == value) return 0;
+    *out = *value;
+    return 1;
+}
+
+static size_t pmap_length(void *p, size_t size) {
+    (void) size;
+    return (size_t)((JanetPMap *) p)->count;
+}
+
+static const Janet *pmap_first(const JanetPMapNode *node) {
+    while (NULL != node) {
+        if (node->collisions || node->datamap) return node->items;
+        node = pmap_child(node, 0);
+    }
+    return NULL;
+}
+
+/* Keys are visited depth first, with the pairs of a node before its children. */
+static Janet pmap_next(void *p, Janet key) {
+    JanetPMap *map = (JanetPMap *) p;
+    if (janet_checktype(key, JANET_NIL)) {
+        const Janet *first = pmap_first(map->root);
+        return first ? *first : janet_wrap_nil();
+    }
+    const JanetPMapNode *path[JANET_PMAP_MAX_DEPTH];
+    int32_t path_index[JANET_PMAP_MAX_DEPTH];
+    uint32_t hash = (uint32_t) janet_hash(key);
+    const JanetPMapNode *node = map->root;
+    int depth = 0;
+    int shift = 0;
+    while (NULL != node) {
+        if (node->collisions) {
+            int32_t i;
+            for (i = 0; i < node->collisions && !janet_equals(node->items[2 * i], key); i++);
+            if (i == node->collisions) return janet_wrap_nil();
+            if (i + 1 < node->collisions) return node->items[2 * (i + 1)];
+            break;
+        }
+        uint32_t bit = pmap_bit(hash, shift);
+        if (node->datamap & bit) {
+            int32_t index = pmap_index(node->datamap, bit);
+            if (!janet_equals(node->items[2 * index], key)) return janet_wrap_nil();
+            if (index + 1 < pmap_popcount(node->datamap)) return node->items[2 * (index + 1)];
+            if (node->nodemap) return *pmap_first(pmap_child(node, 0));
+            break;
+        }
+        if (!(node->nodemap & bit)) return janet_wrap_nil();
+        path[depth] = node;
+        path_index[depth] = pmap_index(node->nodemap, bit);
+        node = pmap_child(node, path_index[depth]);
+        depth++;
+        shift += JANET_PMAP_BITS;
+    }
+    if (NULL == node) return janet_wrap_nil();
+    /* Key was the last in its subtree, so move on to the next sibling subtree */
+    while (depth > 0) {
+        depth--;
+        const JanetPMapNode *parent = path[depth];
+        if (path_index[depth] + 1 < pmap_nchildren(parent)) {
+            return *pmap_first(pmap_child(parent, path_index[depth] + 1));
+        }
+    }
+    return janet_wrap_nil();
+}
+
+static uint32_t pmap_node_hash(const JanetPMapNode *node) {
+    /* Order independent, so maps with the same pairs hash the same in any collision order */
+    uint32_t hash = 0;
+    int32_t ndata = pmap_ndata(node);
+    int32_t nchildren = pmap_nchildren(node);
+    for (int32_t i = 0; i < ndata; i++) {
+        hash += janet_hash_mix((uint32_t) janet_hash(node->items[2 * i]),
+                               (uint32_t) janet_hash(node->items[2 * i + 1]));
+    }
+    for (int32_t i = 0; i < nchildren; i++) {
+        hash += pmap_node_hash(pmap_child(node, i));
+    }
+    return hash;
+}
+
+static int32_t pmap_hash(void *p, size_t size) {
+    JanetPMap *map = (JanetPMap *) p;
+    (void) size;
+    if (map->hash == 0) {
+        uint32_t hash = janet_hash_mix(33, (uint32_t) map->count);
+        if (NULL != map->root) hash = janet_hash_mix(hash, pmap_node_hash(map->root));
+        map->hash = hash ? (int32_t) hash : 1;
+    }
+    return map->hash;
+}
+
+/* Check that every pair in node is also in other */
+static int pmap_node_subset(const JanetPMapNode *node, const JanetPMapNode *other) {
+    int32_t ndata = pmap_ndata(node);
+    int32_t nchildren = pmap_nchildren(node);
+    for (int32_t i = 0; i < ndata; i++) {
+        Janet key = node->items[2 * i];
+        const Janet *value = pmap_find(other, key, (uint32_t) janet_hash(key));
+        if (NULL == value || !janet_equals(*value, node->items[2 * i + 1])) return 0;
+    }
+    for (int32_t i = 0; i < nchildren; i++) {
+        if (!pmap_node_subset(pmap_child(node, i), other)) return 0;
+    }
+    return 1;
+}
+
+static int pmap_compare(void *p1, void *p2) {
+    JanetPMap *m1 = (JanetPMap *) p1;
+    JanetPMap *m2 = (JanetPMap *) p2;
+    if (m1->root == m2->root) return 0;
+    if (m1->count != m2->count) return m1->count < m2->count ? -1 : 1;
+    int32_t h1 = pmap_hash(m1, 0);
+    int32_t h2 = pmap_hash(m2, 0);
+    if (h1 != h2) return h1 < h2 ? -1 : 1;
+    if (pmap_node_subset(m1->root, m2->root)) return 0;
+    return m1 < m2 ? -1 : 1;
+}
+
+static void pmap_marshal_node(const JanetPMapNode *node, JanetMarshalContext *ctx) {
+    int32_t ndata = pmap_ndata(node);
+    int32_t nchildren = pmap_nchildren(node);
+    for (int32_t i = 0; i < 2 * ndata; i++) {
+        janet_marshal_janet(ctx, node->items[i]);
+    }
+    for (int32_t i = 0; i < nchildren; i++) {
+        pmap_marshal_node(pmap_child(node, i), ctx);
+    }
+}
+
+static void pmap_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetPMap *map = (JanetPMap *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, map->count);
+    if (NULL != map->root) pmap_marshal_node(map->root, ctx);
+}
+
+static void pmap_put_pair(JanetPMap *map, Janet key, Janet value);
+
+static void *pmap_unmarshal(JanetMarshalContext *ctx) {
+    JanetPMap *map = janet_unmarshal_abstract(ctx, sizeof(JanetPMap));
+    map->root = NULL;
+    map->count = 0;
+    map->hash = 0;
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid pmap count");
+    for (int32_t i = 0; i < count; i++) {
+        Janet key = janet_unmarshal_janet(ctx);
+        Janet value = janet_unmarshal_janet(ctx);
+        pmap_put_pair(map, key, value);
+    }
+    return map;
+}
+
+static void pmap_tostring(void *p, JanetBuffer *buffer) {
+    JanetPMap *map = (JanetPMap *) p;
+    janet_buffer_push_u8(buffer, '{');
+    int first = 1;
+    for (Janet key = pmap_next(map, janet_wrap_nil());
+            !janet_checktype(key, JANET_NIL);
+            key = pmap_next(map, key)) {
+        Janet value;
+        pmap_get(map, key, &value);
+        if (!first) janet_buffer_push_u8(buffer, ' ');
+        first = 0;
+        janet_description_b(buffer, key);
+        janet_buffer_push_u8(buffer, ' ');
+        janet_description_b(buffer, value);
+    }
+    janet_buffer_push_u8(buffer, '}');
+}
+
+const JanetAbstractType janet_pmap_type = {
+    "core/pmap",
+    NULL,
+    pmap_gcmark,
+    pmap_get,
+    NULL,
+    pmap_marshal,
+    pmap_unmarshal,
+    pmap_tostring,
+    pmap_compare,
+    pmap_hash,
+    pmap_next,
+    NULL,
+    pmap_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetPMap *pmap_alloc(const JanetPMapNode *root, int32_t count) {
+    JanetPMap *map = janet_abstract(&janet_pmap_type, sizeof(JanetPMap));
+    map->root = (JanetPMapNode *) root;
+    map->count = count;
+    map->hash = 0;
+    return map;
+}
+
+/* Update a map that is still being built and not yet visible to any other code */
+static void pmap_put_pair(JanetPMap *map, Janet key, Janet value) {
+    if (janet_checktype(key, JANET_NIL)) return;
+    if (janet_checktype(key, JANET_NUMBER) && isnan(janet_unwrap_number(key))) return;
+    uint32_t hash = (uint32_t) janet_hash(key);
+    if (janet_checktype(value, JANET_NIL)) {
+        if (NULL == map->root) return;
+        int removed = 0;
+        const JanetPMapNode *root = pmap_dissoc(map->root, 0, key, hash, &removed);
+        if (NULL != root && root != map->root && pmap_is_single(root)) {
+            /* A single pair passed up from deeper in the trie must be re-indexed at the root */
+            root = pmap_assoc(NULL, 0, root->items[0], root->items[1],
+                              (uint32_t) janet_hash(root->items[0]), &removed);
+            removed = 1;
+        }
+        map->root = (JanetPMapNode *) root;
+        map->count -= removed;
+    } else {
+        int added = 0;
+        map->root = pmap_assoc(map->root, 0, key, value, hash, &added);
+        map->count += added;
+    }
+    map->hash = 0;
+}
+
+static void pmap_put_dict(JanetPMap *map, Janet dict) {
+    if (janet_checkabstract(dict, &janet_pmap_type)) {
+        JanetPMap *other = janet_unwrap_abstract(dict);
+        if (NULL == map->root) {
+            map->root = other->root;
+            map->count = other->count;
+            map->hash = other->hash;
+            return;
+        }
+        for (Janet key = pmap_next(other, janet_wrap_nil());
+                !janet_checktype(key, JANET_NIL);
+                key = pmap_next(other, key)) {
+            Janet value;
+            pmap_get(other, key, &value);
+            pmap_put_pair(map, key, value);
+        }
+        return;
+    }
+    const JanetKV *kvs = NULL;
+    int32_t len, cap = 0;
+    if (!janet_dictionary_view(dict, &kvs, &len, &cap)) {
+        janet_panicf("expected dictionary or pmap, got %v", dict);
+    }
+    for (int32_t i = 0; i < cap; i++) {
+        if (!janet_checktype(kvs[i].key, JANET_NIL)) {
+            pmap_put_pair(map, kvs[i].key, kvs[i].value);
+        }
+    }
+}
+
+static JanetPMap *pmap_getmap(const Janet *argv, int32_t n) {
+    return (JanetPMap *) janet_getabstract(argv, n, &janet_pmap_type);
+}
+
+/* C Functions */
+
+JANET_CORE_FN(cfun_pmap_new,
+              "(pmap/new & kvs)",
+              "Create a new persistent map from alternating keys and values. "
+              "Persistent maps are immutable like structs, but `pmap/put` and "
+              "`pmap/remove` return an updated map in O(log n) time by sharing "
+              "most of their structure with the original. They support `get`, "
+              "`in`, `length`, `next`, equality, hashing and marshalling.") {
+    if (argc & 1) janet_panic("expected even number of arguments");
+    JanetPMap *map = pmap_alloc(NULL, 0);
+    for (int32_t i = 0; i < argc; i += 2) {
+        pmap_put_pair(map, argv[i], argv[i + 1]);
+    }
+    return janet_wrap_abstract(map);
+}
+
+JANET_CORE_FN(cfun_pmap_put,
+              "(pmap/put m key value & more)",
+              "Return a new persistent map with `key` set to `value`. More keys "
+              "and values can follow. Putting a nil value removes the key. "
+              "The original map `m` is unchanged.") {
+    janet_arity(argc, 3, -1);
+    if (!(argc & 1)) janet_panic("expected even number of keys and values");
+    JanetPMap *src = pmap_getmap(argv, 0);
+    JanetPMap *map = pmap_alloc(src->root, src->count);
+    for (int32_t i = 1; i < argc; i += 2) {
+        pmap_put_pair(map, argv[i], argv[i + 1]);
+    }
+    return janet_wrap_abstract(map);
+}
+
+JANET_CORE_FN(cfun_pmap_remove,
+              "(pmap/remove m & keys)",
+              "Return a new persistent map without the given keys. The original "
+              "map `m` is unchanged.") {
+    janet_arity(argc, 1, -1);
+    JanetPMap *src = pmap_getmap(argv, 0);
+    JanetPMap *map = pmap_alloc(src->root, src->count);
+    for (int32_t i = 1; i < argc; i++) {
+        pmap_put_pair(map, argv[i], janet_wrap_nil());
+    }
+    return janet_wrap_abstract(map);
+}
+
+JANET_CORE_FN(cfun_pmap_merge,
+              "(pmap/merge & dicts)",
+              "Merge tables, structs and persistent maps into a new persistent map. "
+              "Later values replace earlier ones. Nothing is copied when the first "
+              "argument is already a persistent map.") {
+    JanetPMap *map = pmap_alloc(NULL, 0);
+    for (int32_t i = 0; i < argc; i++) {
+        pmap_put_dict(map, argv[i]);
+    }
+    return janet_wrap_abstract(map);
+}
+
+JANET_CORE_FN(cfun_pmap_to_struct,
+              "(pmap/to-struct m)",
+              "Convert a persistent map to a struct.") {
+    janet_fixarity(argc, 1);
+    JanetPMap *map = pmap_getmap(argv, 0);
+    JanetKV *st = janet_struct_begin(map->count);
+    for (Janet key = pmap_next(map, janet_wrap_nil());
+            !janet_checktype(key, JANET_NIL);
+            key = pmap_next(map, key)) {
+        Janet value;
+        pmap_get(map, key, &value);
+        janet_struct_put(st, key, value);
+    }
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+JANET_CORE_FN(cfun_pmap_to_table,
+              "(pmap/to-table m)",
+              "Convert a persistent map to a new table.") {
+    janet_fixarity(argc, 1);
+    JanetPMap *map = pmap_getmap(argv, 0);
+    JanetTable *t = janet_table(map->count);
+    for (Janet key = pmap_next(map, janet_wrap_nil());
+            !janet_checktype(key, JANET_NIL);
+            key = pmap_next(map, key)) {
+        Janet value;
+        pmap_get(map, key, &value);
+        janet_table_put(t, key, value);
+    }
+    return janet_wrap_table(t);
+}
+
+JANET_CORE_FN(cfun_pmap_pmapp,
+              "(pmap? x)",
+              "Check if `x` is a persistent map.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(janet_checkabstract(argv[0], &janet_pmap_type) != NULL);
+}
+
+/* Module entry point */
+void janet_lib_pmap(JanetTable *env) {
+    JanetRegExt pmap_cfuns[] = {
+        JANET_CORE_REG("pmap/new", cfun_pmap_new),
+        JANET_CORE_REG("pmap/put", cfun_pmap_put),
+        JANET_CORE_REG("pmap/remove", cfun_pmap_remove),
+        JANET_CORE_REG("pmap/merge", cfun_pmap_merge),
+        JANET_CORE_REG("pmap/to-struct", cfun_pmap_to_struct),
+        JANET_CORE_REG("pmap/to-table", cfun_pmap_to_table),
+        JANET_CORE_REG("pmap?", cfun_pmap_pmapp),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, pmap_cfuns);
+    janet_register_abstract_type(&janet_pmap_type);
+}
@@ -39,24 +39,9 @@
 /* Temporary buffer size */
 #define BUFSIZE 64
 
-/* Preprocessor hacks */
-#define STR_HELPER(x) #x
-#define STR(x) STR_HELPER(x)
-
 static void number_to_string_b(JanetBuffer *buffer, double x) {
-    janet_buffer_ensure(buffer, buffer->count + BUFSIZE, 2);
-    const char *fmt = (x == floor(x) &&
-                       x <= JANET_INTMAX_DOUBLE &&
-                       x >= JANET_INTMIN_DOUBLE) ? "%.0f" : ("%." STR(DBL_DIG) "g");
-    int count;
-    if (x == 0.0) {
-        /* Prevent printing of '-0' */
-        count = 1;
-        buffer->data[buffer->count] = '0';
-    } else {
-        count = snprintf((char *) buffer->data + buffer->count, BUFSIZE, fmt, x);
-    }
-    buffer->count += count;
+    /* Prevent printing of '-0' */
+    janet_buffer_dtostr_prec(buffer, x == 0.0 ? 0.0 : x, DBL_DIG);
 }
 
 /* expects non positive x */
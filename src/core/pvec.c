@@ -0,0 +1,479 @@
+/*
+* Copyright (c) 2026 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+/* Persistent vectors, stored as bit-partitioned tries with 32 slots per node.
+ * Leaves hold values, and inner nodes hold child nodes, indexed by 5 bits of
+ * the element's position per level. A vector is a window [start, start + count)
+ * into its trie, so slices share the trie of the original without copying.
+ * Changing an element copies only the nodes on its path.
+ *
+ * Transients are mutable vectors for building a vector in bulk. Every
+ * transient has a unique edit id, and nodes created by a transient are tagged
+ * with that id so the transient can keep changing them in place. Turning a
+ * transient back into a persistent vector retires its id. */
+
+#define JANET_PVEC_BITS 5
+#define JANET_PVEC_WIDTH 32
+#define JANET_PVEC_MASK 31
+
+typedef struct {
+    uint64_t edit; /* Transient that may change this node in place, or 0 */
+    Janet items[JANET_PVEC_WIDTH];
+} JanetPVecNode;
+
+typedef struct {
+    JanetPVecNode *root;
+    int32_t shift; /* Shift of the root level, 0 if the root is a leaf */
+    int32_t start;
+    int32_t count;
+    int32_t hash; /* 0 if not yet computed */
+    uint64_t edit; /* Edit id of a transient, 0 once made persistent */
+} JanetPVec;
+
+static JANET_THREAD_LOCAL uint64_t janet_pvec_next_edit = 0;
+
+static int pvec_node_gcmark(void *p, size_t size) {
+    JanetPVecNode *node = (JanetPVecNode *) p;
+    (void) size;
+    for (int i = 0; i < JANET_PVEC_WIDTH; i++) {
+        janet_mark(node->items[i]);
+    }
+    return 0;
+}
+
+static const JanetAbstractType janet_pvec_node_type = {
+    "core/pvec-node",
+    NULL,
+    pvec_node_gcmark,
+    JANET_ATEND_GCMARK
+};
+
+/* Get a node that may be changed by the given transient, copying it if needed */
+static JanetPVecNode *pvec_editable(JanetPVecNode *node, uint64_t edit) {
+    if (NULL != node && edit && node->edit == edit) return node;
+    JanetPVecNode *copy = janet_abstract(&janet_pvec_node_type, sizeof(JanetPVecNode));
+    copy->edit = edit;
+    if (NULL == node) {
+        for (int i = 0; i < JANET_PVEC_WIDTH; i++) {
+            copy->items[i] = janet_wrap_nil();
+        }
+    } else {
+        memcpy(copy->items, node->items, sizeof(copy->items));
+    }
+    return copy;
+}
+
+static JanetPVecNode *pvec_set_node(JanetPVecNode *node, int32_t shift, uint32_t index,
+                                    Janet value, uint64_t edit) {
+    JanetPVecNode *copy = pvec_editable(node, edit);
+    uint32_t slot = (index >> shift) & JANET_PVEC_MASK;
+    if (shift == 0) {
+        copy->items[slot] = value;
+    } else {
+        Janet child = copy->items[slot];
+        JanetPVecNode *childnode = janet_checktype(child, JANET_NIL) ? NULL : janet_unwrap_abstract(child);
+        childnode = pvec_set_node(childnode, shift - JANET_PVEC_BITS, index, value, edit);
+        copy->items[slot] = janet_wrap_abstract(childnode);
+    }
+    return copy;
+}
+
+static Janet pvec_ref(const JanetPVec *vec, int32_t i) {
+    uint32_t index = (uint32_t)(vec->start + i);
+    const JanetPVecNode *node = vec->root;
+    for (int32_t shift = vec->shift; shift > 0; shift -= JANET_PVEC_BITS) {
+        node = janet_unwrap_abstract(node->items[(index >> shift) & JANET_PVEC_MASK]);
+    }
+    return node->items[index & JANET_PVEC_MASK];
+}
+
+/* Set the element at position i, where i may be one past the end */
+static void pvec_set(JanetPVec *vec, int32_t i, Janet value) {
+    if (i == vec->count) {
+        if (vec->count == INT32_MAX || vec->start > INT32_MAX - vec->count - 1) {
+            janet_panic("pvec too large");
+        }
+        uint64_t index = (uint64_t) vec->start + (uint64_t) vec->count;
+        if (NULL != vec->root && (index >> (vec->shift + JANET_PVEC_BITS))) {
+            /* Out of room, so add a level above the root */
+            JanetPVecNode *root = pvec_editable(NULL, vec->edit);
+            root->items[0] = janet_wrap_abstract(vec->root);
+            vec->root = root;
+            vec->shift += JANET_PVEC_BITS;
+        }
+        vec->count++;
+    }
+    vec->root = pvec_set_node(vec->root, vec->shift, (uint32_t)(vec->start + i), value, vec->edit);
+    vec->hash = 0;
+}
+
+static void pvec_pop(JanetPVec *vec) {
+    if (vec->count == 1) {
+        vec->root = NULL;
+        vec->shift = 0;
+        vec->start = 0;
+        vec->count = 0;
+    } else {
+        /* Clear the slot so the popped value can be collected */
+        pvec_set(vec, vec->count - 1, janet_wrap_nil());
+        vec->count--;
+    }
+    vec->hash = 0;
+}
+
+/* Abstract type methods, shared by vectors and transients */
+
+static int pvec_gcmark(void *p, size_t size) {
+    JanetPVec *vec = (JanetPVec *) p;
+    (void) size;
+    if (NULL != vec->root) janet_mark(janet_wrap_abstract(vec->root));
+    return 0;
+}
+
+static int pvec_get(void *p, Janet key, Janet *out) {
+    JanetPVec *vec = (JanetPVec *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= vec->count) return 0;
+    *out = pvec_ref(vec, i);
+    return 1;
+}
+
+static size_t pvec_length(void *p, size_t size) {
+    (void) size;
+    return (size_t)((JanetPVec *) p)->count;
+}
+
+static Janet pvec_next(void *p, Janet key) {
+    JanetPVec *vec = (JanetPVec *) p;
+    int32_t i;
+    if (janet_checktype(key, JANET_NIL)) {
+        i = 0;
+    } else if (janet_checkint(key)) {
+        i = janet_unwrap_integer(key) + 1;
+    } else {
+        return janet_wrap_nil();
+    }
+    return (i >= 0 && i < vec->count) ? janet_wrap_integer(i) : janet_wrap_nil();
+}
+
+static void pvec_tostring(void *p, JanetBuffer *buffer) {
+    JanetPVec *vec = (JanetPVec *) p;
+    janet_buffer_push_u8(buffer, '[');
+    for (int32_t i = 0; i < vec->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        janet_description_b(buffer, pvec_ref(vec, i));
+    }
+    janet_buffer_push_u8(buffer, ']');
+}
+
+static int32_t pvec_hash(void *p, size_t size) {
+    JanetPVec *vec = (JanetPVec *) p;
+    (void) size;
+    if (vec->hash == 0) {
+        uint32_t hash = 33;
+        for (int32_t i = 0; i < vec->count; i++) {
+            hash = janet_hash_mix(hash, (uint32_t) janet_hash(pvec_ref(vec, i)));
+        }
+        vec->hash = hash ? (int32_t) hash : 1;
+    }
+    return vec->hash;
+}
+
+/* Same order as tuples - element by element, then by length */
+static int pvec_compare(void *p1, void *p2) {
+    JanetPVec *v1 = (JanetPVec *) p1;
+    JanetPVec *v2 = (JanetPVec *) p2;
+    int32_t n = v1->count < v2->count ? v1->count : v2->count;
+    for (int32_t i = 0; i < n; i++) {
+        int diff = janet_compare(pvec_ref(v1, i), pvec_ref(v2, i));
+        if (diff) return diff;
+    }
+    return v1->count == v2->count ? 0 : v1->count < v2->count ? -1 : 1;
+}
+
+static void pvec_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetPVec *vec = (JanetPVec *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, vec->count);
+    for (int32_t i = 0; i < vec->count; i++) {
+        janet_marshal_janet(ctx, pvec_ref(vec, i));
+    }
+}
+
+static void *pvec_unmarshal(JanetMarshalContext *ctx) {
+    JanetPVec *vec = janet_unmarshal_abstract(ctx, sizeof(JanetPVec));
+    vec->root = NULL;
+    vec->shift = 0;
+    vec->start = 0;
+    vec->count = 0;
+    vec->hash = 0;
+    vec->edit = ++janet_pvec_next_edit;
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0) janet_panic("invalid pvec count");
+    for (int32_t i = 0; i < count; i++) {
+        pvec_set(vec, i, janet_unmarshal_janet(ctx));
+    }
+    vec->edit = 0;
+    return vec;
+}
+
+static void pvec_transient_put(void *p, Janet key, Janet value);
+
+const JanetAbstractType janet_pvec_type = {
+    "core/pvec",
+    NULL,
+    pvec_gcmark,
+    pvec_get,
+    NULL,
+    pvec_marshal,
+    pvec_unmarshal,
+    pvec_tostring,
+    pvec_compare,
+    pvec_hash,
+    pvec_next,
+    NULL,
+    pvec_length,
+    JANET_ATEND_LENGTH
+};
+
+static const JanetAbstractType janet_pvec_transient_type = {
+    "core/pvec-transient",
+    NULL,
+    pvec_gcmark,
+    pvec_get,
+    pvec_transient_put,
+    NULL,
+    NULL,
+    pvec_tostring,
+    NULL,
+    NULL,
+    pvec_next,
+    NULL,
+    pvec_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetPVec *pvec_alloc(const JanetAbstractType *type, const JanetPVec *src, uint64_t edit) {
+    JanetPVec *vec = janet_abstract(type, sizeof(JanetPVec));
+    if (NULL == src) {
+        vec->root = NULL;
+        vec->shift = 0;
+        vec->start = 0;
+        vec->count = 0;
+        vec->hash = 0;
+    } else {
+        *vec = *src;
+    }
+    vec->edit = edit;
+    return vec;
+}
+
+static void pvec_transient_put(void *p, Janet key, Janet value) {
+    JanetPVec *vec = (JanetPVec *) p;
+    if (!vec->edit) janet_panic("transient pvec used after pvec/persistent");
+    if (!janet_checkint(key)) janet_panicf("expected integer key, got %v", key);
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i > vec->count) {
+        janet_panicf("index %d out of range [0, %d]", i, vec->count);
+    }
+    pvec_set(vec, i, value);
+}
+
+/* Functions that update a vector return a changed copy of a persistent vector,
+ * or change a transient in place and return it. */
+static JanetPVec *pvec_update(const Janet *argv, int32_t n) {
+    JanetPVec *vec = janet_checkabstract(argv[n], &janet_pvec_transient_type);
+    if (NULL != vec) {
+        if (!vec->edit) janet_panic("transient pvec used after pvec/persistent");
+        return vec;
+    }
+    vec = janet_getabstract(argv, n, &janet_pvec_type);
+    return pvec_alloc(&janet_pvec_type, vec, 0);
+}
+
+/* C Functions */
+
+JANET_CORE_FN(cfun_pvec_new,
+              "(pvec/new & xs)",
+              "Create a persistent vector of `xs`. Persistent vectors are immutable "
+              "sequences like tuples, but `pvec/push`, `pvec/set`, `pvec/pop` and "
+              "`pvec/slice` return a new vector in O(log n) time or better by sharing "
+              "structure with the original. They support `get`, `in`, `length`, "
+              "`next`, equality, hashing and marshalling.") {
+    JanetPVec *vec = pvec_alloc(&janet_pvec_type, NULL, ++janet_pvec_next_edit);
+    for (int32_t i = 0; i < argc; i++) {
+        pvec_set(vec, i, argv[i]);
+    }
+    vec->edit = 0;
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_from,
+              "(pvec/from xs)",
+              "Create a persistent vector from an indexed data structure `xs`.") {
+    janet_fixarity(argc, 1);
+    if (janet_checkabstract(argv[0], &janet_pvec_type)) return argv[0];
+    JanetView view = janet_getindexed(argv, 0);
+    JanetPVec *vec = pvec_alloc(&janet_pvec_type, NULL, ++janet_pvec_next_edit);
+    for (int32_t i = 0; i < view.len; i++) {
+        pvec_set(vec, i, view.items[i]);
+    }
+    vec->edit = 0;
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_push,
+              "(pvec/push v & xs)",
+              "Append `xs` to the end of vector `v`. Returns a new vector, or `v` "
+              "itself if it is a transient.") {
+    janet_arity(argc, 1, -1);
+    JanetPVec *vec = pvec_update(argv, 0);
+    for (int32_t i = 1; i < argc; i++) {
+        pvec_set(vec, vec->count, argv[i]);
+    }
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_set,
+              "(pvec/set v i x)",
+              "Set the element at index `i` of vector `v` to `x`. `i` may be the "
+              "length of `v` to append. Returns a new vector, or `v` itself if it "
+              "is a transient.") {
+    janet_fixarity(argc, 3);
+    JanetPVec *vec = pvec_update(argv, 0);
+    int32_t i = janet_getinteger(argv, 1);
+    if (i < 0 || i > vec->count) {
+        janet_panicf("index %d out of range [0, %d]", i, vec->count);
+    }
+    pvec_set(vec, i, argv[2]);
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_pop,
+              "(pvec/pop v)",
+              "Remove the last element of vector `v`. Returns a new vector, or `v` "
+              "itself if it is a transient. Popping an empty vector returns it unchanged.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *vec = pvec_update(argv, 0);
+    if (vec->count > 0) pvec_pop(vec);
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_slice,
+              "(pvec/slice v &opt start end)",
+              "Get a slice of persistent vector `v` from `start` to `end`, with the "
+              "same range semantics as `tuple/slice`. Takes constant time, and the "
+              "slice shares all of its elements with `v`.") {
+    janet_arity(argc, 1, 3);
+    JanetPVec *src = janet_getabstract(argv, 0, &janet_pvec_type);
+    JanetRange range = janet_getslice(argc, argv);
+    JanetPVec *vec = pvec_alloc(&janet_pvec_type, range.end > range.start ? src : NULL, 0);
+    if (range.end > range.start) {
+        vec->start = src->start + range.start;
+        vec->count = range.end - range.start;
+        vec->hash = 0;
+    }
+    return janet_wrap_abstract(vec);
+}
+
+JANET_CORE_FN(cfun_pvec_transient,
+              "(pvec/transient v)",
+              "Get a transient copy of persistent vector `v`. A transient can be "
+              "changed in place with `pvec/push`, `pvec/set`, `pvec/pop` and `put`, "
+              "which is much faster than building a vector one persistent update at "
+              "a time. Call `pvec/persistent` when done. `v` is never changed.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *src = janet_getabstract(argv, 0, &janet_pvec_type);
+    return janet_wrap_abstract(pvec_alloc(&janet_pvec_transient_type, src, ++janet_pvec_next_edit));
+}
+
+JANET_CORE_FN(cfun_pvec_persistent,
+              "(pvec/persistent t)",
+              "Turn transient `t` into a persistent vector in constant time. `t` "
+              "cannot be changed afterwards.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *src = janet_getabstract(argv, 0, &janet_pvec_transient_type);
+    if (!src->edit) janet_panic("transient pvec used after pvec/persistent");
+    src->edit = 0;
+    return janet_wrap_abstract(pvec_alloc(&janet_pvec_type, src, 0));
+}
+
+JANET_CORE_FN(cfun_pvec_to_tuple,
+              "(pvec/to-tuple v)",
+              "Convert a persistent vector or transient to a tuple.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *vec = janet_checkabstract(argv[0], &janet_pvec_transient_type);
+    if (NULL == vec) vec = janet_getabstract(argv, 0, &janet_pvec_type);
+    Janet *tup = janet_tuple_begin(vec->count);
+    for (int32_t i = 0; i < vec->count; i++) {
+        tup[i] = pvec_ref(vec, i);
+    }
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+JANET_CORE_FN(cfun_pvec_to_array,
+              "(pvec/to-array v)",
+              "Convert a persistent vector or transient to a new array.") {
+    janet_fixarity(argc, 1);
+    JanetPVec *vec = janet_checkabstract(argv[0], &janet_pvec_transient_type);
+    if (NULL == vec) vec = janet_getabstract(argv, 0, &janet_pvec_type);
+    JanetArray *array = janet_array(vec->count);
+    for (int32_t i = 0; i < vec->count; i++) {
+        array->data[i] = pvec_ref(vec, i);
+    }
+    array->count = vec->count;
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_pvec_pvecp,
+              "(pvec? x)",
+              "Check if `x` is a persistent vector.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(janet_checkabstract(argv[0], &janet_pvec_type) != NULL);
+}
+
+/* Module entry point */
+void janet_lib_pvec(JanetTable *env) {
+    JanetRegExt pvec_cfuns[] = {
+        JANET_CORE_REG("pvec/new", cfun_pvec_new),
+        JANET_CORE_REG("pvec/from", cfun_pvec_from),
+        JANET_CORE_REG("pvec/push", cfun_pvec_push),
+        JANET_CORE_REG("pvec/set", cfun_pvec_set),
+        JANET_CORE_REG("pvec/pop", cfun_pvec_pop),
+        JANET_CORE_REG("pvec/slice", cfun_pvec_slice),
+        JANET_CORE_REG("pvec/transient", cfun_pvec_transient),
+        JANET_CORE_REG("pvec/persistent", cfun_pvec_persistent),
+        JANET_CORE_REG("pvec/to-tuple", cfun_pvec_to_tuple),
+        JANET_CORE_REG("pvec/to-array", cfun_pvec_to_array),
+        JANET_CORE_REG("pvec?", cfun_pvec_pvecp),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, pvec_cfuns);
+    janet_register_abstract_type(&janet_pvec_type);
+}
@@ -0,0 +1,635 @@
+/*
+* Copyright (c) 2026 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#if defined(JANET_EV) && !defined(JANET_WINDOWS)
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+/* Ropes are immutable byte sequences stored as height balanced (AVL) trees.
+ * Leaves point into a Janet string, so a leaf can be a slice of a string
+ * without copying it, and inner nodes hold the total length of their
+ * subtrees. Every node is itself a rope value. Concatenation, insertion and
+ * slicing build a new tree in O(log n) time that shares all other nodes with
+ * the originals.
+ *
+ * Joining small leaves copies them into one leaf of at most
+ * JANET_ROPE_LEAF_MAX bytes, so building a rope from many small pieces does
+ * not leave one node per piece. */
+
+#define JANET_ROPE_LEAF_MAX 256
+#define JANET_ROPE_IOV_MAX 64
+
+typedef struct JanetRope JanetRope;
+struct JanetRope {
+    JanetRope *left; /* NULL for leaves */
+    JanetRope *right;
+    const uint8_t *str; /* Leaf data, NULL for an empty rope */
+    int32_t offset; /* Start of the leaf data in str */
+    int32_t height; /* 0 for leaves */
+    int64_t length;
+};
+
+static int rope_gcmark(void *p, size_t size) {
+    JanetRope *rope = (JanetRope *) p;
+    (void) size;
+    if (NULL != rope->left) {
+        janet_mark(janet_wrap_abstract(rope->left));
+        janet_mark(janet_wrap_abstract(rope->right));
+    } else if (NULL != rope->str) {
+        janet_mark(janet_wrap_string(rope->str));
+    }
+    return 0;
+}
+
+static int rope_get(void *p, Janet key, Janet *out);
+static size_t rope_length(void *p, size_t size);
+static Janet rope_next(void *p, Janet key);
+static void rope_tostring(void *p, JanetBuffer *buffer);
+static void rope_marshal(void *p, JanetMarshalContext *ctx);
+static void *rope_unmarshal(JanetMarshalContext *ctx);
+
+const JanetAbstractType janet_rope_type = {
+    "core/rope",
+    NULL,
+    rope_gcmark,
+    rope_get,
+    NULL,
+    rope_marshal,
+    rope_unmarshal,
+    rope_tostring,
+    NULL,
+    NULL,
+    rope_next,
+    NULL,
+    rope_length,
+    JANET_ATEND_LENGTH
+};
+
+/* Building ropes */
+
+static JanetRope *rope_leaf(const uint8_t *str, int32_t offset, int32_t length) {
+    JanetRope *rope = janet_abstract(&janet_rope_type, sizeof(JanetRope));
+    rope->left = NULL;
+    rope->right = NULL;
+    rope->str = length ? str : NULL;
+    rope->offset = length ? offset : 0;
+    rope->height = 0;
+    rope->length = length;
+    return rope;
+}
+
+static JanetRope *rope_node(JanetRope *left, JanetRope *right) {
+    JanetRope *rope = janet_abstract(&janet_rope_type, sizeof(JanetRope));
+    rope->left = left;
+    rope->right = right;
+    rope->str = NULL;
+    rope->offset = 0;
+    rope->height = 1 + (left->height > right->height ? left->height : right->height);
+    rope->length = left->length + right->length;
+    return rope;
+}
+
+/* Make a node from subtrees whose heights differ by at most 2, rotating
+ * once or twice if they differ by 2. */
+static JanetRope *rope_balance(JanetRope *left, JanetRope *right) {
+    if (right->height > left->height + 1) {
+        if (right->left->height > right->right->height) {
+            JanetRope *mid = right->left;
+            return rope_node(rope_node(left, mid->left), rope_node(mid->right, right->right));
+        }
+        return rope_node(rope_node(left, right->left), right->right);
+    }
+    if (left->height > right->height + 1) {
+        if (left->right->height > left->left->height) {
+            JanetRope *mid = left->right;
+            return rope_node(rope_node(left->left, mid->left), rope_node(mid->right, right));
+        }
+        return rope_node(left->left, rope_node(left->right, right));
+    }
+    return rope_node(left, right);
+}
+
+static JanetRope *rope_join(JanetRope *left, JanetRope *right) {
+    if (left->length == 0) return right;
+    if (right->length == 0) return left;
+    if (left->length > INT64_MAX - right->length) janet_panic("rope too large");
+    if (!left->height && !right->height &&
+            left->length + right->length <= JANET_ROPE_LEAF_MAX) {
+        int32_t nleft = (int32_t) left->length;
+        int32_t nright = (int32_t) right->length;
+        uint8_t *str = janet_string_begin(nleft + nright);
+        memcpy(str, left->str + left->offset, nleft);
+        memcpy(str + nleft, right->str + right->offset, nright);
+        return rope_leaf(janet_string_end(str), 0, nleft + nright);
+    }
+    /* Walk down the taller side until the heights are close. A small leaf is
+     * carried down to the nearest leaf so it can be merged with it. */
+    if (left->height > right->height + 1 ||
+            (!right->height && left->height && right->length < JANET_ROPE_LEAF_MAX)) {
+        return rope_balance(left->left, rope_join(left->right, right));
+    }
+    if (right->height > left->height + 1 ||
+            (!left->height && right->height && left->length < JANET_ROPE_LEAF_MAX)) {
+        return rope_balance(rope_join(left, right->left), right->right);
+    }
+    return rope_node(left, right);
+}
+
+/* Split a rope into the bytes before index and the bytes from index on */
+static void rope_split(JanetRope *rope, int64_t index, JanetRope **left, JanetRope **right) {
+    if (index <= 0) {
+        *left = rope_leaf(NULL, 0, 0);
+        *right = rope;
+    } else if (index >= rope->length) {
+        *left = rope;
+        *right = rope_leaf(NULL, 0, 0);
+    } else if (NULL == rope->left) {
+        int32_t i = (int32_t) index;
+        *left = rope_leaf(rope->str, rope->offset, i);
+        *right = rope_leaf(rope->str, rope->offset + i, (int32_t) rope->length - i);
+    } else if (index < rope->left->length) {
+        JanetRope *rest;
+        rope_split(rope->left, index, left, &rest);
+        *right = rope_join(rest, rope->right);
+    } else if (index == rope->left->length) {
+        *left = rope->left;
+        *right = rope->right;
+    } else {
+        JanetRope *rest;
+        rope_split(rope->right, index - rope->left->length, &rest, right);
+        *left = rope_join(rope->left, rest);
+    }
+}
+
+static JanetRope *rope_slice(JanetRope *rope, int64_t start, int64_t end) {
+    if (start == 0 && end == rope->length) return rope;
+    JanetRope *head, *tail;
+    rope_split(rope, end, &head, &tail);
+    rope_split(head, start, &tail, &head);
+    return head;
+}
+
+/* Turn a rope or byte sequence into a rope. Strings, symbols and keywords are
+ * shared, and other byte sequences are copied. */
+static JanetRope *rope_from(const Janet *argv, int32_t n) {
+    Janet x = argv[n];
+    JanetRope *rope = janet_checkabstract(x, &janet_rope_type);
+    if (NULL != rope) return rope;
+    switch (janet_type(x)) {
+        case JANET_STRING:
+        case JANET_SYMBOL:
+        case JANET_KEYWORD: {
+            const uint8_t *str = janet_unwrap_string(x);
+            return rope_leaf(str, 0, janet_string_length(str));
+        }
+        default: {
+            JanetByteView view;
+            if (!janet_bytes_view(x, &view.bytes, &view.len)) {
+                janet_panic_type(x, n, JANET_TFLAG_BYTES | JANET_TFLAG_ABSTRACT);
+            }
+            return rope_leaf(janet_string(view.bytes, view.len), 0, view.len);
+        }
+    }
+}
+
+static JanetRope *rope_from_args(JanetRope *rope, int32_t argc, const Janet *argv, int32_t first) {
+    for (int32_t i = first; i < argc; i++) {
+        rope = rope_join(rope, rope_from(argv, i));
+    }
+    return rope;
+}
+
+/* Reading ropes */
+
+static uint8_t rope_ref(const JanetRope *rope, int64_t index) {
+    while (NULL != rope->left) {
+        if (index < rope->left->length) {
+            rope = rope->left;
+        } else {
+            index -= rope->left->length;
+            rope = rope->right;
+        }
+    }
+    return rope->str[rope->offset + index];
+}
+
+/* Call visit on each leaf piece of the bytes in [start, end), in order.
+ * Stops early and returns 0 if visit returns 0. */
+typedef int (*JanetRopeVisitor)(const uint8_t *str, int32_t offset, int32_t length, void *arg);
+
+static int rope_visit(const JanetRope *rope, int64_t start, int64_t end,
+                      JanetRopeVisitor visit, void *arg) {
+    while (start < end) {
+        if (NULL == rope->left) {
+            return visit(rope->str, rope->offset + (int32_t) start, (int32_t)(end - start), arg);
+        }
+        int64_t nleft = rope->left->length;
+        if (start < nleft) {
+            if (!rope_visit(rope->left, start, end < nleft ? end : nleft, visit, arg)) return 0;
+        }
+        start = start > nleft ? start - nleft : 0;
+        end -= nleft;
+        rope = rope->right;
+    }
+    return 1;
+}
+
+static int rope_copy_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    uint8_t **dest = (uint8_t **) arg;
+    memcpy(*dest, str + offset, length);
+    *dest += length;
+    return 1;
+}
+
+static const uint8_t *rope_flatten(const JanetRope *rope, int64_t start, int64_t end) {
+    if (end - start > INT32_MAX) janet_panic("rope too large to flatten");
+    if (NULL == rope->left && start == 0 && end == rope->length &&
+            rope->offset == 0 && NULL != rope->str &&
+            janet_string_length(rope->str) == rope->length) {
+        return rope->str;
+    }
+    uint8_t *str = janet_string_begin((int32_t)(end - start));
+    uint8_t *dest = str;
+    rope_visit(rope, start, end, rope_copy_visitor, &dest);
+    return janet_string_end(str);
+}
+
+static int rope_buffer_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    janet_buffer_push_bytes((JanetBuffer *) arg, str + offset, length);
+    return 1;
+}
+
+static int rope_chunk_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    JanetArray *array = (JanetArray *) arg;
+    if (offset == 0 && length == janet_string_length(str)) {
+        janet_array_push(array, janet_wrap_string(str));
+    } else {
+        janet_array_push(array, janet_stringv(str + offset, length));
+    }
+    return 1;
+}
+
+/* Abstract type methods */
+
+static int rope_get(void *p, Janet key, Janet *out) {
+    JanetRope *rope = (JanetRope *) p;
+    if (!janet_checkint64(key)) return 0;
+    int64_t i = (int64_t) janet_unwrap_number(key);
+    if (i < 0 || i >= rope->length) return 0;
+    *out = janet_wrap_integer(rope_ref(rope, i));
+    return 1;
+}
+
+static size_t rope_length(void *p, size_t size) {
+    (void) size;
+    return (size_t)((JanetRope *) p)->length;
+}
+
+static Janet rope_next(void *p, Janet key) {
+    JanetRope *rope = (JanetRope *) p;
+    int64_t i;
+    if (janet_checktype(key, JANET_NIL)) {
+        i = 0;
+    } else if (janet_checkint64(key)) {
+        i = (int64_t) janet_unwrap_number(key) + 1;
+    } else {
+        return janet_wrap_nil();
+    }
+    return (i >= 0 && i < rope->length) ? janet_wrap_number((double) i) : janet_wrap_nil();
+}
+
+static void rope_tostring(void *p, JanetBuffer *buffer) {
+    JanetRope *rope = (JanetRope *) p;
+    int64_t shown = rope->length > 64 ? 64 : rope->length;
+    janet_description_b(buffer, janet_wrap_string(rope_flatten(rope, 0, shown)));
+    if (shown < rope->length) {
+        janet_formatb(buffer, "... (%f bytes)", (double) rope->length);
+    }
+}
+
+static int rope_count_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    (void) str;
+    (void) offset;
+    (void) length;
+    (*(int64_t *) arg)++;
+    return 1;
+}
+
+static int rope_marshal_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    JanetMarshalContext *ctx = (JanetMarshalContext *) arg;
+    janet_marshal_int(ctx, length);
+    janet_marshal_bytes(ctx, str + offset, length);
+    return 1;
+}
+
+/* Marshalled as the bytes of each leaf, so leaves are not shared between
+ * ropes after unmarshalling. */
+static void rope_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetRope *rope = (JanetRope *) p;
+    int64_t nleaves = 0;
+    janet_marshal_abstract(ctx, p);
+    rope_visit(rope, 0, rope->length, rope_count_visitor, &nleaves);
+    janet_marshal_int64(ctx, nleaves);
+    rope_visit(rope, 0, rope->length, rope_marshal_visitor, ctx);
+}
+
+static void *rope_unmarshal(JanetMarshalContext *ctx) {
+    JanetRope *result = janet_unmarshal_abstract(ctx, sizeof(JanetRope));
+    *result = (JanetRope) {
+        NULL, NULL, NULL, 0, 0, 0
+    };
+    JanetRope *rope = rope_leaf(NULL, 0, 0);
+    int64_t nleaves = janet_unmarshal_int64(ctx);
+    if (nleaves < 0) janet_panic("invalid rope");
+    for (int64_t i = 0; i < nleaves; i++) {
+        int32_t length = janet_unmarshal_int(ctx);
+        if (length <= 0) janet_panic("invalid rope leaf");
+        uint8_t *str = janet_string_begin(length);
+        janet_unmarshal_bytes(ctx, str, length);
+        rope = rope_join(rope, rope_leaf(janet_string_end(str), 0, length));
+    }
+    *result = *rope;
+    return result;
+}
+
+/* Writing ropes to streams. On POSIX, leaves are written straight from the
+ * tree with writev, up to JANET_ROPE_IOV_MAX at a time. Sockets use sendmsg
+ * with MSG_NOSIGNAL instead so a closed peer raises an error like net/write
+ * rather than killing the process with SIGPIPE. */
+
+#ifdef JANET_EV
+#ifndef JANET_WINDOWS
+
+typedef struct {
+    JanetRope *rope;
+    int64_t start;
+} RopeWriteState;
+
+typedef struct {
+    struct iovec iov[JANET_ROPE_IOV_MAX];
+    int count;
+} RopeIOVec;
+
+static int rope_iov_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    RopeIOVec *vec = (RopeIOVec *) arg;
+    vec->iov[vec->count].iov_base = (void *)(str + offset);
+    vec->iov[vec->count].iov_len = (size_t) length;
+    return ++vec->count < JANET_ROPE_IOV_MAX;
+}
+
+static void rope_ev_callback_write(JanetFiber *fiber, JanetAsyncEvent event) {
+    JanetStream *stream = fiber->ev_stream;
+    RopeWriteState *state = (RopeWriteState *) fiber->ev_state;
+    switch (event) {
+        default:
+            break;
+        case JANET_ASYNC_EVENT_MARK:
+            janet_mark(janet_wrap_abstract(state->rope));
+            break;
+        case JANET_ASYNC_EVENT_CLOSE:
+            janet_cancel(fiber, janet_cstringv("stream closed"));
+            janet_async_end(fiber);
+            break;
+        case JANET_ASYNC_EVENT_ERR:
+            janet_cancel(fiber, janet_cstringv("stream err"));
+            janet_async_end(fiber);
+            break;
+        case JANET_ASYNC_EVENT_HUP:
+            janet_cancel(fiber, janet_cstringv("stream hup"));
+            janet_async_end(fiber);
+            break;
+        case JANET_ASYNC_EVENT_INIT:
+        case JANET_ASYNC_EVENT_WRITE:
+            while (state->start < state->rope->length) {
+                RopeIOVec vec;
+                vec.count = 0;
+                rope_visit(state->rope, state->start, state->rope->length, rope_iov_visitor, &vec);
+                ssize_t nwrote;
+                do {
+                    if (stream->flags & JANET_STREAM_SOCKET) {
+                        struct msghdr msg;
+                        memset(&msg, 0, sizeof(msg));
+                        msg.msg_iov = vec.iov;
+                        msg.msg_iovlen = vec.count;
+                        nwrote = sendmsg(stream->handle, &msg, MSG_NOSIGNAL);
+                    } else {
+                        nwrote = writev(stream->handle, vec.iov, vec.count);
+                    }
+                } while (nwrote == -1 && errno == EINTR);
+                if (nwrote == -1) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                    janet_cancel(fiber, janet_ev_lasterr());
+                    janet_async_end(fiber);
+                    return;
+                }
+                if (nwrote == 0) {
+                    janet_cancel(fiber, janet_cstringv("disconnect"));
+                    janet_async_end(fiber);
+                    return;
+                }
+                state->start += nwrote;
+            }
+            janet_schedule(fiber, janet_wrap_nil());
+            janet_async_end(fiber);
+            break;
+    }
+}
+
+#endif
+
+static JANET_NO_RETURN void rope_ev_write(JanetStream *stream, JanetRope *rope) {
+#ifdef JANET_WINDOWS
+    janet_ev_write_string(stream, rope_flatten(rope, 0, rope->length));
+#else
+    RopeWriteState *state = janet_malloc(sizeof(RopeWriteState));
+    if (NULL == state) {
+        JANET_OUT_OF_MEMORY;
+    }
+    state->rope = rope;
+    state->start = 0;
+    janet_async_start(stream, JANET_ASYNC_LISTEN_WRITE, rope_ev_callback_write, state);
+#endif
+}
+
+#endif
+
+static int rope_file_visitor(const uint8_t *str, int32_t offset, int32_t length, void *arg) {
+    return fwrite(str + offset, length, 1, (FILE *) arg) == 1;
+}
+
+/* Get an index into a rope with the same rules as string/slice */
+static int64_t rope_getindex(const Janet *argv, int32_t argc, int32_t n, int64_t length, int64_t dflt) {
+    if (n >= argc || janet_checktype(argv[n], JANET_NIL)) return dflt;
+    int64_t i = janet_getinteger64(argv, n);
+    if (i < 0) i += length + 1;
+    if (i < 0 || i > length) {
+        janet_panicf("index %v out of range [0, %f]", argv[n], (double) length);
+    }
+    return i;
+}
+
+/* C Functions */
+
+JANET_CORE_FN(cfun_rope_new,
+              "(rope/new & parts)",
+              "Create a rope of the bytes of `parts`, which may be ropes, strings, "
+              "symbols, keywords, buffers or other byte sequences. Ropes are immutable "
+              "byte sequences for assembling large text. Joining ropes with `rope/new`, "
+              "`rope/insert` and `rope/slice` takes O(log n) time and shares the bytes of "
+              "the originals instead of copying them. Strings are shared as well, and "
+              "other byte sequences are copied. Ropes support `get`, `in`, `length`, "
+              "`next` and marshalling. Use `rope/flatten` to get a string where a "
+              "byte sequence is needed.") {
+    return janet_wrap_abstract(rope_from_args(rope_leaf(NULL, 0, 0), argc, argv, 0));
+}
+
+JANET_CORE_FN(cfun_rope_insert,
+              "(rope/insert r index & parts)",
+              "Get a rope with the bytes of `parts` inserted into rope `r` before byte "
+              "`index`. Negative indices count back from the end of `r`, as in "
+              "`string/slice`, so -1 appends.") {
+    janet_arity(argc, 2, -1);
+    JanetRope *rope = janet_getabstract(argv, 0, &janet_rope_type);
+    int64_t index = rope_getindex(argv, argc, 1, rope->length, 0);
+    JanetRope *head, *tail;
+    rope_split(rope, index, &head, &tail);
+    return janet_wrap_abstract(rope_join(rope_from_args(head, argc, argv, 2), tail));
+}
+
+JANET_CORE_FN(cfun_rope_slice,
+              "(rope/slice r &opt start end)",
+              "Get the bytes of rope `r` from `start` to `end` as a rope, with the same "
+              "range semantics as `string/slice`. The slice shares its bytes with `r`.") {
+    janet_arity(argc, 1, 3);
+    JanetRope *rope = janet_getabstract(argv, 0, &janet_rope_type);
+    int64_t start = rope_getindex(argv, argc, 1, rope->length, 0);
+    int64_t end = rope_getindex(argv, argc, 2, rope->length, rope->length);
+    if (end < start) end = start;
+    return janet_wrap_abstract(rope_slice(rope, start, end));
+}
+
+JANET_CORE_FN(cfun_rope_byte,
+              "(rope/byte r index)",
+              "Get the byte of rope `r` at `index` as an integer. Takes O(log n) time.") {
+    janet_fixarity(argc, 2);
+    JanetRope *rope = janet_getabstract(argv, 0, &janet_rope_type);
+    int64_t index = janet_getinteger64(argv, 1);
+    if (index < 0 || index >= rope->length) {
+        janet_panicf("index %v out of range [0, %f)", argv[1], (double) rope->length);
+    }
+    return janet_wrap_integer(rope_ref(rope, index));
+}
+
+JANET_CORE_FN(cfun_rope_flatten,
+              "(rope/flatten r &opt start end)",
+              "Copy the bytes of rope `r` from `start` to `end` into a new string, with "
+              "the same range semantics as `string/slice`.") {
+    janet_arity(argc, 1, 3);
+    JanetRope *rope = janet_getabstract(argv, 0, &janet_rope_type);
+    int64_t start = rope_getindex(argv, argc, 1, rope->length, 0);
+    int64_t end = rope_getindex(argv, argc, 2, rope->length, rope->length);
+    if (end < start) end = start;
+    return janet_wrap_string(rope_flatten(rope, start, end));
+}
+
+JANET_CORE_FN(cfun_rope_chunks,
+              "(rope/chunks r)",
+              "Get an array of strings that hold the bytes of rope `r` in order. Strings "
+              "that were added to the rope whole are returned as they are.") {
+    janet_fixarity(argc, 1);
+    JanetRope *rope = janet_getabstract(argv, 0, &janet_rope_type);
+    JanetArray *array = janet_array(0);
+    rope_visit(rope, 0, rope->length, rope_chunk_visitor, array);
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_rope_write,
+              "(rope/write dest r &opt timeout)",
+              "Write the bytes of rope `r` to `dest`, which may be a file, a stream or "
+              "a buffer, without flattening `r`. Writing to a stream suspends the "
+              "current fiber until the write completes, like `ev/write`, and takes an "
+              "optional timeout in seconds. Returns `dest`, or nil for a stream.") {
+    janet_arity(argc, 2, 3);
+    JanetRope *rope = janet_getabstract(argv, 1, &janet_rope_type);
+    if (janet_checktype(argv[0], JANET_BUFFER)) {
+        JanetBuffer *buffer = janet_unwrap_buffer(argv[0]);
+        if (rope->length > INT32_MAX - buffer->count) janet_panic("buffer overflow");
+        janet_buffer_extra(buffer, (int32_t) rope->length);
+        rope_visit(rope, 0, rope->length, rope_buffer_visitor, buffer);
+        return argv[0];
+    }
+    JanetFile *iof = janet_checkfile(argv[0]);
+    if (NULL != iof) {
+        if (iof->flags & JANET_FILE_CLOSED)
+            janet_panic("file is closed");
+        if (!(iof->flags & (JANET_FILE_WRITE | JANET_FILE_APPEND | JANET_FILE_UPDATE)))
+            janet_panic("file is not writeable");
+        if (!rope_visit(rope, 0, rope->length, rope_file_visitor, iof->file)) {
+            janet_panic("error writing to file");
+        }
+        return argv[0];
+    }
+#ifdef JANET_EV
+    JanetStream *stream = janet_checkabstract(argv[0], &janet_stream_type);
+    if (NULL != stream) {
+        janet_stream_flags(stream, JANET_STREAM_WRITABLE);
+        double to = janet_optnumber(argv, argc, 2, INFINITY);
+        if (to != INFINITY) janet_addtimeout(to);
+        rope_ev_write(stream, rope);
+    }
+#endif
+    janet_panicf("expected file, stream or buffer, got %v", argv[0]);
+}
+
+JANET_CORE_FN(cfun_rope_ropep,
+              "(rope? x)",
+              "Check if `x` is a rope.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(NULL != janet_checkabstract(argv[0], &janet_rope_type));
+}
+
+void janet_lib_rope(JanetTable *env) {
+    JanetRegExt rope_cfuns[] = {
+        JANET_CORE_REG("rope/new", cfun_rope_new),
+        JANET_CORE_REG("rope/insert", cfun_rope_insert),
+        JANET_CORE_REG("rope/slice", cfun_rope_slice),
+        JANET_CORE_REG("rope/byte", cfun_rope_byte),
+        JANET_CORE_REG("rope/flatten", cfun_rope_flatten),
+        JANET_CORE_REG("rope/chunks", cfun_rope_chunks),
+        JANET_CORE_REG("rope/write", cfun_rope_write),
+        JANET_CORE_REG("rope?", cfun_rope_ropep),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, rope_cfuns);
+    janet_register_abstract_type(&janet_rope_type);
+}
@@ -66,13 +66,37 @@ typedef struct {
     uint32_t sched_id;
     int is_error;
     int has_worker;
-#ifdef JANET_WINDOWS
-    HANDLE worker;
-    HANDLE worker_event;
-#else
-    pthread_t worker;
-#endif
+    void *worker; /* Watchdog entry used to interrupt the VM */
 } JanetTimeout;
+
+#ifndef JANET_EV_TIMER_HEAP
+/* Timeouts are kept in a hierarchical timing wheel. Each level has
+ * JANET_TW_SLOTS slots, and each slot in level n covers JANET_TW_SLOTS^n ticks.
+ * Timeouts too far in the future to fit in the wheel go in an overflow list. */
+#define JANET_TW_BITS 6
+#define JANET_TW_SLOTS (1 << JANET_TW_BITS)
+#define JANET_TW_LEVELS 6
+
+typedef struct JanetTimerNode JanetTimerNode;
+struct JanetTimerNode {
+    JanetTimeout to;
+    JanetTimerNode *next;
+    JanetTimerNode *prev;
+    uint64_t tick;
+    int16_t level;
+    int16_t slot;
+};
+
+typedef struct {
+    JanetTimerNode *slots[JANET_TW_LEVELS][JANET_TW_SLOTS];
+    uint64_t occupied[JANET_TW_LEVELS];
+    JanetTimerNode *overflow;
+    JanetTimerNode *expired;
+    JanetTimerNode *free_list;
+    uint64_t cur;
+    size_t deadline_count;
+} JanetTimerWheel;
+#endif
 #endif
 
 /* Registry table for C functions - contains metadata that can
@@ -88,6 +112,17 @@ typedef struct {
     /* int32_t max_arity; */
 } JanetCFunRegistry;
 
+/* Strings up to this many bytes are deduplicated through a small per-VM cache */
+#define JANET_SHORT_STRING_MAX 8
+#define JANET_SHORT_STRING_CACHE 1024
+
+/* A slot in the symbol cache. The hash is kept next to the symbol so that
+ * probing can skip most mismatches without touching the symbol itself. */
+typedef struct {
+    const uint8_t *sym;
+    int32_t hash;
+} JanetSymCacheSlot;
+
 struct JanetVM {
     /* Place for user data */
     void *user;
@@ -127,13 +162,22 @@ struct JanetVM {
      * We need this to look up the constructors when unmarshalling. */
     JanetTable *abstract_registry;
 
-    /* Immutable value cache */
-    const uint8_t **cache;
+    /* Immutable value cache. While the cache grows, symbols move from
+     * cache_old to cache a few slots at a time. */
+    JanetSymCacheSlot *cache;
     uint32_t cache_capacity;
     uint32_t cache_count;
     uint32_t cache_deleted;
+    JanetSymCacheSlot *cache_old;
+    uint32_t cache_old_capacity;
+    uint32_t cache_old_next;
     uint8_t gensym_counter[8];
 
+    /* Recently created short strings, indexed by a cheap hash of their
+     * contents. Cleared before every collection, so entries never keep a
+     * string alive. */
+    const uint8_t *short_strings[JANET_SHORT_STRING_CACHE];
+
     /* Garbage collection */
     void *blocks;
     void *weak_blocks;
@@ -172,14 +216,30 @@ struct JanetVM {
     /* Event loop and scheduler globals */
 #ifdef JANET_EV
     size_t tq_count;
-    size_t tq_capacity;
     JanetQueue spawn;
+#ifdef JANET_EV_TIMER_HEAP
+    size_t tq_capacity;
     JanetTimeout *tq;
+#else
+    JanetTimerWheel tw;
+#endif
     JanetRNG ev_rng;
     volatile JanetAtomicInt listener_count; /* used in signal handler, must be volatile */
     JanetTable threaded_abstracts; /* All abstract types that can be shared between threads (used in this thread) */
     JanetTable active_tasks; /* All possibly live task fibers - used just for tracking */
     JanetTable signal_handlers;
+    int32_t ev_max_events; /* Max number of events to get from one poll */
+    int32_t ev_accept_batch; /* Max number of connections accepted per readiness event */
+    int32_t ev_task_budget; /* Max number of tasks to resume before polling again, 0 for no limit */
+    void *ev_events; /* Buffer for polled events */
+    int32_t ev_events_capacity;
+#ifndef JANET_WINDOWS
+    void *proc_waiters; /* Subprocesses waited on with SIGCHLD when pidfds are not available */
+    size_t proc_waiter_count;
+    size_t proc_waiter_capacity;
+    int proc_sigchld_slot;
+    volatile JanetAtomicInt proc_sigchld_pending; /* used in signal handler, must be volatile */
+#endif
 #ifdef JANET_WINDOWS
     void **iocp;
     void *connect_ex; /* MSWsock extension if available */
@@ -218,6 +278,9 @@ void janet_net_deinit(void);
 #ifdef JANET_EV
 void janet_ev_init(void);
 void janet_ev_deinit(void);
+#ifndef JANET_WINDOWS
+void janet_ev_deinit_procs(void);
+#endif
 #endif
 
 #endif /* JANET_STATE_H_defined */
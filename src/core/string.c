@@ -45,14 +45,30 @@ const uint8_t *janet_string_end(uint8_t *str) {
     return str;
 }
 
-/* Load a buffer as a string */
+/* Load a buffer as a string. Short strings are looked up in a cache of recent
+ * short strings first, so repeated tokens, keys and single characters share
+ * one allocation and skip computing the full hash again. */
 const uint8_t *janet_string(const uint8_t *buf, int32_t len) {
+    const uint8_t **slot = NULL;
+    if (len <= JANET_SHORT_STRING_MAX) {
+        uint32_t h = 2166136261u ^ (uint32_t) len;
+        for (int32_t i = 0; i < len; i++) {
+            h = (h ^ buf[i]) * 16777619u;
+        }
+        slot = janet_vm.short_strings + ((h ^ (h >> 15)) & (JANET_SHORT_STRING_CACHE - 1));
+        const uint8_t *cached = *slot;
+        if (NULL != cached && janet_string_length(cached) == len &&
+                (len == 0 || !memcmp(cached, buf, len))) {
+            return cached;
+        }
+    }
     JanetStringHead *head = janet_gcalloc(JANET_MEMORY_STRING, sizeof(JanetStringHead) + (size_t) len + 1);
     head->length = len;
     head->hash = janet_string_calchash(buf, len);
     uint8_t *data = (uint8_t *)head->data;
     safe_memcpy(data, buf, len);
     data[len] = 0;
+    if (NULL != slot) *slot = data;
     return data;
 }
 
@@ -89,11 +105,11 @@ const uint8_t *janet_cstring(const char *str) {
     return janet_string((const uint8_t *)str, (int32_t)strlen(str));
 }
 
-/* Knuth Morris Pratt Algorithm */
+/* Substring search with janet_memsearch. The Knuth Morris Pratt table is
+ * only used to bound its worst case. */
 
 struct kmp_state {
     int32_t i;
-    int32_t j;
     int32_t textlen;
     int32_t patlen;
     int32_t *lookup;
@@ -114,7 +130,6 @@ static void kmp_init(
     }
     s->lookup = lookup;
     s->i = 0;
-    s->j = 0;
     s->text = text;
     s->pat = pat;
     s->textlen = textlen;
@@ -136,36 +151,85 @@ static void kmp_deinit(struct kmp_state *state) {
 
 static void kmp_seti(struct kmp_state *state, int32_t i) {
     state->i = i;
-    state->j = 0;
 }
 
 static int32_t kmp_next(struct kmp_state *state) {
-    int32_t i = state->i;
-    int32_t j = state->j;
-    int32_t textlen = state->textlen;
-    int32_t patlen = state->patlen;
-    const uint8_t *text = state->text;
-    const uint8_t *pat = state->pat;
-    int32_t *lookup = state->lookup;
-    while (i < textlen) {
-        if (text[i] == pat[j]) {
-            if (j == patlen - 1) {
-                state->i = i + 1;
-                state->j = lookup[j];
-                return i - j;
-            } else {
-                i++;
-                j++;
-            }
-        } else {
-            if (j > 0) {
-                j = lookup[j - 1];
-            } else {
-                i++;
+    if (state->i > state->textlen - state->patlen) return -1;
+    const uint8_t *found = janet_memsearch(state->text + state->i, (size_t)(state->textlen - state->i),
+                                           state->pat, (size_t) state->patlen, state->lookup);
+    if (NULL == found) {
+        state->i = state->textlen;
+        return -1;
+    }
+    int32_t result = (int32_t)(found - state->text);
+    state->i = result + 1;
+    return result;
+}
+
+/* Split a search between threads, see (dyn :match-threads). Each segment
+ * finds the occurrences that start inside it, reading past its end where
+ * needed, so the segments together find the same overlapping occurrences
+ * as a serial search. The lookup table is shared between segments. */
+
+typedef struct {
+    struct kmp_state kmp;
+    int32_t *found;
+    size_t count;
+    size_t capacity;
+} KmpSegment;
+
+static void kmp_segment_run(void *data, int32_t index) {
+    KmpSegment *seg = (KmpSegment *) data + index;
+    int32_t result;
+    while ((result = kmp_next(&seg->kmp)) >= 0) {
+        if (seg->count == seg->capacity) {
+            size_t newcap = seg->capacity ? 2 * seg->capacity : 64;
+            int32_t *found = janet_realloc(seg->found, sizeof(int32_t) * newcap);
+            if (NULL == found) {
+                JANET_OUT_OF_MEMORY;
             }
+            seg->found = found;
+            seg->capacity = newcap;
         }
+        seg->found[seg->count++] = result;
+    }
+}
+
+/* Returns NULL if the search should run serially */
+static KmpSegment *kmp_parallel(struct kmp_state *state, int32_t *count) {
+    int32_t n = janet_match_threads(state->textlen - state->i);
+    if (n <= 1) return NULL;
+    KmpSegment *segments = janet_smalloc(sizeof(KmpSegment) * n);
+    int64_t span = state->textlen - state->i;
+    for (int32_t k = 0; k < n; k++) {
+        KmpSegment *seg = segments + k;
+        int64_t to = state->i + span * (k + 1) / n;
+        int64_t end = to + state->patlen - 1;
+        seg->kmp = *state;
+        seg->kmp.i = state->i + (int32_t)(span * k / n);
+        seg->kmp.textlen = end < state->textlen ? (int32_t) end : state->textlen;
+        seg->found = NULL;
+        seg->count = 0;
+        seg->capacity = 0;
+    }
+    janet_os_parallel(n, kmp_segment_run, segments);
+    /* Move results to scratch memory */
+    for (int32_t k = 0; k < n; k++) {
+        KmpSegment *seg = segments + k;
+        int32_t *found = janet_smalloc(sizeof(int32_t) * (seg->count + 1));
+        if (seg->count) memcpy(found, seg->found, sizeof(int32_t) * seg->count);
+        janet_free(seg->found);
+        seg->found = found;
+    }
+    *count = n;
+    return segments;
+}
+
+static void kmp_parallel_free(KmpSegment *segments, int32_t count) {
+    for (int32_t k = 0; k < count; k++) {
+        janet_sfree(segments[k].found);
     }
-    return -1;
+    janet_sfree(segments);
 }
 
 /* CFuns */
@@ -351,10 +415,28 @@ JANET_CORE_FN(cfun_string_findall,
               "Searches for all instances of pattern `patt` in string "
               "`str`. Returns an array of all indices of found patterns. Overlapping "
               "instances of the pattern are counted individually, meaning a byte in `str` "
-              "may contribute to multiple found patterns.") {
-    int32_t result;
+              "may contribute to multiple found patterns. If `(dyn :match-threads)` is an "
+              "integer greater than 1, large strings are searched by that many threads. "
+              "The thread count is a dynamic binding rather than an argument so that it "
+              "also reaches searches made inside other functions. It is ignored if the "
+              "sandbox disallows `:threads`.") {
+    int32_t result, count;
     struct kmp_state state;
     findsetup(argc, argv, &state, 0);
+    KmpSegment *segments = kmp_parallel(&state, &count);
+    if (NULL != segments) {
+        size_t total = 0;
+        for (int32_t k = 0; k < count; k++) total += segments[k].count;
+        JanetArray *array = janet_array((int32_t) total);
+        for (int32_t k = 0; k < count; k++) {
+            for (size_t j = 0; j < segments[k].count; j++) {
+                array->data[array->count++] = janet_wrap_integer(segments[k].found[j]);
+            }
+        }
+        kmp_parallel_free(segments, count);
+        kmp_deinit(&state);
+        return janet_wrap_array(array);
+    }
     JanetArray *array = janet_array(0);
     while ((result = kmp_next(&state)) >= 0) {
         janet_array_push(array, janet_wrap_integer(result));
@@ -442,8 +524,9 @@ JANET_CORE_FN(cfun_string_split,
               "substrings. The substrings will not contain the delimiter `delim`. If `delim` "
               "is not found, the returned array will have one element. Will start searching "
               "for `delim` at the index `start` (if provided), and return up to a maximum "
-              "of `limit` results (if provided).") {
-    int32_t result;
+              "of `limit` results (if provided). Large strings can be searched by several "
+              "threads with `(dyn :match-threads)`, as with `string/find-all`.") {
+    int32_t result, count;
     JanetArray *array;
     struct kmp_state state;
     int32_t limit = -1, lastindex = 0;
@@ -452,6 +535,26 @@ JANET_CORE_FN(cfun_string_split,
     }
     findsetup(argc, argv, &state, 1);
     array = janet_array(0);
+    KmpSegment *segments = kmp_parallel(&state, &count);
+    if (NULL != segments) {
+        /* Segments find overlapping delimiters, keep the ones a serial split would use */
+        int done = 0;
+        for (int32_t k = 0; k < count && !done; k++) {
+            for (size_t j = 0; j < segments[k].count; j++) {
+                result = segments[k].found[j];
+                if (result < lastindex) continue;
+                if (!--limit) {
+                    done = 1;
+                    break;
+                }
+                const uint8_t *slice = janet_string(state.text + lastindex, result - lastindex);
+                janet_array_push(array, janet_wrap_string(slice));
+                lastindex = result + state.patlen;
+            }
+        }
+        kmp_parallel_free(segments, count);
+        kmp_seti(&state, state.textlen);
+    }
     while ((result = kmp_next(&state)) >= 0 && --limit) {
         const uint8_t *slice = janet_string(state.text + lastindex, result - lastindex);
         janet_array_push(array, janet_wrap_string(slice));
@@ -464,30 +567,25 @@ JANET_CORE_FN(cfun_string_split,
     return janet_wrap_array(array);
 }
 
+/* Make the 256 bit bitmap of the bytes in a set */
+static void set_bitmap(JanetByteView set, uint32_t *bitmap) {
+    memset(bitmap, 0, 8 * sizeof(uint32_t));
+    for (int32_t i = 0; i < set.len; i++) {
+        bitmap[set.bytes[i] >> 5] |= (uint32_t) 1 << (set.bytes[i] & 0x1F);
+    }
+}
+
 JANET_CORE_FN(cfun_string_checkset,
               "(string/check-set set str)",
               "Checks that the string `str` only contains bytes that appear in the string `set`. "
               "Returns true if all bytes in `str` appear in `set`, false if some bytes in `str` do "
               "not appear in `set`.") {
-    uint32_t bitset[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint32_t bitset[8];
     janet_fixarity(argc, 2);
     JanetByteView set = janet_getbytes(argv, 0);
     JanetByteView str = janet_getbytes(argv, 1);
-    /* Populate set */
-    for (int32_t i = 0; i < set.len; i++) {
-        int index = set.bytes[i] >> 5;
-        uint32_t mask = 1 << (set.bytes[i] & 0x1F);
-        bitset[index] |= mask;
-    }
-    /* Check set */
-    for (int32_t i = 0; i < str.len; i++) {
-        int index = str.bytes[i] >> 5;
-        uint32_t mask = 1 << (str.bytes[i] & 0x1F);
-        if (!(bitset[index] & mask)) {
-            return janet_wrap_false();
-        }
-    }
-    return janet_wrap_true();
+    set_bitmap(set, bitset);
+    return janet_wrap_boolean(janet_memscan(str.bytes, (size_t) str.len, bitset, 1) == (size_t) str.len);
 }
 
 JANET_CORE_FN(cfun_string_join,
@@ -569,35 +667,27 @@ JANET_CORE_FN(cfun_string_format,
     return janet_stringv(buffer->data, buffer->count);
 }
 
-static int trim_help_checkset(JanetByteView set, uint8_t x) {
-    for (int32_t j = 0; j < set.len; j++)
-        if (set.bytes[j] == x)
-            return 1;
-    return 0;
-}
-
-static int32_t trim_help_leftedge(JanetByteView str, JanetByteView set) {
-    for (int32_t i = 0; i < str.len; i++)
-        if (!trim_help_checkset(set, str.bytes[i]))
-            return i;
-    return str.len;
+static int32_t trim_help_leftedge(JanetByteView str, const uint32_t *set) {
+    return (int32_t) janet_memscan(str.bytes, (size_t) str.len, set, 1);
 }
 
-static int32_t trim_help_rightedge(JanetByteView str, JanetByteView set) {
+static int32_t trim_help_rightedge(JanetByteView str, const uint32_t *set) {
     for (int32_t i = str.len - 1; i >= 0; i--)
-        if (!trim_help_checkset(set, str.bytes[i]))
+        if (!(set[str.bytes[i] >> 5] & ((uint32_t) 1 << (str.bytes[i] & 0x1F))))
             return i + 1;
     return 0;
 }
 
-static void trim_help_args(int32_t argc, Janet *argv, JanetByteView *str, JanetByteView *set) {
+static void trim_help_args(int32_t argc, Janet *argv, JanetByteView *str, uint32_t *set) {
     janet_arity(argc, 1, 2);
     *str = janet_getbytes(argv, 0);
     if (argc >= 2) {
-        *set = janet_getbytes(argv, 1);
+        set_bitmap(janet_getbytes(argv, 1), set);
     } else {
-        set->bytes = (const uint8_t *)(" \t\r\n\v\f");
-        set->len = 6;
+        JanetByteView whitespace;
+        whitespace.bytes = (const uint8_t *)(" \t\r\n\v\f");
+        whitespace.len = 6;
+        set_bitmap(whitespace, set);
     }
 }
 
@@ -605,8 +695,9 @@ JANET_CORE_FN(cfun_string_trim,
               "(string/trim str &opt set)",
               "Trim leading and trailing whitespace from a byte sequence. If the argument "
               "`set` is provided, consider only characters in `set` to be whitespace.") {
-    JanetByteView str, set;
-    trim_help_args(argc, argv, &str, &set);
+    JanetByteView str;
+    uint32_t set[8];
+    trim_help_args(argc, argv, &str, set);
     int32_t left_edge = trim_help_leftedge(str, set);
     int32_t right_edge = trim_help_rightedge(str, set);
     if (right_edge < left_edge)
@@ -618,8 +709,9 @@ JANET_CORE_FN(cfun_string_triml,
               "(string/triml str &opt set)",
               "Trim leading whitespace from a byte sequence. If the argument "
               "`set` is provided, consider only characters in `set` to be whitespace.") {
-    JanetByteView str, set;
-    trim_help_args(argc, argv, &str, &set);
+    JanetByteView str;
+    uint32_t set[8];
+    trim_help_args(argc, argv, &str, set);
     int32_t left_edge = trim_help_leftedge(str, set);
     return janet_stringv(str.bytes + left_edge, str.len - left_edge);
 }
@@ -628,8 +720,9 @@ JANET_CORE_FN(cfun_string_trimr,
               "(string/trimr str &opt set)",
               "Trim trailing whitespace from a byte sequence. If the argument "
               "`set` is provided, consider only characters in `set` to be whitespace.") {
-    JanetByteView str, set;
-    trim_help_args(argc, argv, &str, &set);
+    JanetByteView str;
+    uint32_t set[8];
+    trim_help_args(argc, argv, &str, set);
     int32_t right_edge = trim_help_rightedge(str, set);
     return janet_stringv(str.bytes, right_edge);
 }
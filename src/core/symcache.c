@@ -36,156 +36,197 @@
 
 #include <string.h>
 
+/* Number of slots of the old table to move for every symbol added while
+ * the cache is growing. Moving at least two slots per symbol finishes well
+ * before the new table fills up. */
+#define JANET_SYMCACHE_MIGRATE 32
+
+static JanetSymCacheSlot *janet_symcache_alloc(uint32_t capacity) {
+    JanetSymCacheSlot *slots = janet_calloc(capacity, sizeof(JanetSymCacheSlot));
+    if (NULL == slots) {
+        JANET_OUT_OF_MEMORY;
+    }
+    return slots;
+}
+
 /* Initialize the cache (allocate cache memory) */
 void janet_symcache_init() {
     janet_vm.cache_capacity = 1024;
-    janet_vm.cache = janet_calloc(1, (size_t) janet_vm.cache_capacity * sizeof(const uint8_t *));
-    if (NULL == janet_vm.cache) {
-        JANET_OUT_OF_MEMORY;
-    }
+    janet_vm.cache = janet_symcache_alloc(janet_vm.cache_capacity);
     memset(&janet_vm.gensym_counter, '0', sizeof(janet_vm.gensym_counter));
     janet_vm.gensym_counter[0] = '_';
     janet_vm.cache_count = 0;
     janet_vm.cache_deleted = 0;
+    janet_vm.cache_old = NULL;
+    janet_vm.cache_old_capacity = 0;
+    janet_vm.cache_old_next = 0;
 }
 
 /* Deinitialize the cache (free the cache memory) */
 void janet_symcache_deinit() {
-    janet_free((void *)janet_vm.cache);
+    janet_free(janet_vm.cache);
+    janet_free(janet_vm.cache_old);
     janet_vm.cache = NULL;
     janet_vm.cache_capacity = 0;
     janet_vm.cache_count = 0;
     janet_vm.cache_deleted = 0;
+    janet_vm.cache_old = NULL;
+    janet_vm.cache_old_capacity = 0;
+    janet_vm.cache_old_next = 0;
 }
 
 /* Mark an entry in the table as deleted. */
 static const uint8_t JANET_SYMCACHE_DELETED[1] = {0};
 
-/* Find an item in the cache and return its location.
- * If the item is not found, return the location
- * where one would put it. */
-static const uint8_t **janet_symcache_findmem(
+/* Find a symbol with the given contents in one table, or return NULL. */
+static JanetSymCacheSlot *janet_symcache_lookup(
+    JanetSymCacheSlot *slots,
+    uint32_t capacity,
     const uint8_t *str,
     int32_t len,
-    int32_t hash,
-    int *success) {
-    uint32_t bounds[4];
-    uint32_t i, j, index;
-    const uint8_t **firstEmpty = NULL;
-
-    /* We will search two ranges - index to the end,
-     * and 0 to the index. */
-    index = (uint32_t)hash & (janet_vm.cache_capacity - 1);
-    bounds[0] = index;
-    bounds[1] = janet_vm.cache_capacity;
-    bounds[2] = 0;
-    bounds[3] = index;
-    for (j = 0; j < 4; j += 2)
-        for (i = bounds[j]; i < bounds[j + 1]; ++i) {
-            const uint8_t *test = janet_vm.cache[i];
-            /* Check empty spots */
-            if (NULL == test) {
-                if (NULL == firstEmpty)
-                    firstEmpty = janet_vm.cache + i;
-                goto notfound;
-            }
-            /* Check for marked deleted */
-            if (JANET_SYMCACHE_DELETED == test) {
-                if (firstEmpty == NULL)
-                    firstEmpty = janet_vm.cache + i;
-                continue;
-            }
-            if (janet_string_equalconst(test, str, len, hash)) {
-                /* Replace first deleted */
-                *success = 1;
-                if (firstEmpty != NULL) {
-                    *firstEmpty = test;
-                    janet_vm.cache[i] = JANET_SYMCACHE_DELETED;
-                    return firstEmpty;
-                }
-                return janet_vm.cache + i;
-            }
+    int32_t hash) {
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = (uint32_t) hash & mask;; i = (i + 1) & mask) {
+        const uint8_t *test = slots[i].sym;
+        if (NULL == test) return NULL;
+        if (slots[i].hash == hash && JANET_SYMCACHE_DELETED != test &&
+                janet_string_equalconst(test, str, len, hash)) {
+            return slots + i;
         }
-notfound:
-    *success = 0;
-    janet_assert(firstEmpty != NULL, "symcache failed to get memory");
-    return firstEmpty;
+    }
+}
+
+/* Find the slot holding a symbol in one table, or return NULL. */
+static JanetSymCacheSlot *janet_symcache_lookup_sym(
+    JanetSymCacheSlot *slots,
+    uint32_t capacity,
+    const uint8_t *sym) {
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = (uint32_t) janet_string_hash(sym) & mask;; i = (i + 1) & mask) {
+        const uint8_t *test = slots[i].sym;
+        if (NULL == test) return NULL;
+        if (test == sym) return slots + i;
+    }
 }
 
-#define janet_symcache_find(str, success) \
-    janet_symcache_findmem((str), janet_string_length(str), janet_string_hash(str), (success))
+/* Find a symbol in the cache, looking in the old table while growing */
+static const uint8_t *janet_symcache_find(const uint8_t *str, int32_t len, int32_t hash) {
+    JanetSymCacheSlot *slot = janet_symcache_lookup(janet_vm.cache, janet_vm.cache_capacity, str, len, hash);
+    if (NULL == slot && NULL != janet_vm.cache_old) {
+        slot = janet_symcache_lookup(janet_vm.cache_old, janet_vm.cache_old_capacity, str, len, hash);
+    }
+    return NULL == slot ? NULL : slot->sym;
+}
 
-/* Resize the cache. */
-static void janet_cache_resize(uint32_t newCapacity) {
-    uint32_t i, oldCapacity;
-    const uint8_t **oldCache = janet_vm.cache;
-    const uint8_t **newCache = janet_calloc(1, (size_t) newCapacity * sizeof(const uint8_t *));
-    if (newCache == NULL) {
-        JANET_OUT_OF_MEMORY;
+/* Insert a symbol known not to be in the table */
+static void janet_symcache_insert(const uint8_t *sym, int32_t hash) {
+    uint32_t mask = janet_vm.cache_capacity - 1;
+    uint32_t i = (uint32_t) hash & mask;
+    while (NULL != janet_vm.cache[i].sym && JANET_SYMCACHE_DELETED != janet_vm.cache[i].sym) {
+        i = (i + 1) & mask;
     }
-    oldCapacity = janet_vm.cache_capacity;
-    janet_vm.cache = newCache;
-    janet_vm.cache_capacity = newCapacity;
-    janet_vm.cache_deleted = 0;
-    /* Add all of the old cache entries back */
-    for (i = 0; i < oldCapacity; ++i) {
-        int status;
-        const uint8_t **bucket;
-        const uint8_t *x = oldCache[i];
-        if (x != NULL && x != JANET_SYMCACHE_DELETED) {
-            bucket = janet_symcache_find(x, &status);
-            if (status || bucket == NULL) {
-                /* there was a problem with the algorithm. */
-                break;
-            }
-            *bucket = x;
+    if (JANET_SYMCACHE_DELETED == janet_vm.cache[i].sym) janet_vm.cache_deleted--;
+    janet_vm.cache[i].sym = sym;
+    janet_vm.cache[i].hash = hash;
+}
+
+/* Move up to n slots from the old table into the new one. Moved slots are
+ * marked deleted so probe chains in the old table stay intact. */
+static void janet_symcache_migrate(uint32_t n) {
+    JanetSymCacheSlot *old = janet_vm.cache_old;
+    if (NULL == old) return;
+    uint32_t end = janet_vm.cache_old_capacity - janet_vm.cache_old_next;
+    end = janet_vm.cache_old_next + (n < end ? n : end);
+    for (uint32_t i = janet_vm.cache_old_next; i < end; i++) {
+        const uint8_t *sym = old[i].sym;
+        if (NULL != sym && JANET_SYMCACHE_DELETED != sym) {
+            janet_symcache_insert(sym, old[i].hash);
+            old[i].sym = JANET_SYMCACHE_DELETED;
         }
     }
-    /* Free the old cache */
-    janet_free((void *)oldCache);
+    janet_vm.cache_old_next = end;
+    if (end == janet_vm.cache_old_capacity) {
+        janet_free(old);
+        janet_vm.cache_old = NULL;
+        janet_vm.cache_old_capacity = 0;
+        janet_vm.cache_old_next = 0;
+    }
+}
+
+/* Make room for n more symbols. Instead of rehashing every symbol at once,
+ * the current table becomes the old table and is drained into a new one as
+ * symbols are added. */
+static void janet_symcache_reserve(uint32_t n) {
+    if ((janet_vm.cache_count + janet_vm.cache_deleted + n) * 2 <= janet_vm.cache_capacity) return;
+    /* Finish any earlier resize first, so there are at most two tables */
+    janet_symcache_migrate(janet_vm.cache_old_capacity);
+    if ((janet_vm.cache_count + janet_vm.cache_deleted + n) * 2 <= janet_vm.cache_capacity) return;
+    janet_vm.cache_old = janet_vm.cache;
+    janet_vm.cache_old_capacity = janet_vm.cache_capacity;
+    janet_vm.cache_old_next = 0;
+    janet_vm.cache_capacity = (uint32_t) janet_tablen((int32_t)(2 * (janet_vm.cache_count + n) + 1));
+    janet_vm.cache = janet_symcache_alloc(janet_vm.cache_capacity);
+    janet_vm.cache_deleted = 0;
 }
 
 /* Add an item to the cache */
-static void janet_symcache_put(const uint8_t *x, const uint8_t **bucket) {
-    if ((janet_vm.cache_count + janet_vm.cache_deleted) * 2 > janet_vm.cache_capacity) {
-        int status;
-        janet_cache_resize(janet_tablen((2 * janet_vm.cache_count + 1)));
-        bucket = janet_symcache_find(x, &status);
-    }
-    /* Add x to the cache */
+static void janet_symcache_put(const uint8_t *x, int32_t hash) {
+    janet_symcache_reserve(1);
+    janet_symcache_migrate(JANET_SYMCACHE_MIGRATE);
+    janet_symcache_insert(x, hash);
     janet_vm.cache_count++;
-    *bucket = x;
 }
 
 /* Remove a symbol from the symcache */
 void janet_symbol_deinit(const uint8_t *sym) {
-    int status = 0;
-    const uint8_t **bucket = janet_symcache_find(sym, &status);
-    if (status) {
-        janet_vm.cache_count--;
+    JanetSymCacheSlot *slot = janet_symcache_lookup_sym(janet_vm.cache, janet_vm.cache_capacity, sym);
+    if (NULL != slot) {
         janet_vm.cache_deleted++;
-        *bucket = JANET_SYMCACHE_DELETED;
+    } else if (NULL != janet_vm.cache_old) {
+        slot = janet_symcache_lookup_sym(janet_vm.cache_old, janet_vm.cache_old_capacity, sym);
+    }
+    if (NULL != slot) {
+        janet_vm.cache_count--;
+        slot->sym = JANET_SYMCACHE_DELETED;
     }
 }
 
-/* Create a symbol from a byte string */
-const uint8_t *janet_symbol(const uint8_t *str, int32_t len) {
-    int32_t hash = janet_string_calchash(str, len);
-    uint8_t *newstr;
-    int success = 0;
-    const uint8_t **bucket = janet_symcache_findmem(str, len, hash, &success);
-    if (success)
-        return *bucket;
+static const uint8_t *janet_symbol_hashed(const uint8_t *str, int32_t len, int32_t hash) {
+    const uint8_t *sym = janet_symcache_find(str, len, hash);
+    if (NULL != sym) return sym;
     JanetStringHead *head = janet_gcalloc(JANET_MEMORY_SYMBOL, sizeof(JanetStringHead) + (size_t) len + 1);
     head->hash = hash;
     head->length = len;
-    newstr = (uint8_t *)(head->data);
+    uint8_t *newstr = (uint8_t *)(head->data);
     safe_memcpy(newstr, str, len);
     newstr[len] = 0;
-    janet_symcache_put((const uint8_t *)newstr, bucket);
+    janet_symcache_put((const uint8_t *)newstr, hash);
     return newstr;
 }
 
+/* Create a symbol from a byte string */
+const uint8_t *janet_symbol(const uint8_t *str, int32_t len) {
+    return janet_symbol_hashed(str, len, janet_string_calchash(str, len));
+}
+
+/* Create many symbols at once. Room for all of them is reserved up front, so
+ * the cache grows at most once, and hashes are computed in batches ahead of
+ * the lookups. */
+void janet_symbol_many(const JanetByteView *strs, int32_t n, const uint8_t **out) {
+    int32_t hashes[64];
+    if (n <= 0) return;
+    janet_symcache_reserve((uint32_t) n);
+    for (int32_t i = 0; i < n; i += 64) {
+        int32_t m = (n - i) < 64 ? (n - i) : 64;
+        for (int32_t j = 0; j < m; j++) {
+            hashes[j] = janet_string_calchash(strs[i + j].bytes, strs[i + j].len);
+        }
+        for (int32_t j = 0; j < m; j++) {
+            out[i + j] = janet_symbol_hashed(strs[i + j].bytes, strs[i + j].len, hashes[j]);
+        }
+    }
+}
+
 /* Get a symbol from a cstring */
 const uint8_t *janet_csymbol(const char *cstr) {
     return janet_symbol((const uint8_t *)cstr, (int32_t) strlen(cstr));
@@ -213,28 +254,23 @@ static void inc_gensym(void) {
  * symbol will be of the format _XXXXXX, where X is a base64 digit, and
  * prefix is the argument passed. No prefix for speed. */
 const uint8_t *janet_symbol_gen(void) {
-    const uint8_t **bucket = NULL;
     uint8_t *sym;
     int32_t hash = 0;
-    int status;
     /* Leave spaces for 6 base 64 digits and two dashes. That means 64^6 possible suffixes, which
      * is enough for resolving collisions. */
     do {
         hash = janet_string_calchash(
                    janet_vm.gensym_counter,
                    sizeof(janet_vm.gensym_counter) - 1);
-        bucket = janet_symcache_findmem(
-                     janet_vm.gensym_counter,
-                     sizeof(janet_vm.gensym_counter) - 1,
-                     hash,
-                     &status);
-    } while (status && (inc_gensym(), 1));
+    } while (NULL != janet_symcache_find(janet_vm.gensym_counter,
+                                         sizeof(janet_vm.gensym_counter) - 1,
+                                         hash) && (inc_gensym(), 1));
     JanetStringHead *head = janet_gcalloc(JANET_MEMORY_SYMBOL, sizeof(JanetStringHead) + sizeof(janet_vm.gensym_counter));
     head->length = sizeof(janet_vm.gensym_counter) - 1;
     head->hash = hash;
     sym = (uint8_t *)(head->data);
     memcpy(sym, janet_vm.gensym_counter, sizeof(janet_vm.gensym_counter));
     sym[head->length] = 0;
-    janet_symcache_put((const uint8_t *)sym, bucket);
+    janet_symcache_put((const uint8_t *)sym, hash);
     return (const uint8_t *)sym;
 }
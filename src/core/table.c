@@ -30,32 +30,53 @@
 
 #define JANET_TABLE_FLAG_STACK 0x10000
 
-static void *janet_memalloc_empty_local(int32_t count) {
-    int32_t i;
-    void *mem = janet_smalloc((size_t) count * sizeof(JanetKV));
-    JanetKV *mmem = (JanetKV *)mem;
-    for (i = 0; i < count; i++) {
-        JanetKV *kv = mmem + i;
-        kv->key = janet_wrap_nil();
-        kv->value = janet_wrap_nil();
+/* Tables use Robin Hood hashing with backward shift deletion, so removing
+ * a key never leaves a tombstone behind. Every slot has a 16 bit tag, stored
+ * after the key-value pairs in the same allocation. The low byte of a tag is
+ * the distance of the entry from its home slot plus one (0 for an empty slot),
+ * saturating at JANET_TABLE_DIST_MAX. The high byte is the top byte of the
+ * key's hash, which lets probes skip most calls to janet_equals. Empty slots
+ * always hold nil for both key and value, so code that walks t->data directly
+ * keeps working.
+ *
+ * With JANET_TABLE_HASH_CACHE, the full hash of every key is also kept between
+ * the pairs and the tags. Rehashing and merging tables then never call janet_hash,
+ * and lookups only call janet_equals when the whole hash matches. */
+#define JANET_TABLE_DIST_MAX 0xFF
+#ifdef JANET_TABLE_HASH_CACHE
+#define JANET_TABLE_SLOT_SIZE (sizeof(JanetKV) + sizeof(int32_t) + sizeof(uint16_t))
+#define janet_table_hashes(data, cap) ((int32_t *)((data) + (cap)))
+#define janet_table_tags(data, cap) ((uint16_t *)(janet_table_hashes(data, cap) + (cap)))
+#define janet_table_slot_hash(data, cap, i) (janet_table_hashes(data, cap)[i])
+#else
+#define JANET_TABLE_SLOT_SIZE (sizeof(JanetKV) + sizeof(uint16_t))
+#define janet_table_tags(data, cap) ((uint16_t *)((data) + (cap)))
+#define janet_table_slot_hash(data, cap, i) janet_hash((data)[i].key)
+#endif
+#define janet_table_tag(hash, dist) ((uint16_t)((((uint32_t)(hash) >> 24) << 8) | (dist)))
+
+static JanetKV *janet_table_alloc(int32_t capacity, int islocal) {
+    size_t size = (size_t) capacity * JANET_TABLE_SLOT_SIZE;
+    JanetKV *data;
+    if (islocal) {
+        data = (JanetKV *) janet_smalloc(size);
+    } else {
+        data = (JanetKV *) janet_malloc(size);
+        if (NULL == data) {
+            JANET_OUT_OF_MEMORY;
+        }
+        janet_vm.next_collection += size;
     }
-    return mem;
+    janet_memempty(data, capacity);
+    memset(janet_table_tags(data, capacity), 0, (size_t) capacity * sizeof(uint16_t));
+    return data;
 }
 
 static JanetTable *janet_table_init_impl(JanetTable *table, int32_t capacity, int stackalloc) {
-    JanetKV *data;
     capacity = janet_tablen(capacity);
     if (stackalloc) table->gc.flags = JANET_TABLE_FLAG_STACK;
     if (capacity) {
-        if (stackalloc) {
-            data = janet_memalloc_empty_local(capacity);
-        } else {
-            data = (JanetKV *) janet_memalloc_empty(capacity);
-            if (NULL == data) {
-                JANET_OUT_OF_MEMORY;
-            }
-        }
-        table->data = data;
+        table->data = janet_table_alloc(capacity, stackalloc);
         table->capacity = capacity;
     } else {
         table->data = NULL;
@@ -108,34 +129,131 @@ JanetTable *janet_table_weakkv(int32_t capacity) {
     return janet_table_init_impl(table, capacity, 0);
 }
 
-/* Find the bucket that contains the given key. Will also return
- * bucket where key should go if not in the table. */
+/* Find the index of the slot holding key, or -1 if the key is not in the table. */
+static int32_t janet_table_index(JanetTable *t, Janet key, int32_t hash) {
+    if (t->capacity == 0) return -1;
+    uint32_t mask = (uint32_t) t->capacity - 1;
+    uint32_t index = (uint32_t) hash & mask;
+    uint16_t *tags = janet_table_tags(t->data, t->capacity);
+    uint16_t tag = janet_table_tag(hash, 1);
+    for (;;) {
+        uint16_t slot = tags[index];
+        /* An entry closer to its home than we are to ours means the key is absent */
+        if ((slot & 0xFF) < (tag & 0xFF)) return -1;
+#ifdef JANET_TABLE_HASH_CACHE
+        if (slot == tag && janet_table_hashes(t->data, t->capacity)[index] == hash &&
+                janet_equals(t->data[index].key, key)) return (int32_t) index;
+#else
+        if (slot == tag && janet_equals(t->data[index].key, key)) return (int32_t) index;
+#endif
+        index = (index + 1) & mask;
+        if ((tag & 0xFF) < JANET_TABLE_DIST_MAX) tag++;
+    }
+}
+
+/* Insert a key that is not yet in the table. The table must have a free slot. */
+static void janet_table_insert(JanetTable *t, Janet key, Janet value, int32_t hash) {
+    uint32_t mask = (uint32_t) t->capacity - 1;
+    uint32_t index = (uint32_t) hash & mask;
+    uint16_t *tags = janet_table_tags(t->data, t->capacity);
+    uint16_t tag = janet_table_tag(hash, 1);
+    JanetKV kv;
+    kv.key = key;
+    kv.value = value;
+    for (;;) {
+        uint16_t slot = tags[index];
+        if (slot == 0) {
+            tags[index] = tag;
+            t->data[index] = kv;
+#ifdef JANET_TABLE_HASH_CACHE
+            janet_table_hashes(t->data, t->capacity)[index] = hash;
+#endif
+            return;
+        }
+        if ((slot & 0xFF) < (tag & 0xFF)) {
+            /* Take the slot from the richer entry and carry it forward instead */
+            JanetKV displaced = t->data[index];
+            tags[index] = tag;
+            t->data[index] = kv;
+            tag = slot;
+            kv = displaced;
+#ifdef JANET_TABLE_HASH_CACHE
+            int32_t *hashes = janet_table_hashes(t->data, t->capacity);
+            int32_t displaced_hash = hashes[index];
+            hashes[index] = hash;
+            hash = displaced_hash;
+#endif
+        }
+        index = (index + 1) & mask;
+        if ((tag & 0xFF) < JANET_TABLE_DIST_MAX) tag++;
+    }
+}
+
+/* Remove the entry at index, shifting the rest of its cluster back one slot. */
+void janet_table_remove_index(JanetTable *t, int32_t i) {
+    uint32_t mask = (uint32_t) t->capacity - 1;
+    uint32_t index = (uint32_t) i;
+    uint16_t *tags = janet_table_tags(t->data, t->capacity);
+    for (;;) {
+        uint32_t next = (index + 1) & mask;
+        uint16_t slot = tags[next];
+        if ((slot & 0xFF) <= 1) break;
+        t->data[index] = t->data[next];
+#ifdef JANET_TABLE_HASH_CACHE
+        janet_table_hashes(t->data, t->capacity)[index] = janet_table_hashes(t->data, t->capacity)[next];
+#endif
+        if ((slot & 0xFF) == JANET_TABLE_DIST_MAX) {
+            /* Saturated distance, recompute it from the hash */
+            int32_t hash = janet_table_slot_hash(t->data, t->capacity, index);
+            uint32_t dist = ((index - ((uint32_t) hash & mask)) & mask) + 1;
+            slot = janet_table_tag(hash, dist < JANET_TABLE_DIST_MAX ? dist : JANET_TABLE_DIST_MAX);
+        } else {
+            slot--;
+        }
+        tags[index] = slot;
+        index = next;
+    }
+    tags[index] = 0;
+    t->data[index].key = janet_wrap_nil();
+    t->data[index].value = janet_wrap_nil();
+    t->count--;
+}
+
+/* Find the bucket that contains the given key. Returns NULL if the key
+ * is not in the table. */
+JanetKV *janet_table_lookup(JanetTable *t, Janet key) {
+    int32_t index = janet_table_index(t, key, janet_hash(key));
+    return index < 0 ? NULL : t->data + index;
+}
+
+/* Deprecated, kept for native modules. Like janet_table_lookup, but a missing
+ * key gives the first empty bucket on its probe sequence, as with the old open
+ * addressing layout. Only NULL for a table with no capacity. */
 JanetKV *janet_table_find(JanetTable *t, Janet key) {
-    return (JanetKV *) janet_dict_find(t->data, t->capacity, key);
+    int32_t hash = janet_hash(key);
+    int32_t index = janet_table_index(t, key, hash);
+    if (index >= 0) return t->data + index;
+    if (t->capacity == 0) return NULL;
+    uint32_t mask = (uint32_t) t->capacity - 1;
+    uint32_t i = (uint32_t) hash & mask;
+    uint16_t *tags = janet_table_tags(t->data, t->capacity);
+    while (tags[i]) i = (i + 1) & mask;
+    return t->data + i;
 }
 
 /* Resize the dictionary table. */
 static void janet_table_rehash(JanetTable *t, int32_t size) {
     JanetKV *olddata = t->data;
-    JanetKV *newdata;
-    int islocal = t->gc.flags & JANET_TABLE_FLAG_STACK;
-    if (islocal) {
-        newdata = (JanetKV *) janet_memalloc_empty_local(size);
-    } else {
-        newdata = (JanetKV *) janet_memalloc_empty(size);
-        if (NULL == newdata) {
-            JANET_OUT_OF_MEMORY;
-        }
-    }
     int32_t oldcapacity = t->capacity;
-    t->data = newdata;
+    uint16_t *oldtags = janet_table_tags(olddata, oldcapacity);
+    int islocal = t->gc.flags & JANET_TABLE_FLAG_STACK;
+    t->data = janet_table_alloc(size, islocal);
     t->capacity = size;
     t->deleted = 0;
     for (int32_t i = 0; i < oldcapacity; i++) {
-        JanetKV *kv = olddata + i;
-        if (!janet_checktype(kv->key, JANET_NIL)) {
-            JanetKV *newkv = janet_table_find(t, kv->key);
-            *newkv = *kv;
+        if (oldtags[i]) {
+            JanetKV *kv = olddata + i;
+            janet_table_insert(t, kv->key, kv->value, janet_table_slot_hash(olddata, oldcapacity, i));
         }
     }
     if (islocal) {
@@ -147,10 +265,11 @@ static void janet_table_rehash(JanetTable *t, int32_t size) {
 
 /* Get a value out of the table */
 Janet janet_table_get(JanetTable *t, Janet key) {
+    int32_t hash = janet_hash(key);
     for (int i = JANET_MAX_PROTO_DEPTH; t && i; t = t->proto, --i) {
-        JanetKV *bucket = janet_table_find(t, key);
-        if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
-            return bucket->value;
+        int32_t index = janet_table_index(t, key, hash);
+        if (index >= 0)
+            return t->data[index].value;
     }
     return janet_wrap_nil();
 }
@@ -168,11 +287,12 @@ Janet janet_table_get_keyword(JanetTable *t, const char *keyword) {
 
 /* Get a value out of the table, and record which prototype it was from. */
 Janet janet_table_get_ex(JanetTable *t, Janet key, JanetTable **which) {
+    int32_t hash = janet_hash(key);
     for (int i = JANET_MAX_PROTO_DEPTH; t && i; t = t->proto, --i) {
-        JanetKV *bucket = janet_table_find(t, key);
-        if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
+        int32_t index = janet_table_index(t, key, hash);
+        if (index >= 0) {
             *which = t;
-            return bucket->value;
+            return t->data[index].value;
         }
     }
     return janet_wrap_nil();
@@ -180,9 +300,9 @@ Janet janet_table_get_ex(JanetTable *t, Janet key, JanetTable **which) {
 
 /* Get a value out of the table. Don't check prototype tables. */
 Janet janet_table_rawget(JanetTable *t, Janet key) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
-        return bucket->value;
+    int32_t index = janet_table_index(t, key, janet_hash(key));
+    if (index >= 0)
+        return t->data[index].value;
     else
         return janet_wrap_nil();
 }
@@ -190,19 +310,30 @@ Janet janet_table_rawget(JanetTable *t, Janet key) {
 /* Remove an entry from the dictionary. Return the value that
  * was removed. */
 Janet janet_table_remove(JanetTable *t, Janet key) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-        Janet ret = bucket->value;
-        t->count--;
-        t->deleted++;
-        bucket->key = janet_wrap_nil();
-        bucket->value = janet_wrap_false();
+    int32_t index = janet_table_index(t, key, janet_hash(key));
+    if (index >= 0) {
+        Janet ret = t->data[index].value;
+        janet_table_remove_index(t, index);
         return ret;
     } else {
         return janet_wrap_nil();
     }
 }
 
+/* Put a non-nil value into the table, given the hash of the key */
+static void janet_table_put_hash(JanetTable *t, Janet key, Janet value, int32_t hash) {
+    int32_t index = janet_table_index(t, key, hash);
+    if (index >= 0) {
+        t->data[index].value = value;
+    } else {
+        if (2 * (t->count + 1) > t->capacity) {
+            janet_table_rehash(t, janet_tablen(2 * t->count + 2));
+        }
+        janet_table_insert(t, key, value, hash);
+        ++t->count;
+    }
+}
+
 /* Put a value into the object */
 void janet_table_put(JanetTable *t, Janet key, Janet value) {
     if (janet_checktype(key, JANET_NIL)) return;
@@ -210,37 +341,20 @@ void janet_table_put(JanetTable *t, Janet key, Janet value) {
     if (janet_checktype(value, JANET_NIL)) {
         janet_table_remove(t, key);
     } else {
-        JanetKV *bucket = janet_table_find(t, key);
-        if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL)) {
-            bucket->value = value;
-        } else {
-            if (NULL == bucket || 2 * (t->count + t->deleted + 1) > t->capacity) {
-                janet_table_rehash(t, janet_tablen(2 * t->count + 2));
-            }
-            bucket = janet_table_find(t, key);
-            if (janet_checktype(bucket->value, JANET_BOOLEAN))
-                --t->deleted;
-            bucket->key = key;
-            bucket->value = value;
-            ++t->count;
-        }
+        janet_table_put_hash(t, key, value, janet_hash(key));
     }
 }
 
 /* Used internally so don't check arguments
  * Put into a table, but if the key already exists do nothing. */
 static void janet_table_put_no_overwrite(JanetTable *t, Janet key, Janet value) {
-    JanetKV *bucket = janet_table_find(t, key);
-    if (NULL != bucket && !janet_checktype(bucket->key, JANET_NIL))
+    int32_t hash = janet_hash(key);
+    if (janet_table_index(t, key, hash) >= 0)
         return;
-    if (NULL == bucket || 2 * (t->count + t->deleted + 1) > t->capacity) {
+    if (2 * (t->count + 1) > t->capacity) {
         janet_table_rehash(t, janet_tablen(2 * t->count + 2));
     }
-    bucket = janet_table_find(t, key);
-    if (janet_checktype(bucket->value, JANET_BOOLEAN))
-        --t->deleted;
-    bucket->key = key;
-    bucket->value = value;
+    janet_table_insert(t, key, value, hash);
     ++t->count;
 }
 
@@ -249,6 +363,7 @@ void janet_table_clear(JanetTable *t) {
     int32_t capacity = t->capacity;
     JanetKV *data = t->data;
     janet_memempty(data, capacity);
+    memset(janet_table_tags(data, capacity), 0, (size_t) capacity * sizeof(uint16_t));
     t->count = 0;
     t->deleted = 0;
 }
@@ -256,15 +371,16 @@ void janet_table_clear(JanetTable *t) {
 /* Clone a table. */
 JanetTable *janet_table_clone(JanetTable *table) {
     JanetTable *newTable = janet_gcalloc(JANET_MEMORY_TABLE, sizeof(JanetTable));
+    size_t size = (size_t) table->capacity * JANET_TABLE_SLOT_SIZE;
     newTable->count = table->count;
     newTable->capacity = table->capacity;
     newTable->deleted = table->deleted;
     newTable->proto = table->proto;
-    newTable->data = janet_malloc(newTable->capacity * sizeof(JanetKV));
+    newTable->data = janet_malloc(size);
     if (NULL == newTable->data) {
         JANET_OUT_OF_MEMORY;
     }
-    memcpy(newTable->data, table->data, (size_t) table->capacity * sizeof(JanetKV));
+    safe_memcpy(newTable->data, table->data, size);
     return newTable;
 }
 
@@ -281,7 +397,18 @@ static void janet_table_mergekv(JanetTable *table, const JanetKV *kvs, int32_t c
 
 /* Merge a table into another table */
 void janet_table_merge_table(JanetTable *table, JanetTable *other) {
+#ifdef JANET_TABLE_HASH_CACHE
+    uint16_t *tags = janet_table_tags(other->data, other->capacity);
+    for (int32_t i = 0; i < other->capacity; i++) {
+        if (tags[i]) {
+            JanetKV *kv = other->data + i;
+            janet_table_put_hash(table, kv->key, kv->value,
+                                 janet_table_slot_hash(other->data, other->capacity, i));
+        }
+    }
+#else
     janet_table_mergekv(table, other->data, other->capacity);
+#endif
 }
 
 /* Merge a struct into a table */
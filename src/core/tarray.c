@@ -0,0 +1,767 @@
+/*
+* Copyright (c) 2026 Calvin Rose
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef JANET_AMALG
+#include "features.h"
+#include <janet.h>
+#include "util.h"
+#endif
+
+#include <inttypes.h>
+
+/* Typed arrays store numbers unboxed and packed in a storage block. An array
+ * is a view of count elements starting somewhere in its storage, so slices
+ * share the storage of the array they were taken from. The arithmetic
+ * kernels below work on raw element pointers. */
+
+typedef enum {
+    JANET_TARRAY_F64,
+    JANET_TARRAY_F32,
+    JANET_TARRAY_I32,
+    JANET_TARRAY_U8,
+    JANET_TARRAY_I64,
+    JANET_TARRAY_U64
+} JanetTArrayType;
+
+#define JANET_TARRAY_TYPE_COUNT 6
+
+static const char *const tarray_type_names[JANET_TARRAY_TYPE_COUNT] = {
+    "f64", "f32", "i32", "u8", "i64", "u64"
+};
+
+static const size_t tarray_type_sizes[JANET_TARRAY_TYPE_COUNT] = {
+    sizeof(double), sizeof(float), sizeof(int32_t), sizeof(uint8_t), sizeof(int64_t), sizeof(uint64_t)
+};
+
+typedef struct {
+    void *storage; /* Abstract that owns the elements */
+    uint8_t *data; /* First element of this view */
+    int32_t count;
+    JanetTArrayType type;
+} JanetTArray;
+
+/* Storage is a plain abstract of raw bytes, only reachable through views */
+static const JanetAbstractType janet_tarray_storage_type = {
+    "core/tarray-storage",
+    JANET_ATEND_NAME
+};
+
+static int tarray_gcmark(void *p, size_t size) {
+    JanetTArray *array = (JanetTArray *) p;
+    (void) size;
+    if (NULL != array->storage) janet_mark(janet_wrap_abstract(array->storage));
+    return 0;
+}
+
+/* Element access */
+
+static Janet tarray_wrap_s64(int64_t x) {
+#ifdef JANET_INT_TYPES
+    return janet_wrap_s64(x);
+#else
+    return janet_wrap_number((double) x);
+#endif
+}
+
+static Janet tarray_wrap_u64(uint64_t x) {
+#ifdef JANET_INT_TYPES
+    return janet_wrap_u64(x);
+#else
+    return janet_wrap_number((double) x);
+#endif
+}
+
+static Janet tarray_ref(const JanetTArray *array, int32_t i) {
+    const uint8_t *p = array->data + (size_t) i * tarray_type_sizes[array->type];
+    switch (array->type) {
+        default:
+        case JANET_TARRAY_F64:
+            return janet_wrap_number(*(const double *) p);
+        case JANET_TARRAY_F32:
+            return janet_wrap_number(*(const float *) p);
+        case JANET_TARRAY_I32:
+            return janet_wrap_number(*(const int32_t *) p);
+        case JANET_TARRAY_U8:
+            return janet_wrap_number(*p);
+        case JANET_TARRAY_I64:
+            return tarray_wrap_s64(*(const int64_t *) p);
+        case JANET_TARRAY_U64:
+            return tarray_wrap_u64(*(const uint64_t *) p);
+    }
+}
+
+/* Convert a Janet number to a single element of the given type at out */
+static void tarray_convert(JanetTArrayType type, Janet x, void *out) {
+    switch (type) {
+        default:
+        case JANET_TARRAY_F64:
+        case JANET_TARRAY_F32: {
+            if (!janet_checktype(x, JANET_NUMBER)) {
+                janet_panicf("expected number, got %v", x);
+            }
+            double d = janet_unwrap_number(x);
+            if (type == JANET_TARRAY_F64) {
+                *(double *) out = d;
+            } else {
+                *(float *) out = (float) d;
+            }
+            break;
+        }
+        case JANET_TARRAY_I32:
+            if (!janet_checkint(x)) {
+                janet_panicf("expected 32 bit signed integer, got %v", x);
+            }
+            *(int32_t *) out = janet_unwrap_integer(x);
+            break;
+        case JANET_TARRAY_U8: {
+            if (!janet_checkint(x) || janet_unwrap_integer(x) < 0 || janet_unwrap_integer(x) > 255) {
+                janet_panicf("expected integer in range [0, 255], got %v", x);
+            }
+            *(uint8_t *) out = (uint8_t) janet_unwrap_integer(x);
+            break;
+        }
+        case JANET_TARRAY_I64:
+            *(int64_t *) out = janet_getinteger64(&x, 0);
+            break;
+        case JANET_TARRAY_U64:
+            *(uint64_t *) out = janet_getuinteger64(&x, 0);
+            break;
+    }
+}
+
+/* Abstract type methods */
+
+static int tarray_get(void *p, Janet key, Janet *out) {
+    JanetTArray *array = (JanetTArray *) p;
+    if (!janet_checkint(key)) return 0;
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= array->count) return 0;
+    *out = tarray_ref(array, i);
+    return 1;
+}
+
+static void tarray_put(void *p, Janet key, Janet value) {
+    JanetTArray *array = (JanetTArray *) p;
+    if (!janet_checkint(key)) janet_panicf("expected integer key, got %v", key);
+    int32_t i = janet_unwrap_integer(key);
+    if (i < 0 || i >= array->count) {
+        janet_panicf("index %d out of range [0, %d)", i, array->count);
+    }
+    tarray_convert(array->type, value, array->data + (size_t) i * tarray_type_sizes[array->type]);
+}
+
+static size_t tarray_length(void *p, size_t size) {
+    (void) size;
+    return (size_t)((JanetTArray *) p)->count;
+}
+
+static Janet tarray_next(void *p, Janet key) {
+    JanetTArray *array = (JanetTArray *) p;
+    int32_t i;
+    if (janet_checktype(key, JANET_NIL)) {
+        i = 0;
+    } else if (janet_checkint(key)) {
+        i = janet_unwrap_integer(key) + 1;
+    } else {
+        return janet_wrap_nil();
+    }
+    return (i >= 0 && i < array->count) ? janet_wrap_integer(i) : janet_wrap_nil();
+}
+
+static JanetByteView tarray_bytes(void *p, size_t size) {
+    JanetTArray *array = (JanetTArray *) p;
+    JanetByteView view;
+    (void) size;
+    view.bytes = array->data;
+    view.len = (int32_t)((size_t) array->count * tarray_type_sizes[array->type]);
+    return view;
+}
+
+static void tarray_tostring(void *p, JanetBuffer *buffer) {
+    JanetTArray *array = (JanetTArray *) p;
+    janet_buffer_push_cstring(buffer, tarray_type_names[array->type]);
+    janet_buffer_push_cstring(buffer, " [");
+    for (int32_t i = 0; i < array->count; i++) {
+        if (i) janet_buffer_push_u8(buffer, ' ');
+        const uint8_t *elem = array->data + (size_t) i * tarray_type_sizes[array->type];
+        char str[32];
+        if (array->type == JANET_TARRAY_I64) {
+            snprintf(str, sizeof(str), "%" PRId64, *(const int64_t *) elem);
+            janet_buffer_push_cstring(buffer, str);
+        } else if (array->type == JANET_TARRAY_U64) {
+            snprintf(str, sizeof(str), "%" PRIu64, *(const uint64_t *) elem);
+            janet_buffer_push_cstring(buffer, str);
+        } else {
+            janet_description_b(buffer, tarray_ref(array, i));
+        }
+    }
+    janet_buffer_push_u8(buffer, ']');
+}
+
+/* Elements are written in native byte order, like buffer/push-float64 */
+static void tarray_marshal(void *p, JanetMarshalContext *ctx) {
+    JanetTArray *array = (JanetTArray *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, (int32_t) array->type);
+    janet_marshal_int(ctx, array->count);
+    janet_marshal_bytes(ctx, array->data, (size_t) array->count * tarray_type_sizes[array->type]);
+}
+
+static void *tarray_unmarshal(JanetMarshalContext *ctx) {
+    JanetTArray *array = janet_unmarshal_abstract(ctx, sizeof(JanetTArray));
+    array->storage = NULL;
+    array->data = NULL;
+    array->count = 0;
+    array->type = JANET_TARRAY_U8;
+    int32_t type = janet_unmarshal_int(ctx);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (type < 0 || type >= JANET_TARRAY_TYPE_COUNT || count < 0 ||
+            (size_t) count > INT32_MAX / tarray_type_sizes[type]) {
+        janet_panic("invalid tarray");
+    }
+    size_t nbytes = (size_t) count * tarray_type_sizes[type];
+    /* Check the input holds all elements before allocating them */
+    if (nbytes) janet_unmarshal_ensure(ctx, nbytes - 1);
+    array->storage = janet_abstract(&janet_tarray_storage_type, nbytes);
+    array->data = array->storage;
+    array->count = count;
+    array->type = (JanetTArrayType) type;
+    janet_unmarshal_bytes(ctx, array->data, nbytes);
+    return array;
+}
+
+const JanetAbstractType janet_tarray_type = {
+    "core/tarray",
+    NULL,
+    tarray_gcmark,
+    tarray_get,
+    tarray_put,
+    tarray_marshal,
+    tarray_unmarshal,
+    tarray_tostring,
+    NULL,
+    NULL,
+    tarray_next,
+    NULL,
+    tarray_length,
+    tarray_bytes,
+    JANET_ATEND_BYTES
+};
+
+static JanetTArray *tarray_new(JanetTArrayType type, int32_t count) {
+    if (count < 0) janet_panicf("expected non-negative length, got %d", count);
+    size_t nbytes = (size_t) count * tarray_type_sizes[type];
+    if (nbytes > INT32_MAX) janet_panic("tarray too large");
+    void *storage = janet_abstract(&janet_tarray_storage_type, nbytes);
+    memset(storage, 0, nbytes);
+    JanetTArray *array = janet_abstract(&janet_tarray_type, sizeof(JanetTArray));
+    array->storage = storage;
+    array->data = storage;
+    array->count = count;
+    array->type = type;
+    return array;
+}
+
+/* Kernels. Each one is generated per element type with restrict pointers,
+ * and loops over fixed size blocks so that the compiler can turn the block
+ * into vector instructions without -O3. Integer arithmetic is done on
+ * unsigned types so that overflow wraps around instead of being undefined. */
+
+#if defined(_MSC_VER) || defined(__cplusplus)
+#define JANET_TARRAY_RESTRICT __restrict
+#else
+#define JANET_TARRAY_RESTRICT restrict
+#endif
+
+#define JANET_TARRAY_BLOCK 16
+
+typedef void (*JanetTArrayKernel)(void *d, const void *a, const void *b, const void *c, int32_t n);
+
+#define JANET_TARRAY_KERNEL(NAME, S, DT, T, EXPR) \
+    static void NAME##_##S##_impl(DT *JANET_TARRAY_RESTRICT d, const T *JANET_TARRAY_RESTRICT a, \
+                                  const T *JANET_TARRAY_RESTRICT b, const T *JANET_TARRAY_RESTRICT c, \
+                                  int32_t n) { \
+        int32_t i = 0; \
+        (void) b; \
+        (void) c; \
+        for (; i + JANET_TARRAY_BLOCK <= n; i += JANET_TARRAY_BLOCK) { \
+            for (int32_t j = 0; j < JANET_TARRAY_BLOCK; j++) { \
+                int32_t k = i + j; \
+                d[k] = (EXPR); \
+            } \
+        } \
+        for (int32_t k = i; k < n; k++) d[k] = (EXPR); \
+    } \
+    static void NAME##_##S(void *d, const void *a, const void *b, const void *c, int32_t n) { \
+        NAME##_##S##_impl(d, a, b, c, n); \
+    }
+
+#define JANET_TARRAY_KERNELS(S, T, W) \
+    JANET_TARRAY_KERNEL(tarray_add, S, T, T, (T)((W) a[k] + (W) b[k])) \
+    JANET_TARRAY_KERNEL(tarray_sub, S, T, T, (T)((W) a[k] - (W) b[k])) \
+    JANET_TARRAY_KERNEL(tarray_mul, S, T, T, (T)((W) a[k] * (W) b[k])) \
+    JANET_TARRAY_KERNEL(tarray_fma, S, T, T, (T)((W) a[k] * (W) b[k] + (W) c[k])) \
+    JANET_TARRAY_KERNEL(tarray_min, S, T, T, b[k] < a[k] ? b[k] : a[k]) \
+    JANET_TARRAY_KERNEL(tarray_max, S, T, T, a[k] < b[k] ? b[k] : a[k]) \
+    JANET_TARRAY_KERNEL(tarray_lt, S, uint8_t, T, a[k] < b[k]) \
+    JANET_TARRAY_KERNEL(tarray_le, S, uint8_t, T, a[k] <= b[k]) \
+    JANET_TARRAY_KERNEL(tarray_gt, S, uint8_t, T, a[k] > b[k]) \
+    JANET_TARRAY_KERNEL(tarray_ge, S, uint8_t, T, a[k] >= b[k]) \
+    JANET_TARRAY_KERNEL(tarray_eq, S, uint8_t, T, a[k] == b[k]) \
+    JANET_TARRAY_KERNEL(tarray_neq, S, uint8_t, T, a[k] != b[k])
+
+/* Reductions keep one accumulator per block lane, so additions in different
+ * lanes are independent and can be vectorized. */
+#define JANET_TARRAY_REDUCTIONS(S, T, ACC) \
+    static ACC tarray_sum_##S(const T *JANET_TARRAY_RESTRICT a, int32_t n) { \
+        ACC acc[JANET_TARRAY_BLOCK] = {0}; \
+        ACC total = 0; \
+        int32_t i = 0; \
+        for (; i + JANET_TARRAY_BLOCK <= n; i += JANET_TARRAY_BLOCK) { \
+            for (int32_t k = 0; k < JANET_TARRAY_BLOCK; k++) acc[k] += (ACC) a[i + k]; \
+        } \
+        for (int32_t k = 0; k < JANET_TARRAY_BLOCK; k++) total += acc[k]; \
+        for (; i < n; i++) total += (ACC) a[i]; \
+        return total; \
+    } \
+    static ACC tarray_dot_##S(const T *JANET_TARRAY_RESTRICT a, const T *JANET_TARRAY_RESTRICT b, int32_t n) { \
+        ACC acc[JANET_TARRAY_BLOCK] = {0}; \
+        ACC total = 0; \
+        int32_t i = 0; \
+        for (; i + JANET_TARRAY_BLOCK <= n; i += JANET_TARRAY_BLOCK) { \
+            for (int32_t k = 0; k < JANET_TARRAY_BLOCK; k++) acc[k] += (ACC) a[i + k] * (ACC) b[i + k]; \
+        } \
+        for (int32_t k = 0; k < JANET_TARRAY_BLOCK; k++) total += acc[k]; \
+        for (; i < n; i++) total += (ACC) a[i] * (ACC) b[i]; \
+        return total; \
+    }
+
+JANET_TARRAY_KERNELS(f64, double, double)
+JANET_TARRAY_KERNELS(f32, float, float)
+JANET_TARRAY_KERNELS(i32, int32_t, uint32_t)
+JANET_TARRAY_KERNELS(u8, uint8_t, uint8_t)
+JANET_TARRAY_KERNELS(i64, int64_t, uint64_t)
+JANET_TARRAY_KERNELS(u64, uint64_t, uint64_t)
+
+JANET_TARRAY_REDUCTIONS(f64, double, double)
+JANET_TARRAY_REDUCTIONS(f32, float, double)
+JANET_TARRAY_REDUCTIONS(i32, int32_t, uint64_t)
+JANET_TARRAY_REDUCTIONS(u8, uint8_t, uint64_t)
+JANET_TARRAY_REDUCTIONS(i64, int64_t, uint64_t)
+JANET_TARRAY_REDUCTIONS(u64, uint64_t, uint64_t)
+
+#define JANET_TARRAY_TABLE(NAME) \
+    static const JanetTArrayKernel NAME##_kernels[JANET_TARRAY_TYPE_COUNT] = { \
+        NAME##_f64, NAME##_f32, NAME##_i32, NAME##_u8, NAME##_i64, NAME##_u64 \
+    }
+
+JANET_TARRAY_TABLE(tarray_add);
+JANET_TARRAY_TABLE(tarray_sub);
+JANET_TARRAY_TABLE(tarray_mul);
+JANET_TARRAY_TABLE(tarray_fma);
+JANET_TARRAY_TABLE(tarray_min);
+JANET_TARRAY_TABLE(tarray_max);
+JANET_TARRAY_TABLE(tarray_lt);
+JANET_TARRAY_TABLE(tarray_le);
+JANET_TARRAY_TABLE(tarray_gt);
+JANET_TARRAY_TABLE(tarray_ge);
+JANET_TARRAY_TABLE(tarray_eq);
+JANET_TARRAY_TABLE(tarray_neq);
+
+/* Run a kernel over typed arrays in chunks. argv[0] is a typed array, the
+ * following nin - 1 arguments are typed arrays of the same type and length
+ * or numbers, and an optional last argument is the destination array. */
+
+#define JANET_TARRAY_CHUNK 512
+
+static int tarray_overlaps(const uint8_t *x, size_t xlen, const uint8_t *y, size_t ylen) {
+    return x < y + ylen && y < x + xlen;
+}
+
+static Janet tarray_apply(int32_t argc, Janet *argv, int32_t nin,
+                          const JanetTArrayKernel *kernels, int mask) {
+    janet_arity(argc, nin, nin + 1);
+    JanetTArray *a = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetTArrayType type = a->type;
+    size_t size = tarray_type_sizes[type];
+    int32_t n = a->count;
+    const uint8_t *in[3] = {a->data, NULL, NULL};
+    size_t stride[3] = {size, 0, 0};
+    uint64_t scalars[2][JANET_TARRAY_CHUNK];
+    for (int32_t j = 1; j < nin; j++) {
+        JanetTArray *b = janet_checkabstract(argv[j], &janet_tarray_type);
+        if (NULL != b) {
+            if (b->type != type || b->count != n) {
+                janet_panicf("bad slot #%d, expected %s array of length %d, got %v",
+                             j, tarray_type_names[type], n, argv[j]);
+            }
+            in[j] = b->data;
+            stride[j] = size;
+        } else {
+            /* Spread a scalar over a whole chunk so kernels only see arrays */
+            uint8_t *buf = (uint8_t *) scalars[j - 1];
+            tarray_convert(type, argv[j], buf);
+            for (int32_t k = 1; k < JANET_TARRAY_CHUNK; k++) {
+                memcpy(buf + k * size, buf, size);
+            }
+            in[j] = buf;
+        }
+    }
+    JanetTArrayType dtype = mask ? JANET_TARRAY_U8 : type;
+    size_t dsize = tarray_type_sizes[dtype];
+    JanetTArray *dest;
+    if (argc > nin && !janet_checktype(argv[nin], JANET_NIL)) {
+        dest = janet_getabstract(argv, nin, &janet_tarray_type);
+        if (dest->type != dtype || dest->count != n) {
+            janet_panicf("bad slot #%d, expected %s array of length %d, got %v",
+                         nin, tarray_type_names[dtype], n, argv[nin]);
+        }
+    } else {
+        dest = tarray_new(dtype, n);
+    }
+
+    /* Kernels take restrict pointers. Writing in place goes through a chunk
+     * sized buffer, and any other overlap through a copy of the whole result. */
+    int inplace = 0, overlap = 0;
+    for (int32_t j = 0; j < nin; j++) {
+        if (!stride[j]) continue;
+        if (tarray_overlaps(dest->data, n * dsize, in[j], n * size)) {
+            if (dest->data == in[j] && dsize == size) {
+                inplace = 1;
+            } else {
+                overlap = 1;
+            }
+        }
+    }
+    uint8_t *out = overlap ? janet_smalloc(n * dsize) : dest->data;
+    uint64_t chunk[JANET_TARRAY_CHUNK];
+    for (int32_t i = 0; i < n; i += JANET_TARRAY_CHUNK) {
+        int32_t m = (n - i) < JANET_TARRAY_CHUNK ? (n - i) : JANET_TARRAY_CHUNK;
+        uint8_t *o = out + (size_t) i * dsize;
+        const uint8_t *x = in[0] + (size_t) i * size;
+        const uint8_t *y = in[1] ? in[1] + (size_t) i * stride[1] : NULL;
+        const uint8_t *z = in[2] ? in[2] + (size_t) i * stride[2] : NULL;
+        if (inplace && !overlap) {
+            kernels[type](chunk, x, y, z, m);
+            memcpy(o, chunk, m * dsize);
+        } else {
+            kernels[type](o, x, y, z, m);
+        }
+    }
+    if (overlap) {
+        memcpy(dest->data, out, n * dsize);
+        janet_sfree(out);
+    }
+    return janet_wrap_abstract(dest);
+}
+
+static JanetTArrayType tarray_gettype(const Janet *argv, int32_t n) {
+    const uint8_t *name = janet_getkeyword(argv, n);
+    for (int i = 0; i < JANET_TARRAY_TYPE_COUNT; i++) {
+        if (!janet_cstrcmp(name, tarray_type_names[i])) return (JanetTArrayType) i;
+    }
+    janet_panicf("bad slot #%d, expected one of :f64, :f32, :i32, :u8, :i64 or :u64, got %v",
+                 n, argv[n]);
+}
+
+/* C Functions */
+
+JANET_CORE_FN(cfun_tarray_new,
+              "(tarray/new type length &opt init)",
+              "Create a typed array of `length` elements, all `init` or 0. A typed array "
+              "stores numbers unboxed in native machine form, and `type` is the element type, one of:\n\n"
+              "* :f64 - 64 bit floats\n\n"
+              "* :f32 - 32 bit floats\n\n"
+              "* :i32 - 32 bit signed integers\n\n"
+              "* :u8 - 8 bit unsigned integers\n\n"
+              "* :i64 - 64 bit signed integers, read as int/s64\n\n"
+              "* :u64 - 64 bit unsigned integers, read as int/u64\n\n"
+              "Typed arrays have a fixed length and support `get`, `put`, `length`, `next` "
+              "and marshalling, and can be used anywhere a byte sequence is expected.") {
+    janet_arity(argc, 2, 3);
+    JanetTArrayType type = tarray_gettype(argv, 0);
+    JanetTArray *array = tarray_new(type, janet_getinteger(argv, 1));
+    if (argc > 2 && array->count > 0) {
+        size_t size = tarray_type_sizes[type];
+        tarray_convert(type, argv[2], array->data);
+        for (int32_t i = 1; i < array->count; i++) {
+            memcpy(array->data + (size_t) i * size, array->data, size);
+        }
+    }
+    return janet_wrap_abstract(array);
+}
+
+JANET_CORE_FN(cfun_tarray_from,
+              "(tarray/from type xs)",
+              "Create a typed array of `type` from an indexed data structure or typed array `xs`.") {
+    janet_fixarity(argc, 2);
+    JanetTArrayType type = tarray_gettype(argv, 0);
+    JanetTArray *src = janet_checkabstract(argv[1], &janet_tarray_type);
+    if (NULL != src) {
+        JanetTArray *array = tarray_new(type, src->count);
+        if (src->type == type) {
+            memcpy(array->data, src->data, (size_t) src->count * tarray_type_sizes[type]);
+        } else {
+            for (int32_t i = 0; i < src->count; i++) {
+                tarray_convert(type, tarray_ref(src, i), array->data + (size_t) i * tarray_type_sizes[type]);
+            }
+        }
+        return janet_wrap_abstract(array);
+    }
+    JanetView view = janet_getindexed(argv, 1);
+    JanetTArray *array = tarray_new(type, view.len);
+    for (int32_t i = 0; i < view.len; i++) {
+        tarray_convert(type, view.items[i], array->data + (size_t) i * tarray_type_sizes[type]);
+    }
+    return janet_wrap_abstract(array);
+}
+
+JANET_CORE_FN(cfun_tarray_from_bytes,
+              "(tarray/from-bytes type bytes)",
+              "Create a typed array of `type` from the raw contents of a byte sequence, in "
+              "native byte order. The length of `bytes` must be a multiple of the element size.") {
+    janet_fixarity(argc, 2);
+    JanetTArrayType type = tarray_gettype(argv, 0);
+    JanetByteView bytes = janet_getbytes(argv, 1);
+    size_t size = tarray_type_sizes[type];
+    if ((size_t) bytes.len % size) {
+        janet_panicf("byte length %d is not a multiple of %d", bytes.len, (int32_t) size);
+    }
+    JanetTArray *array = tarray_new(type, (int32_t)((size_t) bytes.len / size));
+    memcpy(array->data, bytes.bytes, (size_t) bytes.len);
+    return janet_wrap_abstract(array);
+}
+
+JANET_CORE_FN(cfun_tarray_slice,
+              "(tarray/slice arr &opt start end)",
+              "Get a view of the elements of `arr` from `start` to `end`, with the same "
+              "range semantics as `array/slice`. The view shares memory with `arr`, so "
+              "changes to either are visible in both.") {
+    janet_arity(argc, 1, 3);
+    JanetTArray *src = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetRange range = janet_getslice(argc, argv);
+    JanetTArray *array = janet_abstract(&janet_tarray_type, sizeof(JanetTArray));
+    *array = *src;
+    array->data = src->data + (size_t) range.start * tarray_type_sizes[src->type];
+    array->count = range.end > range.start ? range.end - range.start : 0;
+    return janet_wrap_abstract(array);
+}
+
+JANET_CORE_FN(cfun_tarray_copy,
+              "(tarray/copy arr)",
+              "Create a new typed array with a copy of the elements of `arr`.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *src = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetTArray *array = tarray_new(src->type, src->count);
+    memcpy(array->data, src->data, (size_t) src->count * tarray_type_sizes[src->type]);
+    return janet_wrap_abstract(array);
+}
+
+JANET_CORE_FN(cfun_tarray_fill,
+              "(tarray/fill arr x)",
+              "Set every element of `arr` to `x`. Returns `arr`.") {
+    janet_fixarity(argc, 2);
+    JanetTArray *array = janet_getabstract(argv, 0, &janet_tarray_type);
+    size_t size = tarray_type_sizes[array->type];
+    uint64_t elem;
+    tarray_convert(array->type, argv[1], &elem);
+    for (int32_t i = 0; i < array->count; i++) {
+        memcpy(array->data + (size_t) i * size, &elem, size);
+    }
+    return argv[0];
+}
+
+JANET_CORE_FN(cfun_tarray_type,
+              "(tarray/type arr)",
+              "Get the element type of typed array `arr` as a keyword.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *array = janet_getabstract(argv, 0, &janet_tarray_type);
+    return janet_ckeywordv(tarray_type_names[array->type]);
+}
+
+JANET_CORE_FN(cfun_tarray_to_array,
+              "(tarray/to-array arr)",
+              "Convert typed array `arr` to a new array of numbers.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *src = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetArray *array = janet_array(src->count);
+    for (int32_t i = 0; i < src->count; i++) {
+        array->data[i] = tarray_ref(src, i);
+    }
+    array->count = src->count;
+    return janet_wrap_array(array);
+}
+
+JANET_CORE_FN(cfun_tarray_add,
+              "(tarray/add a b &opt dest)",
+              "Add typed array `a` and `b` elementwise, where `b` is a typed array of the "
+              "same type and length as `a` or a number. Writes the result into `dest` and "
+              "returns it, or returns a new typed array if `dest` is not given. `dest` may be "
+              "`a` or `b`. Integer arithmetic wraps around on overflow.") {
+    return tarray_apply(argc, argv, 2, tarray_add_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_sub,
+              "(tarray/sub a b &opt dest)",
+              "Subtract `b` from typed array `a` elementwise. See `tarray/add` for the arguments.") {
+    return tarray_apply(argc, argv, 2, tarray_sub_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_mul,
+              "(tarray/mul a b &opt dest)",
+              "Multiply typed array `a` and `b` elementwise. See `tarray/add` for the arguments.") {
+    return tarray_apply(argc, argv, 2, tarray_mul_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_fma,
+              "(tarray/fma a b c &opt dest)",
+              "Compute `a * b + c` elementwise, where `a` is a typed array and `b` and `c` are "
+              "typed arrays of the same type and length or numbers. See `tarray/add` for `dest`.") {
+    return tarray_apply(argc, argv, 3, tarray_fma_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_min,
+              "(tarray/min a b &opt dest)",
+              "Get the smaller of `a` and `b` elementwise. See `tarray/add` for the arguments.") {
+    return tarray_apply(argc, argv, 2, tarray_min_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_max,
+              "(tarray/max a b &opt dest)",
+              "Get the larger of `a` and `b` elementwise. See `tarray/add` for the arguments.") {
+    return tarray_apply(argc, argv, 2, tarray_max_kernels, 0);
+}
+
+JANET_CORE_FN(cfun_tarray_cmp,
+              "(tarray/cmp op a b &opt dest)",
+              "Compare typed array `a` with `b` elementwise, where `op` is one of "
+              ":< :<= :> :>= := or :not=. Returns a :u8 typed array with 1 where the "
+              "comparison holds and 0 elsewhere, written into `dest` if given.") {
+    janet_arity(argc, 3, 4);
+    const uint8_t *op = janet_getkeyword(argv, 0);
+    const JanetTArrayKernel *kernels;
+    if (!janet_cstrcmp(op, "<")) {
+        kernels = tarray_lt_kernels;
+    } else if (!janet_cstrcmp(op, "<=")) {
+        kernels = tarray_le_kernels;
+    } else if (!janet_cstrcmp(op, ">")) {
+        kernels = tarray_gt_kernels;
+    } else if (!janet_cstrcmp(op, ">=")) {
+        kernels = tarray_ge_kernels;
+    } else if (!janet_cstrcmp(op, "=")) {
+        kernels = tarray_eq_kernels;
+    } else if (!janet_cstrcmp(op, "not=")) {
+        kernels = tarray_neq_kernels;
+    } else {
+        janet_panicf("unknown comparison %v", argv[0]);
+    }
+    return tarray_apply(argc - 1, argv + 1, 2, kernels, 1);
+}
+
+JANET_CORE_FN(cfun_tarray_sum,
+              "(tarray/sum arr)",
+              "Get the sum of the elements of typed array `arr`. Floats are summed as 64 bit "
+              "floats, and integers wrap around on overflow.") {
+    janet_fixarity(argc, 1);
+    JanetTArray *a = janet_getabstract(argv, 0, &janet_tarray_type);
+    int32_t n = a->count;
+    switch (a->type) {
+        default:
+        case JANET_TARRAY_F64:
+            return janet_wrap_number(tarray_sum_f64((const double *) a->data, n));
+        case JANET_TARRAY_F32:
+            return janet_wrap_number(tarray_sum_f32((const float *) a->data, n));
+        case JANET_TARRAY_I32:
+            return janet_wrap_number((double)(int64_t) tarray_sum_i32((const int32_t *) a->data, n));
+        case JANET_TARRAY_U8:
+            return janet_wrap_number((double) tarray_sum_u8(a->data, n));
+        case JANET_TARRAY_I64:
+            return tarray_wrap_s64((int64_t) tarray_sum_i64((const int64_t *) a->data, n));
+        case JANET_TARRAY_U64:
+            return tarray_wrap_u64(tarray_sum_u64((const uint64_t *) a->data, n));
+    }
+}
+
+JANET_CORE_FN(cfun_tarray_dot,
+              "(tarray/dot a b)",
+              "Get the dot product of typed arrays `a` and `b` of the same type and length.") {
+    janet_fixarity(argc, 2);
+    JanetTArray *a = janet_getabstract(argv, 0, &janet_tarray_type);
+    JanetTArray *b = janet_getabstract(argv, 1, &janet_tarray_type);
+    if (b->type != a->type || b->count != a->count) {
+        janet_panicf("bad slot #1, expected %s array of length %d, got %v",
+                     tarray_type_names[a->type], a->count, argv[1]);
+    }
+    int32_t n = a->count;
+    switch (a->type) {
+        default:
+        case JANET_TARRAY_F64:
+            return janet_wrap_number(tarray_dot_f64((const double *) a->data, (const double *) b->data, n));
+        case JANET_TARRAY_F32:
+            return janet_wrap_number(tarray_dot_f32((const float *) a->data, (const float *) b->data, n));
+        case JANET_TARRAY_I32:
+            return janet_wrap_number((double)(int64_t) tarray_dot_i32((const int32_t *) a->data,
+                                     (const int32_t *) b->data, n));
+        case JANET_TARRAY_U8:
+            return janet_wrap_number((double) tarray_dot_u8(a->data, b->data, n));
+        case JANET_TARRAY_I64:
+            return tarray_wrap_s64((int64_t) tarray_dot_i64((const int64_t *) a->data,
+                                   (const int64_t *) b->data, n));
+        case JANET_TARRAY_U64:
+            return tarray_wrap_u64(tarray_dot_u64((const uint64_t *) a->data,
+                                                  (const uint64_t *) b->data, n));
+    }
+}
+
+JANET_CORE_FN(cfun_tarray_tarrayp,
+              "(tarray? x)",
+              "Check if `x` is a typed array.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(janet_checkabstract(argv[0], &janet_tarray_type) != NULL);
+}
+
+/* Module entry point */
+void janet_lib_tarray(JanetTable *env) {
+    JanetRegExt tarray_cfuns[] = {
+        JANET_CORE_REG("tarray/new", cfun_tarray_new),
+        JANET_CORE_REG("tarray/from", cfun_tarray_from),
+        JANET_CORE_REG("tarray/from-bytes", cfun_tarray_from_bytes),
+        JANET_CORE_REG("tarray/slice", cfun_tarray_slice),
+        JANET_CORE_REG("tarray/copy", cfun_tarray_copy),
+        JANET_CORE_REG("tarray/fill", cfun_tarray_fill),
+        JANET_CORE_REG("tarray/type", cfun_tarray_type),
+        JANET_CORE_REG("tarray/to-array", cfun_tarray_to_array),
+        JANET_CORE_REG("tarray/add", cfun_tarray_add),
+        JANET_CORE_REG("tarray/sub", cfun_tarray_sub),
+        JANET_CORE_REG("tarray/mul", cfun_tarray_mul),
+        JANET_CORE_REG("tarray/fma", cfun_tarray_fma),
+        JANET_CORE_REG("tarray/min", cfun_tarray_min),
+        JANET_CORE_REG("tarray/max", cfun_tarray_max),
+        JANET_CORE_REG("tarray/cmp", cfun_tarray_cmp),
+        JANET_CORE_REG("tarray/sum", cfun_tarray_sum),
+        JANET_CORE_REG("tarray/dot", cfun_tarray_dot),
+        JANET_CORE_REG("tarray?", cfun_tarray_tarrayp),
+        JANET_REG_END
+    };
+    janet_core_cfuns_ext(env, NULL, tarray_cfuns);
+    janet_register_abstract_type(&janet_tarray_type);
+}
@@ -111,6 +111,9 @@ JANET_CORE_FN(cfun_tuple_setmap,
               "should be integers.") {
     janet_fixarity(argc, 3);
     const Janet *tup = janet_gettuple(argv, 0);
+    if (janet_tuple_head(tup)->gc.flags & JANET_MEM_SHARED) {
+        janet_panic("cannot set sourcemap of a shared tuple");
+    }
     janet_tuple_head(tup)->sm_line = janet_getinteger(argv, 1);
     janet_tuple_head(tup)->sm_column = janet_getinteger(argv, 2);
     return argv[0];
@@ -52,6 +52,15 @@
 #include <inttypes.h>
 #include <float.h>
 
+#if !defined(JANET_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define JANET_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#define JANET_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 /* Base 64 lookup table for digits */
 const char janet_base64[65] =
     "0123456789"
@@ -123,19 +132,123 @@ uint32_t janet_hash_mix(uint32_t input, uint32_t more) {
     return input ^ (0x9e3779b9 + (mix1 << 6) + (mix1 >> 2));
 }
 
-#ifndef JANET_PRF
+#ifdef JANET_PRF
 
-int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
-    if (NULL == str || len == 0) return 5381;
-    const uint8_t *end = str + len;
-    uint32_t hash = 5381;
-    while (str < end)
-        hash = (hash << 5) + hash + *str++;
-    hash = janet_hash_mix(hash, (uint32_t) len);
-    return (int32_t) hash;
+static uint8_t hash_key[JANET_HASH_KEY_SIZE] = {0};
+
+void janet_init_hash_key(uint8_t new_key[JANET_HASH_KEY_SIZE]) {
+    memcpy(hash_key, new_key, sizeof(hash_key));
 }
 
+#endif
+
+#if defined(JANET_FAST_HASH)
+
+/*
+  Fast non-cryptographic string hash, following the public domain wyhash
+  (final version 4) by Wang Yi: https://github.com/wangyi-fudan/wyhash
+
+  Strings are read 8 bytes at a time, and strings longer than 48 bytes are
+  consumed by three independent lanes. Much faster than siphash on long
+  strings, but offers no protection against chosen collisions, so only use
+  it for trusted input. With JANET_PRF the hash key is used as the seed.
+*/
+
+static void wymum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t)(r >> 64);
 #else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t wyr3(const uint8_t *p, size_t k) {
+    return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+static const uint64_t wysecret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+/* The seed must already be mixed with the secret */
+static uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed) {
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wysecret[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wysecret[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wysecret[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wysecret[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wysecret[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wysecret[0] ^ len, b ^ wysecret[1]);
+}
+
+int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
+#ifdef JANET_PRF
+    uint64_t seed;
+    memcpy(&seed, hash_key, sizeof(seed));
+    seed ^= wymix(seed ^ wysecret[0], wysecret[1]);
+#else
+    uint64_t seed = 0xca813bf4c7abf0a9ull; /* wymix(wysecret[0], wysecret[1]) */
+#endif
+    uint64_t hash = wyhash(str, len > 0 ? (size_t) len : 0, seed);
+    return (int32_t)(uint32_t)(hash ^ (hash >> 32));
+}
+
+#elif defined(JANET_PRF)
 
 /*
   Public domain siphash implementation sourced from:
@@ -231,12 +344,6 @@ static uint32_t halfsiphash(const uint8_t *in, const size_t inlen, const uint8_t
 }
 /* end of siphash */
 
-static uint8_t hash_key[JANET_HASH_KEY_SIZE] = {0};
-
-void janet_init_hash_key(uint8_t new_key[JANET_HASH_KEY_SIZE]) {
-    memcpy(hash_key, new_key, sizeof(hash_key));
-}
-
 /* Calculate hash for string */
 
 int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
@@ -245,6 +352,18 @@ int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
     return (int32_t)hash;
 }
 
+#else
+
+int32_t janet_string_calchash(const uint8_t *str, int32_t len) {
+    if (NULL == str || len == 0) return 5381;
+    const uint8_t *end = str + len;
+    uint32_t hash = 5381;
+    while (str < end)
+        hash = (hash << 5) + hash + *str++;
+    hash = janet_hash_mix(hash, (uint32_t) len);
+    return (int32_t) hash;
+}
+
 #endif
 
 /* Computes hash of an array of values */
@@ -952,6 +1071,250 @@ JanetTable *janet_get_core_table(const char *name) {
     return janet_unwrap_table(out);
 }
 
+/* Byte search
+ *
+ * Substring search filters 16 or 32 start positions at a time by comparing
+ * the first and last bytes of the pattern, and checks the middle of each
+ * candidate with memcmp. When given a KMP table, the search switches to KMP
+ * once checking candidates costs more than scanning, so repetitive text stays
+ * linear. Set scanning looks up the low and high nibbles of each byte with
+ * shuffles. None of this uses the Janet VM, so it runs on worker threads. */
+
+#define JANET_SEARCH_SLACK 256
+
+#ifdef JANET_SIMD_SSE2
+static int janet_ctz32(uint32_t x) {
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+#endif
+
+typedef struct {
+    const uint8_t *text;
+    const uint8_t *pat;
+    size_t patlen;
+    size_t last; /* Last position a match can start at */
+    size_t work; /* Bytes compared while checking candidates */
+    int bounded; /* Give up on filtering when checking costs too much */
+} JanetSearch;
+
+enum {
+    JANET_SEARCH_MORE,
+    JANET_SEARCH_FOUND,
+    JANET_SEARCH_KMP
+};
+
+/* Check a candidate whose first and last bytes match */
+static int janet_search_check(JanetSearch *s, size_t i) {
+    s->work += s->patlen;
+    return !memcmp(s->text + i + 1, s->pat + 1, s->patlen - 2);
+}
+
+#define janet_search_spent(s, i) ((s)->bounded && (s)->work > (i) + JANET_SEARCH_SLACK)
+
+#ifdef JANET_SIMD_SSE2
+static size_t janet_search_sse2(JanetSearch *s, size_t i, int *status) {
+    const __m128i first = _mm_set1_epi8((char) s->pat[0]);
+    const __m128i last = _mm_set1_epi8((char) s->pat[s->patlen - 1]);
+    while (i + 15 <= s->last) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s->text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s->text + i + s->patlen - 1));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + janet_ctz32(mask);
+            if (janet_search_check(s, at)) {
+                *status = JANET_SEARCH_FOUND;
+                return at;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+        if (janet_search_spent(s, i)) {
+            *status = JANET_SEARCH_KMP;
+            return i;
+        }
+    }
+    return i;
+}
+#endif
+
+#ifdef JANET_SIMD_AVX2
+static int janet_has_avx2(void) {
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return has_avx2;
+}
+
+__attribute__((target("avx2")))
+static size_t janet_search_avx2(JanetSearch *s, size_t i, int *status) {
+    const __m256i first = _mm256_set1_epi8((char) s->pat[0]);
+    const __m256i last = _mm256_set1_epi8((char) s->pat[s->patlen - 1]);
+    while (i + 31 <= s->last) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s->text + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s->text + i + s->patlen - 1));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t at = i + janet_ctz32(mask);
+            if (janet_search_check(s, at)) {
+                *status = JANET_SEARCH_FOUND;
+                return at;
+            }
+            mask &= mask - 1;
+        }
+        i += 32;
+        if (janet_search_spent(s, i)) {
+            *status = JANET_SEARCH_KMP;
+            return i;
+        }
+    }
+    return i;
+}
+
+/* Find the first byte in or out of a set, 32 bytes at a time. Each byte
+ * x = 16 * hi + lo is looked up as bit hi & 7 of row lo of one of two
+ * tables, picked by hi & 8. */
+__attribute__((target("avx2")))
+static size_t janet_scan_avx2(const uint8_t *text, size_t len, const uint32_t *bitmap, int invert) {
+    uint8_t rows[32] = {0};
+    for (int x = 0; x < 256; x++) {
+        if (bitmap[x >> 5] & ((uint32_t) 1 << (x & 0x1F))) {
+            rows[(x & 0x0F) + ((x & 0x80) ? 16 : 0)] |= (uint8_t)(1 << ((x >> 4) & 7));
+        }
+    }
+    const __m256i lows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) rows));
+    const __m256i highs = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(rows + 16)));
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i eight = _mm256_set1_epi8(0x08);
+    uint32_t flip = invert ? 0xFFFFFFFFu : 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i upper = _mm256_cmpeq_epi8(_mm256_and_si256(hi, eight), eight);
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lows, lo), _mm256_shuffle_epi8(highs, lo), upper);
+        __m256i bit = _mm256_shuffle_epi8(bits, hi);
+        __m256i in = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+        uint32_t mask = ((uint32_t) _mm256_movemask_epi8(in)) ^ flip;
+        if (mask) return i + janet_ctz32(mask);
+    }
+    return i;
+}
+#endif
+
+/* Finish a search with KMP, starting from position i */
+static const uint8_t *janet_search_kmp(JanetSearch *s, size_t i, size_t len, const int32_t *lookup) {
+    size_t j = 0;
+    while (i < len) {
+        if (s->text[i] == s->pat[j]) {
+            i++;
+            if (++j == s->patlen) return s->text + i - j;
+        } else if (j > 0) {
+            j = lookup[j - 1];
+        } else {
+            i++;
+        }
+    }
+    return NULL;
+}
+
+/* Find the first occurrence of pat in text. lookup is an optional KMP table
+ * for pat that bounds the worst case. */
+const uint8_t *janet_memsearch(const uint8_t *text, size_t len,
+                               const uint8_t *pat, size_t patlen,
+                               const int32_t *lookup) {
+    if (patlen == 0) return text;
+    if (patlen > len) return NULL;
+    if (patlen == 1) return memchr(text, pat[0], len);
+    JanetSearch s;
+    s.text = text;
+    s.pat = pat;
+    s.patlen = patlen;
+    s.last = len - patlen;
+    s.work = 0;
+    s.bounded = NULL != lookup;
+    int status = JANET_SEARCH_MORE;
+    size_t i = 0;
+#ifdef JANET_SIMD_AVX2
+    if (janet_has_avx2()) i = janet_search_avx2(&s, i, &status);
+#endif
+#ifdef JANET_SIMD_SSE2
+    if (status == JANET_SEARCH_MORE) i = janet_search_sse2(&s, i, &status);
+#endif
+    while (status == JANET_SEARCH_MORE && i <= s.last) {
+        const uint8_t *found = memchr(text + i, pat[0], s.last - i + 1);
+        if (NULL == found) return NULL;
+        i = (size_t)(found - text);
+        if (text[i + patlen - 1] == pat[patlen - 1] && janet_search_check(&s, i)) {
+            status = JANET_SEARCH_FOUND;
+            break;
+        }
+        i++;
+        if (janet_search_spent(&s, i)) status = JANET_SEARCH_KMP;
+    }
+    switch (status) {
+        case JANET_SEARCH_FOUND:
+            return text + i;
+        case JANET_SEARCH_KMP:
+            return janet_search_kmp(&s, i, len, lookup);
+        default:
+            return NULL;
+    }
+}
+
+/* Find the first byte of text that is in the set of a 256 bit bitmap, or
+ * that is not in it if invert is set. Returns len if there is none. Short
+ * runs are not worth building the lookup tables for, so the first
+ * JANET_SCAN_SCALAR bytes are checked one at a time. */
+#define JANET_SCAN_SCALAR 256
+#define janet_scan_stop(bitmap, c, invert) \
+    ((!!((bitmap)[(c) >> 5] & ((uint32_t) 1 << ((c) & 0x1F)))) != (invert))
+size_t janet_memscan(const uint8_t *text, size_t len, const uint32_t *bitmap, int invert) {
+    size_t i = 0;
+    size_t scalar = len < JANET_SCAN_SCALAR ? len : JANET_SCAN_SCALAR;
+    invert = !!invert;
+    for (; i < scalar; i++) {
+        if (janet_scan_stop(bitmap, text[i], invert)) return i;
+    }
+#ifdef JANET_SIMD_AVX2
+    if (len - i >= 32 && janet_has_avx2()) {
+        i += janet_scan_avx2(text + i, len - i, bitmap, invert);
+    }
+#endif
+    for (; i < len; i++) {
+        if (janet_scan_stop(bitmap, text[i], invert)) break;
+    }
+    return i;
+}
+
+/* How many threads to split a search over len bytes between, from
+ * (dyn :match-threads). Small inputs are not worth starting a thread for,
+ * and a sandbox that disallows threads keeps every search serial. */
+int32_t janet_match_threads(int32_t len) {
+#ifdef JANET_EV
+    if (janet_vm.sandbox_flags & JANET_SANDBOX_THREADS) return 1;
+    Janet x = janet_dyn("match-threads");
+    if (!janet_checkint(x)) return 1;
+    int32_t n = janet_unwrap_integer(x);
+    if (n > JANET_MATCH_MAX_THREADS) n = JANET_MATCH_MAX_THREADS;
+    if (n > len / JANET_MATCH_SEGMENT) n = len / JANET_MATCH_SEGMENT;
+    return n < 1 ? 1 : n;
+#else
+    (void) len;
+    return 1;
+#endif
+}
+
 /* Sort keys of a dictionary type */
 int32_t janet_sorted_keys(const JanetKV *dict, int32_t cap, int32_t *index_buffer) {
 
@@ -98,6 +98,7 @@ JanetTable *janet_get_core_table(const char *name);
 void janet_def_addflags(JanetFuncDef *def);
 
 void janet_buffer_dtostr(JanetBuffer *buffer, double x);
+void janet_buffer_dtostr_prec(JanetBuffer *buffer, double x, int precision);
 
 const char *janet_strerror(int e);
 
@@ -131,6 +132,18 @@ const JanetKV *janet_dict_find_keyword(
     int32_t cstr_len);
 
 Janet janet_table_get_keyword(JanetTable *t, const char *keyword);
+void janet_table_remove_index(JanetTable *t, int32_t index);
+
+/* Extra atomic operations, used internally for lock-free structures */
+int janet_atomic_cas(JanetAtomicInt volatile *x, JanetAtomicInt expected, JanetAtomicInt desired);
+void janet_atomic_store(JanetAtomicInt volatile *x, JanetAtomicInt value);
+void janet_atomic_fence(void);
+
+/* Shared heaps */
+#ifdef JANET_EV
+void *janet_shared_heap(Janet x);
+void janet_abstract_adopt_threaded(void *abst);
+#endif
 
 /* Registry functions */
 void janet_registry_put(
@@ -197,6 +210,30 @@ typedef void *Clib;
 #endif
 char *get_processed_name(const char *name);
 
+/* Vectorized byte search */
+const uint8_t *janet_memsearch(const uint8_t *text, size_t len,
+                               const uint8_t *pat, size_t patlen,
+                               const int32_t *lookup);
+size_t janet_memscan(const uint8_t *text, size_t len, const uint32_t *bitmap, int invert);
+
+/* Split large searches across threads, see (dyn :match-threads). Each thread
+ * gets at least JANET_MATCH_SEGMENT bytes of input. */
+#ifndef JANET_MATCH_SEGMENT
+#define JANET_MATCH_SEGMENT 65536
+#endif
+#define JANET_MATCH_MAX_THREADS 256
+#define JANET_PARALLEL_STACK (4 * 1024 * 1024)
+int32_t janet_match_threads(int32_t len);
+void janet_os_parallel(int32_t n, void (*fn)(void *data, int32_t index), void *data);
+
+/* Executable memory for generated machine code, shared by ffi/jitfn and
+ * the native peg backend. */
+#ifdef JANET_FFI_JIT
+void *janet_jit_map(const uint8_t *bytes, size_t len, size_t *alloc_size);
+void *janet_jit_try_map(const uint8_t *bytes, size_t len, size_t *alloc_size);
+void janet_jit_unmap(void *ptr, size_t alloc_size);
+#endif
+
 #ifdef JANET_PLAN9
 #define RETRY_EINTR(RC, CALL) (RC) = CALL;
 #else
@@ -226,6 +263,11 @@ void janet_lib_tuple(JanetTable *env);
 void janet_lib_buffer(JanetTable *env);
 void janet_lib_table(JanetTable *env);
 void janet_lib_struct(JanetTable *env);
+void janet_lib_pmap(JanetTable *env);
+void janet_lib_pvec(JanetTable *env);
+void janet_lib_tarray(JanetTable *env);
+void janet_lib_rope(JanetTable *env);
+void janet_lib_json(JanetTable *env);
 void janet_lib_fiber(JanetTable *env);
 void janet_lib_os(JanetTable *env);
 void janet_lib_string(JanetTable *env);
@@ -55,6 +55,17 @@ static void push_traversal_node(void *lhs, void *rhs, int32_t index2) {
     *(++janet_vm.traversal) = node;
 }
 
+/* Comparisons can nest when an abstract type's compare function compares the
+ * values it holds, so each comparison only uses the part of the traversal
+ * stack above where the enclosing comparison left off. */
+static size_t traversal_floor(void) {
+    return janet_vm.traversal_base == NULL ? 0 : (size_t)(janet_vm.traversal - janet_vm.traversal_base);
+}
+
+static void traversal_restore(size_t floor) {
+    if (janet_vm.traversal_base != NULL) janet_vm.traversal = janet_vm.traversal_base + floor;
+}
+
 /*
  * Used for travsersing structs and tuples without recursion
  * Returns:
@@ -63,9 +74,9 @@ static void push_traversal_node(void *lhs, void *rhs, int32_t index2) {
  * 2 - no next node found
  * 3 - early stop - lhs > rhs
  */
-static int traversal_next(Janet *x, Janet *y) {
+static int traversal_next(Janet *x, Janet *y, size_t floor) {
     JanetTraversalNode *t = janet_vm.traversal;
-    while (t && t > janet_vm.traversal_base) {
+    while (t && t > janet_vm.traversal_base + floor) {
         JanetGCObject *self = t->self;
         JanetTupleHead *tself = (JanetTupleHead *)self;
         JanetStructHead *sself = (JanetStructHead *)self;
@@ -246,8 +257,7 @@ static int janet_compare_abstract(JanetAbstract xx, JanetAbstract yy) {
     return xt->compare(xx, yy);
 }
 
-int janet_equals(Janet x, Janet y) {
-    janet_vm.traversal = janet_vm.traversal_base;
+static int janet_equals_impl(Janet x, Janet y, size_t floor) {
     do {
         if (janet_type(x) != janet_type(y)) return 0;
         switch (janet_type(x)) {
@@ -268,6 +278,17 @@ int janet_equals(Janet x, Janet y) {
             default:
                 if (janet_unwrap_pointer(x) != janet_unwrap_pointer(y)) return 0;
                 break;
+            case JANET_SYMBOL:
+            case JANET_KEYWORD: {
+                /* Symbols are interned per thread, so only a copy in a shared heap can be
+                 * equal to a symbol at a different address. */
+                const uint8_t *s1 = janet_unwrap_symbol(x);
+                const uint8_t *s2 = janet_unwrap_symbol(y);
+                if (s1 == s2) break;
+                if (!((janet_string_head(s1)->gc.flags | janet_string_head(s2)->gc.flags) & JANET_MEM_SHARED)) return 0;
+                if (!janet_string_equal(s1, s2)) return 0;
+                break;
+            }
             case JANET_TUPLE: {
                 const Janet *t1 = janet_unwrap_tuple(x);
                 const Janet *t2 = janet_unwrap_tuple(y);
@@ -292,10 +313,17 @@ int janet_equals(Janet x, Janet y) {
             }
             break;
         }
-    } while (!traversal_next(&x, &y));
+    } while (!traversal_next(&x, &y, floor));
     return 1;
 }
 
+int janet_equals(Janet x, Janet y) {
+    size_t floor = traversal_floor();
+    int ret = janet_equals_impl(x, y, floor);
+    traversal_restore(floor);
+    return ret;
+}
+
 static uint64_t murmur64(uint64_t h) {
     h ^= h >> 33;
     h *= 0xff51afd7ed558ccdUL;
@@ -368,8 +396,7 @@ int32_t janet_hash(Janet x) {
 /* Compares x to y. If they are equal returns 0. If x is less, returns -1.
  * If y is less, returns 1. All types are comparable
  * and should have strict ordering, excepts NaNs. */
-int janet_compare(Janet x, Janet y) {
-    janet_vm.traversal = janet_vm.traversal_base;
+static int janet_compare_impl(Janet x, Janet y, size_t floor) {
     int status;
     do {
         JanetType tx = janet_type(x);
@@ -435,10 +462,17 @@ int janet_compare(Janet x, Janet y) {
                 break;
             }
         }
-    } while (!(status = traversal_next(&x, &y)));
+    } while (!(status = traversal_next(&x, &y, floor)));
     return status - 2;
 }
 
+int janet_compare(Janet x, Janet y) {
+    size_t floor = traversal_floor();
+    int ret = janet_compare_impl(x, y, floor);
+    traversal_restore(floor);
+    return ret;
+}
+
 static int32_t getter_checkint(JanetType type, Janet key, int32_t max) {
     if (!janet_checkint(key)) goto bad;
     int32_t ret = janet_unwrap_integer(key);
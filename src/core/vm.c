@@ -1669,6 +1669,7 @@ int janet_init(void) {
     janet_vm.gc_mark_phase = 0;
 
     janet_symcache_init();
+    memset((void *) janet_vm.short_strings, 0, sizeof(janet_vm.short_strings));
 
     /* Initialize gc roots */
     janet_vm.roots = NULL;
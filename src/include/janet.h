@@ -1003,6 +1003,7 @@ struct JanetFiber {
     JanetStream *ev_stream; /* which stream we are waiting on */
     void *ev_state; /* Extra data for ev callback state. On windows, first element must be OVERLAPPED. */
     void *supervisor_channel; /* Channel to push self to when complete */
+    void *ev_timeout; /* Pending timeout that is removed when the fiber is rescheduled */
 #endif
 };
 
@@ -1529,6 +1530,12 @@ JANET_API int32_t janet_abstract_decref(void *abst);
  * this abstract type before calling `janet_free` on it's backing memory. */
 JANET_API int32_t janet_abstract_decref_maybe_free(void *abst);
 
+/* Copy an immutable value - strings, symbols, keywords, tuples and structs - into a reference counted
+ * heap that can be shared between threads. Shared values are sent over threaded channels and to new
+ * threads by pointer instead of being copied. */
+JANET_API Janet janet_share(Janet x);
+JANET_API int janet_is_shared(Janet x);
+
 /* Expose channel utilities */
 JANET_API JanetChannel *janet_channel_make(uint32_t limit);
 JANET_API JanetChannel *janet_channel_make_threaded(uint32_t limit);
@@ -1832,12 +1839,14 @@ JANET_API void janet_formatbv(JanetBuffer *bufp, const char *format, va_list arg
 JANET_API JanetSymbol janet_symbol(const uint8_t *str, int32_t len);
 JANET_API JanetSymbol janet_csymbol(const char *str);
 JANET_API JanetSymbol janet_symbol_gen(void);
+JANET_API void janet_symbol_many(const JanetByteView *strs, int32_t n, JanetSymbol *out);
 #define janet_symbolv(str, len) janet_wrap_symbol(janet_symbol((str), (len)))
 #define janet_csymbolv(cstr) janet_wrap_symbol(janet_csymbol(cstr))
 
 /* Keyword functions */
 #define janet_keyword janet_symbol
 #define janet_ckeyword janet_csymbol
+#define janet_keyword_many janet_symbol_many
 #define janet_keywordv(str, len) janet_wrap_keyword(janet_keyword((str), (len)))
 #define janet_ckeywordv(cstr) janet_wrap_keyword(janet_ckeyword(cstr))
 
@@ -1870,6 +1879,10 @@ JANET_API void janet_table_put(JanetTable *t, Janet key, Janet value);
 JANET_API JanetStruct janet_table_to_struct(JanetTable *t);
 JANET_API void janet_table_merge_table(JanetTable *table, JanetTable *other);
 JANET_API void janet_table_merge_struct(JanetTable *table, JanetStruct other);
+JANET_API JanetKV *janet_table_lookup(JanetTable *t, Janet key);
+/* Deprecated, use janet_table_lookup. For a missing key this returns an empty
+ * bucket (nil key) that is not linked into the table, so writing to it does not
+ * insert the key. Use janet_table_put to insert. */
 JANET_API JanetKV *janet_table_find(JanetTable *t, Janet key);
 JANET_API JanetTable *janet_table_clone(JanetTable *table);
 JANET_API void janet_table_clear(JanetTable *table);
@@ -2363,6 +2376,11 @@ typedef enum {
     RULE_ONLY_TAGS,    /* [rule] */
     RULE_MATCHSPLICE,  /* [rule, constant, tag] */
     RULE_DEBUG,        /* [] */
+    RULE_SPAN,         /* [lo, hi, bitmap (8 words), nstops, stops] */
+    RULE_DISPATCH,     /* [len, rules..., table (65 words)] */
+    RULE_CHOICE_NOCAP, /* [len, rules...] */
+    RULE_BETWEEN_NOCAP, /* [lo, hi, rule] */
+    RULE_MEMO,         /* [rule] */
 } JanetPegOpcode;
 
 typedef struct {
@@ -2371,6 +2389,8 @@ typedef struct {
     size_t bytecode_len;
     uint32_t num_constants;
     int has_backref;
+    void *native;
+    size_t native_size;
 } JanetPeg;
 
 #endif
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <janet.h>
+
+/* Disable leak sanitizer */
+int __lsan_is_turned_off(void) {
+    return 1;
+}
+
+/* Build [-]I.FeX from the input, where I and F have up to 24 digits and X
+ * is between -400 and 400. */
+static size_t build_number(const uint8_t *data, size_t size, char *buf, int pad) {
+    size_t n = 0, i = 4;
+    if (size < 4) return 0;
+    int nint = data[0] % 25, nfrac = data[1] % 25;
+    int ex = (int)(((uint32_t) data[2] << 8 | data[3]) % 801) - 400;
+    if (data[0] & 0x80) buf[n++] = '-';
+    for (int j = 0; j < nint; j++) buf[n++] = (char)('0' + (i < size ? data[i++] : 0) % 10);
+    if (nint == 0) buf[n++] = '0';
+    buf[n++] = '.';
+    for (int j = 0; j < nfrac; j++) buf[n++] = (char)('0' + (i < size ? data[i++] : 0) % 10);
+    /* Trailing zeros don't change the value, but more than 19 digits
+     * can't take the Eisel-Lemire fast path in src/core/strtod.c, so this
+     * sends the same number through the bignat path. */
+    if (pad) for (int j = 0; j < 20; j++) buf[n++] = '0';
+    n += (size_t) sprintf(buf + n, "e%d", ex);
+    return n;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+    /* init Janet */
+    janet_init();
+
+    /* fuzz janet_scan_number in src/core/strtod.c with arbitrary bytes */
+    double raw;
+    janet_scan_number(data, (int32_t) size, &raw);
+
+    /* compare the fast path and the bignat path on the same number */
+    char fast[128], slow[128];
+    size_t nfast = build_number(data, size, fast, 0);
+    size_t nslow = build_number(data, size, slow, 1);
+    if (nfast) {
+        double a, b;
+        int ea = janet_scan_number((const uint8_t *) fast, (int32_t) nfast, &a);
+        int eb = janet_scan_number((const uint8_t *) slow, (int32_t) nslow, &b);
+        if (ea || eb || memcmp(&a, &b, sizeof(double))) {
+            fprintf(stderr, "mismatch: %.*s -> %.17g, %.*s -> %.17g\n",
+                    (int) nfast, fast, a, (int) nslow, slow, b);
+            abort();
+        }
+    }
+
+    /* cleanup Janet */
+    janet_deinit();
+
+    return 0;
+}